@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013-2016 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_atomic.h>
+
+#include "shared.h"
+#include "benchmark_shared.h"
+
+static enum fi_op op_type = FI_SUM;
+static enum fi_datatype datatypes[] = { FI_UINT64, FI_DOUBLE };
+static enum fi_datatype datatype = FI_DATATYPE_LAST;
+
+static enum fi_op get_fi_op(char *op)
+{
+	enum fi_op ops[] = { FI_MIN, FI_MAX, FI_SUM, FI_PROD, FI_BOR,
+			     FI_BAND, FI_BXOR, FI_ATOMIC_WRITE };
+	const char *names[] = { "min", "max", "sum", "prod", "bor",
+				"band", "bxor", "write" };
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ops); i++) {
+		if (!strcmp(op, names[i]))
+			return ops[i];
+	}
+	return FI_ATOMIC_OP_LAST;
+}
+
+static enum fi_datatype get_fi_datatype(char *type)
+{
+	enum fi_datatype types[] = { FI_INT32, FI_UINT32, FI_INT64, FI_UINT64,
+				     FI_FLOAT, FI_DOUBLE };
+	const char *names[] = { "int32", "uint32", "int64", "uint64",
+				"float", "double" };
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(types); i++) {
+		if (!strcmp(type, names[i]))
+			return types[i];
+	}
+	return FI_DATATYPE_LAST;
+}
+
+/*
+ * The initiator streams windows of fi_atomic calls at the target's
+ * buffer.  The target only drives progress until the final ft_sync,
+ * so the result is reported by the initiator.
+ */
+static int atomic_bw(enum fi_datatype type)
+{
+	int ret, len, i, j;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr) {
+		for (i = j = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+			if (i == opts.warmup_iterations)
+				ft_start();
+
+			ret = ft_post_atomic(FT_ATOMIC_BASE, ep, NULL, NULL,
+					     NULL, NULL, &remote, type, op_type,
+					     &tx_ctx_arr[j].context);
+			if (ret)
+				return ret;
+
+			if (++j == opts.window_size) {
+				ret = ft_get_tx_comp(tx_seq);
+				if (ret)
+					return ret;
+				j = 0;
+			}
+		}
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+		ft_stop();
+	}
+
+	ret = ft_sync();
+	if (ret || !opts.dst_addr)
+		return ret;
+
+	/* fi_tostr returns a static buffer */
+	len = snprintf(test_name, sizeof(test_name), "%s_",
+		       fi_tostr(&type, FI_TYPE_ATOMIC_TYPE));
+	snprintf(test_name + len, sizeof(test_name) - len, "%s_%zu",
+		 fi_tostr(&op_type, FI_TYPE_ATOMIC_OP),
+		 opts.transfer_size / datatype_to_size(type));
+	show_perf(test_name, opts.transfer_size, opts.iterations, &start, &end,
+		  1);
+	return 0;
+}
+
+static int run_datatype(enum fi_datatype type)
+{
+	size_t max_count, size;
+	int i, ret;
+
+	ret = check_base_atomic_op(ep, op_type, type, &max_count);
+	if (ret == -FI_ENOSYS || ret == -FI_EOPNOTSUPP) {
+		fprintf(stderr, "Provider doesn't support %s on %s\n",
+			fi_tostr(&op_type, FI_TYPE_ATOMIC_OP),
+			fi_tostr(&type, FI_TYPE_ATOMIC_TYPE));
+		return 0;
+	} else if (ret) {
+		return ret;
+	}
+	size = datatype_to_size(type);
+
+	if (opts.options & FT_OPT_SIZE) {
+		if (opts.transfer_size % size ||
+		    opts.transfer_size / size > max_count)
+			return 0;
+		init_test(&opts, test_name, sizeof(test_name));
+		return atomic_bw(type);
+	}
+
+	for (i = 0; i < TEST_CNT; i++) {
+		if (!ft_use_size(i, opts.sizes_enabled) ||
+		    test_size[i].size % size ||
+		    test_size[i].size / size > max_count)
+			continue;
+		opts.transfer_size = test_size[i].size;
+		init_test(&opts, test_name, sizeof(test_name));
+		ret = atomic_bw(type);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = ft_exchange_keys(&remote);
+	if (ret)
+		return ret;
+
+	if (datatype != FI_DATATYPE_LAST) {
+		ret = run_datatype(datatype);
+	} else {
+		for (i = 0; i < ARRAY_SIZE(datatypes) && !ret; i++)
+			ret = run_datatype(datatypes[i]);
+	}
+	if (ret)
+		return ret;
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "ho:z:" CS_OPTS INFO_OPTS BENCHMARK_OPTS)) !=
+			-1) {
+		switch (op) {
+		case 'o':
+			op_type = get_fi_op(optarg);
+			if (op_type == FI_ATOMIC_OP_LAST) {
+				fprintf(stderr, "Not a valid atomic operation\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'z':
+			datatype = get_fi_datatype(optarg);
+			if (datatype == FI_DATATYPE_LAST) {
+				fprintf(stderr, "Not a valid atomic datatype\n");
+				return EXIT_FAILURE;
+			}
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Atomic throughput versus vector "
+				   "count using RDM.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-o <op>", "atomic op: min|max|sum|"
+					    "prod|bor|band|bxor|write "
+					    "(default: sum)");
+			FT_PRINT_OPTS_USAGE("-z <datatype>", "atomic datatype: "
+					    "int32|uint32|int64|uint64|float|"
+					    "double (default: uint64 and double)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG | FI_ATOMIC;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013-2016 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include "shared.h"
+#include "benchmark_shared.h"
+
+static struct fi_cq_tagged_entry *comps;
+
+/*
+ * Drain a window of receive completions, reading up to `batch` entries
+ * per fi_cq_read call.  rx_seq is always one ahead, see bandwidth().
+ */
+static int cq_drain(size_t batch)
+{
+	ssize_t ret;
+
+	while (rx_cq_cntr < rx_seq - 1) {
+		ret = fi_cq_read(rxcq, comps, MIN(batch, rx_seq - 1 - rx_cq_cntr));
+		if (ret > 0) {
+			rx_cq_cntr += ret;
+		} else if (ret == -FI_EAVAIL) {
+			ret = ft_cq_readerr(rxcq);
+			rx_cq_cntr++;
+			if (ret)
+				return (int) ret;
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return (int) ret;
+		}
+	}
+	return 0;
+}
+
+static int cq_read_bw(size_t batch)
+{
+	int ret, i, j;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		if (opts.dst_addr) {
+			for (j = 0; j < opts.window_size; j++) {
+				ret = ft_post_tx(ep, remote_fi_addr,
+						 opts.transfer_size, NO_CQ_DATA,
+						 &tx_ctx_arr[j].context);
+				if (ret)
+					return ret;
+			}
+			ret = ft_get_tx_comp(tx_seq);
+			if (ret)
+				return ret;
+			ret = ft_rx(ep, 4);
+		} else {
+			for (j = 0; j < opts.window_size; j++) {
+				ret = ft_post_rx(ep, opts.transfer_size,
+						 &rx_ctx_arr[j].context);
+				if (ret)
+					return ret;
+			}
+			ret = cq_drain(batch);
+			if (ret)
+				return ret;
+			ret = ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+		}
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	snprintf(test_name, sizeof(test_name), "%s_batch_%zu",
+		 opts.dst_addr ? "tx" : "cq_read", batch);
+	show_perf(test_name, opts.transfer_size, opts.iterations, &start, &end,
+		  opts.window_size);
+	return 0;
+}
+
+static int run(void)
+{
+	size_t batch;
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	comps = calloc(opts.window_size, sizeof(*comps));
+	if (!comps)
+		return -FI_ENOMEM;
+
+	for (batch = 1; batch <= (size_t) opts.window_size; batch <<= 1) {
+		ret = cq_read_bw(batch);
+		if (ret)
+			goto out;
+	}
+
+	ret = ft_finalize();
+out:
+	free(comps);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE;
+	opts.transfer_size = 4;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "h" CS_OPTS INFO_OPTS BENCHMARK_OPTS)) !=
+			-1) {
+		switch (op) {
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "CQ read throughput versus batch size "
+				   "using RDM.");
+			ft_benchmark_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
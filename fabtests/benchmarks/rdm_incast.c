@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2019 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include "shared.h"
+#include "benchmark_shared.h"
+
+/*
+ * Many-to-one bandwidth test.  The client opens num_senders endpoints
+ * sharing one AV and set of CQs, and every endpoint streams a window of
+ * messages to the server's single endpoint at the same time.  The server
+ * reports the aggregate goodput seen by the receiver.
+ */
+
+static int num_senders = 8;
+static struct fid_ep **senders;
+static struct ft_context *ctx_arr;
+
+static int open_senders(void)
+{
+	struct fi_info *info;
+	int i, ret;
+
+	senders = calloc(num_senders, sizeof(*senders));
+	if (!senders)
+		return -FI_ENOMEM;
+
+	/* The first sender is the endpoint used to exchange addresses */
+	senders[0] = ep;
+	if (num_senders == 1)
+		return 0;
+
+	/* Let the provider pick a source address for the others */
+	info = fi_dupinfo(fi);
+	if (!info)
+		return -FI_ENOMEM;
+	free(info->src_addr);
+	info->src_addr = NULL;
+	info->src_addrlen = 0;
+
+	for (i = 1; i < num_senders; i++) {
+		ret = fi_endpoint(domain, info, &senders[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			goto out;
+		}
+
+		ret = ft_enable_ep(senders[i], eq, av, txcq, rxcq, txcntr,
+				   rxcntr);
+		if (ret)
+			goto out;
+	}
+out:
+	fi_freeinfo(info);
+	return ret;
+}
+
+static void close_senders(void)
+{
+	int i;
+
+	if (!senders)
+		return;
+
+	for (i = 1; i < num_senders; i++)
+		FT_CLOSE_FID(senders[i]);
+	free(senders);
+}
+
+/*
+ * Every sender posts one message per iteration.  After each window the
+ * server waits for all messages and replies, like bandwidth() does.
+ */
+static int incast_bw(void)
+{
+	int ret, i, j, k, total;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	total = opts.iterations + opts.warmup_iterations;
+	for (i = j = 0; i < total; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		for (k = 0; k < num_senders; k++) {
+			if (opts.dst_addr)
+				ret = ft_post_tx(senders[k], remote_fi_addr,
+						 opts.transfer_size, NO_CQ_DATA,
+						 &ctx_arr[j * num_senders + k].context);
+			else
+				ret = ft_post_rx(ep, opts.transfer_size,
+						 &ctx_arr[j * num_senders + k].context);
+			if (ret)
+				return ret;
+		}
+
+		if (++j < opts.window_size && i < total - 1)
+			continue;
+		j = 0;
+
+		if (opts.dst_addr) {
+			ret = ft_get_tx_comp(tx_seq);
+			if (ret)
+				return ret;
+			ret = ft_rx(ep, 4);
+		} else {
+			ret = ft_get_rx_comp(rx_seq - 1);
+			if (ret)
+				return ret;
+			ret = ft_tx(ep, remote_fi_addr, 4, &tx_ctx);
+		}
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	snprintf(test_name, sizeof(test_name), "%s_%d_to_1",
+		 opts.dst_addr ? "incast_tx" : "incast_rx", num_senders);
+	show_perf(test_name, opts.transfer_size, opts.iterations, &start, &end,
+		  num_senders);
+	return 0;
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	opts.av_size = num_senders + 1;
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ctx_arr = calloc(opts.window_size * num_senders, sizeof(*ctx_arr));
+	if (!ctx_arr)
+		return -FI_ENOMEM;
+
+	if (opts.dst_addr) {
+		ret = open_senders();
+		if (ret)
+			goto out;
+	}
+
+	if (!(opts.options & FT_OPT_SIZE)) {
+		for (i = 0; i < TEST_CNT; i++) {
+			if (!ft_use_size(i, opts.sizes_enabled))
+				continue;
+			opts.transfer_size = test_size[i].size;
+			ret = incast_bw();
+			if (ret)
+				goto out;
+		}
+	} else {
+		ret = incast_bw();
+		if (ret)
+			goto out;
+	}
+
+	ret = ft_finalize();
+out:
+	close_senders();
+	free(ctx_arr);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_BW;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:h" CS_OPTS INFO_OPTS
+			    BENCHMARK_OPTS)) != -1) {
+		switch (op) {
+		case 'n':
+			num_senders = atoi(optarg);
+			break;
+		default:
+			ft_parse_benchmark_opts(op, optarg);
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Many-to-one bandwidth test for RDM "
+				   "endpoints.");
+			ft_benchmark_usage();
+			FT_PRINT_OPTS_USAGE("-n <senders>",
+					    "number of sending endpoints "
+					    "(default: 8)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	if (num_senders < 1) {
+		FT_ERR("number of senders must be at least 1");
+		return EXIT_FAILURE;
+	}
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->domain_attr->resource_mgmt = FI_RM_ENABLED;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
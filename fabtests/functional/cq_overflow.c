@@ -0,0 +1,254 @@
+/*
+ * Copyright (c) 2019 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "shared.h"
+
+#define CANCEL_TAG 0xC
+#define STANDARD_TAG 0xA
+#define MSG_COUNT 64
+#define CQ_SIZE 4
+
+/*
+ * Receive completions are generated while the receive CQ is not being read,
+ * so that they overflow the CQ, and the first round starts behind an error
+ * completion.  The test checks that every completion is reported once and
+ * in order.
+ */
+static int cq_overflow_client(void)
+{
+	int ret, round, i;
+
+	for (round = 0; round < 2; round++) {
+		ft_tag = 0;
+		ret = ft_rx(ep, 1);
+		if (ret)
+			return ret;
+
+		ft_tag = STANDARD_TAG;
+		for (i = 0; i < MSG_COUNT; i++) {
+			ret = ft_post_tx(ep, remote_fi_addr, opts.transfer_size,
+					 NO_CQ_DATA, &tx_ctx);
+			if (ret)
+				return ret;
+		}
+
+		ret = ft_get_tx_comp(tx_seq);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int cq_overflow_read_cancel(void *cancel_ctx)
+{
+	struct fi_cq_err_entry comp;
+	int ret, retries = 0;
+
+	do {
+		ret = fi_cq_read(rxcq, &comp, 1);
+		if (ret == -FI_EAVAIL)
+			break;
+		usleep(1000);
+	} while (ret == -FI_EAGAIN && ++retries < 5000);
+	if (ret != -FI_EAVAIL) {
+		FT_PRINTERR("ERROR: no error entry ahead of the completions",
+			    -FI_EOTHER);
+		return -FI_EOTHER;
+	}
+
+	ret = fi_cq_readerr(rxcq, &comp, 0);
+	if (ret != 1 || comp.err != FI_ECANCELED ||
+	    comp.op_context != cancel_ctx) {
+		FT_PRINTERR("ERROR: unexpected error entry", -FI_EOTHER);
+		return -FI_EOTHER;
+	}
+
+	if (opts.verbose)
+		fprintf(stdout, "GOOD: read error entry\n");
+	return 0;
+}
+
+static int cq_overflow_host(void)
+{
+	struct fi_context recv_ctx[MSG_COUNT], cancel_ctx;
+	struct fi_cq_err_entry comp;
+	int ret, round, i, retries;
+
+	for (round = 0; round < 2; round++) {
+		if (!round) {
+			ft_tag = CANCEL_TAG;
+			ret = ft_post_rx(ep, opts.transfer_size, &cancel_ctx);
+			if (ret)
+				return ret;
+
+			ret = fi_cancel(&ep->fid, &cancel_ctx);
+			if (ret) {
+				FT_PRINTERR("fi_cancel", ret);
+				return ret;
+			}
+		}
+
+		ft_tag = STANDARD_TAG;
+		for (i = 0; i < MSG_COUNT; i++) {
+			ret = ft_post_rx(ep, opts.transfer_size, &recv_ctx[i]);
+			if (ret)
+				return ret;
+		}
+
+		ft_tag = 0;
+		ret = ft_tx(ep, remote_fi_addr, 1, &tx_ctx);
+		if (ret)
+			return ret;
+
+		/* Progress the endpoint through the transmit CQ only */
+		for (i = 0; i < 1000; i++) {
+			ret = fi_cq_read(txcq, &comp, 0);
+			if (ret < 0 && ret != -FI_EAGAIN) {
+				FT_PRINTERR("fi_cq_read", ret);
+				return ret;
+			}
+			usleep(100);
+		}
+
+		if (!round) {
+			ret = cq_overflow_read_cancel(&cancel_ctx);
+			if (ret)
+				return ret;
+		}
+
+		for (i = 0, retries = 0; i < MSG_COUNT && retries < 5000; ) {
+			ret = fi_cq_read(rxcq, &comp, 1);
+			if (ret == -FI_EAGAIN) {
+				retries++;
+				usleep(1000);
+				continue;
+			}
+			if (ret < 0) {
+				FT_PRINTERR("fi_cq_read", ret);
+				return ret;
+			}
+			if (comp.op_context != &recv_ctx[i]) {
+				FT_PRINTERR("ERROR: completion out of order",
+					    -FI_EOTHER);
+				return -FI_EOTHER;
+			}
+			i++;
+		}
+		if (i < MSG_COUNT) {
+			FT_PRINTERR("ERROR: missing completions", -FI_EOTHER);
+			return -FI_EOTHER;
+		}
+
+		ret = fi_cq_read(rxcq, &comp, 1);
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("ERROR: unexpected extra completion",
+				    -FI_EOTHER);
+			return -FI_EOTHER;
+		}
+
+		if (opts.verbose)
+			fprintf(stdout, "GOOD: round %d completed in order\n",
+				round);
+	}
+
+	fprintf(stdout, "GOOD: Completed CQ Overflow Test\n");
+	return 0;
+}
+
+static int run_test(void)
+{
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	if (opts.dst_addr)
+		return cq_overflow_client();
+	else
+		return cq_overflow_host();
+}
+
+int main(int argc, char **argv)
+{
+	int op;
+	int ret = 0;
+	int spsc = 0;
+
+	opts = INIT_OPTS;
+	opts.rx_cq_size = CQ_SIZE;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "VTh" ADDR_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parse_addr_opts(op, optarg, &opts);
+			ft_parseinfo(op, optarg, hints, &opts);
+			break;
+		case 'V':
+			opts.verbose = 1;
+			break;
+		case 'T':
+			spsc = 1;
+			break;
+		case '?':
+		case 'h':
+			ft_usage(argv[0], "CQ Overflow Functional test");
+			FT_PRINT_OPTS_USAGE("-V", "Enable Verbose printing");
+			FT_PRINT_OPTS_USAGE("-T", "Use FI_THREAD_SAFE with "
+					    "single reader CQs (FI_CQ_SPSC)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	if (spsc) {
+		hints->domain_attr->threading = FI_THREAD_SAFE;
+		cq_attr.flags = FI_CQ_SPSC;
+	} else {
+		hints->domain_attr->threading = FI_THREAD_ENDPOINT;
+	}
+
+	ret = run_test();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -37,6 +37,7 @@
 #include <getopt.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <dirent.h>
 
 #include <rdma/fi_errno.h>
 #include <rdma/fi_domain.h>
@@ -231,6 +232,100 @@ static int sum_all_reduce_test_run()
 	return -FI_ENOEQ;
 }
 
+/*
+ * Repeats one allreduce, which restarts its kept schedule, for more
+ * operations than the 16 bit sequence number in a cid can count, so the
+ * rewritten tags wrap around while the results are checked.
+ */
+#define RESTART_ITERS ((1 << 16) + 64)
+
+static int allreduce_restart_test_run()
+{
+	int err;
+	uint64_t done_flag;
+	uint64_t result, data, expect_result = 0;
+	uint64_t i, iter;
+	struct fi_collective_attr attr;
+
+	attr.op = FI_SUM;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_ALLREDUCE, &attr, 0);
+	if (err) {
+		FT_DEBUG("SUM AllReduce collective not supported: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	for (i = 0; i < pm_job.num_ranks; i++)
+		expect_result += i;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	for (iter = 0; iter < RESTART_ITERS; iter++) {
+		data = pm_job.my_rank + iter;
+		result = 0;
+		err = fi_allreduce(ep, &data, 1, NULL, &result, NULL, coll_addr,
+				   FI_UINT64, FI_SUM, 0, &done_flag);
+		if (err) {
+			FT_DEBUG("collective allreduce failed: %d (%s)\n", err,
+				 fi_strerror(err));
+			return err;
+		}
+
+		err = wait_for_comp(&done_flag);
+		if (err)
+			return err;
+
+		if (result != expect_result + iter * pm_job.num_ranks) {
+			FT_DEBUG("allreduce %" PRIu64 " failed; expect: %" PRIu64
+				 ", actual: %" PRIu64 "\n", iter,
+				 expect_result + iter * pm_job.num_ranks, result);
+			return -FI_ENOEQ;
+		}
+	}
+
+	return FI_SUCCESS;
+}
+
+/*
+ * An allreduce with an operation that has no reduction fails where its data
+ * is reduced, and a node leader passes the failure on to the other members
+ * of its node.  Every rank must reach a reduction or the failure, which
+ * holds on a single node or for a power of two number of ranks.  The
+ * allreduce issued next must still complete.
+ */
+static int allreduce_fail_test_run()
+{
+	int err;
+	uint64_t done_flag;
+	uint64_t result = 0;
+	uint64_t data = pm_job.my_rank;
+	struct fi_cq_err_entry comp = { 0 };
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_allreduce(ep, &data, 1, NULL, &result, NULL, coll_addr,
+			   FI_UINT64, FI_ATOMIC_WRITE, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective allreduce failed: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err != -FI_EAVAIL) {
+		FT_DEBUG("failing allreduce not reported: %d\n", err);
+		return err ? err : -FI_EOTHER;
+	}
+
+	err = fi_cq_readerr(txcq, &comp, 0);
+	if (err != 1 || comp.op_context != &done_flag || !comp.err) {
+		FT_DEBUG("unexpected allreduce error entry: %d\n", err);
+		return -FI_EOTHER;
+	}
+
+	return sum_all_reduce_test_run();
+}
+
 static int all_gather_test_run()
 {
 	int err;
@@ -415,6 +510,264 @@ out:
 	return err;
 }
 
+static int reduce_test_run()
+{
+	int err;
+	uint64_t done_flag;
+	uint64_t result = 0;
+	uint64_t expect_result = 0;
+	uint64_t data = pm_job.my_rank;
+	uint64_t i;
+	struct fi_collective_attr attr;
+	fi_addr_t root = pm_job.num_ranks - 1;
+
+	attr.op = FI_SUM;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_REDUCE, &attr, 0);
+	if (err) {
+		FT_DEBUG("SUM Reduce collective not supported: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	for (i = 0; i < pm_job.num_ranks; i++) {
+		expect_result += i;
+	}
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_reduce(ep, &data, 1, NULL, &result, NULL, coll_addr, root,
+			FI_UINT64, FI_SUM, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective reduce failed: %d (%s)\n", err, fi_strerror(err));
+		return err;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err)
+		return err;
+
+	if (pm_job.my_rank != root || result == expect_result)
+		return FI_SUCCESS;
+
+	FT_DEBUG("reduce failed; expect: %ld, actual: %ld\n", expect_result, result);
+	return -FI_ENOEQ;
+}
+
+static int reduce_scatter_test_run()
+{
+	int err;
+	uint64_t done_flag;
+	uint64_t result = 0;
+	uint64_t expect_result = 0;
+	uint64_t *data;
+	uint64_t i;
+	struct fi_collective_attr attr;
+
+	attr.op = FI_SUM;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_REDUCE_SCATTER, &attr, 0);
+	if (err) {
+		FT_DEBUG("SUM Reduce-Scatter collective not supported: %d (%s)\n",
+			 err, fi_strerror(err));
+		return err;
+	}
+
+	data = malloc(pm_job.num_ranks * sizeof(*data));
+	if (!data)
+		return -FI_ENOMEM;
+
+	// every rank contributes i + rank to the value for rank i
+	for (i = 0; i < pm_job.num_ranks; i++) {
+		data[i] = i + pm_job.my_rank;
+		expect_result += pm_job.my_rank + i;
+	}
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_reduce_scatter(ep, data, 1, NULL, &result, NULL, coll_addr,
+				FI_UINT64, FI_SUM, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective reduce_scatter failed: %d (%s)\n", err,
+			 fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err)
+		goto out;
+
+	if (result != expect_result) {
+		FT_DEBUG("reduce_scatter failed; expect: %ld, actual: %ld\n",
+			 expect_result, result);
+		err = -FI_ENOEQ;
+	}
+out:
+	free(data);
+	return err;
+}
+
+static int gather_test_run()
+{
+	int err;
+	uint64_t done_flag;
+	uint64_t *result;
+	uint64_t data = pm_job.my_rank;
+	uint64_t i;
+	struct fi_collective_attr attr;
+	fi_addr_t root = pm_job.num_ranks - 1;
+
+	attr.op = FI_NOOP;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_GATHER, &attr, 0);
+	if (err) {
+		FT_DEBUG("Gather collective not supported: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	result = calloc(pm_job.num_ranks, sizeof(*result));
+	if (!result)
+		return -FI_ENOMEM;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_gather(ep, &data, 1, NULL, result, NULL, coll_addr, root,
+			FI_UINT64, 0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective gather failed: %d (%s)\n", err, fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err || pm_job.my_rank != root)
+		goto out;
+
+	for (i = 0; i < pm_job.num_ranks; i++) {
+		if (result[i] != i) {
+			FT_DEBUG("gather failed; expect[%ld]: %ld, actual[%ld]: %ld\n",
+				 i, i, i, result[i]);
+			err = -FI_ENOEQ;
+			goto out;
+		}
+	}
+out:
+	free(result);
+	return err;
+}
+
+static int alltoall_test_run()
+{
+	int err;
+	uint64_t done_flag;
+	uint64_t *result, *data;
+	uint64_t i;
+	struct fi_collective_attr attr;
+
+	attr.op = FI_NOOP;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_ALLTOALL, &attr, 0);
+	if (err) {
+		FT_DEBUG("Alltoall collective not supported: %d (%s)\n", err,
+			 fi_strerror(err));
+		return err;
+	}
+
+	result = calloc(pm_job.num_ranks, sizeof(*result));
+	data = malloc(pm_job.num_ranks * sizeof(*data));
+	if (!result || !data) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+
+	// the value sent from rank j to rank i is j * num_ranks + i
+	for (i = 0; i < pm_job.num_ranks; i++)
+		data[i] = pm_job.my_rank * pm_job.num_ranks + i;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	err = fi_alltoall(ep, data, 1, NULL, result, NULL, coll_addr, FI_UINT64,
+			  0, &done_flag);
+	if (err) {
+		FT_DEBUG("collective alltoall failed: %d (%s)\n", err,
+			 fi_strerror(err));
+		goto out;
+	}
+
+	err = wait_for_comp(&done_flag);
+	if (err)
+		goto out;
+
+	for (i = 0; i < pm_job.num_ranks; i++) {
+		if (result[i] != i * pm_job.num_ranks + pm_job.my_rank) {
+			FT_DEBUG("alltoall failed; expect[%ld]: %ld, actual[%ld]: %ld\n",
+				 i, i * pm_job.num_ranks + pm_job.my_rank, i,
+				 result[i]);
+			err = -FI_ENOEQ;
+			goto out;
+		}
+	}
+out:
+	free(data);
+	free(result);
+	return err;
+}
+
+/*
+ * Counts the node segments that util collectives place in /dev/shm when
+ * several members of a group share a host.  Returns -1 if they cannot be
+ * listed.
+ */
+static int node_segment_count(void)
+{
+	struct dirent *entry;
+	DIR *dir;
+	int cnt = 0;
+
+	dir = opendir("/dev/shm");
+	if (!dir)
+		return -1;
+
+	while ((entry = readdir(dir)))
+		cnt += !strncmp(entry->d_name, "ofi_coll_", 9);
+	closedir(dir);
+	return cnt;
+}
+
+/*
+ * Only the node leader, rank 0 here, may remove the segment of a
+ * hierarchical group.  Every other member leaves the group first, and the
+ * segment must still be there for the leader afterwards.
+ */
+static int node_leave_test_run()
+{
+	int err, cnt;
+
+	cnt = node_segment_count();
+	pm_barrier();
+
+	if (pm_job.my_rank) {
+		fi_close(&coll_mc->fid);
+		coll_mc = NULL;
+	}
+	pm_barrier();
+
+	err = FI_SUCCESS;
+	if (!pm_job.my_rank && cnt > 0 && node_segment_count() < cnt) {
+		FT_DEBUG("node segment removed by a member: %d -> %d\n",
+			 cnt, node_segment_count());
+		err = -FI_EOTHER;
+	}
+	return err;
+}
+
+static void node_leave_teardown()
+{
+	if (coll_mc)
+		fi_close(&coll_mc->fid);
+	free(av_set);
+}
+
 struct coll_test tests[] = {
 	{
 		.name = "join_test",
@@ -434,6 +787,18 @@ struct coll_test tests[] = {
 		.run = sum_all_reduce_test_run,
 		.teardown = coll_teardown
 	},
+	{
+		.name = "allreduce_restart_test",
+		.setup = coll_setup,
+		.run = allreduce_restart_test_run,
+		.teardown = coll_teardown
+	},
+	{
+		.name = "allreduce_fail_test",
+		.setup = coll_setup,
+		.run = allreduce_fail_test_run,
+		.teardown = coll_teardown
+	},
 	{
 		.name = "all_gather_test",
 		.setup = coll_setup,
@@ -452,6 +817,36 @@ struct coll_test tests[] = {
 		.run = broadcast_test_run,
 		.teardown = coll_teardown,
 	},
+	{
+		.name = "reduce_test",
+		.setup = coll_setup,
+		.run = reduce_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "reduce_scatter_test",
+		.setup = coll_setup,
+		.run = reduce_scatter_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "gather_test",
+		.setup = coll_setup,
+		.run = gather_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "alltoall_test",
+		.setup = coll_setup,
+		.run = alltoall_test_run,
+		.teardown = coll_teardown,
+	},
+	{
+		.name = "node_leave_test",
+		.setup = coll_setup,
+		.run = node_leave_test_run,
+		.teardown = node_leave_teardown,
+	},
 };
 
 const int NUM_TESTS = ARRAY_SIZE(tests);
@@ -0,0 +1,614 @@
+/*
+ * Copyright (c) 2020 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_domain.h>
+#include <rdma/fabric.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_cm.h>
+#include <rdma/fi_collective.h>
+
+#include <core.h>
+#include <shared.h>
+
+/*
+ * Measures the bandwidth of large software allreduce, broadcast and
+ * scatter operations.  The reduction step of each allreduce runs the
+ * kernels selected by the provider, so this compares FI_REDUCE_KERNELS
+ * settings, and broadcast and scatter compare FI_COLL_SEGMENT_SIZE
+ * settings.  The overlap test issues two allreduces together and computes
+ * while they progress.
+ */
+
+static struct fid_av_set *av_set;
+static fi_addr_t world_addr;
+static struct fid_mc *coll_mc;
+
+static int wait_for_event(uint32_t event)
+{
+	struct fi_cq_err_entry comp = { 0 };
+	uint32_t ev;
+	int err;
+
+	do {
+		err = fi_eq_read(eq, &ev, NULL, 0, 0);
+		if (err >= 0) {
+			if (ev == event)
+				return FI_SUCCESS;
+		} else if (err != -FI_EAGAIN) {
+			return err;
+		}
+
+		err = fi_cq_read(rxcq, &comp, 1);
+		if (err < 0 && err != -FI_EAGAIN)
+			return err;
+
+		err = fi_cq_read(txcq, &comp, 1);
+		if (err < 0 && err != -FI_EAGAIN)
+			return err;
+	} while (err == -FI_EAGAIN);
+
+	return err;
+}
+
+static int wait_for_comp(void *ctx)
+{
+	struct fi_cq_err_entry comp = { 0 };
+	int err;
+
+	for (;;) {
+		err = fi_cq_read(rxcq, &comp, 1);
+		if (err < 0 && err != -FI_EAGAIN)
+			return err;
+
+		if (err > 0 && comp.op_context == ctx)
+			return FI_SUCCESS;
+
+		err = fi_cq_read(txcq, &comp, 1);
+		if (err < 0 && err != -FI_EAGAIN)
+			return err;
+
+		if (err > 0 && comp.op_context == ctx)
+			return FI_SUCCESS;
+	}
+}
+
+static int poll_overlap(void *ctx1, void *ctx2, int *pending)
+{
+	struct fi_cq_err_entry comp = { 0 };
+	int err;
+
+	err = fi_cq_read(rxcq, &comp, 1);
+	if (err < 0 && err != -FI_EAGAIN)
+		return err;
+
+	if (err > 0 && (comp.op_context == ctx1 || comp.op_context == ctx2))
+		(*pending)--;
+
+	err = fi_cq_read(txcq, &comp, 1);
+	if (err < 0 && err != -FI_EAGAIN)
+		return err;
+
+	if (err > 0 && (comp.op_context == ctx1 || comp.op_context == ctx2))
+		(*pending)--;
+
+	return FI_SUCCESS;
+}
+
+static int coll_setup(void)
+{
+	struct fi_av_set_attr av_set_attr;
+	int err;
+
+	av_set_attr.count = pm_job.num_ranks;
+	av_set_attr.start_addr = 0;
+	av_set_attr.end_addr = pm_job.num_ranks - 1;
+	av_set_attr.stride = 1;
+
+	err = fi_av_set(av, &av_set_attr, &av_set, NULL);
+	if (err) {
+		FT_PRINTERR("fi_av_set", err);
+		return err;
+	}
+
+	err = fi_av_set_addr(av_set, &world_addr);
+	if (err) {
+		FT_PRINTERR("fi_av_set_addr", err);
+		return err;
+	}
+
+	err = fi_join_collective(ep, world_addr, av_set, 0, &coll_mc, NULL);
+	if (err) {
+		FT_PRINTERR("fi_join_collective", err);
+		return err;
+	}
+
+	return wait_for_event(FI_JOIN_COMPLETE);
+}
+
+static void coll_teardown(void)
+{
+	fi_close(&coll_mc->fid);
+	free(av_set);
+}
+
+static void fill_data(void *buf, size_t count, enum fi_datatype datatype)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (datatype == FI_FLOAT)
+			((float *) buf)[i] = (float) (pm_job.my_rank + i % 64);
+		else
+			((uint64_t *) buf)[i] = pm_job.my_rank + i;
+	}
+}
+
+static int check_result(void *buf, size_t count, enum fi_datatype datatype)
+{
+	size_t ranks = pm_job.num_ranks;
+	size_t base = ranks * (ranks - 1) / 2;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (datatype == FI_FLOAT) {
+			if (((float *) buf)[i] != (float) (base + ranks * (i % 64)))
+				goto err;
+		} else {
+			if (((uint64_t *) buf)[i] != base + ranks * i)
+				goto err;
+		}
+	}
+	return FI_SUCCESS;
+err:
+	FT_ERR("allreduce result mismatch at index %zu\n", i);
+	return -FI_EOTHER;
+}
+
+static int allreduce_bw(size_t size, enum fi_datatype datatype,
+			const char *type_name)
+{
+	struct fi_collective_attr attr;
+	fi_addr_t coll_addr;
+	uint64_t done_flag;
+	void *data, *result;
+	size_t count;
+	int i, err;
+
+	attr.op = FI_SUM;
+	attr.datatype = datatype;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_ALLREDUCE, &attr, 0);
+	if (err) {
+		FT_PRINTERR("fi_query_collective", err);
+		return err;
+	}
+
+	count = size / datatype_to_size(datatype);
+	data = malloc(size);
+	result = malloc(size);
+	if (!data || !result) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+	fill_data(data, count, datatype);
+
+	coll_addr = fi_mc_addr(coll_mc);
+	pm_barrier();
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		err = fi_allreduce(ep, data, count, NULL, result, NULL,
+				   coll_addr, datatype, FI_SUM, 0, &done_flag);
+		if (err) {
+			FT_PRINTERR("fi_allreduce", err);
+			goto out;
+		}
+
+		err = wait_for_comp(&done_flag);
+		if (err) {
+			FT_PRINTERR("fi_cq_read", err);
+			goto out;
+		}
+	}
+	ft_stop();
+
+	err = check_result(result, count, datatype);
+	if (err)
+		goto out;
+
+	if (pm_job.my_rank == 0) {
+		snprintf(test_name, sizeof(test_name), "allreduce_sum_%s",
+			 type_name);
+		show_perf(test_name, size, opts.iterations, &start, &end, 1);
+	}
+out:
+	free(result);
+	free(data);
+	return err;
+}
+
+#define OVERLAP_BLOCK 4096
+
+/*
+ * Starts two allreduces of size bytes each, then updates a separate array
+ * of the same length, polling for completions after every block of
+ * OVERLAP_BLOCK elements, and finally waits for both allreduces.
+ */
+static int allreduce_overlap_bw(size_t size)
+{
+	struct fi_collective_attr attr;
+	fi_addr_t coll_addr;
+	uint64_t done_flag[2];
+	float *data, *result[2], *work;
+	size_t count, j, k;
+	int i, pending, err;
+
+	attr.op = FI_SUM;
+	attr.datatype = FI_FLOAT;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_ALLREDUCE, &attr, 0);
+	if (err) {
+		FT_PRINTERR("fi_query_collective", err);
+		return err;
+	}
+
+	count = size / sizeof(*data);
+	data = malloc(size);
+	result[0] = malloc(size);
+	result[1] = malloc(size);
+	work = calloc(count, sizeof(*work));
+	if (!data || !result[0] || !result[1] || !work) {
+		err = -FI_ENOMEM;
+		goto out;
+	}
+	fill_data(data, count, FI_FLOAT);
+
+	coll_addr = fi_mc_addr(coll_mc);
+	pm_barrier();
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		err = fi_allreduce(ep, data, count, NULL, result[0], NULL,
+				   coll_addr, FI_FLOAT, FI_SUM, 0, &done_flag[0]);
+		if (err) {
+			FT_PRINTERR("fi_allreduce", err);
+			goto out;
+		}
+
+		err = fi_allreduce(ep, data, count, NULL, result[1], NULL,
+				   coll_addr, FI_FLOAT, FI_SUM, 0, &done_flag[1]);
+		if (err) {
+			FT_PRINTERR("fi_allreduce", err);
+			goto out;
+		}
+
+		pending = 2;
+		for (j = 0; j < count; j += OVERLAP_BLOCK) {
+			for (k = j; k < count && k < j + OVERLAP_BLOCK; k++)
+				work[k] = work[k] * 0.5f + data[k];
+
+			err = poll_overlap(&done_flag[0], &done_flag[1],
+					   &pending);
+			if (err)
+				goto err;
+		}
+
+		while (pending) {
+			err = poll_overlap(&done_flag[0], &done_flag[1],
+					   &pending);
+			if (err)
+				goto err;
+		}
+	}
+	ft_stop();
+
+	err = check_result(result[0], count, FI_FLOAT);
+	if (!err)
+		err = check_result(result[1], count, FI_FLOAT);
+	if (err)
+		goto out;
+
+	if (pm_job.my_rank == 0) {
+		snprintf(test_name, sizeof(test_name), "allreduce_overlap_float");
+		show_perf(test_name, size, opts.iterations, &start, &end, 2);
+	}
+	goto out;
+err:
+	FT_PRINTERR("fi_cq_read", err);
+out:
+	free(work);
+	free(result[1]);
+	free(result[0]);
+	free(data);
+	return err;
+}
+
+static int broadcast_bw(size_t size, fi_addr_t root)
+{
+	struct fi_collective_attr attr;
+	fi_addr_t coll_addr;
+	uint64_t done_flag;
+	uint64_t *data;
+	size_t count, j;
+	int i, err;
+
+	attr.op = FI_NOOP;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_BROADCAST, &attr, 0);
+	if (err) {
+		FT_PRINTERR("fi_query_collective", err);
+		return err;
+	}
+
+	count = size / sizeof(*data);
+	data = malloc(size);
+	if (!data)
+		return -FI_ENOMEM;
+
+	for (j = 0; j < count; j++)
+		data[j] = pm_job.my_rank == root ? root + j : 0;
+
+	coll_addr = fi_mc_addr(coll_mc);
+	pm_barrier();
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		err = fi_broadcast(ep, data, count, NULL, coll_addr, root,
+				   FI_UINT64, 0, &done_flag);
+		if (err) {
+			FT_PRINTERR("fi_broadcast", err);
+			goto out;
+		}
+
+		err = wait_for_comp(&done_flag);
+		if (err) {
+			FT_PRINTERR("fi_cq_read", err);
+			goto out;
+		}
+	}
+	ft_stop();
+
+	for (j = 0; j < count; j++) {
+		if (data[j] != root + j) {
+			FT_ERR("broadcast result mismatch at index %zu\n", j);
+			err = -FI_EOTHER;
+			goto out;
+		}
+	}
+
+	if (pm_job.my_rank == 0) {
+		snprintf(test_name, sizeof(test_name), "broadcast_uint64");
+		show_perf(test_name, size, opts.iterations, &start, &end, 1);
+	}
+out:
+	free(data);
+	return err;
+}
+
+/* size is the amount of data delivered to each process */
+static int scatter_bw(size_t size, fi_addr_t root)
+{
+	struct fi_collective_attr attr;
+	fi_addr_t coll_addr;
+	uint64_t done_flag;
+	uint64_t *data = NULL, *result;
+	size_t count, j;
+	int i, err;
+
+	attr.op = FI_NOOP;
+	attr.datatype = FI_UINT64;
+	attr.mode = 0;
+	err = fi_query_collective(domain, FI_SCATTER, &attr, 0);
+	if (err) {
+		FT_PRINTERR("fi_query_collective", err);
+		return err;
+	}
+
+	count = size / sizeof(*result);
+	result = malloc(size);
+	if (!result)
+		return -FI_ENOMEM;
+
+	if (pm_job.my_rank == root) {
+		data = malloc(size * pm_job.num_ranks);
+		if (!data) {
+			err = -FI_ENOMEM;
+			goto out;
+		}
+		for (j = 0; j < count * pm_job.num_ranks; j++)
+			data[j] = j;
+	}
+
+	coll_addr = fi_mc_addr(coll_mc);
+	pm_barrier();
+
+	for (i = 0; i < opts.iterations + opts.warmup_iterations; i++) {
+		if (i == opts.warmup_iterations)
+			ft_start();
+
+		err = fi_scatter(ep, data, count, NULL, result, NULL, coll_addr,
+				 root, FI_UINT64, 0, &done_flag);
+		if (err) {
+			FT_PRINTERR("fi_scatter", err);
+			goto out;
+		}
+
+		err = wait_for_comp(&done_flag);
+		if (err) {
+			FT_PRINTERR("fi_cq_read", err);
+			goto out;
+		}
+	}
+	ft_stop();
+
+	for (j = 0; j < count; j++) {
+		if (result[j] != pm_job.my_rank * count + j) {
+			FT_ERR("scatter result mismatch at index %zu\n", j);
+			err = -FI_EOTHER;
+			goto out;
+		}
+	}
+
+	if (pm_job.my_rank == 0) {
+		snprintf(test_name, sizeof(test_name), "scatter_uint64");
+		show_perf(test_name, size, opts.iterations, &start, &end, 1);
+	}
+out:
+	free(data);
+	free(result);
+	return err;
+}
+
+static inline int setup_hints(void)
+{
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG | FI_COLLECTIVE;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->control_progress = FI_PROGRESS_MANUAL;
+	hints->domain_attr->data_progress = FI_PROGRESS_MANUAL;
+	if (!hints->fabric_attr->prov_name)
+		hints->fabric_attr->prov_name = strdup("tcp");
+	return FI_SUCCESS;
+}
+
+static int multinode_setup_fabric(int argc, char **argv)
+{
+	char my_name[FT_MAX_CTRL_MSG];
+	size_t len;
+	int err;
+
+	setup_hints();
+
+	err = ft_getinfo(hints, &fi);
+	if (err)
+		return err;
+
+	err = ft_open_fabric_res();
+	if (err)
+		return err;
+
+	opts.av_size = pm_job.num_ranks;
+
+	av_attr.type = FI_AV_TABLE;
+	err = ft_alloc_active_res(fi);
+	if (err)
+		return err;
+
+	err = ft_enable_ep(ep, eq, av, txcq, rxcq, txcntr, rxcntr);
+	if (err)
+		return err;
+
+	len = FT_MAX_CTRL_MSG;
+	err = fi_getname(&ep->fid, (void *) my_name, &len);
+	if (err) {
+		FT_PRINTERR("error determining local endpoint name", err);
+		return err;
+	}
+
+	pm_job.name_len = len;
+	pm_job.names = malloc(len * pm_job.num_ranks);
+	if (!pm_job.names) {
+		FT_ERR("error allocating memory for address exchange\n");
+		return -FI_ENOMEM;
+	}
+
+	err = pm_allgather(my_name, pm_job.names, pm_job.name_len);
+	if (err) {
+		FT_PRINTERR("error exchanging addresses", err);
+		return err;
+	}
+
+	pm_job.fi_addrs = calloc(pm_job.num_ranks, sizeof(*pm_job.fi_addrs));
+	if (!pm_job.fi_addrs) {
+		FT_ERR("error allocating memory for av fi addrs\n");
+		return -FI_ENOMEM;
+	}
+
+	err = fi_av_insert(av, pm_job.names, pm_job.num_ranks, pm_job.fi_addrs,
+			   0, NULL);
+	if (err != pm_job.num_ranks) {
+		FT_ERR("unable to insert all addresses into AV table: %d (%s)\n",
+		       err, fi_strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+int multinode_run_tests(int argc, char **argv)
+{
+	int i, ret;
+
+	ret = multinode_setup_fabric(argc, argv);
+	if (ret)
+		goto out;
+
+	ret = coll_setup();
+	if (ret)
+		goto out;
+
+	for (i = 0; i < TEST_CNT && !ret; i++) {
+		if (!ft_use_size(i, opts.sizes_enabled) ||
+		    test_size[i].size < sizeof(uint64_t))
+			continue;
+
+		ret = allreduce_bw(test_size[i].size, FI_FLOAT, "float");
+		if (!ret)
+			ret = allreduce_bw(test_size[i].size, FI_UINT64,
+					   "uint64");
+		if (!ret)
+			ret = allreduce_overlap_bw(test_size[i].size);
+		if (!ret)
+			ret = broadcast_bw(test_size[i].size, 0);
+		if (!ret)
+			ret = scatter_bw(test_size[i].size, 0);
+	}
+
+	pm_barrier();
+	coll_teardown();
+out:
+	free(pm_job.names);
+	free(pm_job.fi_addrs);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
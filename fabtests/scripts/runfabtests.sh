@@ -119,6 +119,8 @@ functional_tests=(
 	"fi_multi_mr -e msg -V"
 	"fi_multi_mr -e rdm -V"
 	"fi_recv_cancel -e rdm -V"
+	"fi_cq_overflow -V"
+	"fi_cq_overflow -V -T"
 	"fi_unexpected_msg -e msg -i 10"
 	"fi_unexpected_msg -e rdm -i 10"
 	"fi_unexpected_msg -e msg -S -i 10"
@@ -154,6 +156,9 @@ short_tests=(
 	"fi_rdm_tagged_pingpong -I 5 -v"
 	"fi_rdm_tagged_bw -I 5"
 	"fi_rdm_tagged_bw -I 5 -v"
+	"fi_rdm_cq_read -I 5"
+	"fi_rdm_incast -I 5"
+	"fi_rdm_atomic_bw -I 5"
 	"fi_dgram_pingpong -I 5"
 )
 
@@ -182,6 +187,9 @@ standard_tests=(
 	"fi_rdm_tagged_pingpong -v"
 	"fi_rdm_tagged_bw"
 	"fi_rdm_tagged_bw -v"
+	"fi_rdm_cq_read"
+	"fi_rdm_incast"
+	"fi_rdm_atomic_bw"
 	"fi_dgram_pingpong"
 	"fi_dgram_pingpong -k"
 )
@@ -203,6 +211,7 @@ complex_tests=(
 multinode_tests=(
 	"fi_multinode"
 	"fi_multinode_coll"
+	"fi_multinode_coll_bw -I 5"
 )
 
 function errcho {
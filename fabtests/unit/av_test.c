@@ -35,6 +35,7 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <unistd.h>
 #include <netdb.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -338,6 +339,105 @@ fail:
 	return TEST_RET_VAL(ret, testret);
 }
 
+/*
+ * Tests:
+ * - a named AV is built by its first opener and shared with later openers
+ */
+static int
+av_shared()
+{
+	int testret;
+	int ret;
+	struct fid_av *av, *av_dup, *av_rd;
+	struct fi_av_attr attr;
+	uint8_t addrbuf[4096];
+	char name[64];
+	int buflen;
+	fi_addr_t fi_addr, fi_addr_dup, fi_addr_rd;
+
+	testret = FAIL;
+	av = av_dup = av_rd = NULL;
+
+	if (av_type != FI_AV_TABLE) {
+		sprintf(err_buf, "test not valid for AV type %s",
+				fi_tostr(&av_type, FI_TYPE_AV_TYPE));
+		ret = -FI_ENOSYS;
+		goto fail;
+	}
+
+	snprintf(name, sizeof(name), "fabtests_av_%d", getpid());
+	memset(&attr, 0, sizeof(attr));
+	attr.type = av_type;
+	attr.count = 32;
+	attr.name = name;
+
+	attr.flags = FI_READ;
+	ret = fi_av_open(domain, &attr, &av_rd, NULL);
+	if (ret == 0) {
+		sprintf(err_buf, "fi_av_open(FI_READ) of missing AV succeeded");
+		ret = -FI_EOTHER;
+		goto fail;
+	}
+
+	attr.flags = 0;
+	ret = fi_av_open(domain, &attr, &av, NULL);
+	if (ret != 0) {
+		sprintf(err_buf, "fi_av_open(%s) = %d, %s", name,
+				ret, fi_strerror(-ret));
+		goto fail;
+	}
+
+	buflen = sizeof(addrbuf);
+	ret = av_create_address_list(good_address, 0, 1, addrbuf, 0, buflen);
+	if (ret < 0) {
+		goto fail;		// av_create_address_list filled err_buf
+	}
+
+	fi_addr = FI_ADDR_NOTAVAIL;
+	ret = fi_av_insert(av, addrbuf, 1, &fi_addr, 0, NULL);
+	if (ret != 1) {
+		sprintf(err_buf, "fi_av_insert ret=%d, %s", ret, fi_strerror(-ret));
+		goto fail;
+	}
+
+	ret = fi_av_open(domain, &attr, &av_dup, NULL);
+	if (ret != 0) {
+		sprintf(err_buf, "second fi_av_open(%s) = %d, %s", name,
+				ret, fi_strerror(-ret));
+		goto fail;
+	}
+
+	attr.flags = FI_READ;
+	ret = fi_av_open(domain, &attr, &av_rd, NULL);
+	if (ret != 0) {
+		sprintf(err_buf, "fi_av_open(%s, FI_READ) = %d, %s", name,
+				ret, fi_strerror(-ret));
+		goto fail;
+	}
+
+	fi_addr_dup = fi_addr_rd = FI_ADDR_NOTAVAIL;
+	ret = fi_av_insert(av_dup, addrbuf, 1, &fi_addr_dup, 0, NULL);
+	if (ret != 1 || fi_addr_dup != fi_addr) {
+		sprintf(err_buf, "second opener resolved %" PRIu64
+				" instead of %" PRIu64, fi_addr_dup, fi_addr);
+		goto fail;
+	}
+
+	ret = fi_av_insert(av_rd, addrbuf, 1, &fi_addr_rd, 0, NULL);
+	if (ret != 1 || fi_addr_rd != fi_addr) {
+		sprintf(err_buf, "FI_READ opener resolved %" PRIu64
+				" instead of %" PRIu64, fi_addr_rd, fi_addr);
+		goto fail;
+	}
+
+	testret = PASS;
+fail:
+	FT_CLOSE_FID(av_rd);
+	FT_CLOSE_FID(av_dup);
+	FT_CLOSE_FID(av);
+	return TEST_RET_VAL(ret, testret);
+}
+
 static int
 av_null_fi_addr()
 {
@@ -963,6 +1063,7 @@ struct test_entry test_array_good[] = {
 	TEST_ENTRY(av_good_2vector_async,
 			"Test async AV inserts with two address vectors"),
 	TEST_ENTRY(av_insert_stages, "Test AV insert at various stages"),
+	TEST_ENTRY(av_shared, "Test sharing a named AV between opens"),
 	{ NULL, "" }
 };
 
@@ -166,6 +166,16 @@ enum {
 	OFI_CLFLUSHOPT_BIT	= (1 << 24),
 	OFI_CLFLUSH_REG		= 3,
 	OFI_CLFLUSH_BIT		= (1 << 23),
+	OFI_OSXSAVE_REG		= 2,
+	OFI_OSXSAVE_BIT		= (1 << 27),
+	OFI_AVX2_REG		= 1,
+	OFI_AVX2_BIT		= (1 << 5),
+	OFI_AVX512F_REG		= 1,
+	OFI_AVX512F_BIT		= (1 << 16),
+	OFI_AVX512BW_REG	= 1,
+	OFI_AVX512BW_BIT	= (1 << 30),
+	OFI_CX16_REG		= 2,
+	OFI_CX16_BIT		= (1 << 13),
 };
 
 int ofi_cpu_supports(unsigned func, unsigned reg, unsigned bit);
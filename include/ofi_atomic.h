@@ -58,6 +58,35 @@ extern void (*ofi_atomic_swap_handlers[OFI_SWAP_OP_LAST][FI_DATATYPE_LAST])
 
 int ofi_atomic_valid(const struct fi_provider *prov,
 		     enum fi_datatype datatype, enum fi_op op, uint64_t flags);
+void ofi_atomic_init(void);
+
+/*
+ * Non-atomic reduction kernels, dst[i] = dst[i] op src[i], for buffers
+ * that are private to the caller, such as collective reduce steps.
+ * Indexed by [op][datatype] for FI_MIN through FI_BXOR.  The table is
+ * selected by ofi_reduce_init() based on the CPU's vector extensions.
+ */
+#define OFI_REDUCE_OP_LAST	(FI_BXOR + 1)
+
+typedef void (*ofi_reduce_func)(void *dst, const void *src, size_t cnt);
+
+extern ofi_reduce_func (*ofi_reduce_handlers)[FI_DATATYPE_LAST];
+
+void ofi_reduce_init(void);
+
+/*
+ * Write handlers for targets whose memory is only updated from the
+ * provider's own progress.  When progress is serialized by the threading
+ * model (FI_THREAD_DOMAIN with FI_PROGRESS_MANUAL), no two updates can
+ * race, and the reduce kernels above can replace the element-wise
+ * compare-and-swap loops.  Returns ofi_atomic_write_handlers otherwise.
+ */
+extern ofi_reduce_func ofi_atomic_serial_handlers[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST];
+
+typedef ofi_reduce_func (*ofi_atomic_write_table)[FI_DATATYPE_LAST];
+
+struct util_domain;
+ofi_atomic_write_table ofi_atomic_write_select(const struct util_domain *domain);
 
 
 #ifdef __cplusplus
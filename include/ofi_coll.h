@@ -50,6 +50,10 @@ enum util_coll_op_type {
 	UTIL_COLL_BROADCAST_OP,
 	UTIL_COLL_ALLGATHER_OP,
 	UTIL_COLL_SCATTER_OP,
+	UTIL_COLL_REDUCE_OP,
+	UTIL_COLL_REDUCE_SCATTER_OP,
+	UTIL_COLL_GATHER_OP,
+	UTIL_COLL_ALLTOALL_OP,
 };
 
 static const char * const log_util_coll_op_type[] = {
@@ -58,7 +62,11 @@ static const char * const log_util_coll_op_type[] = {
 	[UTIL_COLL_ALLREDUCE_OP] = "COLL_ALLREDUCE",
 	[UTIL_COLL_BROADCAST_OP] = "COLL_BROADCAST",
 	[UTIL_COLL_ALLGATHER_OP] = "COLL_ALLGATHER",
-	[UTIL_COLL_SCATTER_OP] = "COLL_SCATTER"
+	[UTIL_COLL_SCATTER_OP] = "COLL_SCATTER",
+	[UTIL_COLL_REDUCE_OP] = "COLL_REDUCE",
+	[UTIL_COLL_REDUCE_SCATTER_OP] = "COLL_REDUCE_SCATTER",
+	[UTIL_COLL_GATHER_OP] = "COLL_GATHER",
+	[UTIL_COLL_ALLTOALL_OP] = "COLL_ALLTOALL"
 };
 
 struct util_av_set {
@@ -77,6 +85,9 @@ enum coll_work_type {
 	UTIL_COLL_REDUCE,
 	UTIL_COLL_COPY,
 	UTIL_COLL_COMP,
+	UTIL_COLL_WAIT,
+	UTIL_COLL_POST,
+	UTIL_COLL_ATTACH,
 };
 
 enum coll_state {
@@ -96,6 +107,7 @@ struct util_coll_operation;
 struct util_coll_work_item {
 	struct slist_entry		ready_entry;
 	struct dlist_entry		waiting_entry;
+	struct slist_entry		sched_entry;
 	struct util_coll_operation 	*coll_op;
 	enum coll_work_type		type;
 	enum coll_state			state;
@@ -128,6 +140,18 @@ struct util_coll_reduce_item {
 	enum fi_op			op;
 };
 
+/*
+ * Waits for, or publishes, a sequence number in a node's shared segment.
+ * Used by the intra-node phases of hierarchical collectives.
+ */
+struct util_coll_flag_item {
+	struct util_coll_work_item	hdr;
+	uint64_t			*flag;
+	uint64_t			value;
+};
+
+struct util_coll_node;
+
 struct util_coll_mc {
 	struct fid_mc		mc_fid;
 	struct fid_ep		*ep;
@@ -136,15 +160,24 @@ struct util_coll_mc {
 	uint16_t		group_id;
 	uint16_t		seq;
 	ofi_atomic32_t		ref;
+	struct util_coll_node	*node;
+	struct dlist_entry	sched_list;
+	size_t			sched_cnt;
+	size_t			sched_bytes;
+	struct dlist_entry	active_list;
 };
 
 struct join_data {
 	struct util_coll_mc *new_mc;
 	struct bitmask data;
 	struct bitmask tmp;
+	uint8_t node_ok;
+	uint8_t node_agreed;
+	uint8_t node_tmp;
 };
 
 struct barrier_data {
+	uint64_t send;
 	uint64_t data;
 	uint64_t tmp;
 };
@@ -160,6 +193,20 @@ struct broadcast_data {
 	void	*scatter;
 };
 
+/*
+ * Identifies the arguments a schedule was built for.  Completed allreduce
+ * and barrier schedules stay on their group and are restarted when an
+ * operation with the same key is issued again.
+ */
+struct util_coll_sched_key {
+	enum util_coll_op_type	type;
+	const void		*buf;
+	void			*result;
+	size_t			count;
+	enum fi_datatype	datatype;
+	enum fi_op		op;
+};
+
 struct util_coll_operation;
 
 typedef void (*util_coll_comp_fn_t)(struct util_coll_operation *coll_op);
@@ -168,17 +215,45 @@ struct util_coll_operation {
 	uint32_t			cid;
 	void				*context;
 	struct util_coll_mc		*mc;
+	/* group the cid was drawn from, mc may move to the node leaders */
+	struct util_coll_mc		*group;
+	struct dlist_entry		active_entry;
 	struct dlist_entry		work_queue;
+	struct slist			ready_queue;
+	struct slist_entry		ready_entry;
+	int				queued;
+	uint64_t			node_seq;
 	union {
 		struct join_data	join;
 		struct barrier_data	barrier;
 		struct allreduce_data	allreduce;
 		void			*scatter;
 		struct broadcast_data	broadcast;
+		void			*reduce;
+		void			*reduce_scatter;
+		void			*gather;
 	} data;
 	util_coll_comp_fn_t		comp_fn;
+	struct slist			sched;
+	struct dlist_entry		sched_entry;
+	struct util_coll_sched_key	key;
+	int				persistent;
+	int				busy;
+	int				failed;
+};
+
+struct ofi_coll_params {
+	size_t				allreduce_limit;
+	size_t				segment_size;
+	size_t				node_limit;
+	size_t				sched_cache;
+	size_t				sched_cache_size;
 };
 
+extern struct ofi_coll_params		coll_params;
+
+void ofi_coll_init(void);
+
 int ofi_query_collective(struct fid_domain *domain, enum fi_collective_op coll,
 			 struct fi_collective_attr *attr, uint64_t flags);
 
@@ -209,6 +284,25 @@ ssize_t ofi_ep_broadcast(struct fid_ep *ep, void *buf, size_t count, void *desc,
 			 fi_addr_t coll_addr, fi_addr_t root_addr,
 			 enum fi_datatype datatype, uint64_t flags, void *context);
 
+ssize_t ofi_ep_reduce(struct fid_ep *ep, const void *buf, size_t count, void *desc,
+		      void *result, void *result_desc, fi_addr_t coll_addr,
+		      fi_addr_t root_addr, enum fi_datatype datatype, enum fi_op op,
+		      uint64_t flags, void *context);
+
+ssize_t ofi_ep_reduce_scatter(struct fid_ep *ep, const void *buf, size_t count,
+			      void *desc, void *result, void *result_desc,
+			      fi_addr_t coll_addr, enum fi_datatype datatype,
+			      enum fi_op op, uint64_t flags, void *context);
+
+ssize_t ofi_ep_gather(struct fid_ep *ep, const void *buf, size_t count, void *desc,
+		      void *result, void *result_desc, fi_addr_t coll_addr,
+		      fi_addr_t root_addr, enum fi_datatype datatype, uint64_t flags,
+		      void *context);
+
+ssize_t ofi_ep_alltoall(struct fid_ep *ep, const void *buf, size_t count, void *desc,
+			void *result, void *result_desc, fi_addr_t coll_addr,
+			enum fi_datatype datatype, uint64_t flags, void *context);
+
 int ofi_coll_ep_progress(struct fid_ep *ep);
 
 void ofi_coll_handle_xfer_comp(uint64_t tag, void *ctx);
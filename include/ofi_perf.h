@@ -37,6 +37,8 @@
 
 #include <assert.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <ofi_osd.h>
 #include <rdma/providers/fi_prov.h>
 
@@ -88,6 +90,9 @@ void ofi_perf_init(void);
 extern enum ofi_perf_domain	perf_domain;
 extern uint32_t			perf_cntr;
 extern uint32_t			perf_flags;
+extern int			perf_size_classes;
+extern char			*perf_dump_file;
+extern int			perf_dump_interval;
 
 
 /*
@@ -152,11 +157,43 @@ static inline void ofi_perf_end(struct ofi_perf_ctx *ctx,
 }
 
 
+/*
+ * Histograms are log2 bucketed, with each power of two split into
+ * OFI_PERF_HIST_SUB linear sub-buckets.  This bounds the error of a
+ * reported percentile to 25% of the value, independent of its magnitude.
+ */
+#define OFI_PERF_HIST_SUB_SHIFT	2
+#define OFI_PERF_HIST_SUB	(1 << OFI_PERF_HIST_SUB_SHIFT)
+#define OFI_PERF_HIST_BUCKETS	(64 * OFI_PERF_HIST_SUB)
+
+/*
+ * Message size classes: 64, 256, 1k, 4k, 16k, 64k, 256k, and larger.
+ * Class 0 collects calls which do not carry a size (e.g. CQ reads), or all
+ * calls when size classes are disabled.
+ */
+#define OFI_PERF_SIZE_CLASSES	9
+
+struct ofi_perf_hist {
+	uint64_t	sum;
+	uint64_t	events;
+	uint64_t	max;
+	uint64_t	bucket[OFI_PERF_HIST_BUCKETS];
+};
+
 struct ofi_perfset {
 	const struct fi_provider *prov;
 	size_t			size;
 	struct ofi_perf_ctx	*ctx;
 	struct ofi_perf_data	*data;
+
+	size_t			classes;
+	struct ofi_perf_hist	*hist;
+	const char		**names;
+	FILE			*dump_fp;
+	int			dump_json;
+	uint64_t		dump_start;
+	uint64_t		dump_next;
+	uint32_t		polls;
 };
 
 int ofi_perfset_create(const struct fi_provider *prov,
@@ -166,6 +203,17 @@ int ofi_perfset_create(const struct fi_provider *prov,
 void ofi_perfset_close(struct ofi_perfset *set);
 
 void ofi_perfset_log(struct ofi_perfset *set, const char **names);
+void ofi_perfset_record(struct ofi_perfset *set, size_t index,
+			size_t len, uint64_t value);
+void ofi_perfset_dump(struct ofi_perfset *set);
+void ofi_perfset_check_dump(struct ofi_perfset *set);
+
+/* Names are required to write a dump file. */
+static inline void ofi_perfset_names(struct ofi_perfset *set,
+				     const char **names)
+{
+	set->names = names;
+}
 
 static inline void ofi_perfset_start(struct ofi_perfset *set, size_t index)
 {
@@ -173,10 +221,36 @@ static inline void ofi_perfset_start(struct ofi_perfset *set, size_t index)
 	ofi_perf_start(set->ctx, &set->data[index]);
 }
 
-static inline void ofi_perfset_end(struct ofi_perfset *set, size_t index)
+/* len is ignored unless size classes are enabled, use SIZE_MAX if unknown */
+static inline void ofi_perfset_end_size(struct ofi_perfset *set,
+					size_t index, size_t len)
 {
+	struct ofi_perf_data *data;
+	uint64_t value;
+
 	assert(index < set->size);
-	ofi_perf_end(set->ctx, &set->data[index]);
+	data = &set->data[index];
+	value = ofi_pmu_read(set->ctx) - data->start;
+	data->sum += value;
+	data->events++;
+	ofi_perfset_record(set, index, len, value);
+}
+
+static inline void ofi_perfset_end(struct ofi_perfset *set, size_t index)
+{
+	ofi_perfset_end_size(set, index, SIZE_MAX);
+}
+
+/*
+ * Called from progress paths.  Checking the clock is limited to once
+ * every OFI_PERF_POLL_MASK + 1 calls.
+ */
+#define OFI_PERF_POLL_MASK	0xFF
+
+static inline void ofi_perfset_poll(struct ofi_perfset *set)
+{
+	if (set->dump_next && !(++set->polls & OFI_PERF_POLL_MASK))
+		ofi_perfset_check_dump(set);
 }
 
 
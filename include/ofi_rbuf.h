@@ -98,6 +98,23 @@ static inline void name ## _free(struct name *cq)		\
 #define ofi_cirque_discard(cq)		((cq)->rcnt++)
 #define ofi_cirque_commit(cq)		((cq)->wcnt++)
 
+/*
+ * Lock-free single-producer/single-consumer access.  The producer
+ * publishes entries with a release store of wcnt after filling them in,
+ * and the consumer releases entries back with a release store of rcnt
+ * after copying them out.
+ */
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+#define OFI_CIRQUE_SPSC 1
+#define ofi_cirque_load_acquire(cnt)	__atomic_load_n(&(cnt), __ATOMIC_ACQUIRE)
+#define ofi_cirque_store_release(cnt, val) \
+	__atomic_store_n(&(cnt), (val), __ATOMIC_RELEASE)
+#else
+#define OFI_CIRQUE_SPSC 0
+#define ofi_cirque_load_acquire(cnt)	(cnt)
+#define ofi_cirque_store_release(cnt, val) ((cnt) = (val))
+#endif
+
 
 /*
  * Simple ring buffer
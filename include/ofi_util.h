@@ -296,6 +296,15 @@ struct util_ep {
 	ofi_fastlock_acquire_t	lock_acquire;
 	ofi_fastlock_release_t	lock_release;
 
+	/*
+	 * Progress scheduling state, see ofi_cq_progress().  The tx and rx CQ
+	 * each keep their own slot, so that they can progress the endpoint
+	 * concurrently.
+	 */
+	ofi_atomic32_t		progress_active[2];
+	uint32_t		progress_idle[2];
+	uint32_t		progress_skip[2];
+
 	struct bitmask		*coll_cid_mask;
 	struct slist		coll_ready_queue;
 };
@@ -318,6 +327,19 @@ ofi_ep_fid_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 			   bfid, flags);
 }
 
+/*
+ * Request that the endpoint be progressed on the next CQ poll.  Providers
+ * call this when an endpoint has queued work which only progress will
+ * complete, such as deferred or unacknowledged transmits.  Endpoints that
+ * are not marked active and generate no completions are progressed at a
+ * decaying rate by ofi_cq_progress().
+ */
+static inline void ofi_ep_set_active(struct util_ep *ep)
+{
+	ofi_atomic_set32(&ep->progress_active[0], 1);
+	ofi_atomic_set32(&ep->progress_active[1], 1);
+}
+
 static inline void ofi_ep_lock_acquire(struct util_ep *ep)
 {
 	ep->lock_acquire(&ep->lock);
@@ -468,6 +490,9 @@ int ofi_wait_fid_del(struct util_wait *wait, void *fid);
  */
 
 typedef void (*fi_cq_read_func)(void **dst, void *src);
+typedef void (*fi_cq_read_bulk_func)(void **dst,
+				     const struct fi_cq_tagged_entry *src,
+				     size_t count);
 
 struct util_cq_oflow_err_entry {
 	struct fi_cq_tagged_entry	*parent_comp;
@@ -495,15 +520,31 @@ struct util_cq {
 	fi_addr_t		*src;
 
 	struct slist		oflow_err_list;
+	/* Completions queued on oflow_err_list, see ofi_cq_progress() */
+	size_t			oflow_cnt;
 	fi_cq_read_func		read_entry;
+	fi_cq_read_bulk_func	read_bulk;
 	int			internal_wait;
 	ofi_atomic32_t		signaled;
 	ofi_cq_progress_func	progress;
+	size_t			progress_ep_cnt;
+
+	/*
+	 * Single-producer/single-consumer mode, enabled by the provider with
+	 * ofi_cq_set_spsc.  The cirque is accessed without cq_lock.  Once an
+	 * error or overflow entry is queued, spsc_slow is set and all later
+	 * completions go to oflow_err_list under cq_lock until the reader
+	 * drains it.
+	 */
+	int			spsc;
+	ofi_atomic32_t		spsc_slow;
 };
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		 struct fi_cq_attr *attr, struct util_cq *cq,
 		 ofi_cq_progress_func progress, void *context);
+void ofi_cq_set_spsc(struct util_cq *cq);
+int ofi_cq_bind_spsc(struct util_cq *cq);
 int ofi_check_bind_cq_flags(struct util_ep *ep, struct util_cq *cq,
 			    uint64_t flags);
 void ofi_cq_progress(struct util_cq *cq);
@@ -522,6 +563,9 @@ int ofi_cq_signal(struct fid_cq *cq_fid);
 
 int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 			  void *buf, uint64_t data, uint64_t tag, fi_addr_t src);
+int ofi_cq_write_spsc_slow(struct util_cq *cq, void *context, uint64_t flags,
+			   size_t len, void *buf, uint64_t data, uint64_t tag,
+			   fi_addr_t src);
 
 static inline void util_cq_signal(struct util_cq *cq)
 {
@@ -543,10 +587,41 @@ ofi_cq_write_comp_entry(struct util_cq *cq, void *context, uint64_t flags,
 	ofi_cirque_commit(cq->cirq);
 }
 
+static inline int
+ofi_cq_write_spsc(struct util_cq *cq, void *context, uint64_t flags,
+		  size_t len, void *buf, uint64_t data, uint64_t tag,
+		  fi_addr_t src)
+{
+	struct fi_cq_tagged_entry *comp;
+	size_t wcnt = cq->cirq->wcnt;
+
+	if (OFI_UNLIKELY(ofi_atomic_get32(&cq->spsc_slow) ||
+			 wcnt - ofi_cirque_load_acquire(cq->cirq->rcnt) >=
+			 cq->cirq->size))
+		return ofi_cq_write_spsc_slow(cq, context, flags, len,
+					      buf, data, tag, src);
+
+	if (cq->src)
+		cq->src[wcnt & cq->cirq->size_mask] = src;
+	comp = &cq->cirq->buf[wcnt & cq->cirq->size_mask];
+	comp->op_context = context;
+	comp->flags = flags;
+	comp->len = len;
+	comp->buf = buf;
+	comp->data = data;
+	comp->tag = tag;
+	ofi_cirque_store_release(cq->cirq->wcnt, wcnt + 1);
+	return 0;
+}
+
 static inline int
 ofi_cq_write_thread_unsafe(struct util_cq *cq, void *context, uint64_t flags,
 			   size_t len, void *buf, uint64_t data, uint64_t tag)
 {
+	if (cq->spsc)
+		return ofi_cq_write_spsc(cq, context, flags, len, buf, data,
+					 tag, FI_ADDR_NOTAVAIL);
+
 	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
 		FI_DBG(cq->domain->prov, FI_LOG_CQ,
 		       "util_cq cirq is full!\n");
@@ -562,6 +637,11 @@ ofi_cq_write(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 	     void *buf, uint64_t data, uint64_t tag)
 {
 	int ret;
+
+	if (cq->spsc)
+		return ofi_cq_write_spsc(cq, context, flags, len, buf, data,
+					 tag, FI_ADDR_NOTAVAIL);
+
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	ret = ofi_cq_write_thread_unsafe(cq, context, flags, len, buf, data, tag);
 	cq->cq_fastlock_release(&cq->cq_lock);
@@ -572,6 +652,10 @@ static inline int
 ofi_cq_write_src_thread_unsafe(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 			       void *buf, uint64_t data, uint64_t tag, fi_addr_t src)
 {
+	if (cq->spsc)
+		return ofi_cq_write_spsc(cq, context, flags, len, buf, data,
+					 tag, src);
+
 	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
 		FI_DBG(cq->domain->prov, FI_LOG_CQ,
 		       "util_cq cirq is full!\n");
@@ -588,6 +672,11 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 		 void *buf, uint64_t data, uint64_t tag, fi_addr_t src)
 {
 	int ret;
+
+	if (cq->spsc)
+		return ofi_cq_write_spsc(cq, context, flags, len, buf, data,
+					 tag, src);
+
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	ret = ofi_cq_write_src_thread_unsafe(cq, context, flags, len,
 					     buf, data, tag, src);
@@ -673,10 +762,28 @@ static inline void ofi_cntr_inc(struct util_cntr *cntr)
 
 struct util_av_entry {
 	ofi_atomic32_t	use_cnt;
-	UT_hash_handle	hh;
 	char		addr[0];
 };
 
+/*
+ * Open-addressing table mapping addresses to AV entries.  Writers are
+ * serialized by the AV lock; lookups only read the table and may run
+ * without it.  A slot key holds the address hash, or one of the EMPTY
+ * and TOMBSTONE markers.  Tables replaced on growth are retired, not
+ * freed, until the AV is closed, so a reader holding a stale table
+ * pointer never touches freed memory.
+ */
+struct util_av_hash_slot {
+	uint64_t		key;
+	struct util_av_entry	*entry;
+};
+
+struct util_av_hash {
+	size_t			size;
+	size_t			used;	/* live + tombstones */
+	struct util_av_hash_slot slot[];
+};
+
 struct util_av {
 	struct fid_av		av_fid;
 	struct util_domain	*domain;
@@ -685,9 +792,14 @@ struct util_av {
 	fastlock_t		lock;
 	const struct fi_provider *prov;
 
-	struct util_av_entry	*hash;
+	struct util_av_hash	*hash;
+	size_t			hash_cnt;
 	struct ofi_bufpool	*av_entry_pool;
 
+	/* named AV, see util_av_shm_init() */
+	struct util_av_shm_hdr	*shm_hdr;
+	struct util_shm		shm;
+
 	struct util_coll_mc	*coll_mc;
 	void			*context;
 	uint64_t		flags;
@@ -714,6 +826,7 @@ int ofi_av_close(struct util_av *av);
 int ofi_av_close_lightweight(struct util_av *av);
 
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr);
+int ofi_av_reserve(struct util_av *av, size_t count);
 int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr);
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr);
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr);
@@ -940,10 +1053,27 @@ char *ofi_strdup_append(const char *head, const char *tail);
 int ofi_exclude_prov_name(char **prov_name, const char *util_prov_name);
 
 
-int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
-		int readonly, void **mapped);
+/*
+ * ofi_shm_map_flags() flags.  OFI_SHM_CREATE creates the segment if it does
+ * not exist, and with OFI_SHM_EXCL fails with -FI_EBUSY if it does.
+ * OFI_SHM_RDONLY maps an existing segment read-only, and fails with
+ * -FI_EAGAIN if its creator has not sized it yet.
+ */
+#define OFI_SHM_CREATE		(1 << 0)
+#define OFI_SHM_EXCL		(1 << 1)
+#define OFI_SHM_RDONLY		(1 << 2)
+
+int ofi_shm_map_flags(struct util_shm *shm, const char *name, size_t size,
+		      int shm_flags, void **mapped);
 int ofi_shm_unmap(struct util_shm *shm);
 
+static inline int ofi_shm_map(struct util_shm *shm, const char *name,
+			      size_t size, int readonly, void **mapped)
+{
+	return ofi_shm_map_flags(shm, name, size,
+				 readonly ? 0 : OFI_SHM_CREATE, mapped);
+}
+
 /*
  * Name Server TODO: add support for Windows OS
  * (osd/windows/pthread.h should be extended)
@@ -238,6 +238,9 @@ enum fi_cq_wait_cond {
 	FI_CQ_COND_THRESHOLD	/* size_t threshold */
 };
 
+/* fi_cq_attr flags */
+#define FI_CQ_SPSC		(1ULL << 22)
+
 struct fi_cq_attr {
 	size_t			size;
 	uint64_t		flags;
@@ -32,6 +32,7 @@
 
 #include "ofi_perf.h"
 #include "ofi_prov.h"
+#include "ofi_iov.h"
 #include "hook_prov.h"
 
 
@@ -271,7 +272,7 @@ perf_msg_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
 
 	ofi_perfset_start(perf_set(myep), perf_recv);
 	ret = fi_recv(myep->hep, buf, len, desc, src_addr, context);
-	ofi_perfset_end(perf_set(myep), perf_recv);
+	ofi_perfset_end_size(perf_set(myep), perf_recv, len);
 	return ret;
 }
 
@@ -284,7 +285,8 @@ perf_msg_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
 
 	ofi_perfset_start(perf_set(myep), perf_recvv);
 	ret = fi_recvv(myep->hep, iov, desc, count, src_addr, context);
-	ofi_perfset_end(perf_set(myep), perf_recvv);
+	ofi_perfset_end_size(perf_set(myep), perf_recvv,
+			     ofi_total_iov_len(iov, count));
 	return ret;
 }
 
@@ -296,7 +298,8 @@ perf_msg_recvmsg(struct fid_ep *ep, const struct fi_msg *msg, uint64_t flags)
 
 	ofi_perfset_start(perf_set(myep), perf_recvmsg);
 	ret = fi_recvmsg(myep->hep, msg, flags);
-	ofi_perfset_end(perf_set(myep), perf_recvmsg);
+	ofi_perfset_end_size(perf_set(myep), perf_recvmsg,
+			     ofi_total_iov_len(msg->msg_iov, msg->iov_count));
 	return ret;
 }
 
@@ -309,7 +312,7 @@ perf_msg_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
 
 	ofi_perfset_start(perf_set(myep), perf_send);
 	ret = fi_send(myep->hep, buf, len, desc, dest_addr, context);
-	ofi_perfset_end(perf_set(myep), perf_send);
+	ofi_perfset_end_size(perf_set(myep), perf_send, len);
 	return ret;
 }
 
@@ -322,7 +325,8 @@ perf_msg_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
 
 	ofi_perfset_start(perf_set(myep), perf_sendv);
 	ret = fi_sendv(myep->hep, iov, desc, count, dest_addr, context);
-	ofi_perfset_end(perf_set(myep), perf_sendv);
+	ofi_perfset_end_size(perf_set(myep), perf_sendv,
+			     ofi_total_iov_len(iov, count));
 	return ret;
 }
 
@@ -335,7 +339,8 @@ perf_msg_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
 
 	ofi_perfset_start(perf_set(myep), perf_sendmsg);
 	ret = fi_sendmsg(myep->hep, msg, flags);
-	ofi_perfset_end(perf_set(myep), perf_sendmsg);
+	ofi_perfset_end_size(perf_set(myep), perf_sendmsg,
+			     ofi_total_iov_len(msg->msg_iov, msg->iov_count));
 	return ret;
 }
 
@@ -348,7 +353,7 @@ perf_msg_inject(struct fid_ep *ep, const void *buf, size_t len,
 
 	ofi_perfset_start(perf_set(myep), perf_inject);
 	ret = fi_inject(myep->hep, buf, len, dest_addr);
-	ofi_perfset_end(perf_set(myep), perf_inject);
+	ofi_perfset_end_size(perf_set(myep), perf_inject, len);
 	return ret;
 }
 
@@ -361,7 +366,7 @@ perf_msg_senddata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
 
 	ofi_perfset_start(perf_set(myep), perf_senddata);
 	ret = fi_senddata(myep->hep, buf, len, desc, data, dest_addr, context);
-	ofi_perfset_end(perf_set(myep), perf_senddata);
+	ofi_perfset_end_size(perf_set(myep), perf_senddata, len);
 	return ret;
 }
 
@@ -374,7 +379,7 @@ perf_msg_injectdata(struct fid_ep *ep, const void *buf, size_t len,
 
 	ofi_perfset_start(perf_set(myep), perf_injectdata);
 	ret = fi_injectdata(myep->hep, buf, len, data, dest_addr);
-	ofi_perfset_end(perf_set(myep), perf_injectdata);
+	ofi_perfset_end_size(perf_set(myep), perf_injectdata, len);
 	return ret;
 }
 
@@ -401,7 +406,7 @@ perf_rma_read(struct fid_ep *ep, void *buf, size_t len, void *desc,
 
 	ofi_perfset_start(perf_set(myep), perf_read);
 	ret = fi_read(myep->hep, buf, len, desc, src_addr, addr, key, context);
-	ofi_perfset_end(perf_set(myep), perf_read);
+	ofi_perfset_end_size(perf_set(myep), perf_read, len);
 	return ret;
 }
 
@@ -416,7 +421,8 @@ perf_rma_readv(struct fid_ep *ep, const struct iovec *iov, void **desc,
 	ofi_perfset_start(perf_set(myep), perf_readv);
 	ret = fi_readv(myep->hep, iov, desc, count, src_addr,
 		       addr, key, context);
-	ofi_perfset_end(perf_set(myep), perf_readv);
+	ofi_perfset_end_size(perf_set(myep), perf_readv,
+			     ofi_total_iov_len(iov, count));
 	return ret;
 }
 
@@ -429,7 +435,8 @@ perf_rma_readmsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
 
 	ofi_perfset_start(perf_set(myep), perf_readmsg);
 	ret = fi_readmsg(myep->hep, msg, flags);
-	ofi_perfset_end(perf_set(myep), perf_readmsg);
+	ofi_perfset_end_size(perf_set(myep), perf_readmsg,
+			     ofi_total_iov_len(msg->msg_iov, msg->iov_count));
 	return ret;
 }
 
@@ -443,7 +450,7 @@ perf_rma_write(struct fid_ep *ep, const void *buf, size_t len, void *desc,
 	ofi_perfset_start(perf_set(myep), perf_write);
 	ret = fi_write(myep->hep, buf, len, desc, dest_addr,
 		       addr, key, context);
-	ofi_perfset_end(perf_set(myep), perf_write);
+	ofi_perfset_end_size(perf_set(myep), perf_write, len);
 	return ret;
 }
 
@@ -458,7 +465,8 @@ perf_rma_writev(struct fid_ep *ep, const struct iovec *iov, void **desc,
 	ofi_perfset_start(perf_set(myep), perf_writev);
 	ret = fi_writev(myep->hep, iov, desc, count, dest_addr,
 			addr, key, context);
-	ofi_perfset_end(perf_set(myep), perf_writev);
+	ofi_perfset_end_size(perf_set(myep), perf_writev,
+			     ofi_total_iov_len(iov, count));
 	return ret;
 }
 
@@ -471,7 +479,8 @@ perf_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg,
 
 	ofi_perfset_start(perf_set(myep), perf_writemsg);
 	ret = fi_writemsg(myep->hep, msg, flags);
-	ofi_perfset_end(perf_set(myep), perf_writemsg);
+	ofi_perfset_end_size(perf_set(myep), perf_writemsg,
+			     ofi_total_iov_len(msg->msg_iov, msg->iov_count));
 	return ret;
 }
 
@@ -484,7 +493,7 @@ perf_rma_inject(struct fid_ep *ep, const void *buf, size_t len,
 
 	ofi_perfset_start(perf_set(myep), perf_inject_write);
 	ret = fi_inject_write(myep->hep, buf, len, dest_addr, addr, key);
-	ofi_perfset_end(perf_set(myep), perf_inject_write);
+	ofi_perfset_end_size(perf_set(myep), perf_inject_write, len);
 	return ret;
 }
 
@@ -499,7 +508,7 @@ perf_rma_writedata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
 	ofi_perfset_start(perf_set(myep), perf_writedata);
 	ret = fi_writedata(myep->hep, buf, len, desc, data,
 			   dest_addr, addr, key, context);
-	ofi_perfset_end(perf_set(myep), perf_writedata);
+	ofi_perfset_end_size(perf_set(myep), perf_writedata, len);
 	return ret;
 }
 
@@ -514,7 +523,7 @@ perf_rma_injectdata(struct fid_ep *ep, const void *buf, size_t len,
 	ofi_perfset_start(perf_set(myep), perf_inject_writedata);
 	ret = fi_inject_writedata(myep->hep, buf, len, data, dest_addr,
 				  addr, key);
-	ofi_perfset_end(perf_set(myep), perf_inject_writedata);
+	ofi_perfset_end_size(perf_set(myep), perf_inject_writedata, len);
 	return ret;
 }
 
@@ -543,7 +552,7 @@ perf_tagged_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
 	ofi_perfset_start(perf_set(myep), perf_trecv);
 	ret = fi_trecv(myep->hep, buf, len, desc, src_addr,
 		       tag, ignore, context);
-	ofi_perfset_end(perf_set(myep), perf_trecv);
+	ofi_perfset_end_size(perf_set(myep), perf_trecv, len);
 	return ret;
 }
 
@@ -558,7 +567,8 @@ perf_tagged_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
 	ofi_perfset_start(perf_set(myep), perf_trecvv);
 	ret = fi_trecvv(myep->hep, iov, desc, count, src_addr,
 			tag, ignore, context);
-	ofi_perfset_end(perf_set(myep), perf_trecvv);
+	ofi_perfset_end_size(perf_set(myep), perf_trecvv,
+			     ofi_total_iov_len(iov, count));
 	return ret;
 }
 
@@ -571,7 +581,8 @@ perf_tagged_recvmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
 
 	ofi_perfset_start(perf_set(myep), perf_trecvmsg);
 	ret = fi_trecvmsg(myep->hep, msg, flags);
-	ofi_perfset_end(perf_set(myep), perf_trecvmsg);
+	ofi_perfset_end_size(perf_set(myep), perf_trecvmsg,
+			     ofi_total_iov_len(msg->msg_iov, msg->iov_count));
 	return ret;
 }
 
@@ -584,7 +595,7 @@ perf_tagged_send(struct fid_ep *ep, const void *buf, size_t len, void *desc,
 
 	ofi_perfset_start(perf_set(myep), perf_tsend);
 	ret = fi_tsend(myep->hep, buf, len, desc, dest_addr, tag, context);
-	ofi_perfset_end(perf_set(myep), perf_tsend);
+	ofi_perfset_end_size(perf_set(myep), perf_tsend, len);
 	return ret;
 }
 
@@ -598,7 +609,8 @@ perf_tagged_sendv(struct fid_ep *ep, const struct iovec *iov, void **desc,
 
 	ofi_perfset_start(perf_set(myep), perf_tsendv);
 	ret = fi_tsendv(myep->hep, iov, desc, count, dest_addr, tag, context);
-	ofi_perfset_end(perf_set(myep), perf_tsendv);
+	ofi_perfset_end_size(perf_set(myep), perf_tsendv,
+			     ofi_total_iov_len(iov, count));
 	return ret;
 }
 
@@ -611,7 +623,8 @@ perf_tagged_sendmsg(struct fid_ep *ep, const struct fi_msg_tagged *msg,
 
 	ofi_perfset_start(perf_set(myep), perf_tsendmsg);
 	ret = fi_tsendmsg(myep->hep, msg, flags);
-	ofi_perfset_end(perf_set(myep), perf_tsendmsg);
+	ofi_perfset_end_size(perf_set(myep), perf_tsendmsg,
+			     ofi_total_iov_len(msg->msg_iov, msg->iov_count));
 	return ret;
 }
 
@@ -624,7 +637,7 @@ perf_tagged_inject(struct fid_ep *ep, const void *buf, size_t len,
 
 	ofi_perfset_start(perf_set(myep), perf_tinject);
 	ret = fi_tinject(myep->hep, buf, len, dest_addr, tag);
-	ofi_perfset_end(perf_set(myep), perf_tinject);
+	ofi_perfset_end_size(perf_set(myep), perf_tinject, len);
 	return ret;
 }
 
@@ -639,7 +652,7 @@ perf_tagged_senddata(struct fid_ep *ep, const void *buf, size_t len, void *desc,
 	ofi_perfset_start(perf_set(myep), perf_tsenddata);
 	ret = fi_tsenddata(myep->hep, buf, len, desc, data,
 			   dest_addr, tag, context);
-	ofi_perfset_end(perf_set(myep), perf_tsenddata);
+	ofi_perfset_end_size(perf_set(myep), perf_tsenddata, len);
 	return ret;
 }
 
@@ -652,7 +665,7 @@ perf_tagged_injectdata(struct fid_ep *ep, const void *buf, size_t len,
 
 	ofi_perfset_start(perf_set(myep), perf_tinjectdata);
 	ret = fi_tinjectdata(myep->hep, buf, len, data, dest_addr, tag);
-	ofi_perfset_end(perf_set(myep), perf_tinjectdata);
+	ofi_perfset_end_size(perf_set(myep), perf_tinjectdata, len);
 	return ret;
 }
 
@@ -678,6 +691,7 @@ static ssize_t perf_cq_read_op(struct fid_cq *cq, void *buf, size_t count)
 	ofi_perfset_start(perf_set_cq(mycq), perf_cq_read);
 	ret = fi_cq_read(mycq->hcq, buf, count);
 	ofi_perfset_end(perf_set_cq(mycq), perf_cq_read);
+	ofi_perfset_poll(perf_set_cq(mycq));
 	return ret;
 }
 
@@ -690,6 +704,7 @@ perf_cq_readerr_op(struct fid_cq *cq, struct fi_cq_err_entry *buf, uint64_t flag
 	ofi_perfset_start(perf_set_cq(mycq), perf_cq_readerr);
 	ret = fi_cq_readerr(mycq->hcq, buf, flags);
 	ofi_perfset_end(perf_set_cq(mycq), perf_cq_readerr);
+	ofi_perfset_poll(perf_set_cq(mycq));
 	return ret;
 }
 
@@ -702,6 +717,7 @@ perf_cq_readfrom_op(struct fid_cq *cq, void *buf, size_t count, fi_addr_t *src_a
 	ofi_perfset_start(perf_set_cq(mycq), perf_cq_readfrom);
 	ret = fi_cq_readfrom(mycq->hcq, buf, count, src_addr);
 	ofi_perfset_end(perf_set_cq(mycq), perf_cq_readfrom);
+	ofi_perfset_poll(perf_set_cq(mycq));
 	return ret;
 }
 
@@ -715,6 +731,7 @@ perf_cq_sread_op(struct fid_cq *cq, void *buf, size_t count,
 	ofi_perfset_start(perf_set_cq(mycq), perf_cq_sread);
 	ret = fi_cq_sread(mycq->hcq, buf, count, cond, timeout);
 	ofi_perfset_end(perf_set_cq(mycq), perf_cq_sread);
+	ofi_perfset_poll(perf_set_cq(mycq));
 	return ret;
 }
 
@@ -728,6 +745,7 @@ perf_cq_sreadfrom_op(struct fid_cq *cq, void *buf, size_t count,
 	ofi_perfset_start(perf_set_cq(mycq), perf_cq_sreadfrom);
 	ret = fi_cq_sreadfrom(mycq->hcq, buf, count, src_addr, cond, timeout);
 	ofi_perfset_end(perf_set_cq(mycq), perf_cq_sreadfrom);
+	ofi_perfset_poll(perf_set_cq(mycq));
 	return ret;
 }
 
@@ -739,6 +757,7 @@ static int perf_cq_signal_op(struct fid_cq *cq)
 	ofi_perfset_start(perf_set_cq(mycq), perf_cq_signal);
 	ret = fi_cq_signal(mycq->hcq);
 	ofi_perfset_end(perf_set_cq(mycq), perf_cq_signal);
+	ofi_perfset_poll(perf_set_cq(mycq));
 	return ret;
 }
 
@@ -762,6 +781,7 @@ static uint64_t perf_cntr_read_op(struct fid_cntr *cntr)
 	ofi_perfset_start(perf_set_cntr(mycntr), perf_cntr_read);
 	ret = fi_cntr_read(mycntr->hcntr);
 	ofi_perfset_end(perf_set_cntr(mycntr), perf_cntr_read);
+	ofi_perfset_poll(perf_set_cntr(mycntr));
 	return ret;
 }
 
@@ -773,6 +793,7 @@ static uint64_t perf_cntr_readerr_op(struct fid_cntr *cntr)
 	ofi_perfset_start(perf_set_cntr(mycntr), perf_cntr_readerr);
 	ret = fi_cntr_readerr(mycntr->hcntr);
 	ofi_perfset_end(perf_set_cntr(mycntr), perf_cntr_readerr);
+	ofi_perfset_poll(perf_set_cntr(mycntr));
 	return ret;
 }
 
@@ -806,6 +827,7 @@ static int perf_cntr_wait_op(struct fid_cntr *cntr, uint64_t threshold, int time
 	ofi_perfset_start(perf_set_cntr(mycntr), perf_cntr_wait);
 	ret = fi_cntr_wait(mycntr->hcntr, threshold, timeout);
 	ofi_perfset_end(perf_set_cntr(mycntr), perf_cntr_wait);
+	ofi_perfset_poll(perf_set_cntr(mycntr));
 	return ret;
 }
 
@@ -883,6 +905,7 @@ static int hook_perf_fabric(struct fi_fabric_attr *attr,
 		free(fab);
 		return ret;
 	}
+	ofi_perfset_names(&fab->perf_set, perf_counters_str);
 
 	/*
 	 * TODO
@@ -82,10 +82,13 @@ extern size_t mrail_num_info;
 enum {
 	MRAIL_POLICY_FIXED,
 	MRAIL_POLICY_ROUND_ROBIN,
-	MRAIL_POLICY_STRIPING
+	MRAIL_POLICY_STRIPING,
+	MRAIL_POLICY_ADAPTIVE
 };
 
 #define MRAIL_MAX_CONFIG		8
+#define MRAIL_RATE_INTERVAL_US		200
+#define MRAIL_RATE_IDLE_US		(16 * MRAIL_RATE_INTERVAL_US)
 
 struct mrail_config {
 	size_t		max_size;
@@ -95,6 +98,7 @@ struct mrail_config {
 extern struct mrail_config mrail_config[MRAIL_MAX_CONFIG];
 extern int mrail_num_config;
 extern int mrail_local_rank;
+extern size_t mrail_reorder_win;
 
 extern struct fi_ops_rma mrail_ops_rma;
 
@@ -181,6 +185,10 @@ struct mrail_tx_buf {
 	struct mrail_rndv_hdr	rndv_hdr;
 	struct mrail_rndv_req	*rndv_req;
 	fid_t			rndv_mr_fid;
+	/* rail feedback, see mrail_rail_completed() */
+	uint32_t		rail;
+	size_t			post_len;
+	uint64_t		post_time;
 };
 
 struct mrail_pkt {
@@ -245,11 +253,17 @@ struct mrail_av {
 	size_t num_avs;
 };
 
+struct mrail_ooo_recv;
+
 struct mrail_peer_info {
+	/* Early arrivals beyond the reorder window, sorted by seq_no */
 	struct slist	ooo_recv_queue;
 	fi_addr_t	addr;
 	uint32_t	seq_no;
 	uint32_t	expected_seq_no;
+	/* Early arrivals within mrail_reorder_win of expected_seq_no,
+	 * indexed by seq_no */
+	struct mrail_ooo_recv *ooo_win[];
 };
 
 struct mrail_ooo_recv {
@@ -273,6 +287,14 @@ struct mrail_ep {
 	struct {
 		struct fid_ep 		*ep;
 		struct fi_info		*info;
+		/* bytes posted to the rail that have not completed yet */
+		ofi_atomic64_t		outstanding;
+		/* smoothed rail throughput in bytes/ms, 0 until sampled */
+		uint64_t		rate;
+		uint64_t		sample_start;
+		size_t			sample_bytes;
+		/* earliest time the rate of an idle rail may be raised */
+		uint64_t		boost_time;
 	}			*rails;
 	size_t			num_eps;
 	ofi_atomic32_t		tx_rail;
@@ -287,6 +309,11 @@ struct mrail_ep {
 	struct ofi_bufpool 	*ooo_recv_pool;
 	struct ofi_bufpool 	*tx_buf_pool;
 	struct slist		deferred_reqs;
+
+	/* reorder statistics, reported when the EP is closed */
+	uint64_t		ooo_count;
+	uint64_t		ooo_overflow;
+	uint32_t		max_ooo_depth;
 };
 
 struct mrail_addr_key {
@@ -380,14 +407,36 @@ static inline int mrail_get_policy(size_t size)
 	return mrail_config[i].policy;
 }
 
-static inline size_t mrail_get_tx_rail(struct mrail_ep *mrail_ep, int policy)
+size_t mrail_get_tx_rail_adaptive(struct mrail_ep *mrail_ep, size_t len);
+
+static inline size_t mrail_get_tx_rail(struct mrail_ep *mrail_ep, int policy,
+				       size_t len)
 {
-	return policy == MRAIL_POLICY_FIXED ?
-				mrail_ep->default_tx_rail :
-				mrail_get_tx_rail_rr(mrail_ep);
+	switch (policy) {
+	case MRAIL_POLICY_FIXED:
+		return mrail_ep->default_tx_rail;
+	case MRAIL_POLICY_ADAPTIVE:
+		return mrail_get_tx_rail_adaptive(mrail_ep, len);
+	default:
+		return mrail_get_tx_rail_rr(mrail_ep);
+	}
+}
 
+/* Only transfers sent under the adaptive policy are timed */
+static inline uint64_t mrail_post_time(int policy)
+{
+	return policy == MRAIL_POLICY_ADAPTIVE ? ofi_gettime_us() : 0;
 }
 
+static inline void
+mrail_rail_posted(struct mrail_ep *mrail_ep, uint32_t rail, size_t len)
+{
+	ofi_atomic_add64(&mrail_ep->rails[rail].outstanding, len);
+}
+
+void mrail_rail_completed(struct mrail_ep *mrail_ep, uint32_t rail,
+			  size_t len, uint64_t post_time);
+
 struct mrail_subreq {
 	struct fi_context context;
 	struct mrail_req *parent;
@@ -396,6 +445,9 @@ struct mrail_subreq {
 	struct fi_rma_iov rma_iov[MRAIL_IOV_LIMIT];
 	size_t iov_count;
 	size_t rma_iov_count;
+	uint32_t rail;
+	size_t len;
+	uint64_t post_time;
 };
 
 struct mrail_req {
@@ -407,6 +459,7 @@ struct mrail_req {
 	struct fi_cq_tagged_entry comp;
 	ofi_atomic32_t expected_subcomps;
 	int op_type;
+	int policy;
 	int pending_subreq;
 	struct mrail_subreq subreqs[];
 };
@@ -192,7 +192,8 @@ int mrail_av_open(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 
 	mrail_av->num_avs = mrail_domain->num_domains;
 
-	util_attr.addrlen = sizeof(struct mrail_peer_info);
+	util_attr.addrlen = sizeof(struct mrail_peer_info) +
+			    mrail_reorder_win * sizeof(struct mrail_ooo_recv *);
 	/* We just need a table to store the mapping */
 	util_attr.flags = 0;
 
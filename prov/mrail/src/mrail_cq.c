@@ -318,8 +318,19 @@ static
 struct mrail_ooo_recv *mrail_get_next_recv(struct mrail_peer_info *peer_info)
 {
 	struct slist *queue = &peer_info->ooo_recv_queue;
+	struct mrail_ooo_recv **slot;
 	struct mrail_ooo_recv *ooo_recv;
 
+	slot = &peer_info->ooo_win[peer_info->expected_seq_no &
+				   (mrail_reorder_win - 1)];
+	if (*slot) {
+		ooo_recv = *slot;
+		assert(ooo_recv->seq_no == peer_info->expected_seq_no);
+		*slot = NULL;
+		peer_info->expected_seq_no++;
+		return ooo_recv;
+	}
+
 	if (!slist_empty(queue)) {
 		ooo_recv = container_of(queue->head, struct mrail_ooo_recv,
 				entry);
@@ -382,6 +393,7 @@ static void mrail_save_ooo_recv(struct mrail_ep *mrail_ep,
 {
 	struct slist *queue = &peer_info->ooo_recv_queue;
 	struct mrail_ooo_recv *ooo_recv;
+	uint32_t depth = seq_no - peer_info->expected_seq_no;
 
 	ooo_recv = ofi_buf_alloc(mrail_ep->ooo_recv_pool);
 	if (!ooo_recv) {
@@ -392,8 +404,18 @@ static void mrail_save_ooo_recv(struct mrail_ep *mrail_ep,
 	ooo_recv->seq_no = seq_no;
 	memcpy(&ooo_recv->comp, comp, sizeof(*comp));
 
-	slist_insert_before_first_match(queue, mrail_ooo_recv_before,
-					&ooo_recv->entry);
+	mrail_ep->ooo_count++;
+	if (depth > mrail_ep->max_ooo_depth)
+		mrail_ep->max_ooo_depth = depth;
+
+	if (depth < mrail_reorder_win) {
+		assert(!peer_info->ooo_win[seq_no & (mrail_reorder_win - 1)]);
+		peer_info->ooo_win[seq_no & (mrail_reorder_win - 1)] = ooo_recv;
+	} else {
+		mrail_ep->ooo_overflow++;
+		slist_insert_before_first_match(queue, mrail_ooo_recv_before,
+						&ooo_recv->entry);
+	}
 
 	FI_DBG(&mrail_prov, FI_LOG_CQ, "saved ooo_recv seq=%d\n", seq_no);
 }
@@ -517,6 +539,9 @@ static void mrail_handle_rma_completion(struct util_cq *cq,
 	subreq = comp->op_context;
 	req = subreq->parent;
 
+	mrail_rail_completed(req->mrail_ep, subreq->rail, subreq->len,
+			     subreq->post_time);
+
 	if (ofi_atomic_dec32(&req->expected_subcomps) == 0) {
 		if (req->comp.flags & MRAIL_RNDV_FLAG) {
 			mrail_finish_rndv_recv(cq, req, comp);
@@ -577,6 +602,9 @@ void mrail_poll_cq(struct util_cq *cq)
 			mrail_handle_rma_completion(cq, &comp);
 		} else if (comp.flags & FI_SEND) {
 			tx_buf = comp.op_context;
+			mrail_rail_completed(tx_buf->ep, tx_buf->rail,
+					     tx_buf->post_len,
+					     tx_buf->post_time);
 			if (tx_buf->hdr.protocol == MRAIL_PROTO_RNDV) {
 				if (tx_buf->hdr.protocol_cmd == MRAIL_RNDV_REQ) {
 					/* buf will be freed when ACK comes */
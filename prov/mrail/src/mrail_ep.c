@@ -338,6 +338,101 @@ static struct mrail_tx_buf *mrail_get_tx_buf(struct mrail_ep *mrail_ep,
 	return tx_buf;
 }
 
+/*
+ * Rail completions are usually reaped in batches, so throughput is sampled
+ * over at least MRAIL_RATE_INTERVAL_US rather than per completion. A sample
+ * window opens with the first completion after the last sample, and starts
+ * when that transfer was posted if the rail sat idle since, so idle time
+ * before it is not counted against the rail. All bytes completed in the
+ * window are divided by its whole length.
+ *
+ * The estimate is shared with the senders picking a rail, and is updated
+ * under the endpoint lock.
+ */
+void mrail_rail_completed(struct mrail_ep *mrail_ep, uint32_t rail,
+			  size_t len, uint64_t post_time)
+{
+	uint64_t now, sample;
+
+	ofi_atomic_sub64(&mrail_ep->rails[rail].outstanding, len);
+	if (!post_time)
+		return;
+
+	now = ofi_gettime_us();
+	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	if (!mrail_ep->rails[rail].sample_bytes)
+		mrail_ep->rails[rail].sample_start =
+			MAX(post_time, mrail_ep->rails[rail].sample_start);
+	mrail_ep->rails[rail].sample_bytes += len;
+
+	if (now - mrail_ep->rails[rail].sample_start < MRAIL_RATE_INTERVAL_US)
+		goto out;
+
+	sample = (uint64_t) mrail_ep->rails[rail].sample_bytes * 1000 /
+		 (now - mrail_ep->rails[rail].sample_start);
+	mrail_ep->rails[rail].sample_start = now;
+	mrail_ep->rails[rail].sample_bytes = 0;
+	mrail_ep->rails[rail].boost_time = now + MRAIL_RATE_IDLE_US;
+
+	/* EWMA with a weight of 1/8 for the new sample */
+	if (mrail_ep->rails[rail].rate)
+		mrail_ep->rails[rail].rate += (sample >> 3) -
+					      (mrail_ep->rails[rail].rate >> 3);
+	else
+		mrail_ep->rails[rail].rate = sample;
+out:
+	ofi_ep_lock_release(&mrail_ep->util_ep);
+}
+
+/*
+ * Pick the rail expected to finish sending len bytes first, given the bytes
+ * already queued on it and its measured throughput. Rails that have not
+ * completed anything yet are probed first.
+ *
+ * A rail that loses after sitting idle for MRAIL_RATE_IDLE_US since its
+ * last sample gets its rate estimate raised a little, at most once per
+ * MRAIL_RATE_INTERVAL_US. This way a rail left with a bad sample (e.g. one
+ * that included connection setup) is eventually retried and measured again,
+ * while a rail that is merely slow is retried only at that pace.
+ *
+ * Called with the endpoint lock held.
+ */
+size_t mrail_get_tx_rail_adaptive(struct mrail_ep *mrail_ep, size_t len)
+{
+	uint64_t cost, min_cost = UINT64_MAX, now = 0;
+	size_t i, rail, best;
+
+	/* Start from the round-robin rail to spread ties across rails */
+	rail = best = mrail_get_tx_rail_rr(mrail_ep);
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		if (!mrail_ep->rails[rail].rate)
+			return rail;
+
+		cost = (ofi_atomic_get64(&mrail_ep->rails[rail].outstanding) +
+			len) * 1000 / mrail_ep->rails[rail].rate;
+		if (cost < min_cost) {
+			min_cost = cost;
+			best = rail;
+		}
+		rail = (rail + 1) % mrail_ep->num_eps;
+	}
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		if (i == best || mrail_ep->rails[i].rate >= UINT32_MAX ||
+		    ofi_atomic_get64(&mrail_ep->rails[i].outstanding))
+			continue;
+
+		if (!now)
+			now = ofi_gettime_us();
+		if (now < mrail_ep->rails[i].boost_time)
+			continue;
+
+		mrail_ep->rails[i].rate += (mrail_ep->rails[i].rate >> 4) + 1;
+		mrail_ep->rails[i].boost_time = now + MRAIL_RATE_INTERVAL_US;
+	}
+	return best;
+}
+
 /*
  * This is an internal send that doesn't use seq_no and doesn't update
  * the counters. The call doesn't return -FI_EAGAIN.
@@ -350,12 +445,13 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	struct mrail_tx_buf *tx_buf;
 	size_t rndv_pkt_size = sizeof(tx_buf->hdr) + sizeof(tx_buf->rndv_hdr);
 	int policy = mrail_get_policy(rndv_pkt_size);
-	uint32_t i = mrail_get_tx_rail(mrail_ep, policy);
+	uint32_t i;
 	struct fi_msg msg;
 	ssize_t ret;
 	uint64_t flags = FI_COMPLETION;
 
 	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	i = mrail_get_tx_rail(mrail_ep, policy, rndv_pkt_size);
 
 	tx_buf = mrail_get_tx_buf(mrail_ep, context, 0, ofi_op_tagged, 0);
 	if (OFI_UNLIKELY(!tx_buf))
@@ -380,6 +476,9 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 	FI_DBG(&mrail_prov, FI_LOG_EP_DATA, "Posting rdnv ack "
 	       " dest_addr: 0x%" PRIx64 " on rail: %d\n", dest_addr, i);
 
+	tx_buf->rail = i;
+	tx_buf->post_len = rndv_pkt_size;
+	tx_buf->post_time = mrail_post_time(policy);
 	do {
 		ret = fi_sendmsg(mrail_ep->rails[i].ep, &msg, flags);
 		if (ret == -FI_EAGAIN) {
@@ -394,6 +493,8 @@ int mrail_send_rndv_ack_blocking(struct mrail_ep *mrail_ep,
 		FI_WARN(&mrail_prov, FI_LOG_EP_DATA,
 			"Unable to fi_sendmsg on rail: %" PRIu32 "\n", i);
 		ofi_buf_free(tx_buf);
+	} else {
+		mrail_rail_posted(mrail_ep, i, rndv_pkt_size);
 	}
 
 	ofi_ep_lock_release(&mrail_ep->util_ep);
@@ -488,7 +589,7 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	struct iovec *iov_dest = alloca(sizeof(*iov_dest) * (count + 1));
 	struct mrail_tx_buf *tx_buf;
 	int policy = mrail_get_policy(len);
-	uint32_t rail = mrail_get_tx_rail(mrail_ep, policy);
+	uint32_t rail;
 	struct fi_msg msg;
 	ssize_t ret;
 	size_t total_len;
@@ -496,6 +597,7 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	peer_info = ofi_av_get_addr(mrail_ep->util_ep.av, (int) dest_addr);
 
 	ofi_ep_lock_acquire(&mrail_ep->util_ep);
+	rail = mrail_get_tx_rail(mrail_ep, policy, len);
 
 	tx_buf = mrail_get_tx_buf(mrail_ep, context, peer_info->seq_no++,
 				  ofi_op_tagged, flags | op);
@@ -538,6 +640,10 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	       " dest_addr: 0x%" PRIx64 " tag: 0x%" PRIx64 " seq: %d"
 	       " on rail: %d\n", len, dest_addr, tag, peer_info->seq_no - 1, rail);
 
+	tx_buf->rail = rail;
+	tx_buf->post_len = total_len;
+	tx_buf->post_time = mrail_post_time(policy);
+
 	ret = fi_sendmsg(mrail_ep->rails[rail].ep, &msg, flags | FI_COMPLETION);
 	if (ret) {
 		FI_WARN(&mrail_prov, FI_LOG_EP_DATA,
@@ -546,6 +652,7 @@ mrail_send_common(struct fid_ep *ep_fid, const struct iovec *iov, void **desc,
 	} else if (!(flags & FI_COMPLETION)) {
 		ofi_ep_tx_cntr_inc(&mrail_ep->util_ep);
 	}
+	mrail_rail_posted(mrail_ep, rail, total_len);
 	ofi_ep_lock_release(&mrail_ep->util_ep);
 	return ret;
 err2:
@@ -779,6 +886,14 @@ static int mrail_ep_close(fid_t fid)
 	int ret, retv = 0;
 	size_t i;
 
+	if (mrail_ep->ooo_count) {
+		FI_INFO(&mrail_prov, FI_LOG_EP_CTRL, "%" PRIu64 " messages "
+			"received out of order, max reorder depth %" PRIu32
+			", %" PRIu64 " beyond the reorder window of %zu\n",
+			mrail_ep->ooo_count, mrail_ep->max_ooo_depth,
+			mrail_ep->ooo_overflow, mrail_reorder_win);
+	}
+
 	mrail_ep_free_bufs(mrail_ep);
 
 	for (i = 0; i < mrail_ep->num_eps; i++) {
@@ -1049,6 +1164,8 @@ int mrail_ep_open(struct fid_domain *domain_fid, struct fi_info *info,
 
 	ofi_atomic_initialize32(&mrail_ep->tx_rail, 0);
 	ofi_atomic_initialize32(&mrail_ep->rx_rail, 0);
+	for (i = 0; i < mrail_ep->num_eps; i++)
+		ofi_atomic_initialize64(&mrail_ep->rails[i].outstanding, 0);
 	mrail_ep->default_tx_rail = mrail_local_rank % mrail_ep->num_eps;
 
 	*ep_fid = &mrail_ep->util_ep.ep_fid;
@@ -45,6 +45,7 @@ struct mrail_config mrail_config[MRAIL_MAX_CONFIG] = {
 };
 int mrail_num_config = 2;
 int mrail_local_rank = 0;
+size_t mrail_reorder_win = 64;
 
 static inline char **mrail_split_addr_strc(const char *addr_strc)
 {
@@ -68,7 +69,7 @@ static int mrail_parse_env_vars(void)
 	fi_param_define(&mrail_prov, "config", FI_PARAM_STRING,
 			"Comma separated list of '<max_size>:<policy>' pairs, "
 			"with <max_size> in ascending order and <policy> being "
-			"fixed, round-robin, or striping");
+			"fixed, round-robin, striping, or adaptive");
 	ret = fi_param_get_str(&mrail_prov, "config", &str);
 	if (!ret) {
 		for (i = 0; i < MRAIL_MAX_CONFIG; i++) {
@@ -92,6 +93,8 @@ static int mrail_parse_env_vars(void)
 				mrail_config[i].policy = MRAIL_POLICY_ROUND_ROBIN;
 			} else if (!strcasecmp(alg, "striping")) {
 				mrail_config[i].policy = MRAIL_POLICY_STRIPING;
+			} else if (!strcasecmp(alg, "adaptive")) {
+				mrail_config[i].policy = MRAIL_POLICY_ADAPTIVE;
 			} else {
 				FI_WARN(&mrail_prov, FI_LOG_CORE, "Invalid policy "
 					"specification %s\n", alg);
@@ -101,6 +104,16 @@ static int mrail_parse_env_vars(void)
 		mrail_num_config = i;
 	}
 
+	fi_param_define(&mrail_prov, "reorder_window", FI_PARAM_SIZE_T,
+			"Number of messages per peer that can arrive ahead of "
+			"sequence and still be reordered in constant time "
+			"(default: %zu). Rounded up to a power of two.",
+			mrail_reorder_win);
+	fi_param_get_size_t(&mrail_prov, "reorder_window", &mrail_reorder_win);
+	if (!mrail_reorder_win)
+		mrail_reorder_win = 1;
+	mrail_reorder_win = roundup_power_of_two(mrail_reorder_win);
+
 	fi_param_define(&mrail_prov, "addr_strc", FI_PARAM_STRING, "Deprecated. "
 			"Replaced by FI_OFI_MRAIL_ADDR.");
 
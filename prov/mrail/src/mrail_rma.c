@@ -103,21 +103,22 @@ static ssize_t mrail_post_subreq(uint32_t rail,
 
 static ssize_t mrail_post_req(struct mrail_req *req)
 {
+	struct mrail_subreq *subreq;
 	size_t i;
-	uint32_t rail;
 	ssize_t ret = 0;
 
 	while (req->pending_subreq >= 0) {
-		/* Try all rails before giving up */
-		for (i = 0; i < req->mrail_ep->num_eps; ++i) {
-			rail = mrail_get_tx_rail_rr(req->mrail_ep);
+		subreq = &req->subreqs[req->pending_subreq];
+		subreq->post_time = mrail_post_time(req->policy);
 
-			ret = mrail_post_subreq(rail,
-					&req->subreqs[req->pending_subreq]);
+		/* Each subreq is sized for its rail, so wait for that rail
+		 * rather than moving the subreq to another one */
+		for (i = 0; i < req->mrail_ep->num_eps; ++i) {
+			ret = mrail_post_subreq(subreq->rail, subreq);
 			if (ret != -FI_EAGAIN) {
 				break;
 			} else {
-				/* One of the rails is busy. Try progressing. */
+				/* The rail is busy. Try progressing. */
 				mrail_poll_cq(req->mrail_ep->util_ep.tx_cq);
 			}
 		}
@@ -129,6 +130,7 @@ static ssize_t mrail_post_req(struct mrail_req *req)
 			/* TODO: Handle errors besides FI_EAGAIN */
 			assert(0);
 		}
+		mrail_rail_posted(req->mrail_ep, subreq->rail, subreq->len);
 		req->pending_subreq--;
 	}
 
@@ -180,31 +182,73 @@ void mrail_progress_deferred_reqs(struct mrail_ep *mrail_ep)
 	}
 }
 
+/*
+ * Split total_len across the rails. Under the adaptive policy, each rail
+ * gets a share proportional to its measured throughput once every rail has
+ * been sampled. Otherwise, the data is striped equally and the first chunk
+ * is the longest.
+ */
+static void mrail_get_rma_shares(struct mrail_ep *mrail_ep, int policy,
+				 size_t total_len, size_t *lens)
+{
+	uint64_t total_rate = 0;
+	size_t i, fastest = 0, assigned = 0;
+
+	if (policy == MRAIL_POLICY_ADAPTIVE &&
+	    total_len >= mrail_ep->num_eps) {
+		for (i = 0; i < mrail_ep->num_eps; i++) {
+			if (!mrail_ep->rails[i].rate) {
+				total_rate = 0;
+				break;
+			}
+			total_rate += mrail_ep->rails[i].rate;
+			if (mrail_ep->rails[i].rate >
+			    mrail_ep->rails[fastest].rate)
+				fastest = i;
+		}
+	}
+
+	if (!total_rate) {
+		for (i = 0; i < mrail_ep->num_eps; i++)
+			lens[i] = total_len / mrail_ep->num_eps;
+		lens[0] += total_len % mrail_ep->num_eps;
+		return;
+	}
+
+	for (i = 0; i < mrail_ep->num_eps; i++) {
+		lens[i] = (size_t) ((double) total_len *
+				    mrail_ep->rails[i].rate / total_rate);
+		assigned += lens[i];
+	}
+	lens[fastest] += total_len - assigned;
+}
+
 static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 		const struct fi_msg_rma *msg, struct mrail_req *req)
 {
-	ssize_t ret;
+	ssize_t ret = 0;
 	struct mrail_subreq *subreq;
+	size_t *lens = alloca(sizeof(*lens) * mrail_ep->num_eps);
 	size_t subreq_count;
 	size_t total_len;
-	size_t chunk_len;
-	size_t subreq_len;
 	size_t iov_index;
 	size_t iov_offset;
 	size_t rma_iov_index;
 	size_t rma_iov_offset;
+	size_t rail;
 	int i;
 
-	/* For now, stripe across all rails.
-	 * This could be determined by a dynamic scheduler instead.
-	 */
-	subreq_count = mrail_ep->num_eps;
+	total_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
+	req->policy = mrail_get_policy(total_len);
+	mrail_get_rma_shares(mrail_ep, req->policy, total_len, lens);
 
-	total_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count); 
-	chunk_len = total_len / subreq_count;
+	/* Rails left out of a weighted split get no subreq; an equal split
+	 * keeps one subreq per rail even if it is empty */
+	for (subreq_count = 0, rail = 0; rail < mrail_ep->num_eps; rail++) {
+		if (lens[rail] || total_len < mrail_ep->num_eps)
+			subreq_count++;
+	}
 
-	/* The first chunk is the longest */
-	subreq_len =  chunk_len + (total_len % subreq_count);
 	iov_index = 0;
 	iov_offset = 0;
 	rma_iov_index = 0;
@@ -218,16 +262,21 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 	 * track of which subreq to post next, starting at the end of the
 	 * array.
 	 */
-	for (i = (subreq_count - 1); i >= 0; --i) {
-		subreq = &req->subreqs[i];
+	for (i = (subreq_count - 1), rail = 0; i >= 0; rail++) {
+		if (!lens[rail] && total_len >= mrail_ep->num_eps)
+			continue;
+
+		subreq = &req->subreqs[i--];
 
 		subreq->parent = req;
+		subreq->rail = rail;
+		subreq->len = lens[rail];
 
 		ret = ofi_copy_iov_desc(subreq->iov, subreq->descs,
 				&subreq->iov_count,
 				(struct iovec *)msg->msg_iov, msg->desc,
 				msg->iov_count, &iov_index, &iov_offset,
-				subreq_len);
+				subreq->len);
 		if (ret) {
 			goto out;
 		}
@@ -235,13 +284,10 @@ static ssize_t mrail_prepare_rma_subreqs(struct mrail_ep *mrail_ep,
 		ret = ofi_copy_rma_iov(subreq->rma_iov, &subreq->rma_iov_count,
 				(struct fi_rma_iov *)msg->rma_iov,
 				msg->rma_iov_count, &rma_iov_index,
-				&rma_iov_offset, subreq_len);
+				&rma_iov_offset, subreq->len);
 		if (ret) {
 			goto out;
 		}
-
-		/* All the other chunks have the same length */
-		subreq_len = chunk_len;
 	}
 
 	ofi_atomic_initialize32(&req->expected_subcomps, subreq_count);
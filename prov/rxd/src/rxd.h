@@ -50,7 +50,9 @@
 #include <ofi_proto.h>
 #include <ofi_enosys.h>
 #include <ofi_rbuf.h>
+#include <ofi_recvwin.h>
 #include <ofi_list.h>
+#include <ofi_indexer.h>
 #include <ofi_util.h>
 #include <ofi_tree.h>
 #include <ofi_atomic.h>
@@ -61,7 +63,7 @@
 
 #define RXD_MAJOR_VERSION 	(1)
 #define RXD_MINOR_VERSION 	(0)
-#define RXD_PROTOCOL_VERSION 	(2)
+#define RXD_PROTOCOL_VERSION 	(3)
 
 #define RXD_MAX_MTU_SIZE	4096
 
@@ -73,9 +75,19 @@
 #define RXD_RX_POOL_CHUNK_CNT	1024
 #define RXD_MAX_PENDING		128
 #define RXD_MAX_PKT_RETRY	50
+#define RXD_DEFAULT_AV_SIZE	1024
+
+/* Retransmission timeout before an RTT has been measured, in usec */
+#define RXD_INIT_RTO		1000
+
+/* Smallest congestion window, in packets */
+#define RXD_MIN_CWND		2
 
 #define RXD_PKT_IN_USE		(1 << 0)
 #define RXD_PKT_ACKED		(1 << 1)
+#define RXD_PKT_RETRANS		(1 << 2)
+#define RXD_PKT_SACKED		(1 << 3)
+#define RXD_PKT_IOV		(1 << 4)
 
 #define RXD_REMOTE_CQ_DATA	(1 << 0)
 #define RXD_NO_TX_COMP		(1 << 1)
@@ -84,12 +96,17 @@
 #define RXD_TAG_HDR		(1 << 4)
 #define RXD_INLINE		(1 << 5)
 #define RXD_MULTI_RECV		(1 << 6)
+#define RXD_ACK_REQ		(1 << 7)
 
 struct rxd_env {
 	int spin_count;
 	int retry;
 	int max_peers;
 	int max_unacked;
+	int min_rto;
+	int max_rto;
+	int loss;
+	int cc;
 };
 
 extern struct rxd_env rxd_env;
@@ -119,8 +136,13 @@ struct rxd_domain {
 	struct ofi_mr_map mr_map;//TODO use util_domain mr_map instead
 };
 
+struct rxd_pkt_entry;
+OFI_DECL_RECVWIN_BUF(struct rxd_pkt_entry *, rxd_robuf, uint64_t);
+
 struct rxd_peer {
 	struct dlist_entry entry;
+	struct dlist_entry peer_entry;
+	fi_addr_t rxd_addr;
 	fi_addr_t peer_addr;
 	uint64_t tx_seq_no;
 	uint64_t rx_seq_no;
@@ -130,6 +152,22 @@ struct rxd_peer {
 	uint16_t tx_window;
 	int retry_cnt;
 
+	/* RTT estimate, scaled by 8 and 4 respectively, and RTO in usec */
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint64_t rto;
+
+	/* AIMD congestion window, in packets */
+	uint16_t cwnd;
+	uint16_t cwnd_cnt;
+	uint64_t recover;
+
+	/* loss recovery statistics */
+	uint64_t retrans_cnt;
+	uint64_t loss_cnt;
+	uint64_t loss_start;
+	uint64_t recovery_time;
+
 	uint16_t unacked_cnt;
 	uint8_t active;
 
@@ -141,7 +179,10 @@ struct rxd_peer {
 	struct dlist_entry rx_list;
 	struct dlist_entry rma_rx_list;
 	struct dlist_entry unacked;
-	struct dlist_entry buf_pkts;
+
+	/* out-of-order packets, allocated on first use */
+	struct rxd_robuf robuf;
+	uint16_t robuf_cnt;
 };
 
 struct rxd_addr {
@@ -160,7 +201,8 @@ struct rxd_av {
 	size_t dg_addrlen;
 
 	fi_addr_t *fi_addr_table;
-	struct rxd_addr *rxd_addr_table;
+	/* struct rxd_addr, allocated as addresses are inserted */
+	struct index_map rxd_addr_table;
 };
 
 struct rxd_cq;
@@ -193,8 +235,10 @@ struct rxd_ep {
 	size_t rx_prefix_size;
 	size_t min_multi_recv_size;
 	int do_local_mr;
-	int next_retry;
+	size_t tx_iov_limit;	/* 0 if payloads must be copied to packets */
+	int next_retry;		/* msec until the next retransmission */
 	int dg_cq_fd;
+	unsigned int loss_seed;
 	uint32_t tx_flags;
 	uint32_t rx_flags;
 
@@ -218,7 +262,9 @@ struct rxd_ep {
 	struct dlist_entry rts_sent_list;
 	struct dlist_entry ctrl_pkts;
 
-	struct rxd_peer peers[];
+	/* struct rxd_peer, allocated on first contact, by rxd address */
+	struct index_map peers;
+	struct dlist_entry peer_list;
 };
 
 static inline struct rxd_domain *rxd_ep_domain(struct rxd_ep *ep)
@@ -231,6 +277,19 @@ static inline struct rxd_av *rxd_ep_av(struct rxd_ep *ep)
 	return container_of(ep->util_ep.av, struct rxd_av, util_av);
 }
 
+static inline struct rxd_addr *rxd_av_addr(struct rxd_av *av,
+					   fi_addr_t rxd_addr)
+{
+	return rxd_addr <= OFI_IDX_MAX_INDEX ?
+	       ofi_idm_lookup(&av->rxd_addr_table, (int) rxd_addr) : NULL;
+}
+
+static inline struct rxd_peer *rxd_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
+{
+	return rxd_addr <= OFI_IDX_MAX_INDEX ?
+	       ofi_idm_lookup(&ep->peers, (int) rxd_addr) : NULL;
+}
+
 static inline struct rxd_cq *rxd_ep_tx_cq(struct rxd_ep *ep)
 {
 	return container_of(ep->util_ep.tx_cq, struct rxd_cq, util_cq);
@@ -303,6 +362,9 @@ struct rxd_pkt_entry {
 	void *desc;
 	fi_addr_t peer;
 	void *pkt;
+	/* header and user buffer slices, sent if RXD_PKT_IOV is set */
+	size_t iov_count;
+	struct iovec iov[RXD_IOV_LIMIT + 1];
 };
 
 struct rxd_unexp_msg {
@@ -327,6 +389,20 @@ static inline struct rxd_base_hdr *rxd_get_base_hdr(struct rxd_pkt_entry *pkt_en
 	return &((struct rxd_ack_pkt *) (pkt_entry->pkt))->base_hdr;
 }
 
+/* number of packets the peer may have unacked */
+static inline uint16_t rxd_peer_window(struct rxd_peer *peer)
+{
+	return MIN(peer->tx_window, peer->cwnd);
+}
+
+/* ask for an ACK when a packet fills the window, so the sender can't stall */
+static inline void rxd_set_ack_req(struct rxd_peer *peer,
+				   struct rxd_base_hdr *hdr)
+{
+	if (peer->unacked_cnt + 1 >= rxd_peer_window(peer))
+		hdr->flags |= RXD_ACK_REQ;
+}
+
 static inline uint64_t rxd_set_pkt_seq(struct rxd_peer *peer,
 				       struct rxd_pkt_entry *pkt_entry)
 {
@@ -426,14 +502,17 @@ int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 /* Pkt resource functions */
 int rxd_ep_post_buf(struct rxd_ep *ep);
 void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer);
+void rxd_ep_skip_rx(struct rxd_ep *ep, fi_addr_t peer, uint64_t seq_no);
 struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep);
 struct rxd_x_entry *rxd_get_tx_entry(struct rxd_ep *ep, uint32_t op);
 struct rxd_x_entry *rxd_get_rx_entry(struct rxd_ep *ep, uint32_t op);
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
-void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
+void rxd_insert_unacked(struct rxd_peer *peer,
 			struct rxd_pkt_entry *pkt_entry);
 ssize_t rxd_send_rts_if_needed(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr);
+struct rxd_peer *rxd_create_peer(struct rxd_ep *ep, fi_addr_t rxd_addr);
+void rxd_free_peer(struct rxd_ep *ep, fi_addr_t rxd_addr);
 int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 		       struct rxd_pkt_entry *pkt_entry);
@@ -469,8 +548,12 @@ struct rxd_x_entry *rxd_rx_entry_init(struct rxd_ep *ep,
 			uint32_t op, uint32_t flags);
 void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_rx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *rx_entry);
-int rxd_get_timeout(uint8_t retry_cnt);
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt);
+uint64_t rxd_get_rto(struct rxd_peer *peer);
+uint64_t rxd_get_retry_time(struct rxd_peer *peer, uint64_t start);
+void rxd_update_rtt(struct rxd_peer *peer, uint64_t rtt);
+void rxd_reset_retry(struct rxd_peer *peer);
+void rxd_cc_ack(struct rxd_peer *peer, uint64_t acked);
+void rxd_cc_loss(struct rxd_peer *peer);
 
 /* Generic message functions */
 ssize_t rxd_ep_generic_recvmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
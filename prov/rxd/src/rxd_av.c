@@ -43,7 +43,7 @@ static int rxd_tree_compare(struct ofi_rbmap *map, void *key, void *data)
 
 	memset(addr, 0, len);
 	av = container_of(map, struct rxd_av, rbmap);
-	ret = fi_av_lookup(av->dg_av, av->rxd_addr_table[(fi_addr_t) data].dg_addr,
+	ret = fi_av_lookup(av->dg_av, rxd_av_addr(av, (fi_addr_t) data)->dg_addr,
 			   addr, &len);
 	if (ret)
 		return -1;
@@ -108,23 +108,78 @@ static fi_addr_t rxd_av_dg_addr(struct rxd_av *av, fi_addr_t fi_addr)
 	fi_addr_t rxd_addr = av->fi_addr_table[fi_addr];
 
 	return rxd_addr == FI_ADDR_UNSPEC ? rxd_addr :
-		av->rxd_addr_table[rxd_addr].dg_addr;
+		rxd_av_addr(av, rxd_addr)->dg_addr;
 }
 
-static fi_addr_t rxd_set_rxd_addr(struct rxd_av *av, fi_addr_t dg_addr)
+/*
+ * rxd addresses are handed out in turn, starting after the last one used.
+ * Chunks of the table that are full are stepped over whole, and unused
+ * chunks are free throughout.
+ */
+static int rxd_next_rxd_addr(struct rxd_av *av)
 {
-	int tries = 0;
+	struct index_map *idm = &av->rxd_addr_table;
+	int idx = av->rxd_addr_idx, tries = 0, chunk, step;
+
+	while (tries < rxd_env.max_peers) {
+		chunk = ofi_idx_array_index(idx);
+		if (!idm->array[chunk] || !ofi_idm_at(idm, idx)) {
+			av->rxd_addr_idx = idx;
+			return 0;
+		}
 
-	while (av->rxd_addr_table[av->rxd_addr_idx].dg_addr != FI_ADDR_UNSPEC &&
-	       tries < av->util_av.count) {
-		if (++av->rxd_addr_idx == av->util_av.count)
-			av->rxd_addr_idx = 0;
-		tries++;
+		step = idm->count[chunk] == OFI_IDX_ENTRY_SIZE ?
+		       OFI_IDX_ENTRY_SIZE - ofi_idx_entry_index(idx) : 1;
+		tries += step;
+		idx += step;
+		if (idx >= rxd_env.max_peers)
+			idx = 0;
+	}
+	return -FI_ENOSPC;
+}
+
+static int rxd_set_rxd_addr(struct rxd_av *av, fi_addr_t dg_addr,
+			    fi_addr_t *rxd_addr)
+{
+	struct rxd_addr *entry;
+	int ret;
+
+	ret = rxd_next_rxd_addr(av);
+	if (ret)
+		return ret;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return -FI_ENOMEM;
+
+	entry->fi_addr = FI_ADDR_UNSPEC;
+	entry->dg_addr = dg_addr;
+	if (ofi_idm_set(&av->rxd_addr_table, av->rxd_addr_idx, entry) < 0) {
+		free(entry);
+		return -FI_ENOMEM;
+	}
+
+	*rxd_addr = av->rxd_addr_idx;
+	return 0;
+}
+
+static void rxd_free_rxd_addr(struct rxd_av *av, fi_addr_t rxd_addr)
+{
+	struct util_ep *util_ep;
+	struct rxd_ep *ep;
+
+	fastlock_acquire(&av->util_av.ep_list_lock);
+	dlist_foreach_container(&av->util_av.ep_list, struct util_ep,
+				util_ep, av_entry) {
+		ep = container_of(util_ep, struct rxd_ep, util_ep);
+		fastlock_acquire(&ep->util_ep.lock);
+		if (rxd_peer(ep, rxd_addr))
+			rxd_free_peer(ep, rxd_addr);
+		fastlock_release(&ep->util_ep.lock);
 	}
-	assert(av->rxd_addr_idx < av->util_av.count && tries < av->util_av.count);
-	av->rxd_addr_table[av->rxd_addr_idx].dg_addr = dg_addr;
+	fastlock_release(&av->util_av.ep_list_lock);
 
-	return av->rxd_addr_idx;
+	free(ofi_idm_clear(&av->rxd_addr_table, (int) rxd_addr));
 }
 
 static fi_addr_t rxd_set_fi_addr(struct rxd_av *av, fi_addr_t rxd_addr)
@@ -139,7 +194,7 @@ static fi_addr_t rxd_set_fi_addr(struct rxd_av *av, fi_addr_t rxd_addr)
 	}
 	assert(av->fi_addr_idx < av->util_av.count && tries < av->util_av.count);
 	av->fi_addr_table[av->fi_addr_idx] = rxd_addr;
-	av->rxd_addr_table[rxd_addr].fi_addr = av->fi_addr_idx;
+	rxd_av_addr(av, rxd_addr)->fi_addr = av->fi_addr_idx;
 
 	return av->fi_addr_idx;
 }
@@ -156,12 +211,17 @@ int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 	if (ret != 1)
 		return -FI_EINVAL;
 
-	*rxd_addr = rxd_set_rxd_addr(av, dg_addr);
+	ret = rxd_set_rxd_addr(av, dg_addr, rxd_addr);
+	if (ret) {
+		fi_av_remove(av->dg_av, &dg_addr, 1, flags);
+		return ret;
+	}
 
 	ret = ofi_rbmap_insert(&av->rbmap, (void *) addr, (void *) (*rxd_addr),
 			       NULL);
 	if (ret) {
 		assert(ret != -FI_EALREADY);
+		free(ofi_idm_clear(&av->rxd_addr_table, (int) *rxd_addr));
 		fi_av_remove(av->dg_av, &dg_addr, 1, flags);
 	}
 
@@ -195,9 +255,9 @@ static int rxd_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 				break;
 		}
 
-		util_addr = av->rxd_addr_table[rxd_addr].fi_addr == FI_ADDR_UNSPEC ?
+		util_addr = rxd_av_addr(av, rxd_addr)->fi_addr == FI_ADDR_UNSPEC ?
 			    rxd_set_fi_addr(av, rxd_addr) :
-			    av->rxd_addr_table[rxd_addr].fi_addr;
+			    rxd_av_addr(av, rxd_addr)->fi_addr;
 		if (fi_addr)
 			fi_addr[i] = util_addr;
 
@@ -262,7 +322,7 @@ static int rxd_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 		rxd_addr = av->fi_addr_table[fi_addr[i]];
 
 		addrlen = RXD_NAME_LENGTH;
-		ret = fi_av_lookup(av->dg_av, av->rxd_addr_table[rxd_addr].dg_addr,
+		ret = fi_av_lookup(av->dg_av, rxd_av_addr(av, rxd_addr)->dg_addr,
 				   addr, &addrlen);
 		if (ret)
 			goto err;
@@ -271,14 +331,13 @@ static int rxd_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 		if (ret)
 			goto err;
 
-		ret = fi_av_remove(av->dg_av, &av->rxd_addr_table[rxd_addr].dg_addr,
+		ret = fi_av_remove(av->dg_av, &rxd_av_addr(av, rxd_addr)->dg_addr,
 				   1, flags);
 		if (ret)
 			goto err;
 
 		av->fi_addr_table[fi_addr[i]] = FI_ADDR_UNSPEC;
-		av->rxd_addr_table[rxd_addr].fi_addr = FI_ADDR_UNSPEC;
-		av->rxd_addr_table[rxd_addr].dg_addr = FI_ADDR_UNSPEC;
+		rxd_free_rxd_addr(av, rxd_addr);
 		av->dg_av_used--;
 	}
 
@@ -325,7 +384,7 @@ static struct fi_ops_av rxd_av_ops = {
 static int rxd_av_close(struct fid *fid)
 {
 	struct rxd_av *av;
-	int ret;
+	int ret, i, j;
 
 	av = container_of(fid, struct rxd_av, util_av.av_fid);
 	ret = fi_close(&av->dg_av->fid);
@@ -337,8 +396,15 @@ static int rxd_av_close(struct fid *fid)
 	if (ret)
 		return ret;
 
+	for (i = 0; i < OFI_IDX_ARRAY_SIZE; i++) {
+		if (!av->rxd_addr_table.array[i])
+			continue;
+		for (j = 0; j < OFI_IDX_ENTRY_SIZE; j++)
+			free(av->rxd_addr_table.array[i][j]);
+	}
+	ofi_idm_reset(&av->rxd_addr_table);
+
 	free(av->fi_addr_table);
-	free(av->rxd_addr_table);
 	free(av);
 	return 0;
 }
@@ -373,14 +439,13 @@ int rxd_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 
 	//TODO implement dynamic AV sizing
 	attr->count = roundup_power_of_two(attr->count ?
-					   attr->count : rxd_env.max_peers);
+					   attr->count : RXD_DEFAULT_AV_SIZE);
 	domain = container_of(domain_fid, struct rxd_domain, util_domain.domain_fid);
 	av = calloc(1, sizeof(*av));
 	if (!av)
 		return -FI_ENOMEM;
 	av->fi_addr_table = calloc(1, attr->count * sizeof(fi_addr_t));
-	av->rxd_addr_table = calloc(1, rxd_env.max_peers * sizeof(struct rxd_addr));
-	if (!av->fi_addr_table || !av->rxd_addr_table) {
+	if (!av->fi_addr_table) {
 		ret = -FI_ENOMEM;
 		goto err1;
 	}
@@ -399,10 +464,6 @@ int rxd_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 	ofi_rbmap_init(&av->rbmap, rxd_tree_compare);
 	for (i = 0; i < attr->count; av->fi_addr_table[i++] = FI_ADDR_UNSPEC)
 		;
-	for (i = 0; i < rxd_env.max_peers; i++) {
-		av->rxd_addr_table[i].fi_addr = FI_ADDR_UNSPEC;
-		av->rxd_addr_table[i].dg_addr = FI_ADDR_UNSPEC;
-	}
 
 	av_attr = *attr;
 	av_attr.count = 0;
@@ -420,7 +481,6 @@ err2:
 	ofi_av_close(&av->util_av);
 err1:
 	free(av->fi_addr_table);
-	free(av->rxd_addr_table);
 	free(av);
 	return ret;
 }
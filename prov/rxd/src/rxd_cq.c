@@ -151,24 +151,11 @@ static void rxd_complete_tx(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	rxd_tx_entry_free(ep, tx_entry);
 }
 
-static int rxd_comp_pkt_seq_no(struct dlist_entry *item, const void *arg)
-{
-	struct rxd_base_hdr *list_hdr;
-	struct rxd_base_hdr *new_hdr;
-
-	list_hdr = rxd_get_base_hdr(container_of(item,
-				   struct rxd_pkt_entry, d_entry));
-
-	new_hdr = rxd_get_base_hdr(container_of((struct dlist_entry *) arg,
-				  struct rxd_pkt_entry, d_entry));
-
-	return new_hdr->seq_no > list_hdr->seq_no;
-}
-
 void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 		      struct rxd_data_pkt *pkt, size_t size)
 {
 	struct rxd_domain *rxd_domain = rxd_ep_domain(ep);
+	struct rxd_peer *peer;
 	uint64_t done;
 	struct iovec *iov;
 	size_t iov_count;
@@ -190,8 +177,8 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 	x_entry->next_seg_no++;
 
 	if (x_entry->next_seg_no < x_entry->num_segs) {
-		if (!(ep->peers[pkt->base_hdr.peer].rx_seq_no %
-		    ep->peers[pkt->base_hdr.peer].rx_window))
+		peer = rxd_peer(ep, pkt->base_hdr.peer);
+		if (!(peer->rx_seq_no % peer->rx_window))
 			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 		return;
 	}
@@ -205,65 +192,66 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 
 static void rxd_verify_active(struct rxd_ep *ep, fi_addr_t addr, fi_addr_t peer_addr)
 {
+	struct rxd_peer *peer = rxd_peer(ep, addr);
 	struct rxd_pkt_entry *pkt_entry;
 
-	if (ep->peers[addr].peer_addr != FI_ADDR_UNSPEC &&
-	    ep->peers[addr].peer_addr != peer_addr)
+	if (peer->peer_addr != FI_ADDR_UNSPEC &&
+	    peer->peer_addr != peer_addr)
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 			"overwriting active peer - unexpected behavior\n");
 
-	ep->peers[addr].peer_addr = peer_addr;
+	peer->peer_addr = peer_addr;
 
-	if (!dlist_empty(&ep->peers[addr].unacked) && 
-	    rxd_get_base_hdr(container_of((&ep->peers[addr].unacked)->next,
+	if (!dlist_empty(&peer->unacked) && 
+	    rxd_get_base_hdr(container_of((&peer->unacked)->next,
 			     struct rxd_pkt_entry, d_entry))->type == RXD_RTS) {
-		dlist_pop_front(&ep->peers[addr].unacked,
+		dlist_pop_front(&peer->unacked,
 				struct rxd_pkt_entry, pkt_entry, d_entry);
+		if (!(pkt_entry->flags & RXD_PKT_RETRANS))
+			rxd_update_rtt(peer,
+				       ofi_gettime_us() - pkt_entry->timestamp);
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			dlist_insert_tail(&pkt_entry->d_entry, &ep->ctrl_pkts);
 			pkt_entry->flags |= RXD_PKT_ACKED;
 		} else {
 			ofi_buf_free(pkt_entry);
-			ep->peers[addr].unacked_cnt--;
+			peer->unacked_cnt--;
 		}
-		dlist_remove(&ep->peers[addr].entry);
+		dlist_remove(&peer->entry);
 	}
 
-	if (!ep->peers[addr].active) {
-		dlist_insert_tail(&ep->peers[addr].entry, &ep->active_peers);
-		ep->peers[addr].retry_cnt = 0;
-		ep->peers[addr].active = 1;
+	if (!peer->active) {
+		dlist_insert_tail(&peer->entry, &ep->active_peers);
+		rxd_reset_retry(peer);
+		peer->active = 1;
 	}
 }
 
 int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
 	struct rxd_base_hdr *hdr = rxd_get_base_hdr(tx_entry->pkt);
+	struct rxd_peer *peer = rxd_peer(ep, tx_entry->peer);
 
-	if (ep->peers[tx_entry->peer].unacked_cnt >=
-	    ep->peers[tx_entry->peer].tx_window)
+	if (peer->unacked_cnt >= rxd_peer_window(peer))
 		return 0;
 
-	tx_entry->start_seq = rxd_set_pkt_seq(&ep->peers[tx_entry->peer],
-					      tx_entry->pkt);
-	if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1) {
-		ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
-						      tx_entry->num_segs;
-	}
-	hdr->peer = ep->peers[tx_entry->peer].peer_addr;
+	tx_entry->start_seq = rxd_set_pkt_seq(peer, tx_entry->pkt);
+	if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1)
+		peer->tx_seq_no = tx_entry->start_seq + tx_entry->num_segs;
+	hdr->peer = peer->peer_addr;
+	if (tx_entry->num_segs > 1)
+		rxd_set_ack_req(peer, hdr);
 	rxd_ep_send_pkt(ep, tx_entry->pkt);
-	rxd_insert_unacked(ep, tx_entry->peer, tx_entry->pkt);
+	rxd_insert_unacked(peer, tx_entry->pkt);
 	tx_entry->pkt = NULL;
 
 	if (tx_entry->op == RXD_READ_REQ || tx_entry->op == RXD_ATOMIC_FETCH ||
 	    tx_entry->op == RXD_ATOMIC_COMPARE) {
 		dlist_remove(&tx_entry->entry);
-		dlist_insert_tail(&tx_entry->entry,
-				  &ep->peers[tx_entry->peer].rma_rx_list);
+		dlist_insert_tail(&tx_entry->entry, &peer->rma_rx_list);
 	}
 
-	return ep->peers[tx_entry->peer].unacked_cnt <
-	       ep->peers[tx_entry->peer].tx_window;
+	return peer->unacked_cnt < rxd_peer_window(peer);
 }
 
 void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
@@ -304,33 +292,30 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 		}
 				
 		if (tx_entry->op == RXD_DATA_READ && !tx_entry->bytes_done) {
-			if (ep->peers[tx_entry->peer].unacked_cnt >=
-		    	    ep->peers[tx_entry->peer].tx_window) {
+			if (peer->unacked_cnt >= rxd_peer_window(peer))
 				break;
-			} 
-			tx_entry->start_seq = ep->peers[tx_entry->peer].tx_seq_no;
-			ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
-							      tx_entry->num_segs;
+			tx_entry->start_seq = peer->tx_seq_no;
+			peer->tx_seq_no = tx_entry->start_seq +
+					  tx_entry->num_segs;
 			inc = 1;
 		}
 
 		ret = rxd_ep_post_data_pkts(ep, tx_entry);
 		if (ret) {
 			if (ret == -FI_ENOMEM && inc)
-				ep->peers[tx_entry->peer].tx_seq_no -=
-							  tx_entry->num_segs;
+				peer->tx_seq_no -= tx_entry->num_segs;
 			break;
 		}
 	}
 
 	if (dlist_empty(&peer->tx_list))
-		peer->retry_cnt = 0;
+		rxd_reset_retry(peer);
 }
 
 static void rxd_update_peer(struct rxd_ep *ep, fi_addr_t peer, fi_addr_t peer_addr)
 {
 	rxd_verify_active(ep, peer, peer_addr);
-	rxd_progress_tx_list(ep, &ep->peers[peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, peer));
 }
 
 static int rxd_send_cts(struct rxd_ep *rxd_ep, struct rxd_rts_pkt *rts_pkt,
@@ -438,6 +423,12 @@ static void rxd_handle_rts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 			return;
 	}
 
+	if (!rxd_peer(ep, rxd_addr) && !rxd_create_peer(ep, rxd_addr)) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"unable to allocate peer\n");
+		return;
+	}
+
 	if (rxd_send_cts(ep, pkt, rxd_addr)) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 			"error posting CTS\n");
@@ -512,12 +503,12 @@ static struct rxd_x_entry *rxd_match_rx(struct rxd_ep *ep,
 	}
 
 	if (!match) {
-		assert(!ep->peers[base->peer].curr_unexp);
+		assert(!rxd_peer(ep, base->peer)->curr_unexp);
 		unexp_msg = rxd_init_unexp(ep, pkt_entry, base, op,
 					   tag, data, msg, msg_size);
 		if (unexp_msg) {
 			dlist_insert_tail(&unexp_msg->entry, unexp_list);
-			ep->peers[base->peer].curr_unexp = unexp_msg;
+			rxd_peer(ep, base->peer)->curr_unexp = unexp_msg;
 		}
 		return NULL;
 	}
@@ -594,9 +585,9 @@ static struct rxd_x_entry *rxd_rma_read_entry_init(struct rxd_ep *ep,
 	rx_entry->cq_entry.flags = ofi_rx_cq_flags(RXD_READ_REQ);
 	rx_entry->cq_entry.len = sar_hdr->size;
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
+	dlist_insert_tail(&rx_entry->entry, &rxd_peer(ep, rx_entry->peer)->tx_list);
 
-	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
 	return rx_entry;
 }
@@ -669,11 +660,11 @@ static struct rxd_x_entry *rxd_rx_atomic_fetch(struct rxd_ep *ep,
 	if (rx_entry->bytes_done != rx_entry->cq_entry.len)
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "fetch data length mismatch\n");
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
+	dlist_insert_tail(&rx_entry->entry, &rxd_peer(ep, rx_entry->peer)->tx_list);
 
 	rxd_ep_send_ack(ep, base_hdr->peer);
 
-	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
 	return rx_entry;
 }
@@ -833,9 +824,9 @@ void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 		     void **msg, size_t size)
 {
 	if (sar_hdr)
-		ep->peers[base_hdr->peer].curr_tx_id = sar_hdr->tx_id;
+		rxd_peer(ep, base_hdr->peer)->curr_tx_id = sar_hdr->tx_id;
 
-	ep->peers[base_hdr->peer].curr_rx_id = rx_entry->rx_id;
+	rxd_peer(ep, base_hdr->peer)->curr_rx_id = rx_entry->rx_id;
 
 	if (base_hdr->type == RXD_READ_REQ)
 		return;
@@ -869,7 +860,7 @@ void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 	rx_entry->next_seg_no++;
 	rx_entry->start_seq = base_hdr->seq_no;
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[base_hdr->peer].rx_list);
+	dlist_insert_tail(&rx_entry->entry, &rxd_peer(ep, base_hdr->peer)->rx_list);
 }
 
 static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
@@ -877,114 +868,97 @@ static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
 {
 	if (data_pkt->base_hdr.type == RXD_DATA)
 		return ofi_bufpool_get_ibuf(ep->rx_entry_pool.pool,
-			     ep->peers[data_pkt->base_hdr.peer].curr_rx_id);
+			     rxd_peer(ep, data_pkt->base_hdr.peer)->curr_rx_id);
 
 	return ofi_bufpool_get_ibuf(ep->tx_entry_pool.pool, data_pkt->ext_hdr.tx_id);
 }
 
-static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
+static void rxd_inc_rx_seq(struct rxd_peer *peer)
 {
-	struct fi_cq_err_entry err_entry;
-	struct rxd_pkt_entry *pkt_entry;
-	struct rxd_base_hdr *base_hdr;
-	struct rxd_sar_hdr *sar_hdr;
-	struct rxd_tag_hdr *tag_hdr;
-	struct rxd_data_hdr *data_hdr;
-	struct rxd_rma_hdr *rma_hdr;
-	struct rxd_atom_hdr *atom_hdr;
-	void *msg;
-	int ret;
-	size_t msg_size;
-	struct rxd_x_entry *rx_entry = NULL;
-	struct rxd_data_pkt *data_pkt;
+	struct rxd_robuf *robuf = &peer->robuf;
+	struct rxd_pkt_entry **pkt_entry;
 
-	while (!dlist_empty(&ep->peers[peer].buf_pkts)) {
-		pkt_entry = container_of((&ep->peers[peer].buf_pkts)->next,
-					struct rxd_pkt_entry, d_entry);
-		base_hdr = rxd_get_base_hdr(pkt_entry);
-		if (base_hdr->seq_no != ep->peers[peer].rx_seq_no)
-			return;
-
-		if (base_hdr->type == RXD_DATA || base_hdr->type == RXD_DATA_READ) {
-			data_pkt = (struct rxd_data_pkt *) pkt_entry->pkt;
-			rx_entry = rxd_get_data_x_entry(ep, data_pkt);
-			rxd_ep_recv_data(ep, rx_entry, data_pkt, pkt_entry->pkt_size);
-		} else {
-			ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
-					      &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
-					      &msg, &msg_size);
-			if (ret) {
-				memset(&err_entry, 0, sizeof(err_entry));
-				err_entry.err = FI_ETRUNC;
-				err_entry.prov_errno = 0;
-				ret = ofi_cq_write_error(&rxd_ep_rx_cq(ep)->util_cq,
-							 &err_entry);
-				if (ret)
-					FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
-						"could not write error entry\n");
-				ep->peers[base_hdr->peer].rx_seq_no++;
-				rxd_remove_free_pkt_entry(pkt_entry);
-				continue;
-			}
-			if (!rx_entry) {
-				if (base_hdr->type == RXD_MSG ||
-				    base_hdr->type == RXD_TAGGED) {
-					ep->peers[base_hdr->peer].rx_seq_no++;
-					continue;
-				}
-				break;
-			}
+	peer->rx_seq_no++;
+	if (!robuf->pending)
+		return;
 
-			rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr,
-					sar_hdr, tag_hdr, data_hdr, rma_hdr,
-					atom_hdr, &msg, msg_size);
-		}
+	pkt_entry = ofi_recvwin_peek(robuf);
+	if (*pkt_entry) {
+		ofi_buf_free(*pkt_entry);
+		*pkt_entry = NULL;
+		peer->robuf_cnt--;
+	}
+	ofi_recvwin_slide(robuf);
+}
 
-		ep->peers[base_hdr->peer].rx_seq_no++;
-		rxd_remove_free_pkt_entry(pkt_entry);
+/*
+ * Hold a packet that arrived ahead of a gap in the sequence until the
+ * missing packets are received.  Returns 0 if the packet was buffered.
+ */
+static int rxd_buf_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+	struct rxd_peer *peer = rxd_peer(ep, base_hdr->peer);
+
+	if (!peer->robuf.pending) {
+		ofi_recvwin_buf_alloc(&peer->robuf,
+				roundup_power_of_two(rxd_env.max_unacked));
+		if (!peer->robuf.pending)
+			return -FI_ENOMEM;
+		peer->robuf.exp_msg_id = peer->rx_seq_no;
 	}
+
+	if (!ofi_recvwin_id_valid(&peer->robuf, base_hdr->seq_no) ||
+	    *ofi_recvwin_get_msg(&peer->robuf, base_hdr->seq_no))
+		return -FI_EALREADY;
+
+	ofi_recvwin_queue_msg(&peer->robuf, &pkt_entry, base_hdr->seq_no);
+	peer->robuf_cnt++;
+	return 0;
 }
 
-static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+static void rxd_handle_ooo_pkt(struct rxd_ep *ep,
+			       struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+	int ret;
+
+	ret = rxd_buf_pkt(ep, pkt_entry);
+
+	/* the ACK reports the gap and what was received past it */
+	if (rxd_env.retry &&
+	    rxd_peer(ep, base_hdr->peer)->peer_addr != FI_ADDR_UNSPEC)
+		rxd_ep_send_ack(ep, base_hdr->peer);
+
+	if (ret)
+		ofi_buf_free(pkt_entry);
+}
+
+static void rxd_recv_data_pkt(struct rxd_ep *ep,
+			      struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+	struct rxd_peer *peer = rxd_peer(ep, pkt->base_hdr.peer);
 	struct rxd_x_entry *x_entry;
 	struct rxd_unexp_msg *unexp_msg;
 
-	if (pkt_entry->pkt_size < sizeof(*pkt) + ep->rx_prefix_size) {
-		FI_WARN(&rxd_prov, FI_LOG_CQ,
-			"Cannot process packet smaller than minimum header size\n");
-		goto free;
-	}
-
-	if (pkt->base_hdr.seq_no == ep->peers[pkt->base_hdr.peer].rx_seq_no) {
-		ep->peers[pkt->base_hdr.peer].rx_seq_no++;
-		if (pkt->base_hdr.type == RXD_DATA &&
-		    ep->peers[pkt->base_hdr.peer].curr_unexp) {
-			unexp_msg = ep->peers[pkt->base_hdr.peer].curr_unexp;
-			dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
-			if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
-				ep->peers[pkt->base_hdr.peer].curr_unexp = NULL;
-				rxd_ep_send_ack(ep, pkt->base_hdr.peer);
-			}
-			return;
+	rxd_inc_rx_seq(peer);
+	if (pkt->base_hdr.type == RXD_DATA && peer->curr_unexp) {
+		unexp_msg = peer->curr_unexp;
+		dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
+		if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
+			peer->curr_unexp = NULL;
+			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 		}
-		x_entry = rxd_get_data_x_entry(ep, pkt);
-		rxd_ep_recv_data(ep, x_entry, pkt, pkt_entry->pkt_size);
-		if (!dlist_empty(&ep->peers[pkt->base_hdr.peer].buf_pkts))
-			rxd_progress_buf_pkts(ep, pkt->base_hdr.peer);
-	} else if (!rxd_env.retry) {
-		dlist_insert_order(&ep->peers[pkt->base_hdr.peer].buf_pkts,
-				   &rxd_comp_pkt_seq_no, &pkt_entry->d_entry);
 		return;
-	} else if (ep->peers[pkt->base_hdr.peer].peer_addr != FI_ADDR_UNSPEC) {
-		rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 	}
-free:
+
+	x_entry = rxd_get_data_x_entry(ep, pkt);
+	rxd_ep_recv_data(ep, x_entry, pkt, pkt_entry->pkt_size);
 	ofi_buf_free(pkt_entry);
 }
 
-static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+static void rxd_recv_op_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_x_entry *rx_entry;
 	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
@@ -993,23 +967,12 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	struct rxd_data_hdr *data_hdr;
 	struct rxd_rma_hdr *rma_hdr;
 	struct rxd_atom_hdr *atom_hdr;
+	struct rxd_peer *peer = rxd_peer(ep, base_hdr->peer);
 	void *msg;
 	size_t msg_size;
 	int ret;
 
-	if (base_hdr->seq_no != ep->peers[base_hdr->peer].rx_seq_no) {
-		if (!rxd_env.retry) {
-			dlist_insert_order(&ep->peers[base_hdr->peer].buf_pkts,
-					   &rxd_comp_pkt_seq_no, &pkt_entry->d_entry);
-			return;
-		}
-
-		if (ep->peers[base_hdr->peer].peer_addr != FI_ADDR_UNSPEC)
-			goto ack;
-		goto release;
-	}
-
-	if (ep->peers[base_hdr->peer].peer_addr == FI_ADDR_UNSPEC)
+	if (peer->peer_addr == FI_ADDR_UNSPEC)
 		goto release;
 
 	ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
@@ -1020,35 +983,125 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 
 	if (!rx_entry) {
 		if (base_hdr->type == RXD_MSG || base_hdr->type == RXD_TAGGED) {
-			if (!ep->peers[base_hdr->peer].curr_unexp)
+			if (!peer->curr_unexp)
 				goto ack;
 
-			ep->peers[base_hdr->peer].rx_seq_no++;
+			rxd_inc_rx_seq(peer);
 
 			if (!sar_hdr)
-				ep->peers[base_hdr->peer].curr_unexp = NULL;
+				peer->curr_unexp = NULL;
 
 			rxd_ep_send_ack(ep, base_hdr->peer);
 			return;
 		}
-		ep->peers[base_hdr->peer].rx_window = 0;
+		peer->rx_window = 0;
 		goto ack;
 	}
 
-	ep->peers[base_hdr->peer].rx_seq_no++;
-	ep->peers[base_hdr->peer].rx_window = rxd_env.max_unacked;
+	rxd_inc_rx_seq(peer);
+	peer->rx_window = rxd_env.max_unacked;
 	rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr, sar_hdr, tag_hdr,
 			data_hdr, rma_hdr, atom_hdr, &msg, msg_size);
 
-	if (!dlist_empty(&ep->peers[base_hdr->peer].buf_pkts))
-		rxd_progress_buf_pkts(ep, base_hdr->peer);
-
 ack:
 	rxd_ep_send_ack(ep, base_hdr->peer);
 release:
 	ofi_buf_free(pkt_entry);
 }
 
+static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t addr)
+{
+	struct rxd_peer *peer = rxd_peer(ep, addr);
+	struct rxd_robuf *robuf = &peer->robuf;
+	struct rxd_pkt_entry **head, *pkt_entry;
+
+	while (peer->robuf_cnt) {
+		head = ofi_recvwin_peek(robuf);
+		if (!*head)
+			return;
+
+		pkt_entry = *head;
+		*head = NULL;
+		peer->robuf_cnt--;
+
+		if (rxd_pkt_type(pkt_entry) == RXD_DATA ||
+		    rxd_pkt_type(pkt_entry) == RXD_DATA_READ)
+			rxd_recv_data_pkt(ep, pkt_entry);
+		else
+			rxd_recv_op_pkt(ep, pkt_entry);
+	}
+
+	/* the gap is closed, only peers with one open hold a buffer */
+	if (robuf->pending) {
+		ofi_recvwin_free(robuf);
+		robuf->pending = NULL;
+	}
+}
+
+void rxd_ep_skip_rx(struct rxd_ep *ep, fi_addr_t peer, uint64_t seq_no)
+{
+	struct rxd_peer *rx_peer = rxd_peer(ep, peer);
+
+	while (ofi_before(rx_peer->rx_seq_no, seq_no))
+		rxd_inc_rx_seq(rx_peer);
+
+	rxd_progress_buf_pkts(ep, peer);
+}
+
+/*
+ * ACK right away when the sender filled its window, or when a hole was just
+ * filled, so the sender learns of it without waiting for the next ACK.
+ */
+static void rxd_ack_req(struct rxd_ep *ep, fi_addr_t peer, int ack)
+{
+	if (ack && rxd_peer(ep, peer)->peer_addr != FI_ADDR_UNSPEC)
+		rxd_ep_send_ack(ep, peer);
+}
+
+static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+	fi_addr_t peer = pkt->base_hdr.peer;
+	struct rxd_peer *rx_peer;
+	int ack;
+
+	if (pkt_entry->pkt_size < sizeof(*pkt) + ep->rx_prefix_size) {
+		FI_WARN(&rxd_prov, FI_LOG_CQ,
+			"Cannot process packet smaller than minimum header size\n");
+		ofi_buf_free(pkt_entry);
+		return;
+	}
+
+	rx_peer = rxd_peer(ep, peer);
+	if (pkt->base_hdr.seq_no != rx_peer->rx_seq_no) {
+		rxd_handle_ooo_pkt(ep, pkt_entry);
+		return;
+	}
+
+	ack = (pkt->base_hdr.flags & RXD_ACK_REQ) || rx_peer->robuf_cnt;
+	rxd_recv_data_pkt(ep, pkt_entry);
+	rxd_progress_buf_pkts(ep, peer);
+	rxd_ack_req(ep, peer, ack);
+}
+
+static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+	fi_addr_t peer = base_hdr->peer;
+	struct rxd_peer *rx_peer = rxd_peer(ep, peer);
+	int ack;
+
+	if (base_hdr->seq_no != rx_peer->rx_seq_no) {
+		rxd_handle_ooo_pkt(ep, pkt_entry);
+		return;
+	}
+
+	ack = (base_hdr->flags & RXD_ACK_REQ) || rx_peer->robuf_cnt;
+	rxd_recv_op_pkt(ep, pkt_entry);
+	rxd_progress_buf_pkts(ep, peer);
+	rxd_ack_req(ep, peer, ack);
+}
+
 static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_cts_pkt *cts = (struct rxd_cts_pkt *) (pkt_entry->pkt);
@@ -1059,34 +1112,120 @@ static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 		return;
 	}
 
+	/* the address may have been removed while the RTS was in flight */
+	if (!rxd_peer(ep, cts->rts_addr))
+		return;
+
 	rxd_update_peer(ep, cts->rts_addr, cts->cts_addr);
 }
 
+/*
+ * Mark the packets the peer holds out of order, so they are not resent, and
+ * resend the ones missing below the highest of them.  SACKed packets stay on
+ * the unacked list until they are acked in order.
+ */
+static void rxd_handle_sack(struct rxd_ep *ep, struct rxd_peer *peer,
+			    struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t seq_no, off, last = 0, sent = 0, hole = 0, now;
+	int sacked = 0, resent = 0, burst = 0;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (ofi_before(seq_no, ack->base_hdr.seq_no))
+			continue;
+
+		off = seq_no - ack->base_hdr.seq_no - 1;
+		if (off >= RXD_SACK_BITS ||
+		    !(ack->sack[off / 64] & (1ULL << (off % 64)))) {
+			pkt_entry->flags &= ~RXD_PKT_SACKED;
+			continue;
+		}
+
+		if (!(pkt_entry->flags & (RXD_PKT_SACKED | RXD_PKT_RETRANS)))
+			sent = pkt_entry->timestamp;
+		pkt_entry->flags |= RXD_PKT_SACKED;
+		last = seq_no;
+		sacked = 1;
+	}
+
+	if (!sacked)
+		return;
+
+	if (sent)
+		rxd_update_rtt(peer, ofi_gettime_us() - sent);
+
+	now = ofi_gettime_us();
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		seq_no = rxd_get_base_hdr(pkt_entry)->seq_no;
+		if (!ofi_before(seq_no, last))
+			break;
+
+		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED |
+					RXD_PKT_SACKED))
+			continue;
+
+		/*
+		 * Overflowing a receive buffer drops runs of packets, while
+		 * isolated holes are more likely noise on the link.
+		 */
+		if (hole && seq_no == hole + 1)
+			burst = 1;
+		hole = seq_no;
+
+		/* resend a hole at most once per RTT */
+		if (now - pkt_entry->timestamp <
+		    (peer->srtt ? peer->srtt >> 3 : peer->rto))
+			continue;
+
+		if (rxd_ep_send_pkt(ep, pkt_entry))
+			break;
+		pkt_entry->flags |= RXD_PKT_RETRANS;
+		peer->retrans_cnt++;
+		resent = 1;
+	}
+
+	if (resent && burst)
+		rxd_cc_loss(peer);
+}
+
 static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 {
 	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
 	struct rxd_pkt_entry *pkt_entry;
-	fi_addr_t peer = ack->base_hdr.peer;
+	struct rxd_peer *peer = rxd_peer(ep, ack->base_hdr.peer);
 	struct rxd_base_hdr *hdr;
+	uint64_t sent = 0;
 
-	ep->peers[peer].tx_window = ack->ext_hdr.rx_id;
+	peer->tx_window = ack->ext_hdr.rx_id;
 
-	if (ep->peers[peer].last_rx_ack == ack->base_hdr.seq_no)
+	if (peer->last_rx_ack == ack->base_hdr.seq_no) {
+		rxd_handle_sack(ep, peer, ack);
 		return;
+	}
 
-	ep->peers[peer].last_rx_ack = ack->base_hdr.seq_no;
+	if (ofi_before(peer->last_rx_ack, ack->base_hdr.seq_no))
+		rxd_cc_ack(peer, ack->base_hdr.seq_no - peer->last_rx_ack);
+	peer->last_rx_ack = ack->base_hdr.seq_no;
 
-	if (dlist_empty(&ep->peers[peer].unacked))
+	if (dlist_empty(&peer->unacked))
 		return;
 
-	pkt_entry = container_of((&ep->peers[peer].unacked)->next,
+	pkt_entry = container_of((&peer->unacked)->next,
 				struct rxd_pkt_entry, d_entry);
 
-	while (&pkt_entry->d_entry != &ep->peers[peer].unacked) {
+	while (&pkt_entry->d_entry != &peer->unacked) {
 		hdr = rxd_get_base_hdr(pkt_entry);
 		if (ofi_after_eq(hdr->seq_no, ack->base_hdr.seq_no))
 			break;
 
+		/* sample the newest packet acked by its first transmission */
+		if (!(pkt_entry->flags & (RXD_PKT_RETRANS | RXD_PKT_SACKED)))
+			sent = pkt_entry->timestamp;
+
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			pkt_entry->flags |= RXD_PKT_ACKED;
 			pkt_entry = container_of((&pkt_entry->d_entry)->next,
@@ -1094,21 +1233,25 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 			continue;
 		}
 		rxd_remove_free_pkt_entry(pkt_entry);
-		ep->peers[peer].unacked_cnt--;
-		ep->peers[peer].retry_cnt = 0;
+		peer->unacked_cnt--;
+		rxd_reset_retry(peer);
 
-		pkt_entry = container_of((&ep->peers[peer].unacked)->next,
+		pkt_entry = container_of((&peer->unacked)->next,
 					struct rxd_pkt_entry, d_entry);
 	}
 
-	rxd_progress_tx_list(ep, &ep->peers[ack->base_hdr.peer]);
+	if (sent)
+		rxd_update_rtt(peer, ofi_gettime_us() - sent);
+
+	rxd_handle_sack(ep, peer, ack);
+	rxd_progress_tx_list(ep, peer);
 } 
 
 void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
 	struct rxd_pkt_entry *pkt_entry =
 		container_of(comp->op_context, struct rxd_pkt_entry, context);
-	fi_addr_t peer;
+	struct rxd_peer *peer;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
 	       "got send completion (type: %s)\n",
@@ -1121,10 +1264,13 @@ void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 		break;
 	default:
 		if (pkt_entry->flags & RXD_PKT_ACKED) {
-			peer = pkt_entry->peer;
+			peer = rxd_peer(ep, pkt_entry->peer);
 			rxd_remove_free_pkt_entry(pkt_entry);
-			ep->peers[peer].unacked_cnt--;
-			rxd_progress_tx_list(ep, &ep->peers[peer]);
+			/* the peer is gone if its address was removed */
+			if (peer) {
+				peer->unacked_cnt--;
+				rxd_progress_tx_list(ep, peer);
+			}
 		} else {
 			pkt_entry->flags &= ~RXD_PKT_IN_USE;
 		}
@@ -1143,7 +1289,24 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	rxd_ep_post_buf(ep);
 	rxd_remove_rx_pkt(ep, pkt_entry);
 
+	if (rxd_env.loss && !(rand_r(&ep->loss_seed) % rxd_env.loss)) {
+		FI_DBG(&rxd_prov, FI_LOG_EP_DATA, "dropping %s packet\n",
+		       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
+		ofi_buf_free(pkt_entry);
+		return;
+	}
+
 	pkt_entry->pkt_size = comp->len;
+	if (rxd_pkt_type(pkt_entry) != RXD_RTS &&
+	    rxd_pkt_type(pkt_entry) != RXD_CTS &&
+	    !rxd_peer(ep, rxd_get_base_hdr(pkt_entry)->peer)) {
+		FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
+		       "dropping %s packet from unknown peer\n",
+		       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
+		ofi_buf_free(pkt_entry);
+		return;
+	}
+
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_RTS:
 		rxd_handle_rts(ep, pkt_entry);
@@ -1247,7 +1410,7 @@ ssize_t rxd_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		cq->cq_fastlock_release(&cq->ep_list_lock);
 
 		ret = fi_wait(&cq->wait->wait_fid, ep_retry == -1 ?
-			      timeout : rxd_get_timeout(ep_retry));
+			      timeout : ep_retry);
 
 		if (ep_retry != -1 && ret == -FI_ETIMEDOUT)
 			ret = 0;
@@ -1288,6 +1451,17 @@ int rxd_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 	if (ret)
 		goto free;
 
+	/*
+	 * Completions are written under the endpoint lock, so an endpoint's
+	 * completions come from one thread at a time.  Reads are serialized
+	 * by the application for FI_THREAD_FID and FI_THREAD_ENDPOINT, or
+	 * when it promises a single reader with FI_CQ_SPSC.
+	 */
+	if (cq->util_cq.domain->threading == FI_THREAD_FID ||
+	    cq->util_cq.domain->threading == FI_THREAD_ENDPOINT ||
+	    (attr->flags & FI_CQ_SPSC))
+		ofi_cq_set_spsc(&cq->util_cq);
+
 	cq->write_fn = cq->util_cq.wait ? rxd_cq_write_signal : rxd_cq_write;
 	*cq_fid = &cq->util_cq.cq_fid;
 	(*cq_fid)->fid.ops = &rxd_cq_fi_ops;
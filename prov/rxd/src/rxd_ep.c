@@ -275,26 +275,94 @@ static int rxd_ep_enable(struct rxd_ep *ep)
 }
 
 /*
- * Exponential back-off starting at 1ms, max 4s.
+ * Retransmission timeout in usec, derived from the peer's RTT estimate
+ * (RFC 6298), with exponential back-off for each retry.
  */
-int rxd_get_timeout(uint8_t retry_cnt)
+uint64_t rxd_get_rto(struct rxd_peer *peer)
 {
-	return MIN(1 << retry_cnt, 4000);
+	return MIN(peer->rto << MIN(peer->retry_cnt, 32),
+		   (uint64_t) rxd_env.max_rto);
 }
 
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt)
+uint64_t rxd_get_retry_time(struct rxd_peer *peer, uint64_t start)
 {
-	return start + rxd_get_timeout(retry_cnt);
+	return start + rxd_get_rto(peer);
 }
 
-void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
-		       struct rxd_pkt_entry *pkt_entry)
+/*
+ * Samples come only from packets that were not retransmitted (Karn's
+ * algorithm), so an ACK is never matched against the wrong transmission.
+ */
+void rxd_update_rtt(struct rxd_peer *peer, uint64_t rtt)
 {
-	struct rxd_data_pkt *data_pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
-	uint32_t seg_size;
+	int64_t err;
+
+	rtt = MAX(rtt, 1);
+	if (!peer->srtt) {
+		peer->srtt = rtt << 3;
+		peer->rttvar = rtt << 1;
+	} else {
+		err = (int64_t) rtt - (int64_t) (peer->srtt >> 3);
+		peer->srtt += err;
+		peer->rttvar += (err < 0 ? -err : err) - (peer->rttvar >> 2);
+	}
 
-	seg_size = tx_entry->cq_entry.len - tx_entry->bytes_done;
-	seg_size = MIN(rxd_ep_domain(ep)->max_seg_sz, seg_size);
+	peer->rto = (peer->srtt >> 3) + peer->rttvar;
+	peer->rto = MAX(peer->rto, (uint64_t) rxd_env.min_rto);
+	peer->rto = MIN(peer->rto, (uint64_t) rxd_env.max_rto);
+}
+
+/*
+ * Until the first RTT sample, keep the backed-off timeout, otherwise a peer
+ * whose RTT exceeds the initial RTO would never produce a valid sample.
+ */
+void rxd_reset_retry(struct rxd_peer *peer)
+{
+	if (!peer->retry_cnt)
+		return;
+
+	peer->recovery_time += ofi_gettime_us() - peer->loss_start;
+	if (!peer->srtt)
+		peer->rto = rxd_get_rto(peer);
+	peer->retry_cnt = 0;
+}
+
+/*
+ * AIMD: the window grows by one packet for every window of packets acked,
+ * and shrinks to 3/4 when packets are lost.
+ */
+void rxd_cc_ack(struct rxd_peer *peer, uint64_t acked)
+{
+	if (!rxd_env.cc || peer->cwnd >= rxd_env.max_unacked)
+		return;
+
+	peer->cwnd_cnt += MIN(acked, (uint64_t) peer->cwnd);
+	if (peer->cwnd_cnt >= peer->cwnd) {
+		peer->cwnd_cnt -= peer->cwnd;
+		peer->cwnd++;
+	}
+}
+
+/*
+ * Shrink the window at most once per window of data.  Timeouts before the
+ * RTT is known are not taken as a sign of congestion.
+ */
+void rxd_cc_loss(struct rxd_peer *peer)
+{
+	if (!rxd_env.cc || !peer->srtt ||
+	    ofi_before(peer->last_rx_ack, peer->recover))
+		return;
+
+	peer->cwnd = MAX(peer->cwnd * 3 / 4, RXD_MIN_CWND);
+	peer->cwnd_cnt = 0;
+	peer->recover = peer->tx_seq_no;
+}
+
+static void rxd_init_data_pkt_hdr(struct rxd_ep *ep,
+				  struct rxd_x_entry *tx_entry,
+				  struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_data_pkt *data_pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
 
 	data_pkt->base_hdr.version = RXD_PROTOCOL_VERSION;
 	data_pkt->base_hdr.type = (tx_entry->cq_entry.flags &
@@ -305,19 +373,74 @@ void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 	data_pkt->ext_hdr.rx_id = tx_entry->rx_id;
 	data_pkt->ext_hdr.tx_id = tx_entry->tx_id;
 	data_pkt->ext_hdr.seg_no = tx_entry->next_seg_no++;
-	data_pkt->base_hdr.peer = ep->peers[tx_entry->peer].peer_addr;
+	data_pkt->base_hdr.peer = rxd_peer(ep, tx_entry->peer)->peer_addr;
+
+	pkt_entry->peer = tx_entry->peer;
+}
+
+void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+		       struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_data_pkt *data_pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+	uint32_t seg_size;
+
+	seg_size = tx_entry->cq_entry.len - tx_entry->bytes_done;
+	seg_size = MIN(rxd_ep_domain(ep)->max_seg_sz, seg_size);
+
+	rxd_init_data_pkt_hdr(ep, tx_entry, pkt_entry);
 
 	pkt_entry->pkt_size = ofi_copy_from_iov(data_pkt->msg, seg_size,
 						tx_entry->iov,
 						tx_entry->iov_count,
 						tx_entry->bytes_done);
-	pkt_entry->peer = tx_entry->peer;
 
 	tx_entry->bytes_done += pkt_entry->pkt_size;
 
 	pkt_entry->pkt_size += sizeof(*data_pkt) + ep->tx_prefix_size;
 }
 
+/*
+ * Send the payload of a data packet straight from the user buffer instead
+ * of copying it into the packet.  The buffer belongs to us until every
+ * segment has been acknowledged, so retransmissions can gather it again.
+ * Returns -FI_ETOOSMALL if the segment spans more buffers than the core
+ * provider can send at once.
+ */
+static int rxd_gather_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+			       struct rxd_pkt_entry *pkt_entry)
+{
+	struct iovec *iov = &pkt_entry->iov[1];
+	size_t i, offset, seg_size, len, count = 0;
+
+	seg_size = MIN(rxd_ep_domain(ep)->max_seg_sz,
+		       tx_entry->cq_entry.len - tx_entry->bytes_done);
+
+	offset = tx_entry->bytes_done;
+	for (i = 0; offset >= tx_entry->iov[i].iov_len; i++)
+		offset -= tx_entry->iov[i].iov_len;
+
+	for (len = seg_size; len; i++, offset = 0) {
+		if (count + 1 == ep->tx_iov_limit)
+			return -FI_ETOOSMALL;
+		iov[count].iov_base = (char *) tx_entry->iov[i].iov_base +
+				      offset;
+		iov[count].iov_len = MIN(len, tx_entry->iov[i].iov_len - offset);
+		len -= iov[count++].iov_len;
+	}
+
+	rxd_init_data_pkt_hdr(ep, tx_entry, pkt_entry);
+
+	pkt_entry->iov[0].iov_base = rxd_pkt_start(pkt_entry);
+	pkt_entry->iov[0].iov_len = sizeof(struct rxd_data_pkt) +
+				    ep->tx_prefix_size;
+	pkt_entry->iov_count = count + 1;
+	pkt_entry->pkt_size = pkt_entry->iov[0].iov_len + seg_size;
+	pkt_entry->flags |= RXD_PKT_IOV;
+
+	tx_entry->bytes_done += seg_size;
+	return 0;
+}
+
 struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 			uint32_t op, const struct iovec *iov, size_t iov_count,
 			uint64_t tag, uint64_t data, uint32_t flags, void *context,
@@ -360,7 +483,8 @@ struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 	rxd_init_base_hdr(ep, &(*ptr), tx_entry);
 
 	dlist_insert_tail(&tx_entry->entry,
-			  &ep->peers[tx_entry->peer].tx_list);
+			  &rxd_peer(ep, tx_entry->peer)->tx_list);
+	ofi_ep_set_active(&ep->util_ep);
 
 	return tx_entry;
 }
@@ -373,29 +497,30 @@ void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	ofi_ibuf_free(tx_entry);
 }
 
-void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
+void rxd_insert_unacked(struct rxd_peer *peer,
 			struct rxd_pkt_entry *pkt_entry)
 {
-	dlist_insert_tail(&pkt_entry->d_entry,
-			  &ep->peers[peer].unacked);
-	ep->peers[peer].unacked_cnt++;
+	dlist_insert_tail(&pkt_entry->d_entry, &peer->unacked);
+	peer->unacked_cnt++;
 }
 
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
+	struct rxd_peer *peer = rxd_peer(ep, tx_entry->peer);
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_data_pkt *data;
 
 	while (tx_entry->bytes_done != tx_entry->cq_entry.len) {
-		if (ep->peers[tx_entry->peer].unacked_cnt >=
-		    ep->peers[tx_entry->peer].tx_window)
+		if (peer->unacked_cnt >= rxd_peer_window(peer))
 			return 0;
 
 		pkt_entry = rxd_get_tx_pkt(ep);
 		if (!pkt_entry)
 			return -FI_ENOMEM;
 
-		rxd_init_data_pkt(ep, tx_entry, pkt_entry);
+		if (!ep->tx_iov_limit ||
+		    rxd_gather_data_pkt(ep, tx_entry, pkt_entry))
+			rxd_init_data_pkt(ep, tx_entry, pkt_entry);
 
 		data = (struct rxd_data_pkt *) (pkt_entry->pkt);
 		data->base_hdr.seq_no = tx_entry->start_seq +
@@ -403,24 +528,30 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 		if (data->base_hdr.type != RXD_DATA_READ)
 			data->base_hdr.seq_no++;
 
+		rxd_set_ack_req(peer, &data->base_hdr);
 		rxd_ep_send_pkt(ep, pkt_entry);
-		rxd_insert_unacked(ep, tx_entry->peer, pkt_entry);
+		rxd_insert_unacked(peer, pkt_entry);
 	}
 
-	return ep->peers[tx_entry->peer].unacked_cnt >=
-	       ep->peers[tx_entry->peer].tx_window;
+	return peer->unacked_cnt >= rxd_peer_window(peer);
 }
 
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	int ret;
 
-	pkt_entry->timestamp = ofi_gettime_ms();
+	pkt_entry->timestamp = ofi_gettime_us();
 
-	ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
-		      pkt_entry->pkt_size, pkt_entry->desc,
-		      rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr,
-		      &pkt_entry->context);
+	if (pkt_entry->flags & RXD_PKT_IOV)
+		ret = fi_sendv(ep->dg_ep, pkt_entry->iov, NULL,
+			       pkt_entry->iov_count,
+			       rxd_av_addr(rxd_ep_av(ep), pkt_entry->peer)->dg_addr,
+			       &pkt_entry->context);
+	else
+		ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
+			      pkt_entry->pkt_size, pkt_entry->desc,
+			      rxd_av_addr(rxd_ep_av(ep), pkt_entry->peer)->dg_addr,
+			      &pkt_entry->context);
 	if (ret) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
 			ret, fi_strerror(-ret));
@@ -433,6 +564,7 @@ int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 
 static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
 {
+	struct rxd_peer *peer;
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_rts_pkt *rts_pkt;
 	ssize_t ret;
@@ -459,17 +591,26 @@ static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
 		return ret;
 	}
 
+	peer = rxd_peer(rxd_ep, rxd_addr);
 	rxd_ep_send_pkt(rxd_ep, pkt_entry);
-	rxd_insert_unacked(rxd_ep, rxd_addr, pkt_entry);
-	dlist_insert_tail(&rxd_ep->peers[rxd_addr].entry, &rxd_ep->rts_sent_list);
+	rxd_insert_unacked(peer, pkt_entry);
+	dlist_insert_tail(&peer->entry, &rxd_ep->rts_sent_list);
 
 	return 0;
 }
 
 ssize_t rxd_send_rts_if_needed(struct rxd_ep *ep, fi_addr_t addr)
 {
-	if (ep->peers[addr].peer_addr == FI_ADDR_UNSPEC &&
-	    dlist_empty(&ep->peers[addr].unacked))
+	struct rxd_peer *peer;
+
+	peer = rxd_peer(ep, addr);
+	if (!peer) {
+		peer = rxd_create_peer(ep, addr);
+		if (!peer)
+			return -FI_ENOMEM;
+	}
+
+	if (peer->peer_addr == FI_ADDR_UNSPEC && dlist_empty(&peer->unacked))
 		return rxd_ep_send_rts(ep, addr);
 	return 0;
 }
@@ -482,7 +623,7 @@ void rxd_init_base_hdr(struct rxd_ep *rxd_ep, void **ptr,
 	hdr->version = RXD_PROTOCOL_VERSION;
 	hdr->type = tx_entry->op;
 	hdr->seq_no = 0;
-	hdr->peer = rxd_ep->peers[tx_entry->peer].peer_addr;
+	hdr->peer = rxd_peer(rxd_ep, tx_entry->peer)->peer_addr;
 	hdr->flags = tx_entry->flags;
 
 	*ptr = (char *) (*ptr) + sizeof(*hdr);
@@ -552,6 +693,20 @@ size_t rxd_init_msg(void **ptr, const struct iovec *iov, size_t iov_count,
 	return done;
 }
 
+static void rxd_ep_get_sack(struct rxd_peer *peer, uint64_t *sack)
+{
+	uint64_t i, cnt, max;
+
+	memset(sack, 0, RXD_SACK_BITS / 8);
+	max = MIN(RXD_SACK_BITS, peer->robuf.win_size - 1);
+	for (i = cnt = 0; i < max && cnt < peer->robuf_cnt; i++) {
+		if (!*ofi_recvwin_get_msg(&peer->robuf, peer->rx_seq_no + 1 + i))
+			continue;
+		sack[i / 64] |= 1ULL << (i % 64);
+		cnt++;
+	}
+}
+
 void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
@@ -569,10 +724,11 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 
 	ack->base_hdr.version = RXD_PROTOCOL_VERSION;
 	ack->base_hdr.type = RXD_ACK;
-	ack->base_hdr.peer = rxd_ep->peers[peer].peer_addr;
-	ack->base_hdr.seq_no = rxd_ep->peers[peer].rx_seq_no;
-	ack->ext_hdr.rx_id = rxd_ep->peers[peer].rx_window;
-	rxd_ep->peers[peer].last_tx_ack = ack->base_hdr.seq_no;
+	ack->base_hdr.peer = rxd_peer(rxd_ep, peer)->peer_addr;
+	ack->base_hdr.seq_no = rxd_peer(rxd_ep, peer)->rx_seq_no;
+	ack->ext_hdr.rx_id = rxd_peer(rxd_ep, peer)->rx_window;
+	rxd_ep_get_sack(rxd_peer(rxd_ep, peer), ack->sack);
+	rxd_peer(rxd_ep, peer)->last_tx_ack = ack->base_hdr.seq_no;
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
 	if (rxd_ep_send_pkt(rxd_ep, pkt_entry))
@@ -599,11 +755,27 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_x_entry *x_entry;
 
+	if (peer->loss_cnt)
+		FI_INFO(&rxd_prov, FI_LOG_EP_CTRL, "peer %zu: %" PRIu64
+			" losses, %" PRIu64 " packets resent, %" PRIu64
+			" usec average recovery, srtt %" PRIu64 " usec, rto %"
+			PRIu64 " usec, cwnd %u\n", (size_t) peer->rxd_addr,
+			peer->loss_cnt, peer->retrans_cnt,
+			peer->recovery_time / peer->loss_cnt, peer->srtt >> 3,
+			peer->rto, peer->cwnd);
+
 	while (!dlist_empty(&peer->unacked)) {
 		dlist_pop_front(&peer->unacked, struct rxd_pkt_entry,
 				pkt_entry, d_entry);
-		ofi_buf_free(pkt_entry);
 		peer->unacked_cnt--;
+		if (pkt_entry->flags & RXD_PKT_IN_USE) {
+			/* the send completion frees it */
+			pkt_entry->flags |= RXD_PKT_ACKED;
+			pkt_entry->peer = FI_ADDR_UNSPEC;
+			dlist_insert_tail(&pkt_entry->d_entry, &ep->ctrl_pkts);
+		} else {
+			ofi_buf_free(pkt_entry);
+		}
 	}
 
 	while(!dlist_empty(&peer->tx_list)) {
@@ -624,7 +796,7 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 		rxd_tx_entry_free(ep, x_entry);
 	}
 
-	dlist_remove(&peer->entry);
+	dlist_remove_init(&peer->entry);
 	peer->active = 0;
 }
 
@@ -651,18 +823,64 @@ static void rxd_cleanup_unexp_msg_list(struct dlist_entry *list)
 	}
 }
 
+static void rxd_free_robuf(struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	size_t i;
+
+	if (!peer->robuf.pending)
+		return;
+
+	for (i = 0; i < peer->robuf.win_size; i++) {
+		pkt_entry = peer->robuf.pending->buf[i];
+		if (pkt_entry)
+			ofi_buf_free(pkt_entry);
+	}
+	ofi_recvwin_free(&peer->robuf);
+	peer->robuf.pending = NULL;
+	peer->robuf_cnt = 0;
+}
+
+static void rxd_drop_unexp_msgs(struct dlist_entry *list, fi_addr_t rxd_addr)
+{
+	struct rxd_unexp_msg *unexp_msg;
+	struct dlist_entry *tmp;
+
+	dlist_foreach_container_safe(list, struct rxd_unexp_msg,
+				     unexp_msg, entry, tmp) {
+		if (unexp_msg->base_hdr->peer == rxd_addr)
+			rxd_cleanup_unexp_msg(unexp_msg);
+	}
+}
+
+void rxd_free_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
+{
+	struct rxd_peer *peer;
+
+	peer = ofi_idm_clear(&ep->peers, (int) rxd_addr);
+	dlist_remove(&peer->peer_entry);
+	rxd_close_peer(ep, peer);
+	rxd_drop_unexp_msgs(&ep->unexp_list, rxd_addr);
+	rxd_drop_unexp_msgs(&ep->unexp_tag_list, rxd_addr);
+	rxd_free_robuf(peer);
+	free(peer);
+}
+
 static int rxd_ep_close(struct fid *fid)
 {
 	int ret;
 	struct rxd_ep *ep;
+	struct rxd_peer *peer;
 	struct rxd_pkt_entry *pkt_entry;
 	struct slist_entry *entry;
-	struct rxd_peer *peer;
 
 	ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
 
-	dlist_foreach_container(&ep->active_peers, struct rxd_peer, peer, entry)
-		rxd_close_peer(ep, peer);
+	while (!dlist_empty(&ep->peer_list)) {
+		peer = container_of(ep->peer_list.next, struct rxd_peer,
+				    peer_entry);
+		rxd_free_peer(ep, peer->rxd_addr);
+	}
 
 	ret = fi_close(&ep->dg_ep->fid);
 	if (ret)
@@ -913,9 +1131,9 @@ static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
 	uint64_t current;
-	int ret, retry = 0;
+	int ret, timeout, retry = 0;
 
-	current = ofi_gettime_ms();
+	current = ofi_gettime_us();
 	if (peer->retry_cnt > RXD_MAX_PKT_RETRY) {
 		rxd_peer_timeout(ep, peer);
 		return;
@@ -923,20 +1141,32 @@ static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
 
 	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
 				pkt_entry, d_entry) {
+		if (pkt_entry->flags & RXD_PKT_SACKED)
+			continue;
 		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED) ||
-		    current < rxd_get_retry_time(pkt_entry->timestamp, peer->retry_cnt))
+		    current < rxd_get_retry_time(peer, pkt_entry->timestamp))
 			break;
 		retry = 1;
 		ret = rxd_ep_send_pkt(ep, pkt_entry);
 		if (ret)
 			break;
+		pkt_entry->flags |= RXD_PKT_RETRANS;
+		peer->retrans_cnt++;
 	}
-	if (retry)
+	if (retry) {
+		if (!peer->retry_cnt) {
+			peer->loss_start = current;
+			peer->loss_cnt++;
+			rxd_cc_loss(peer);
+		}
 		peer->retry_cnt++;
+	}
 
-	if (!dlist_empty(&peer->unacked))
-		ep->next_retry = ep->next_retry == -1 ? peer->retry_cnt :
-				 MIN(ep->next_retry, peer->retry_cnt);
+	if (!dlist_empty(&peer->unacked)) {
+		timeout = (int) ((rxd_get_rto(peer) + 999) / 1000);
+		ep->next_retry = ep->next_retry == -1 ? timeout :
+				 MIN(ep->next_retry, timeout);
+	}
 }
 
 void rxd_ep_progress(struct util_ep *util_ep)
@@ -984,6 +1214,10 @@ void rxd_ep_progress(struct util_ep *util_ep)
 			rxd_progress_tx_list(ep, peer);
 	}
 
+	/* unacknowledged packets need progress to be retransmitted */
+	if (!dlist_empty(&ep->active_peers) ||
+	    !dlist_empty(&ep->rts_sent_list))
+		ofi_ep_set_active(&ep->util_ep);
 out:
 	fastlock_release(&ep->util_ep.lock);
 }
@@ -1126,6 +1360,7 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	dlist_init(&ep->rx_list);
 	dlist_init(&ep->rx_tag_list);
 	dlist_init(&ep->active_peers);
+	dlist_init(&ep->peer_list);
 	dlist_init(&ep->rts_sent_list);
 	dlist_init(&ep->unexp_list);
 	dlist_init(&ep->unexp_tag_list);
@@ -1139,23 +1374,36 @@ err:
 	return ret;
 }
 
-static void rxd_init_peer(struct rxd_ep *ep, uint64_t rxd_addr)
+struct rxd_peer *rxd_create_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
 {
-	ep->peers[rxd_addr].peer_addr = FI_ADDR_UNSPEC;
-	ep->peers[rxd_addr].tx_seq_no = 0;
-	ep->peers[rxd_addr].rx_seq_no = 0;
-	ep->peers[rxd_addr].last_rx_ack = 0;
-	ep->peers[rxd_addr].last_tx_ack = 0;
-	ep->peers[rxd_addr].rx_window = rxd_env.max_unacked;
-	ep->peers[rxd_addr].tx_window = rxd_env.max_unacked;
-	ep->peers[rxd_addr].unacked_cnt = 0;
-	ep->peers[rxd_addr].retry_cnt = 0;
-	ep->peers[rxd_addr].active = 0;
-	dlist_init(&ep->peers[rxd_addr].unacked);
-	dlist_init(&ep->peers[rxd_addr].tx_list);
-	dlist_init(&ep->peers[rxd_addr].rx_list);
-	dlist_init(&ep->peers[rxd_addr].rma_rx_list);
-	dlist_init(&ep->peers[rxd_addr].buf_pkts);
+	struct rxd_peer *peer;
+
+	if (rxd_addr > OFI_IDX_MAX_INDEX)
+		return NULL;
+
+	peer = calloc(1, sizeof(*peer));
+	if (!peer)
+		return NULL;
+
+	if (ofi_idm_set(&ep->peers, (int) rxd_addr, peer) < 0) {
+		free(peer);
+		return NULL;
+	}
+
+	peer->rxd_addr = rxd_addr;
+	peer->peer_addr = FI_ADDR_UNSPEC;
+	peer->rx_window = rxd_env.max_unacked;
+	peer->tx_window = rxd_env.max_unacked;
+	peer->cwnd = rxd_env.max_unacked;
+	peer->rto = MIN(MAX(RXD_INIT_RTO, rxd_env.min_rto), rxd_env.max_rto);
+	dlist_init(&peer->entry);
+	dlist_init(&peer->unacked);
+	dlist_init(&peer->tx_list);
+	dlist_init(&peer->rx_list);
+	dlist_init(&peer->rma_rx_list);
+	dlist_insert_tail(&peer->peer_entry, &ep->peer_list);
+
+	return peer;
 }
 
 int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
@@ -1164,10 +1412,9 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	struct fi_info *dg_info;
 	struct rxd_domain *rxd_domain;
 	struct rxd_ep *rxd_ep;
-	int ret, i;
+	int ret;
 
-	rxd_ep = calloc(1, sizeof(*rxd_ep) + sizeof(struct rxd_peer) *
-			rxd_env.max_peers);
+	rxd_ep = calloc(1, sizeof(*rxd_ep));
 	if (!rxd_ep)
 		return -FI_ENOMEM;
 
@@ -1187,6 +1434,9 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 
 	memcpy(dg_info->src_addr, info->src_addr, info->src_addrlen);
 	rxd_ep->do_local_mr = ofi_mr_local(dg_info);
+	if (!rxd_ep->do_local_mr && dg_info->tx_attr->iov_limit > 1)
+		rxd_ep->tx_iov_limit = MIN(dg_info->tx_attr->iov_limit,
+					   RXD_IOV_LIMIT + 1);
 
 	ret = fi_endpoint(rxd_domain->dg_domain, dg_info, &rxd_ep->dg_ep, rxd_ep);
 	if (ret)
@@ -1205,13 +1455,11 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	fi_freeinfo(dg_info);
 
 	rxd_ep->next_retry = -1;
+	rxd_ep->loss_seed = (unsigned int) getpid();
 	ret = rxd_ep_init_res(rxd_ep, info);
 	if (ret)
 		goto err3;
 
-	for (i = 0; i < rxd_env.max_peers; rxd_init_peer(rxd_ep, i++))
-		;
-
 	rxd_ep->util_ep.ep_fid.fid.ops = &rxd_ep_fi_ops;
 	rxd_ep->util_ep.ep_fid.cm = &rxd_ep_cm;
 	rxd_ep->util_ep.ep_fid.ops = &rxd_ops_ep;
@@ -41,8 +41,12 @@
 struct rxd_env rxd_env = {
 	.spin_count	= 1000,
 	.retry		= 1,
-	.max_peers	= 1024,
+	.max_peers	= OFI_IDX_MAX_INDEX,
 	.max_unacked	= 128,
+	.min_rto	= 200,
+	.max_rto	= 4000000,
+	.loss		= 0,
+	.cc		= 1,
 };
 
 char *rxd_pkt_type_str[] = {
@@ -55,6 +59,19 @@ static void rxd_init_env(void)
 	fi_param_get_bool(&rxd_prov, "retry", &rxd_env.retry);
 	fi_param_get_int(&rxd_prov, "max_peers", &rxd_env.max_peers);
 	fi_param_get_int(&rxd_prov, "max_unacked", &rxd_env.max_unacked);
+	fi_param_get_int(&rxd_prov, "min_rto", &rxd_env.min_rto);
+	fi_param_get_int(&rxd_prov, "max_rto", &rxd_env.max_rto);
+	fi_param_get_int(&rxd_prov, "loss", &rxd_env.loss);
+	fi_param_get_bool(&rxd_prov, "cc", &rxd_env.cc);
+
+	if (rxd_env.max_peers <= 0 || rxd_env.max_peers > OFI_IDX_MAX_INDEX)
+		rxd_env.max_peers = OFI_IDX_MAX_INDEX;
+	if (rxd_env.min_rto <= 0)
+		rxd_env.min_rto = 1;
+	if (rxd_env.max_rto < rxd_env.min_rto)
+		rxd_env.max_rto = rxd_env.min_rto;
+	if (rxd_env.loss < 0)
+		rxd_env.loss = 0;
 }
 
 void rxd_info_to_core_mr_modes(uint32_t version, const struct fi_info *hints,
@@ -144,9 +161,21 @@ RXD_INI
 	fi_param_define(&rxd_prov, "retry", FI_PARAM_BOOL,
 			"Toggle packet retrying (default: yes)");
 	fi_param_define(&rxd_prov, "max_peers", FI_PARAM_INT,
-			"Maximum number of peers to track (default: 1024)");
+			"Maximum number of peers to track (default: 1048575)");
 	fi_param_define(&rxd_prov, "max_unacked", FI_PARAM_INT,
 			"Maximum number of packets to send at once (default: 128)");
+	fi_param_define(&rxd_prov, "min_rto", FI_PARAM_INT,
+			"Lower bound of the retransmission timeout, in "
+			"microseconds (default: 200)");
+	fi_param_define(&rxd_prov, "max_rto", FI_PARAM_INT,
+			"Upper bound of the retransmission timeout, in "
+			"microseconds (default: 4000000)");
+	fi_param_define(&rxd_prov, "loss", FI_PARAM_INT,
+			"Drop one in N received packets at random, to test "
+			"loss recovery (default: 0, disabled)");
+	fi_param_define(&rxd_prov, "cc", FI_PARAM_BOOL,
+			"Adapt the number of unacked packets per peer to "
+			"losses, up to max_unacked (default: yes)");
 
 	rxd_init_env();
 
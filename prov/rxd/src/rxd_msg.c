@@ -77,7 +77,7 @@ static void rxd_progress_unexp_msg(struct rxd_ep *ep, struct rxd_x_entry *rx_ent
 {
 	struct rxd_pkt_entry *pkt_entry;
 	uint64_t num_segs = 0;
-	uint16_t curr_id = ep->peers[unexp_msg->base_hdr->peer].curr_rx_id;
+	uint16_t curr_id = rxd_peer(ep, unexp_msg->base_hdr->peer)->curr_rx_id;
 
 	rxd_progress_op(ep, rx_entry, unexp_msg->pkt_entry, unexp_msg->base_hdr,
 			unexp_msg->sar_hdr, unexp_msg->tag_hdr,
@@ -93,11 +93,11 @@ static void rxd_progress_unexp_msg(struct rxd_ep *ep, struct rxd_x_entry *rx_ent
 		num_segs++;
 	}
 
-	if (ep->peers[unexp_msg->base_hdr->peer].curr_unexp) {
+	if (rxd_peer(ep, unexp_msg->base_hdr->peer)->curr_unexp) {
 		if (!unexp_msg->sar_hdr || num_segs == unexp_msg->sar_hdr->num_segs - 1)
-			ep->peers[unexp_msg->base_hdr->peer].curr_rx_id = curr_id;
+			rxd_peer(ep, unexp_msg->base_hdr->peer)->curr_rx_id = curr_id;
 		else
-			ep->peers[unexp_msg->base_hdr->peer].curr_unexp = NULL;
+			rxd_peer(ep, unexp_msg->base_hdr->peer)->curr_unexp = NULL;
 	}
 
 	rxd_free_unexp_msg(unexp_msg);
@@ -137,23 +137,26 @@ static int rxd_progress_unexp_list(struct rxd_ep *ep,
 static int rxd_ep_discard_recv(struct rxd_ep *rxd_ep, void *context,
 			       struct rxd_unexp_msg *unexp_msg)
 {
+	fi_addr_t peer = unexp_msg->base_hdr->peer;
 	uint64_t seq = unexp_msg->base_hdr->seq_no;
 	int ret;
 
 	assert(unexp_msg->tag_hdr);
 	seq += unexp_msg->sar_hdr ? unexp_msg->sar_hdr->num_segs : 1;
 
-	rxd_ep->peers[unexp_msg->base_hdr->peer].rx_seq_no =
-			MAX(seq, rxd_ep->peers[unexp_msg->base_hdr->peer].rx_seq_no);
-	rxd_ep_send_ack(rxd_ep, unexp_msg->base_hdr->peer);
-
 	ret = ofi_cq_write(rxd_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
 			   0, NULL, unexp_msg->data_hdr ?
 			   unexp_msg->data_hdr->cq_data : 0,
 			   unexp_msg->tag_hdr->tag);
 
+	if (rxd_peer(rxd_ep, peer)->curr_unexp == unexp_msg)
+		rxd_peer(rxd_ep, peer)->curr_unexp = NULL;
 	rxd_cleanup_unexp_msg(unexp_msg);
 
+	/* drop any segments of the message that are still to come */
+	rxd_ep_skip_rx(rxd_ep, peer, seq);
+	rxd_ep_send_ack(rxd_ep, peer);
+
 	return ret;
 }
 
@@ -371,7 +374,7 @@ ssize_t rxd_ep_generic_inject(struct rxd_ep *rxd_ep, const struct iovec *iov,
 		goto out;
 	}
 
-	if (rxd_ep->peers[rxd_addr].peer_addr != FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr != FI_ADDR_UNSPEC)
 		(void) rxd_start_xfer(rxd_ep, tx_entry);
 
 out:
@@ -409,7 +412,7 @@ ssize_t rxd_ep_generic_sendmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
 	if (!tx_entry)
 		goto out;
 
-	if (rxd_ep->peers[rxd_addr].peer_addr == FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr == FI_ADDR_UNSPEC)
 		goto out;
 
 	ret = rxd_start_xfer(rxd_ep, tx_entry);
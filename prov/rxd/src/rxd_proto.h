@@ -118,13 +118,18 @@ struct rxd_cts_pkt {
 	uint64_t		cts_addr;
 };
 
+#define RXD_SACK_BITS		128
+
 /*
  * ACK: to signal received packets and send tx/rx id info
+ * 	- base_hdr.seq_no: next sequence number expected in order
+ * 	- sack: selective ack, bit i is set if packet seq_no + 1 + i has
+ * 		been received out of order
  */
 struct rxd_ack_pkt {
 	struct rxd_base_hdr	base_hdr;
 	struct rxd_ext_hdr	ext_hdr;
-	//TODO fill in more fields? Selective ack?
+	uint64_t		sack[RXD_SACK_BITS / 64];
 };
 
 /*
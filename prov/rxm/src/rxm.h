@@ -53,6 +53,7 @@
 #include <ofi_list.h>
 #include <ofi_proto.h>
 #include <ofi_iov.h>
+#include <ofi_atomic.h>
 
 #ifndef _RXM_H_
 #define _RXM_H_
@@ -278,6 +279,7 @@ struct rxm_domain {
 	struct util_domain util_domain;
 	struct fid_domain *msg_domain;
 	size_t max_atomic_size;
+	ofi_atomic_write_table atomic_write;
 	uint64_t mr_key;
 	uint8_t mr_local;
 };
@@ -800,6 +802,7 @@ rxm_ep_enqueue_deferred_tx_queue(struct rxm_deferred_tx_entry *tx_entry)
 		dlist_insert_tail(&tx_entry->rxm_conn->deferred_conn_entry,
 				  &tx_entry->rxm_ep->deferred_tx_conn_queue);
 	dlist_insert_tail(&tx_entry->entry, &tx_entry->rxm_conn->deferred_tx_queue);
+	ofi_ep_set_active(&tx_entry->rxm_ep->util_ep);
 }
 
 static inline void
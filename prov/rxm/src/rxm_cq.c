@@ -136,6 +136,13 @@ static int rxm_cq_write_error_trunc(struct rxm_rx_buf *rx_buf, size_t done_len)
 	return 0;
 }
 
+/* Collective transfers complete to util_coll rather than to the user CQ */
+static inline int rxm_is_coll_xfer(struct rxm_ep *rxm_ep, struct ofi_op_hdr *hdr)
+{
+	return (rxm_ep->rxm_info->caps & FI_COLLECTIVE) &&
+	       hdr->op == ofi_op_tagged && (hdr->tag & OFI_COLL_TAG_FLAG);
+}
+
 static int rxm_finish_recv(struct rxm_rx_buf *rx_buf, size_t done_len)
 {
 	struct rxm_recv_entry *recv_entry = rx_buf->recv_entry;
@@ -147,6 +154,12 @@ static int rxm_finish_recv(struct rxm_rx_buf *rx_buf, size_t done_len)
 		goto release;
 	}
 
+	if (rxm_is_coll_xfer(rx_buf->ep, &rx_buf->pkt.hdr)) {
+		ofi_coll_handle_xfer_comp(rx_buf->pkt.hdr.tag,
+					  recv_entry->context);
+		goto release;
+	}
+
 	if (rx_buf->recv_entry->flags & FI_COMPLETION ||
 	    rx_buf->ep->rxm_info->mode & FI_BUFFERED_RECV) {
 		ret = rxm_cq_write_recv_comp(rx_buf, rx_buf->recv_entry->context,
@@ -251,11 +264,17 @@ static inline int rxm_finish_sar_segment_send(struct rxm_ep *rxm_ep, struct rxm_
 		ofi_buf_free(tx_buf);
 		break;
 	case RXM_SAR_SEG_LAST:
-		ret = rxm_cq_tx_comp_write(rxm_ep, ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
-					   tx_buf->app_context, tx_buf->flags);
+		if (rxm_is_coll_xfer(rxm_ep, &tx_buf->pkt.hdr)) {
+			ofi_coll_handle_xfer_comp(tx_buf->pkt.hdr.tag,
+						  tx_buf->app_context);
+		} else {
+			ret = rxm_cq_tx_comp_write(rxm_ep,
+					ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
+					tx_buf->app_context, tx_buf->flags);
 
-		assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
-		ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
+			assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
+			ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
+		}
 		first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->
 					buf_pools[RXM_BUF_POOL_TX_SAR].pool,
 					tx_buf->pkt.ctrl_hdr.msg_id);
@@ -291,11 +310,18 @@ static int rxm_rndv_tx_finish(struct rxm_ep *rxm_ep, struct rxm_tx_rndv_buf *tx_
 	if (!rxm_ep->rdm_mr_local)
 		rxm_msg_mr_closev(tx_buf->mr, tx_buf->count);
 
-	ret = rxm_cq_tx_comp_write(rxm_ep, ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
-				   tx_buf->app_context, tx_buf->flags);
+	if (rxm_is_coll_xfer(rxm_ep, &tx_buf->pkt.hdr)) {
+		ofi_coll_handle_xfer_comp(tx_buf->pkt.hdr.tag,
+					  tx_buf->app_context);
+		ret = FI_SUCCESS;
+	} else {
+		ret = rxm_cq_tx_comp_write(rxm_ep,
+					   ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
+					   tx_buf->app_context, tx_buf->flags);
 
-	assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
-	ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
+		assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
+		ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
+	}
 
 	ofi_buf_free(tx_buf);
 
@@ -874,13 +900,14 @@ static ssize_t rxm_atomic_send_resp(struct rxm_ep *rxm_ep,
 	return ret;
 }
 
-static inline void rxm_do_atomic(struct rxm_pkt *pkt, void *dst, void *src,
+static inline void rxm_do_atomic(struct rxm_domain *domain,
+				 struct rxm_pkt *pkt, void *dst, void *src,
 				 void *cmp, void *res, size_t count,
 				 enum fi_datatype datatype, enum fi_op op)
 {
 	switch (pkt->hdr.op) {
 	case ofi_op_atomic:
-		ofi_atomic_write_handlers[op][datatype](dst, src, count);
+		domain->atomic_write[op][datatype](dst, src, count);
 		break;
 	case ofi_op_atomic_fetch:
 		ofi_atomic_readwrite_handlers[op][datatype](dst, src, res,
@@ -958,7 +985,7 @@ static inline ssize_t rxm_handle_atomic_req(struct rxm_ep *rxm_ep,
 	resp_hdr = (struct rxm_atomic_resp_hdr *) resp_buf->pkt.data;
 
 	for (i = 0, offset = 0; i < rx_buf->pkt.hdr.atomic.ioc_count; i++) {
-		rxm_do_atomic(&rx_buf->pkt,
+		rxm_do_atomic(domain, &rx_buf->pkt,
 			      (uintptr_t *) req_hdr->rma_ioc[i].addr,
 			      req_hdr->data + offset,
 			      req_hdr->data + len + offset,
@@ -1401,6 +1428,11 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 					     deferred_conn_entry, conn_entry_tmp)
 			rxm_ep_progress_deferred_queue(rxm_ep, rxm_conn);
 	}
+
+	/* msg_cq completions may only advance protocol state, such as
+	 * rendezvous or SAR transfers, without writing to the rxm CQ */
+	if (comp_read || !dlist_empty(&rxm_ep->deferred_tx_conn_queue))
+		ofi_ep_set_active(util_ep);
 }
 
 void rxm_ep_progress(struct util_ep *util_ep)
@@ -1417,6 +1449,8 @@ void rxm_ep_progress_coll(struct util_ep *util_ep)
 	ofi_ep_lock_release(util_ep);
 
 	ofi_coll_ep_progress(&util_ep->ep_fid);
+	if (!slist_empty(&util_ep->coll_ready_queue))
+		ofi_ep_set_active(util_ep);
 }
 
 static int rxm_cq_close(struct fid *fid)
@@ -2137,13 +2137,13 @@ static struct fi_ops_collective rxm_ops_collective = {
 	.size = sizeof(struct fi_ops_collective),
 	.barrier = ofi_ep_barrier,
 	.broadcast = ofi_ep_broadcast,
-	.alltoall = fi_coll_no_alltoall,
+	.alltoall = ofi_ep_alltoall,
 	.allreduce = ofi_ep_allreduce,
 	.allgather = ofi_ep_allgather,
-	.reduce_scatter = fi_coll_no_reduce_scatter,
-	.reduce = fi_coll_no_reduce,
+	.reduce_scatter = ofi_ep_reduce_scatter,
+	.reduce = ofi_ep_reduce,
 	.scatter = ofi_ep_scatter,
-	.gather = fi_coll_no_gather,
+	.gather = ofi_ep_gather,
 	.msg = fi_coll_no_msg,
 };
 
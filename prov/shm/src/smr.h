@@ -159,6 +159,7 @@ struct smr_domain {
 	int			dom_idx;
 	int			ep_idx;
 	int			fast_rma;
+	ofi_atomic_write_table	atomic_write;
 };
 
 #define SMR_PREFIX	"fi_shm://"
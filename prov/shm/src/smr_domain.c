@@ -105,6 +105,8 @@ int smr_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	smr_domain->fast_rma = smr_fast_rma_enabled(info->domain_attr->mr_mode,
 						    info->tx_attr->msg_order);
 	fastlock_release(&smr_fabric->util_fabric.lock);
+	smr_domain->atomic_write =
+		ofi_atomic_write_select(&smr_domain->util_domain);
 
 	*domain = &smr_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &smr_domain_fi_ops;
@@ -641,6 +641,9 @@ void tcpx_ep_progress(struct tcpx_ep *ep)
 	}
 
 	tcpx_process_rx_msg(ep);
+
+	if (!slist_empty(&ep->tx_queue))
+		ofi_ep_set_active(&ep->util_ep);
 }
 
 void tcpx_progress(struct util_ep *util_ep)
@@ -702,4 +705,7 @@ void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 		if (!slist_empty(&tcpx_ep->tx_queue) && wait)
 			wait->signal(wait);
 	}
+
+	if (!slist_empty(&tcpx_ep->tx_queue))
+		ofi_ep_set_active(&tcpx_ep->util_ep);
 }
@@ -32,6 +32,12 @@ AC_DEFUN([FI_UDP_CONFIGURE],[
 				[],
 				[udp_shm_happy=1],
 				[udp_shm_happy=0])])
+
+	       # batched datagram I/O is optional
+	       AC_CHECK_FUNCS([sendmmsg recvmmsg])
+
+	       # memory mapped receive ring is optional
+	       AC_CHECK_HEADERS([linux/if_packet.h linux/filter.h])
 	      ])
 
 	AS_IF([test $udp_h_happy -eq 1 && \
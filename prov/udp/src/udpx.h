@@ -41,6 +41,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/udp.h>
 
 #include <rdma/fabric.h>
 #include <rdma/fi_atomic.h>
@@ -72,6 +73,15 @@ extern struct fi_provider udpx_prov;
 extern struct util_prov udpx_util_prov;
 extern struct fi_info udpx_info;
 
+struct udpx_env {
+	int	tx_batch;
+	int	gso;
+	int	gro;
+	int	rx_ring;
+};
+
+extern struct udpx_env udpx_env;
+
 
 int udpx_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
 		void *context);
@@ -83,6 +93,12 @@ int udpx_eq_open(struct fid_fabric *fabric, struct fi_eq_attr *attr,
 
 #define UDPX_FLAG_MULTI_RECV	1
 #define UDPX_IOV_LIMIT		4
+#define UDPX_BATCH_SIZE		32
+
+/* Segmentation offload limits: kernel segment count and UDP/IPv4 payload */
+#define UDPX_GSO_MAX_SEGS	64
+#define UDPX_GSO_MAX_SIZE	65507
+#define UDPX_GRO_BUF_SIZE	65536
 
 struct udpx_ep_entry {
 	void			*context;
@@ -94,6 +110,38 @@ struct udpx_ep_entry {
 
 OFI_DECLARE_CIRQUE(struct udpx_ep_entry, udpx_rx_cirq);
 
+/*
+ * Sends posted with FI_MORE, or all sends if udpx_env.tx_batch is set,
+ * are queued and transmitted together by udpx_ep_flush_tx().
+ */
+struct udpx_tx_entry {
+	void			*context;
+	struct iovec		iov[UDPX_IOV_LIMIT];
+	uint8_t			iov_count;
+	socklen_t		addrlen;
+	struct sockaddr_in6	addr;
+};
+
+OFI_DECLARE_CIRQUE(struct udpx_tx_entry, udpx_tx_cirq);
+
+/*
+ * Memory mapped receive ring.  The kernel copies datagrams addressed to
+ * the endpoint into frames shared with a packet socket, which are then
+ * consumed without a system call per datagram.
+ */
+struct udpx_ring {
+	int			fd;
+	char			*buf;
+	size_t			frame_size;
+	size_t			frame_cnt;
+	size_t			pos;
+	void			*frame;	/* frame held by the segment cursor */
+	size_t			seg_max;
+	/* progress calls left before the socket is polled again */
+	unsigned int		sock_wait;
+	unsigned int		sock_backoff;
+};
+
 struct udpx_ep;
 typedef void (*udpx_rx_comp_func)(struct udpx_ep *ep, void *context,
 		uint64_t flags, size_t len, void *buf, void *addr);
@@ -104,14 +152,31 @@ struct udpx_ep {
 	udpx_rx_comp_func	rx_comp;
 	udpx_tx_comp_func	tx_comp;
 	struct udpx_rx_cirq	*rxq;    /* protected by rx_cq lock */
+	struct udpx_tx_cirq	*txq;    /* protected by tx_cq lock */
 	SOCKET			sock;
 	int			is_bound;
+	int			gso;
+
+	/* coalesced datagram being split into posted receives */
+	char			*seg_buf;
+	size_t			seg_len;
+	size_t			seg_off;
+	size_t			seg_size;
+	struct sockaddr_in6	seg_addr;
+	char			*gro_buf;
+	struct udpx_ring	ring;
 	ofi_atomic32_t		ref;
 };
 
 int udpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 		  struct fid_ep **ep, void *context);
 
+int udpx_ring_open(struct udpx_ep *ep);
+void udpx_ring_close(struct udpx_ep *ep);
+ssize_t udpx_ring_read(struct udpx_ep *ep);
+int udpx_ring_poll_sock(struct udpx_ring *ring);
+void udpx_ring_sock_polled(struct udpx_ring *ring, int found);
+
 
 int udpx_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 		 struct fid_cq **cq, void *context);
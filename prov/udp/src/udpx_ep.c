@@ -34,6 +34,7 @@
 #include <string.h>
 
 #include "udpx.h"
+#include <ofi_iov.h>
 
 
 static int udpx_setname(fid_t fid, void *addr, size_t addrlen)
@@ -256,39 +257,442 @@ static void udpx_rx_src_comp(struct udpx_ep *ep, void *context, uint64_t flags,
 	udpx_rx_comp(ep, context, flags, len, buf, addr);
 }
 
-static void udpx_rx_comp_signal(struct udpx_ep *ep, void *context,
-			uint64_t flags, size_t len, void *buf, void *addr)
+static void udpx_ep_signal(struct util_cq *cq)
 {
-	udpx_rx_comp(ep, context, flags, len, buf, addr);
-	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
+	if (cq->wait)
+		cq->wait->signal(cq->wait);
+}
+
+static void udpx_ep_tx_error(struct udpx_ep *ep, void *context, ssize_t err)
+{
+	struct fi_cq_err_entry err_entry = {
+		.op_context = context,
+		.flags = FI_SEND,
+		.err = (int) -err,
+		.prov_errno = (int) -err,
+	};
+
+	FI_WARN(&udpx_prov, FI_LOG_EP_DATA, "send failed %zd (%s)\n",
+		err, fi_strerror((int) -err));
+	if (ofi_cq_write_error(ep->util_ep.tx_cq, &err_entry))
+		FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+			"unable to write error completion\n");
+}
+
+#if HAVE_SENDMMSG
+#define udpx_mmsghdr mmsghdr
+#else
+struct udpx_mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+#endif
+
+static int udpx_sendmmsg(SOCKET sock, struct udpx_mmsghdr *msgvec,
+			 unsigned int vlen)
+{
+#if HAVE_SENDMMSG
+	return sendmmsg(sock, msgvec, vlen, 0);
+#else
+	ssize_t ret;
+
+	ret = ofi_sendmsg_udp(sock, &msgvec[0].msg_hdr, 0);
+	if (ret < 0)
+		return -1;
+	msgvec[0].msg_len = (unsigned int) ret;
+	return 1;
+#endif
+}
+
+union udpx_gso_ctrl {
+	struct cmsghdr	align;
+	char		buf[CMSG_SPACE(sizeof(uint16_t))];
+};
+
+#ifdef UDP_SEGMENT
+static void udpx_set_gso_ctrl(struct msghdr *hdr, union udpx_gso_ctrl *ctrl,
+			      uint16_t seg)
+{
+	struct cmsghdr *cmsg;
+
+	memset(ctrl, 0, sizeof(*ctrl));
+	hdr->msg_control = ctrl->buf;
+	hdr->msg_controllen = sizeof(ctrl->buf);
+	cmsg = CMSG_FIRSTHDR(hdr);
+	cmsg->cmsg_level = IPPROTO_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(seg));
+	memcpy(CMSG_DATA(cmsg), &seg, sizeof(seg));
+}
+
+/* Errors returned when the route or device cannot segment the datagram */
+static int udpx_gso_error(ssize_t err)
+{
+	return err == -EIO || err == -EINVAL || err == -ENOPROTOOPT ||
+	       err == -EOPNOTSUPP;
+}
+
+static int udpx_gso_supported(SOCKET sock)
+{
+	socklen_t len = sizeof(int);
+	int val;
+
+	return !getsockopt(sock, IPPROTO_UDP, UDP_SEGMENT, (void *) &val,
+			   &len);
+}
+#else
+static void udpx_set_gso_ctrl(struct msghdr *hdr, union udpx_gso_ctrl *ctrl,
+			      uint16_t seg)
+{
+	assert(0);
+}
+
+static int udpx_gso_error(ssize_t err)
+{
+	return 0;
 }
 
-static void udpx_rx_src_comp_signal(struct udpx_ep *ep, void *context,
-			uint64_t flags, size_t len, void *buf, void *addr)
+static int udpx_gso_supported(SOCKET sock)
 {
-	udpx_rx_src_comp(ep, context, flags, len, buf, addr);
-	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
+	return 0;
+}
+#endif
+
+static struct udpx_tx_entry *udpx_ep_tx_entry(struct udpx_ep *ep, size_t pos)
+{
+	return &ep->txq->buf[(ep->txq->rcnt + pos) & ep->txq->size_mask];
 }
 
+/*
+ * Describe the queued send at position pos with hdr.  With GSO, the sends
+ * that follow to the same address are appended as segments of a single
+ * datagram, provided all but the last one match the size of the first.
+ * The kernel splits the datagram back into one packet per send.  Returns
+ * the number of queued sends covered by hdr.
+ */
+static size_t udpx_ep_tx_msg(struct udpx_ep *ep, size_t pos, size_t max,
+			     struct msghdr *hdr, struct iovec *iov,
+			     union udpx_gso_ctrl *ctrl)
+{
+	struct udpx_tx_entry *entry, *next;
+	size_t cnt, iov_cnt, seg, len, size;
+
+	entry = udpx_ep_tx_entry(ep, pos);
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->msg_name = &entry->addr;
+	hdr->msg_namelen = entry->addrlen;
+	hdr->msg_iov = entry->iov;
+	hdr->msg_iovlen = entry->iov_count;
+	if (!ep->gso)
+		return 1;
+
+	seg = len = ofi_total_iov_len(entry->iov, entry->iov_count);
+	memcpy(iov, entry->iov, entry->iov_count * sizeof(*iov));
+	iov_cnt = entry->iov_count;
+
+	for (cnt = 1; seg && cnt < max && cnt < UDPX_GSO_MAX_SEGS; ) {
+		next = udpx_ep_tx_entry(ep, pos + cnt);
+		size = ofi_total_iov_len(next->iov, next->iov_count);
+		if (next->addrlen != entry->addrlen ||
+		    memcmp(&next->addr, &entry->addr, entry->addrlen) ||
+		    !size || size > seg || len + size > UDPX_GSO_MAX_SIZE)
+			break;
+
+		memcpy(&iov[iov_cnt], next->iov,
+		       next->iov_count * sizeof(*iov));
+		iov_cnt += next->iov_count;
+		len += size;
+		cnt++;
+		if (size < seg)
+			break;
+	}
+
+	if (cnt > 1) {
+		udpx_set_gso_ctrl(hdr, ctrl, (uint16_t) seg);
+		hdr->msg_iov = iov;
+		hdr->msg_iovlen = iov_cnt;
+	}
+	return cnt;
+}
+
+/*
+ * Transmit queued sends, as many per system call as possible.  Entries
+ * stay queued while the socket is busy.  On any other error the failed
+ * entry is removed, and its context is returned so that the caller can
+ * report the error once the tx CQ lock has been released.
+ */
+static ssize_t udpx_ep_flush_tx(struct udpx_ep *ep, void **err_context)
+{
+	struct udpx_mmsghdr mmsg[UDPX_BATCH_SIZE];
+	struct iovec iov[UDPX_BATCH_SIZE * UDPX_IOV_LIMIT];
+	union udpx_gso_ctrl ctrl[UDPX_BATCH_SIZE];
+	size_t segs[UDPX_BATCH_SIZE];
+	size_t i, j, cnt, pos, done = 0;
+	unsigned int msgs;
+	ssize_t ret = 0;
+
+	while (!ofi_cirque_isempty(ep->txq)) {
+		cnt = MIN(ofi_cirque_usedcnt(ep->txq),
+			  ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq));
+		cnt = MIN(cnt, UDPX_BATCH_SIZE);
+		if (!cnt)
+			break;
+
+		for (pos = 0, msgs = 0; pos < cnt; msgs++) {
+			segs[msgs] = udpx_ep_tx_msg(ep, pos, cnt - pos,
+						    &mmsg[msgs].msg_hdr,
+						    &iov[pos * UDPX_IOV_LIMIT],
+						    &ctrl[msgs]);
+			pos += segs[msgs];
+		}
+
+		ret = udpx_sendmmsg(ep->sock, mmsg, msgs);
+		if (ret < 0) {
+			ret = -ofi_sockerr();
+			if (ret == -FI_EAGAIN || ret == -ENOBUFS) {
+				ret = 0;
+				break;
+			}
+
+			if (segs[0] > 1 && udpx_gso_error(ret)) {
+				FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+					"GSO send failed %zd (%s), disabling\n",
+					ret, fi_strerror((int) -ret));
+				ep->gso = 0;
+				continue;
+			}
+
+			*err_context = ofi_cirque_head(ep->txq)->context;
+			ofi_cirque_discard(ep->txq);
+			break;
+		}
+
+		for (i = 0; i < (size_t) ret; i++) {
+			for (j = 0; j < segs[i]; j++) {
+				udpx_tx_comp(ep,
+					ofi_cirque_head(ep->txq)->context);
+				ofi_cirque_discard(ep->txq);
+			}
+			done += segs[i];
+		}
+		ret = 0;
+	}
+
+	if (done)
+		udpx_ep_signal(ep->util_ep.tx_cq);
+	return ret;
+}
+
+#if HAVE_RECVMMSG
+static int udpx_ep_recv_batch(struct udpx_ep *ep, size_t cnt)
+{
+	struct mmsghdr mmsg[UDPX_BATCH_SIZE];
+	struct sockaddr_in6 addr[UDPX_BATCH_SIZE];
+	struct udpx_ep_entry *entry;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) & ep->rxq->size_mask];
+		memset(&mmsg[i].msg_hdr, 0, sizeof(mmsg[i].msg_hdr));
+		mmsg[i].msg_hdr.msg_name = &addr[i];
+		mmsg[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		mmsg[i].msg_hdr.msg_iov = entry->iov;
+		mmsg[i].msg_hdr.msg_iovlen = entry->iov_count;
+	}
+
+	ret = recvmmsg(ep->sock, mmsg, (unsigned int) cnt, 0, NULL);
+	for (i = 0; ret > 0 && i < (size_t) ret; i++) {
+		entry = ofi_cirque_head(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0, mmsg[i].msg_len,
+			    NULL, &addr[i]);
+		ofi_cirque_discard(ep->rxq);
+	}
+	return ret;
+}
+#endif
+
+#ifdef UDP_GRO
+static int udpx_gro_set(SOCKET sock, int val)
+{
+	return setsockopt(sock, IPPROTO_UDP, UDP_GRO, (void *) &val,
+			  sizeof(val));
+}
+
+#define udpx_gro_enable(sock)	udpx_gro_set(sock, 1)
+#define udpx_gro_disable(sock)	udpx_gro_set(sock, 0)
+
+/* Read the next, possibly coalesced, datagram into the GRO buffer */
+static ssize_t udpx_ep_read_gro(struct udpx_ep *ep)
+{
+	union {
+		struct cmsghdr	align;
+		char		buf[CMSG_SPACE(sizeof(int))];
+	} ctrl;
+	struct cmsghdr *cmsg;
+	struct msghdr hdr;
+	struct iovec iov;
+	ssize_t ret;
+	int seg;
+
+	iov.iov_base = ep->gro_buf;
+	iov.iov_len = UDPX_GRO_BUF_SIZE;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_name = &ep->seg_addr;
+	hdr.msg_namelen = sizeof(ep->seg_addr);
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = ctrl.buf;
+	hdr.msg_controllen = sizeof(ctrl.buf);
+
+	ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
+	if (ret < 0)
+		return ret;
+
+	ep->seg_buf = ep->gro_buf;
+	ep->seg_len = ret;
+	ep->seg_off = 0;
+	ep->seg_size = ret;
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+		if (cmsg->cmsg_level == IPPROTO_UDP &&
+		    cmsg->cmsg_type == UDP_GRO) {
+			memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+			if (seg > 0)
+				ep->seg_size = seg;
+		}
+	}
+	return ret;
+}
+#else
+#define udpx_gro_enable(sock)	(-1)
+#define udpx_gro_disable(sock)	(-1)
+
+static ssize_t udpx_ep_read_gro(struct udpx_ep *ep)
+{
+	return -1;
+}
+#endif
+
+/*
+ * Each segment of a coalesced datagram, read from the GRO buffer or the
+ * receive ring, completes one posted receive.  Segments without a posted
+ * receive stay under the cursor until the next progress call.
+ */
+static size_t udpx_ep_recv_segs(struct udpx_ep *ep, size_t cnt,
+				ssize_t (*read_seg)(struct udpx_ep *ep))
+{
+	struct udpx_ep_entry *entry;
+	size_t seg, len, done;
+
+	for (done = 0; done < cnt; done++) {
+		if (!ep->seg_buf && read_seg(ep) < 0)
+			break;
+
+		entry = ofi_cirque_head(ep->rxq);
+		seg = MIN(ep->seg_size, ep->seg_len - ep->seg_off);
+		len = ofi_copy_to_iov(entry->iov, entry->iov_count, 0,
+				      ep->seg_buf + ep->seg_off, seg);
+		ep->rx_comp(ep, entry->context, 0, len, NULL, &ep->seg_addr);
+		ofi_cirque_discard(ep->rxq);
+
+		ep->seg_off += seg;
+		if (ep->seg_off >= ep->seg_len)
+			ep->seg_buf = NULL;
+	}
+
+	if (done)
+		udpx_ep_signal(ep->util_ep.rx_cq);
+	return done;
+}
+
+/*
+ * A batch stops at a receive whose buffer is already used by an earlier
+ * receive in the batch, so that an application reposting its buffers sees
+ * each datagram before a later one overwrites it.
+ */
+static size_t udpx_ep_rx_batch_cnt(struct udpx_ep *ep, size_t cnt)
+{
+	struct udpx_ep_entry *entry, *prev;
+	size_t i, j;
+
+	for (i = 1; i < cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) & ep->rxq->size_mask];
+		if (!entry->iov_count)
+			continue;
+
+		for (j = 0; j < i; j++) {
+			prev = &ep->rxq->buf[(ep->rxq->rcnt + j) &
+					     ep->rxq->size_mask];
+			if (prev->iov_count &&
+			    entry->iov[0].iov_base == prev->iov[0].iov_base)
+				return i;
+		}
+	}
+	return i;
+}
+
+/*
+ * Receives are limited by the number of posted buffers and the space left
+ * in the CQ.  With recvmmsg, up to UDPX_BATCH_SIZE datagrams are received
+ * per call, and waiters are signaled once for the whole batch.
+ */
 static void udpx_ep_progress(struct util_ep *util_ep)
 {
 	struct udpx_ep *ep;
 	struct udpx_ep_entry *entry;
 	struct msghdr hdr;
 	struct sockaddr_in6 addr;
+	void *err_context;
+	size_t cnt;
 	ssize_t ret;
 
 	ep = container_of(util_ep, struct udpx_ep, util_ep);
+	if (!ofi_cirque_isempty(ep->txq)) {
+		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+		ret = udpx_ep_flush_tx(ep, &err_context);
+		fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+		if (ret)
+			udpx_ep_tx_error(ep, err_context, ret);
+	}
+
+	if (!ep->util_ep.rx_cq)
+		return;
+
+	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq),
+		  ofi_cirque_freecnt(ep->util_ep.rx_cq->cirq));
+	if (!cnt)
+		goto out;
+
+	cnt = udpx_ep_rx_batch_cnt(ep, MIN(cnt, UDPX_BATCH_SIZE));
+
+	if (ep->gro_buf) {
+		udpx_ep_recv_segs(ep, cnt, udpx_ep_read_gro);
+		goto out;
+	}
+
+	/* The socket only receives datagrams that the ring cannot */
+	if (ep->ring.buf && (udpx_ep_recv_segs(ep, cnt, udpx_ring_read) ||
+			     !udpx_ring_poll_sock(&ep->ring)))
+		goto out;
+
+#if HAVE_RECVMMSG
+	if (cnt > 1) {
+		ret = udpx_ep_recv_batch(ep, cnt);
+		if (ret > 0)
+			udpx_ep_signal(ep->util_ep.rx_cq);
+		if (ep->ring.buf)
+			udpx_ring_sock_polled(&ep->ring, ret >= 0);
+		goto out;
+	}
+#endif
+
 	hdr.msg_name = &addr;
 	hdr.msg_namelen = sizeof(addr);
 	hdr.msg_control = NULL;
 	hdr.msg_controllen = 0;
 	hdr.msg_flags = 0;
 
-	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
-	if (ofi_cirque_isempty(ep->rxq))
-		goto out;
-
 	entry = ofi_cirque_head(ep->rxq);
 	hdr.msg_iov = entry->iov;
 	hdr.msg_iovlen = entry->iov_count;
@@ -297,7 +701,10 @@ static void udpx_ep_progress(struct util_ep *util_ep)
 	if (ret >= 0) {
 		ep->rx_comp(ep, entry->context, 0, ret, NULL, &addr);
 		ofi_cirque_discard(ep->rxq);
+		udpx_ep_signal(ep->util_ep.rx_cq);
 	}
+	if (ep->ring.buf)
+		udpx_ring_sock_polled(&ep->ring, ret >= 0);
 out:
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
 }
@@ -387,17 +794,72 @@ udpx_dest_addrlen(struct udpx_ep *ep, fi_addr_t addr, uint64_t flags)
 		ep->util_ep.av->addrlen;
 }
 
+static int udpx_ep_tx_queued(struct udpx_ep *ep, uint64_t flags)
+{
+	return (flags & FI_MORE) || udpx_env.tx_batch ||
+	       !ofi_cirque_isempty(ep->txq);
+}
+
+/*
+ * Caller holds the tx CQ lock and has verified that the CQ has space for
+ * all queued sends plus this one.  The queue is flushed when it fills, or
+ * by a send that is not part of a batch.  A flush error is returned
+ * through err and err_context, separate from the status of this send.
+ */
+static ssize_t
+udpx_ep_queue_tx(struct udpx_ep *ep, const struct iovec *iov, size_t count,
+		 const void *addr, size_t addrlen, void *context,
+		 uint64_t flags, void **err_context, ssize_t *err)
+{
+	struct udpx_tx_entry *entry;
+
+	if (ofi_cirque_isfull(ep->txq)) {
+		*err = udpx_ep_flush_tx(ep, err_context);
+		if (ofi_cirque_isfull(ep->txq) || *err)
+			return -FI_EAGAIN;
+	}
+
+	entry = ofi_cirque_tail(ep->txq);
+	entry->context = context;
+	for (entry->iov_count = 0; entry->iov_count < count;
+	     entry->iov_count++)
+		entry->iov[entry->iov_count] = iov[entry->iov_count];
+	entry->addrlen = (socklen_t) addrlen;
+	memcpy(&entry->addr, addr, addrlen);
+	ofi_cirque_commit(ep->txq);
+
+	if ((!(flags & FI_MORE) && !udpx_env.tx_batch) ||
+	    ofi_cirque_isfull(ep->txq))
+		*err = udpx_ep_flush_tx(ep, err_context);
+
+	if (!ofi_cirque_isempty(ep->txq))
+		ofi_ep_set_active(&ep->util_ep);
+	return 0;
+}
+
 static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
-			   const void *addr, size_t addrlen, void *context)
+			   const void *addr, size_t addrlen, void *context,
+			   uint64_t flags)
 {
-	ssize_t ret;
+	struct iovec iov;
+	void *err_context;
+	ssize_t ret, err = 0;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+	if (ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq) <=
+	    ofi_cirque_usedcnt(ep->txq)) {
 		ret = -FI_EAGAIN;
 		goto out;
 	}
 
+	if (udpx_ep_tx_queued(ep, flags)) {
+		iov.iov_base = (void *) buf;
+		iov.iov_len = len;
+		ret = udpx_ep_queue_tx(ep, &iov, 1, addr, addrlen, context,
+				       flags, &err_context, &err);
+		goto out;
+	}
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				addr, (socklen_t)addrlen);
 	if (ret == (ssize_t)len) {
@@ -408,6 +870,8 @@ static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 	}
 out:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	if (err)
+		udpx_ep_tx_error(ep, err_context, err);
 	return ret;
 }
 
@@ -418,7 +882,7 @@ static ssize_t udpx_send(struct fid_ep *ep_fid, const void *buf, size_t len,
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
 	return udpx_sendto(ep, buf, len, ofi_ip_av_get_addr(ep->util_ep.av, (int)dest_addr),
-			   ep->util_ep.av->addrlen, context);
+			   ep->util_ep.av->addrlen, context, 0);
 }
 
 static ssize_t udpx_send_mc(struct fid_ep *ep_fid, const void *buf, size_t len,
@@ -429,7 +893,7 @@ static ssize_t udpx_send_mc(struct fid_ep *ep_fid, const void *buf, size_t len,
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
 	return udpx_sendto(ep, buf, len, (const void *) (uintptr_t) dest_addr,
 			   ofi_sizeofaddr((const void *) (uintptr_t) dest_addr),
-			   context);
+			   context, 0);
 }
 
 static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
@@ -437,7 +901,8 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 {
 	struct udpx_ep *ep;
 	struct msghdr hdr;
-	ssize_t ret;
+	void *err_context;
+	ssize_t ret, err = 0;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
 	hdr.msg_name = (void *)udpx_dest_addr(ep, msg->addr, flags);
@@ -449,11 +914,26 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	hdr.msg_flags = 0;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
-	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
+	if (ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq) <=
+	    ofi_cirque_usedcnt(ep->txq)) {
 		ret = -FI_EAGAIN;
 		goto out;
 	}
 
+	/*
+	 * Queued sends reference the caller's buffers, which an inject send
+	 * may reuse on return.  Send it now, after the sends queued before.
+	 */
+	if (flags & FI_INJECT) {
+		if (!ofi_cirque_isempty(ep->txq))
+			err = udpx_ep_flush_tx(ep, &err_context);
+	} else if (udpx_ep_tx_queued(ep, flags)) {
+		ret = udpx_ep_queue_tx(ep, msg->msg_iov, msg->iov_count,
+				       hdr.msg_name, hdr.msg_namelen,
+				       msg->context, flags, &err_context, &err);
+		goto out;
+	}
+
 	ret = ofi_sendmsg_udp(ep->sock, &hdr, 0);
 	if (ret >= 0) {
 		ep->tx_comp(ep, msg->context);
@@ -463,6 +943,8 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	}
 out:
 	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	if (err)
+		udpx_ep_tx_error(ep, err_context, err);
 	return ret;
 }
 
@@ -562,13 +1044,23 @@ static int udpx_ep_close(struct fid *fid)
 			wait = container_of(ep->util_ep.rx_cq->wait,
 					    struct util_wait_fd, util_wait);
 			fi_epoll_del(wait->epoll_fd, (int)ep->sock);
+			if (ep->ring.buf)
+				fi_epoll_del(wait->epoll_fd, ep->ring.fd);
 		}
 		fid_list_remove(&ep->util_ep.rx_cq->ep_list,
 				&ep->util_ep.rx_cq->ep_list_lock,
 				&ep->util_ep.ep_fid.fid);
 	}
 
+	if (ep->util_ep.tx_cq && ep->util_ep.tx_cq != ep->util_ep.rx_cq)
+		fid_list_remove(&ep->util_ep.tx_cq->ep_list,
+				&ep->util_ep.tx_cq->ep_list_lock,
+				&ep->util_ep.ep_fid.fid);
+
+	udpx_tx_cirq_free(ep->txq);
 	udpx_rx_cirq_free(ep->rxq);
+	free(ep->gro_buf);
+	udpx_ring_close(ep);
 	ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
 	free(ep);
@@ -579,12 +1071,13 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq,
 			   uint64_t flags)
 {
 	struct util_wait_fd *wait;
-	int ret;
+	int listed, ret;
 
 	ret = ofi_check_bind_cq_flags(&ep->util_ep, cq, flags);
 	if (ret)
 		return ret;
 
+	listed = (ep->util_ep.tx_cq == cq) || (ep->util_ep.rx_cq == cq);
 	if (flags & FI_TRANSMIT) {
 		ep->util_ep.tx_cq = cq;
 		ofi_atomic_inc32(&cq->ref);
@@ -595,25 +1088,21 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq,
 	if (flags & FI_RECV) {
 		ep->util_ep.rx_cq = cq;
 		ofi_atomic_inc32(&cq->ref);
+		ep->rx_comp = (cq->domain->info_domain_caps & FI_SOURCE) ?
+			      udpx_rx_src_comp : udpx_rx_comp;
 
 		if (cq->wait) {
-			ep->rx_comp =
-				(cq->domain->info_domain_caps & FI_SOURCE) ?
-				udpx_rx_src_comp_signal :
-				udpx_rx_comp_signal;
-
 			wait = container_of(cq->wait,
 					    struct util_wait_fd, util_wait);
 			ret = fi_epoll_add(wait->epoll_fd, (int)ep->sock,
 					   FI_EPOLL_IN, &ep->util_ep.ep_fid.fid);
 			if (ret)
 				return ret;
-		} else {
-			ep->rx_comp =
-				(cq->domain->info_domain_caps & FI_SOURCE) ?
-				udpx_rx_src_comp : udpx_rx_comp;
 		}
+	}
 
+	/* Queued sends are flushed by progress, driven from either CQ */
+	if (!listed) {
 		ret = fid_list_insert(&cq->ep_list,
 				      &cq->ep_list_lock,
 				      &ep->util_ep.ep_fid.fid);
@@ -691,6 +1180,32 @@ static void udpx_bind_src_addr(struct udpx_ep *ep)
 	freeaddrinfo(rai);
 }
 
+static void udpx_ep_init_ring(struct udpx_ep *ep)
+{
+	struct util_wait_fd *wait;
+	int ret;
+
+	ret = udpx_ring_open(ep);
+	if (ret) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"unable to open receive ring: %s\n",
+			fi_strerror(-ret));
+		return;
+	}
+
+	if (ep->util_ep.rx_cq->wait) {
+		wait = container_of(ep->util_ep.rx_cq->wait,
+				    struct util_wait_fd, util_wait);
+		ret = fi_epoll_add(wait->epoll_fd, ep->ring.fd,
+				   FI_EPOLL_IN, &ep->util_ep.ep_fid.fid);
+		if (ret) {
+			FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+				"unable to wait on receive ring\n");
+			udpx_ring_close(ep);
+		}
+	}
+}
+
 static int udpx_ep_ctrl(struct fid *fid, int command, void *arg)
 {
 	struct udpx_ep *ep;
@@ -705,6 +1220,8 @@ static int udpx_ep_ctrl(struct fid *fid, int command, void *arg)
 
 		if (!ep->is_bound)
 			udpx_bind_src_addr(ep);
+		if (udpx_env.rx_ring > 0 && !ep->ring.buf)
+			udpx_ep_init_ring(ep);
 		break;
 	default:
 		return -FI_ENOSYS;
@@ -720,6 +1237,31 @@ static struct fi_ops udpx_ep_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+static void udpx_ep_init_offload(struct udpx_ep *ep)
+{
+	ep->gso = udpx_env.gso && udpx_gso_supported(ep->sock);
+	if (udpx_env.gso && !ep->gso)
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"UDP_SEGMENT not supported, GSO disabled\n");
+
+	/* the receive ring takes precedence over GRO */
+	if (!udpx_env.gro || udpx_env.rx_ring > 0)
+		return;
+
+	if (udpx_gro_enable(ep->sock)) {
+		FI_INFO(&udpx_prov, FI_LOG_EP_CTRL,
+			"UDP_GRO not supported, GRO disabled\n");
+		return;
+	}
+
+	ep->gro_buf = malloc(UDPX_GRO_BUF_SIZE);
+	if (!ep->gro_buf) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+			"unable to allocate GRO buffer\n");
+		udpx_gro_disable(ep->sock);
+	}
+}
+
 static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 {
 	int family;
@@ -732,6 +1274,12 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 		return ret;
 	}
 
+	ep->txq = udpx_tx_cirq_create(UDPX_BATCH_SIZE);
+	if (!ep->txq) {
+		ret = -FI_ENOMEM;
+		goto err1;
+	}
+
 	family = info->src_addr ?
 		 ((struct sockaddr *) info->src_addr)->sa_family : AF_INET;
 	ep->sock = socket(family, SOCK_DGRAM, IPPROTO_UDP);
@@ -751,10 +1299,12 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 	if (ret)
 		goto err2;
 
+	udpx_ep_init_offload(ep);
 	return 0;
 err2:
 	ofi_close_socket(ep->sock);
 err1:
+	udpx_tx_cirq_free(ep->txq);
 	udpx_rx_cirq_free(ep->rxq);
 	return ret;
 }
@@ -40,6 +40,14 @@
 #include <net/if.h>
 
 
+struct udpx_env udpx_env = {
+	.tx_batch = 0,
+	.gso = 1,
+	.gro = 0,
+	.rx_ring = 0,
+};
+
+
 #if HAVE_GETIFADDRS
 static void udpx_getinfo_ifs(struct fi_info **info)
 {
@@ -131,6 +139,27 @@ UDP_INI
 {
 	fi_param_define(&udpx_prov, "iface", FI_PARAM_STRING,
 			"Specify interface name");
+	fi_param_define(&udpx_prov, "tx_batch", FI_PARAM_BOOL,
+			"Queue all sends and transmit them in batches from "
+			"the progress engine.  Otherwise only sends posted "
+			"with FI_MORE are batched (default: no).");
+	fi_param_define(&udpx_prov, "gso", FI_PARAM_BOOL,
+			"Send batched datagrams to the same address as a "
+			"single UDP_SEGMENT (GSO) datagram, when supported "
+			"by the kernel (default: yes).");
+	fi_param_define(&udpx_prov, "gro", FI_PARAM_BOOL,
+			"Receive coalesced datagrams using UDP_GRO, when "
+			"supported by the kernel.  Datagrams are received "
+			"into a bounce buffer and copied into posted "
+			"receives (default: no).");
+	fi_param_define(&udpx_prov, "rx_ring", FI_PARAM_INT,
+			"Number of frames in a memory mapped packet socket "
+			"ring used to receive datagrams without a system "
+			"call.  Requires CAP_NET_RAW (default: 0, disabled).");
+	fi_param_get_bool(&udpx_prov, "tx_batch", &udpx_env.tx_batch);
+	fi_param_get_bool(&udpx_prov, "gso", &udpx_env.gso);
+	fi_param_get_bool(&udpx_prov, "gro", &udpx_env.gro);
+	fi_param_get_int(&udpx_prov, "rx_ring", &udpx_env.rx_ring);
 
 	return &udpx_prov;
 }
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2013-2016 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "udpx.h"
+
+/* Most progress calls that may pass between polls of the socket */
+#define UDPX_RING_SOCK_BACKOFF	255
+
+/*
+ * The UDP socket only holds the datagrams the ring cannot take, which are
+ * rare.  Rather than a system call each time the ring is empty, the socket
+ * is polled at an interval that grows while it has nothing to read, and
+ * right away once the ring skips a datagram that was left to it.
+ */
+int udpx_ring_poll_sock(struct udpx_ring *ring)
+{
+	if (!ring->sock_wait)
+		return 1;
+
+	ring->sock_wait--;
+	return 0;
+}
+
+void udpx_ring_sock_polled(struct udpx_ring *ring, int found)
+{
+	if (found)
+		ring->sock_backoff = 0;
+	else
+		ring->sock_backoff = MIN(ring->sock_backoff * 2 + 1,
+					 UDPX_RING_SOCK_BACKOFF);
+	ring->sock_wait = ring->sock_backoff;
+}
+
+#if HAVE_LINUX_IF_PACKET_H && HAVE_LINUX_FILTER_H
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/virtio_net.h>
+#if HAVE_GETIFADDRS
+#include <ifaddrs.h>
+#endif
+
+#include <ofi_mem.h>
+
+#ifndef VIRTIO_NET_HDR_GSO_UDP_L4
+#define VIRTIO_NET_HDR_GSO_UDP_L4	5
+#endif
+
+#ifndef TP_STATUS_CSUM_VALID
+#define TP_STATUS_CSUM_VALID		(1 << 7)
+#endif
+
+/* IPv4 and UDP header, without options */
+#define UDPX_RING_HDR_LEN	28
+
+/*
+ * The packet socket is bound to all interfaces, since traffic to a local
+ * address is looped back regardless of the interface that owns it.  Only
+ * UDP/IPv4 datagrams addressed to the endpoint are accepted, and of a
+ * fragmented one only its first fragment, which tells the ring that the
+ * datagram is left to the socket.  Loads are relative to the network
+ * header, independent of the link layer.
+ */
+enum {
+	UDPX_RING_FILTER_ADDR = 8,
+	UDPX_RING_FILTER_PORT = 14,
+	UDPX_RING_FILTER_DROP = 16,
+};
+
+#define UDPX_RING_NET(off)	((uint32_t) (SKF_NET_OFF + (off)))
+#define UDPX_RING_JF(insn)	(UDPX_RING_FILTER_DROP - (insn) - 1)
+
+static const struct sock_filter udpx_ring_filter[] = {
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDPX_RING_NET(0)),
+	BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xf0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x40, 0, UDPX_RING_JF(2)),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDPX_RING_NET(9)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, UDPX_RING_JF(4)),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, UDPX_RING_NET(6)),
+	BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, UDPX_RING_JF(6), 0),
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, UDPX_RING_NET(16)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, UDPX_RING_JF(8)),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDPX_RING_NET(0)),
+	BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x0f),
+	BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2),
+	BPF_STMT(BPF_MISC | BPF_TAX, 0),
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, UDPX_RING_NET(2)),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, UDPX_RING_JF(14)),
+	BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+static int udpx_ring_attach(SOCKET sock, struct sock_filter *filter,
+			    size_t len)
+{
+	struct sock_fprog prog;
+
+	prog.len = (unsigned short) len;
+	prog.filter = filter;
+	return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER,
+			  &prog, sizeof(prog));
+}
+
+static int udpx_ring_set_filter(SOCKET sock, const struct sockaddr_in *sin)
+{
+	struct sock_filter filter[ARRAY_SIZE(udpx_ring_filter)];
+
+	memcpy(filter, udpx_ring_filter, sizeof(filter));
+	if (sin->sin_addr.s_addr == htonl(INADDR_ANY))
+		filter[UDPX_RING_FILTER_ADDR - 1] =
+			(struct sock_filter) BPF_STMT(BPF_LD | BPF_IMM, 0);
+	else
+		filter[UDPX_RING_FILTER_ADDR].k =
+			ntohl(sin->sin_addr.s_addr);
+	filter[UDPX_RING_FILTER_PORT].k = ntohs(sin->sin_port);
+
+	return udpx_ring_attach(sock, filter, ARRAY_SIZE(filter));
+}
+
+/*
+ * Datagrams larger than the interface MTU may arrive fragmented, which
+ * the ring cannot reassemble.  Those are left to the UDP socket, which
+ * drops everything the ring delivers.
+ */
+static int udpx_ring_set_sock_filter(SOCKET sock, size_t seg_max)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+		BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K,
+			 (uint32_t) seg_max + sizeof(struct udphdr), 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+
+	return udpx_ring_attach(sock, filter, ARRAY_SIZE(filter));
+}
+
+/* Smallest MTU of the interfaces that the endpoint may receive from */
+static size_t udpx_ring_mtu(SOCKET sock, const struct sockaddr_in *sin)
+{
+	size_t mtu = 0;
+#if HAVE_GETIFADDRS
+	struct ifaddrs *ifaddrs, *ifa;
+	struct ifreq ifr;
+
+	if (getifaddrs(&ifaddrs))
+		goto out;
+
+	for (ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || ifa->ifa_addr->sa_family != AF_INET ||
+		    !(ifa->ifa_flags & IFF_UP))
+			continue;
+
+		if (sin->sin_addr.s_addr != htonl(INADDR_ANY) &&
+		    sin->sin_addr.s_addr !=
+		    ((struct sockaddr_in *) ifa->ifa_addr)->sin_addr.s_addr)
+			continue;
+
+		memset(&ifr, 0, sizeof(ifr));
+		strncpy(ifr.ifr_name, ifa->ifa_name, sizeof(ifr.ifr_name) - 1);
+		if (ioctl(sock, SIOCGIFMTU, &ifr) || ifr.ifr_mtu <= 0)
+			continue;
+
+		if (!mtu || (size_t) ifr.ifr_mtu < mtu)
+			mtu = ifr.ifr_mtu;
+	}
+	freeifaddrs(ifaddrs);
+out:
+#endif
+	return mtu ? mtu : 1500;
+}
+
+int udpx_ring_open(struct udpx_ep *ep)
+{
+	struct udpx_ring *ring = &ep->ring;
+	struct tpacket_req req;
+	struct sockaddr_ll sll;
+	struct sockaddr_in sin;
+	socklen_t len;
+	int val, ret;
+
+	len = sizeof(sin);
+	if (getsockname(ep->sock, (struct sockaddr *) &sin, &len))
+		return -ofi_sockerr();
+	if (sin.sin_family != AF_INET)
+		return -FI_ENOSYS;
+
+	/* PACKET_VNET_HDR requires a raw socket */
+	ring->fd = socket(AF_PACKET, SOCK_RAW, 0);
+	if (ring->fd < 0)
+		return -ofi_sockerr();
+
+	val = TPACKET_V2;
+	ret = setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION,
+			 &val, sizeof(val));
+	if (ret)
+		goto err1;
+
+	/* Reports the segment size of GSO datagrams sent over loopback */
+	val = 1;
+	ret = setsockopt(ring->fd, SOL_PACKET, PACKET_VNET_HDR,
+			 &val, sizeof(val));
+	if (ret)
+		goto err1;
+
+	ret = udpx_ring_set_filter(ring->fd, &sin);
+	if (ret)
+		goto err1;
+
+	/* Each frame holds a complete, possibly GSO, datagram */
+	ring->frame_size = ofi_get_aligned_size(TPACKET_ALIGN(TPACKET2_HDRLEN) +
+			sizeof(struct virtio_net_hdr) + ETH_HLEN + IP_MAXPACKET,
+			ofi_get_page_size());
+	ring->frame_cnt = udpx_env.rx_ring;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = (unsigned int) ring->frame_size;
+	req.tp_block_nr = (unsigned int) ring->frame_cnt;
+	req.tp_frame_size = (unsigned int) ring->frame_size;
+	req.tp_frame_nr = (unsigned int) ring->frame_cnt;
+	ret = setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING,
+			 &req, sizeof(req));
+	if (ret)
+		goto err1;
+
+	ring->buf = mmap(NULL, ring->frame_size * ring->frame_cnt,
+			 PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+	if (ring->buf == MAP_FAILED) {
+		ret = -1;
+		goto err1;
+	}
+
+	/* Datagrams sent during setup may be dropped, but never duplicated */
+	ring->seg_max = udpx_ring_mtu(ep->sock, &sin) - UDPX_RING_HDR_LEN;
+	ret = udpx_ring_set_sock_filter(ep->sock, ring->seg_max);
+	if (ret)
+		goto err2;
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_IP);
+	ret = bind(ring->fd, (struct sockaddr *) &sll, sizeof(sll));
+	if (ret)
+		goto err3;
+
+	ring->pos = 0;
+	ring->frame = NULL;
+	ring->sock_wait = 0;
+	ring->sock_backoff = 0;
+	return 0;
+err3:
+	ret = -ofi_sockerr();
+	setsockopt(ep->sock, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+	munmap(ring->buf, ring->frame_size * ring->frame_cnt);
+	goto err;
+err2:
+	ret = -ofi_sockerr();
+	munmap(ring->buf, ring->frame_size * ring->frame_cnt);
+	goto err;
+err1:
+	ret = -ofi_sockerr();
+err:
+	ring->buf = NULL;
+	ofi_close_socket(ring->fd);
+	return ret;
+}
+
+void udpx_ring_close(struct udpx_ep *ep)
+{
+	struct udpx_ring *ring = &ep->ring;
+
+	if (!ring->buf)
+		return;
+
+	setsockopt(ep->sock, SOL_SOCKET, SO_DETACH_FILTER, NULL, 0);
+	munmap(ring->buf, ring->frame_size * ring->frame_cnt);
+	ring->buf = NULL;
+	ring->frame = NULL;
+	ep->seg_buf = NULL;
+	ofi_close_socket(ring->fd);
+}
+
+static struct tpacket2_hdr *udpx_ring_frame(struct udpx_ring *ring)
+{
+	return (struct tpacket2_hdr *) (ring->buf +
+					ring->pos * ring->frame_size);
+}
+
+static void udpx_ring_release(struct udpx_ring *ring)
+{
+	struct tpacket2_hdr *hdr = ring->frame;
+
+	__atomic_store_n(&hdr->tp_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	ring->frame = NULL;
+	if (++ring->pos == ring->frame_cnt)
+		ring->pos = 0;
+}
+
+/*
+ * The UDP socket drops the datagrams that the ring delivers, and with
+ * them the ones whose checksum is wrong, so the ring must check it too.
+ * The kernel reports in tp_status when it has verified the checksum, or
+ * when the datagram was sent locally and has none yet.
+ */
+static int udpx_ring_csum_ok(struct tpacket2_hdr *hdr, struct ip *ip,
+			     struct udphdr *udp, size_t udp_len, int gso)
+{
+	const uint16_t *word = (const uint16_t *) udp;
+	uint16_t last = 0;
+	uint64_t sum;
+	size_t i;
+
+	if ((hdr->tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)) ||
+	    !udp->check)
+		return 1;
+
+	/* each segment of a GSO datagram has its own checksum */
+	if (gso)
+		return 0;
+
+	sum = (ip->ip_src.s_addr >> 16) + (ip->ip_src.s_addr & 0xffff) +
+	      (ip->ip_dst.s_addr >> 16) + (ip->ip_dst.s_addr & 0xffff) +
+	      htons(IPPROTO_UDP) + udp->len;
+	for (i = 0; i < udp_len / 2; i++)
+		sum += word[i];
+	if (udp_len & 1) {
+		memcpy(&last, (char *) udp + udp_len - 1, 1);
+		sum += last;
+	}
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return sum == 0xffff;
+}
+
+/*
+ * Point the endpoint's segment cursor at the UDP payload of a frame.
+ * Returns the payload length, or a negative value if the frame should be
+ * skipped: -FI_EMSGSIZE if the datagram is received by the socket.
+ */
+static ssize_t udpx_ring_parse(struct udpx_ep *ep, struct tpacket2_hdr *hdr)
+{
+	struct virtio_net_hdr *vnet;
+	struct sockaddr_in *sin;
+	struct udphdr *udp;
+	struct ip *ip;
+	size_t ip_len, len;
+	int gso;
+
+	if (hdr->tp_snaplen != hdr->tp_len ||
+	    hdr->tp_net < hdr->tp_mac ||
+	    hdr->tp_len < hdr->tp_net - hdr->tp_mac + UDPX_RING_HDR_LEN)
+		return -FI_EAGAIN;
+
+	ip = (struct ip *) ((char *) hdr + hdr->tp_net);
+	if (ntohs(ip->ip_off) & IP_MF)
+		return -FI_EMSGSIZE;
+
+	ip_len = ntohs(ip->ip_len);
+	if (ip_len > hdr->tp_len - (hdr->tp_net - hdr->tp_mac) ||
+	    ip_len < (size_t) ip->ip_hl * 4 + sizeof(*udp))
+		return -FI_EAGAIN;
+
+	udp = (struct udphdr *) ((char *) ip + ip->ip_hl * 4);
+	if (ntohs(udp->len) != ip_len - ip->ip_hl * 4)
+		return -FI_EAGAIN;
+	len = ip_len - ip->ip_hl * 4 - sizeof(*udp);
+
+	vnet = (struct virtio_net_hdr *) ((char *) hdr + hdr->tp_mac -
+					  sizeof(*vnet));
+	gso = vnet->gso_type == VIRTIO_NET_HDR_GSO_UDP_L4;
+	if (!udpx_ring_csum_ok(hdr, ip, udp, len + sizeof(*udp), gso))
+		return -FI_EAGAIN;
+
+	if (gso) {
+		ep->seg_size = vnet->gso_size;
+		if (!ep->seg_size)
+			return -FI_EAGAIN;
+	} else {
+		ep->seg_size = len;
+	}
+
+	if (ep->seg_size > ep->ring.seg_max)
+		return -FI_EMSGSIZE;
+
+	ep->seg_buf = (char *) (udp + 1);
+	ep->seg_len = len;
+	ep->seg_off = 0;
+
+	sin = (struct sockaddr_in *) &ep->seg_addr;
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = udp->source;
+	sin->sin_addr = ip->ip_src;
+	return len;
+}
+
+/*
+ * Releases the frame under the segment cursor, and loads the next frame
+ * owned by user space.  The frame is held until its segments have been
+ * copied into posted receives.
+ */
+ssize_t udpx_ring_read(struct udpx_ep *ep)
+{
+	struct udpx_ring *ring = &ep->ring;
+	struct tpacket2_hdr *hdr;
+	ssize_t ret;
+
+	do {
+		if (ring->frame)
+			udpx_ring_release(ring);
+
+		hdr = udpx_ring_frame(ring);
+		if (!(__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) &
+		      TP_STATUS_USER))
+			return -FI_EAGAIN;
+
+		ring->frame = hdr;
+		ret = udpx_ring_parse(ep, hdr);
+		if (ret == -FI_EMSGSIZE)
+			ring->sock_wait = 0;
+	} while (ret < 0);
+
+	return ret;
+}
+
+#else /* HAVE_LINUX_IF_PACKET_H && HAVE_LINUX_FILTER_H */
+
+int udpx_ring_open(struct udpx_ep *ep)
+{
+	return -FI_ENOSYS;
+}
+
+void udpx_ring_close(struct udpx_ep *ep)
+{
+}
+
+ssize_t udpx_ring_read(struct udpx_ep *ep)
+{
+	return -FI_EAGAIN;
+}
+
+#endif
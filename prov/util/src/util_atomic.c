@@ -59,6 +59,109 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 	return ofi_datatype_size_table[datatype];
 }
 
+#if defined(HAVE_BUILTIN_MM_ATOMICS) && defined(HAVE_CMPXCHG16B)
+
+/*
+ * 16 byte datatypes (double complex and long double) use cmpxchg16b
+ * directly rather than the locked generic path of the compiler runtime.
+ * The instruction requires a 16 byte aligned target.  Misaligned targets
+ * fall back to a striped spinlock; a given address is always handled the
+ * same way, so the two paths never race on the same element.
+ */
+struct ofi_u128 {
+	uint64_t lo;
+	uint64_t hi;
+};
+
+#define OFI_CAS16_LOCK_CNT	64
+
+static char ofi_cas16_locks[OFI_CAS16_LOCK_CNT];
+
+static int ofi_cas16_locked(void *dst, void *cmp, const void *val)
+{
+	char *lock = &ofi_cas16_locks[((uintptr_t) dst >> 4) %
+				      OFI_CAS16_LOCK_CNT];
+	int ret;
+
+	while (__atomic_test_and_set(lock, __ATOMIC_ACQUIRE))
+		;
+	ret = !memcmp(dst, cmp, sizeof(struct ofi_u128));
+	if (ret)
+		memcpy(dst, val, sizeof(struct ofi_u128));
+	else
+		memcpy(cmp, dst, sizeof(struct ofi_u128));
+	__atomic_clear(lock, __ATOMIC_RELEASE);
+	return ret;
+}
+
+/* Same contract as __atomic_compare_exchange: cmp is updated on failure */
+static inline int ofi_cas16(void *dst, void *cmp, const void *val)
+{
+	struct ofi_u128 c, v;
+	char ok;
+
+	if ((uintptr_t) dst & 0xf)
+		return ofi_cas16_locked(dst, cmp, val);
+
+	memcpy(&c, cmp, sizeof c);
+	memcpy(&v, val, sizeof v);
+	__asm__ __volatile__ ("lock cmpxchg16b %1; sete %0"
+			      : "=q" (ok), "+m" (*(struct ofi_u128 *) dst),
+				"+a" (c.lo), "+d" (c.hi)
+			      : "b" (v.lo), "c" (v.hi)
+			      : "memory", "cc");
+	if (!ok)
+		memcpy(cmp, &c, sizeof c);
+	return ok;
+}
+
+/* A failed exchange returns the current value without changing it */
+static inline void ofi_load16(void *src, void *res)
+{
+	memset(res, 0, sizeof(struct ofi_u128));
+	(void) ofi_cas16(src, res, res);
+}
+
+static inline void ofi_exchange16(void *dst, const void *val, void *res)
+{
+	memcpy(res, dst, sizeof(struct ofi_u128));
+	while (!ofi_cas16(dst, res, val))
+		;
+}
+
+#define ofi_atomic_cas(dst, cmp, val)					\
+	__builtin_choose_expr(sizeof(*(dst)) == 16,			\
+		ofi_cas16(dst, cmp, val),				\
+		__atomic_compare_exchange(dst, cmp, val, 0,		\
+			__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+#define ofi_atomic_load(src, res)					\
+	__builtin_choose_expr(sizeof(*(src)) == 16,			\
+		ofi_load16(src, res),					\
+		__atomic_load(src, res, __ATOMIC_SEQ_CST))
+#define ofi_atomic_exchange(dst, val, res)				\
+	__builtin_choose_expr(sizeof(*(dst)) == 16,			\
+		ofi_exchange16(dst, val, res),				\
+		__atomic_exchange(dst, val, res, __ATOMIC_SEQ_CST))
+#define ofi_atomic_store(dst, val)					\
+	do {								\
+		__typeof__(*(dst)) _old;				\
+		ofi_atomic_exchange(dst, val, &_old);			\
+	} while (0)
+
+#elif defined(HAVE_BUILTIN_MM_ATOMICS)
+
+#define ofi_atomic_cas(dst, cmp, val)					\
+	__atomic_compare_exchange(dst, cmp, val, 0,			\
+				  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define ofi_atomic_load(src, res)					\
+	__atomic_load(src, res, __ATOMIC_SEQ_CST)
+#define ofi_atomic_exchange(dst, val, res)				\
+	__atomic_exchange(dst, val, res, __ATOMIC_SEQ_CST)
+#define ofi_atomic_store(dst, val)					\
+	__atomic_store(dst, val, __ATOMIC_SEQ_CST)
+
+#endif
+
 /*
  * Basic atomic operations
  */
@@ -80,16 +183,15 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 #define OFI_OP_BXOR(type,dst,src)	\
 		__atomic_fetch_xor(&(dst), (src), __ATOMIC_SEQ_CST)
 #define OFI_OP_WRITE(type,dst,src)	\
-		__atomic_store(&(dst), &(src), __ATOMIC_SEQ_CST)
+		ofi_atomic_store(&(dst), &(src))
 
 #define OFI_OP_READ(type,dst,res)	\
-		__atomic_load(&(dst), &(res), __ATOMIC_SEQ_CST)
+		ofi_atomic_load(&(dst), &(res))
 #define OFI_OP_READWRITE(type,dst,src,res)	\
-		__atomic_exchange(&(dst), &(src), &(res), __ATOMIC_SEQ_CST)
+		ofi_atomic_exchange(&(dst), &(src), &(res))
 
 #define OFI_OP_CSWAP_EQ(type,dst,src,cmp)	\
-		__atomic_compare_exchange(&(dst),&(cmp),&(src),0,	\
-					  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+		ofi_atomic_cas(&(dst), &(cmp), &(src))
 #define OFI_OP_CSWAP_NE(type,dst,src,cmp)	((cmp) != (dst))
 #define OFI_OP_CSWAP_LE(type,dst,src,cmp)	((cmp) <= (dst))
 #define OFI_OP_CSWAP_LT(type,dst,src,cmp)	((cmp) <  (dst))
@@ -105,8 +207,7 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 #define OFI_OP_LAND_COMPLEX(type,dst,src) ofi_complex_land_##type(dst,src)
 #define OFI_OP_LXOR_COMPLEX(type,dst,src) ofi_complex_lxor_##type(dst,src)
 #define OFI_OP_CSWAP_EQ_COMPLEX(type,dst,src,cmp)	\
-		__atomic_compare_exchange(&(dst),&(cmp),&(src),0,	\
-					  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+		ofi_atomic_cas(&(dst), &(cmp), &(src))
 #define OFI_OP_CSWAP_NE_COMPLEX(type,dst,src,cmp)	\
 			(!ofi_complex_eq_##type(dst,cmp))
 
@@ -203,18 +304,12 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		size_t i;						\
 		type *d = (dst);					\
 		const type *s = (src);					\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			success = 0;					\
+			target = d[i];					\
 			do {						\
-				target = d[i];				\
-				val = op(type, d[i], s[i]);		\
-				success = __atomic_compare_exchange(	\
-						&d[i],&target,&val,0,	\
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-			} while (!success);				\
+				val = op(type, target, s[i]);		\
+			} while (!ofi_atomic_cas(&d[i], &target, &val)); \
 		}							\
 	}
 
@@ -228,20 +323,13 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		type *d = (dst);					\
 		const type *s = (src);					\
 		type temp_s;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			do {						\
-				success = 1;				\
-				target = d[i];				\
-				if (op(type, d[i], s[i])) {		\
-					temp_s = s[i];			\
-					success = __atomic_compare_exchange( \
-						&d[i],&target,&temp_s, 0, \
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-				}					\
-			} while (!success);				\
+			target = d[i];					\
+			temp_s = s[i];					\
+			while (op(type, target, temp_s) &&		\
+			       !ofi_atomic_cas(&d[i], &target, &temp_s)) \
+				;					\
 		}							\
 	}
 
@@ -255,18 +343,12 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		ofi_complex_##type *d = (dst);				\
 		const ofi_complex_##type *s = (src);			\
 		size_t i;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			success = 0;					\
+			target = d[i];					\
 			do {						\
-				target = d[i];				\
-				val = op(type, d[i], s[i]);		\
-				success = __atomic_compare_exchange(	\
-						&d[i],&target,&val,0,	\
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-			} while (!success);				\
+				val = op(type, target, s[i]);		\
+			} while (!ofi_atomic_cas(&d[i], &target, &val)); \
 		}							\
 	}
 
@@ -365,18 +447,12 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		type *d = (dst);					\
 		type *r = (res);					\
 		const type *s = (src);					\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			success = 0;					\
+			target = d[i];					\
 			do {						\
-				target = d[i];				\
-				val = op(type, d[i], s[i]);		\
-				success = __atomic_compare_exchange(	\
-						&d[i],&target,&val,0,	\
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-			} while (!success);				\
+				val = op(type, target, s[i]);		\
+			} while (!ofi_atomic_cas(&d[i], &target, &val)); \
 			r[i] = target;					\
 		}							\
 	}
@@ -392,20 +468,13 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		type *r = (res);					\
 		const type *s = (src);					\
 		type temp_s;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			do {						\
-				target = d[i];				\
-				success = 1;				\
-				if (op(type, d[i], s[i])) {		\
-					temp_s = s[i];		\
-					success = __atomic_compare_exchange( \
-						&d[i],&target,&temp_s, 0, \
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-				}					\
-			} while (!success);				\
+			target = d[i];					\
+			temp_s = s[i];					\
+			while (op(type, target, temp_s) &&		\
+			       !ofi_atomic_cas(&d[i], &target, &temp_s)) \
+				;					\
 			r[i] = target;					\
 		}							\
 	}
@@ -453,18 +522,12 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		ofi_complex_##type *r = res;				\
 		const ofi_complex_##type *s = src;			\
 		size_t i;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			success = 0;					\
+			target = d[i];					\
 			do {						\
-				target = d[i];				\
-				val = op(type, d[i], s[i]);		\
-				success = __atomic_compare_exchange(	\
-						&d[i],&target,&val,0,	\
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-			} while (!success);				\
+				val = op(type, target, s[i]);		\
+			} while (!ofi_atomic_cas(&d[i], &target, &val)); \
 			r[i] = target;					\
 		}							\
 	}
@@ -541,9 +604,12 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		for (i = 0; i < cnt; i++) {				\
 			temp_c = c[i];					\
 			temp_s = s[i];					\
-			/* We never use weak operations */		\
-			(void) op(type, d[i], temp_s, temp_c);		\
-			/* If d[i] != temp_c then d[i] -> temp_c */	\
+			/* If d[i] != temp_c then d[i] -> temp_c.  Retry	\
+			 * when only the representation differs, such	\
+			 * as the padding of a long double. */		\
+			while (!op(type, d[i], temp_s, temp_c) &&	\
+			       temp_c == c[i])				\
+				;					\
 			r[i] = temp_c;					\
 		}							\
 	}
@@ -561,18 +627,12 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		const type *c = cmp;					\
 		const type *s = src;					\
 		type val;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			success = 0;					\
+			target = d[i];					\
 			do {						\
-				target = d[i];				\
-				val = op(type, d[i], s[i], c[i]);	\
-				success = __atomic_compare_exchange(	\
-						&d[i],&target,&val, 0,	\
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-			} while (!success);				\
+				val = op(type, target, s[i], c[i]);	\
+			} while (!ofi_atomic_cas(&d[i], &target, &val)); \
 			r[i] = target;					\
 		}							\
 	}
@@ -590,20 +650,13 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		const type *c = cmp;					\
 		const type *s = src;					\
 		type temp_s;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			do {						\
-				success = 1;				\
-				target = d[i];				\
-				if (op(type, d[i], s[i], c[i])) {	\
-					temp_s = s[i];			\
-					success = __atomic_compare_exchange( \
-						&d[i],&target,&temp_s, 0, \
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-				}					\
-			} while (!success);				\
+			target = d[i];					\
+			temp_s = s[i];					\
+			while (op(type, target, temp_s, c[i]) &&	\
+			       !ofi_atomic_cas(&d[i], &target, &temp_s)) \
+				;					\
 			r[i] = target;					\
 		}							\
 	}
@@ -625,8 +678,10 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		for (i = 0; i < cnt; i++) {				\
 			temp_c = c[i];					\
 			temp_s = s[i];					\
-			(void) op(type, d[i], temp_s, temp_c);		\
 			/* If d[i] != temp_c then d[i] -> temp_c */	\
+			while (!op(type, d[i], temp_s, temp_c) &&	\
+			       ofi_complex_eq_##type(temp_c, c[i]))	\
+				;					\
 			r[i] = temp_c;					\
 		}							\
 	}
@@ -644,20 +699,13 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 		const ofi_complex_##type *s = src;			\
 		ofi_complex_##type temp_s;				\
 		size_t i;						\
-		int success;						\
 									\
 		for (i = 0; i < cnt; i++) {				\
-			do {						\
-				success = 1;				\
-				target = d[i];				\
-				if (op(type, d[i], s[i], c[i])) {	\
-					temp_s = s[i];			\
-					success = __atomic_compare_exchange( \
-						&d[i],&target,&temp_s, 0, \
-						__ATOMIC_SEQ_CST,	\
-						__ATOMIC_SEQ_CST);	\
-				}					\
-			} while (!success);				\
+			target = d[i];					\
+			temp_s = s[i];					\
+			while (op(type, target, temp_s, c[i]) &&	\
+			       !ofi_atomic_cas(&d[i], &target, &temp_s)) \
+				;					\
 			r[i] = target;					\
 		}							\
 	}
@@ -730,7 +778,30 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 
 #ifdef HAVE_BUILTIN_MM_ATOMICS
 
-/* Only support 8 byte and under datatypes */
+#ifdef HAVE_CMPXCHG16B
+
+/* 16 byte datatypes, see ofi_cas16() */
+#define OFI_DEFINE_16B_HANDLERS(ATOMICTYPE, FUNCNAME, op)		\
+	OFI_DEF_##ATOMICTYPE##_COMPLEX_##FUNCNAME(op ##_COMPLEX, double)\
+	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, long_double)
+
+#define OFI_DEFINE_16B_REALNO_HANDLERS(ATOMICTYPE, FUNCNAME, op)	\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, long_double)
+
+#else /* HAVE_CMPXCHG16B */
+
+#define OFI_DEFINE_16B_HANDLERS(ATOMICTYPE, FUNCNAME, op)		\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME
+
+#define OFI_DEFINE_16B_REALNO_HANDLERS(ATOMICTYPE, FUNCNAME, op)	\
+	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEF_NOOP_##FUNCNAME
+
+#endif /* HAVE_CMPXCHG16B */
+
+/* Only support 16 byte and under datatypes */
 #define OFI_DEFINE_ALL_HANDLERS(ATOMICTYPE, FUNCNAME, op)		\
 	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, int8_t)			\
 	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, uint8_t)			\
@@ -743,8 +814,7 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, float)			\
 	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, double)			\
 	OFI_DEF_##ATOMICTYPE##_COMPLEX_##FUNCNAME(op ##_COMPLEX, float)	\
-	OFI_DEF_NOOP_##FUNCNAME						\
-	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEFINE_16B_HANDLERS(ATOMICTYPE, FUNCNAME, op)		\
 	OFI_DEF_NOOP_##FUNCNAME
 
 #define OFI_DEFINE_REALNO_HANDLERS(ATOMICTYPE, FUNCNAME, op)		\
@@ -759,8 +829,7 @@ size_t ofi_datatype_size(enum fi_datatype datatype)
 	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, float)			\
 	OFI_DEF_##ATOMICTYPE##_##FUNCNAME(op, double)			\
 	OFI_DEF_NOOP_##FUNCNAME						\
-	OFI_DEF_NOOP_##FUNCNAME						\
-	OFI_DEF_NOOP_##FUNCNAME						\
+	OFI_DEFINE_16B_REALNO_HANDLERS(ATOMICTYPE, FUNCNAME, op)	\
 	OFI_DEF_NOOP_##FUNCNAME
 
 #else /* HAVE_BUILTIN_MM_ATOMICS */
@@ -900,6 +969,40 @@ static void ofi_log_atomic_info(const struct fi_provider *prov)
 	FI_INFO(prov, FI_LOG_DOMAIN, "Using built-in memory model atomics.\n");
 }
 
+#ifdef HAVE_CMPXCHG16B
+
+/* Nearly every x86-64 CPU has cmpxchg16b, but it is not architectural. */
+void ofi_atomic_init(void)
+{
+	int op;
+
+	if (ofi_cpu_supports(0x1, OFI_CX16_REG, OFI_CX16_BIT))
+		return;
+
+	FI_INFO(&core_prov, FI_LOG_CORE,
+		"cmpxchg16b not supported, disabling 16 byte atomics\n");
+	for (op = 0; op < OFI_WRITE_OP_LAST; op++) {
+		ofi_atomic_write_handlers[op][FI_DOUBLE_COMPLEX] = NULL;
+		ofi_atomic_write_handlers[op][FI_LONG_DOUBLE] = NULL;
+	}
+	for (op = 0; op < OFI_READWRITE_OP_LAST; op++) {
+		ofi_atomic_readwrite_handlers[op][FI_DOUBLE_COMPLEX] = NULL;
+		ofi_atomic_readwrite_handlers[op][FI_LONG_DOUBLE] = NULL;
+	}
+	for (op = 0; op < OFI_SWAP_OP_LAST; op++) {
+		ofi_atomic_swap_handlers[op][FI_DOUBLE_COMPLEX] = NULL;
+		ofi_atomic_swap_handlers[op][FI_LONG_DOUBLE] = NULL;
+	}
+}
+
+#else /* HAVE_CMPXCHG16B */
+
+void ofi_atomic_init(void)
+{
+}
+
+#endif /* HAVE_CMPXCHG16B */
+
 #else /* HAVE_BUILTIN_MM_ATOMICS */
 
 /**********************
@@ -999,6 +1102,10 @@ static void ofi_log_atomic_info(const struct fi_provider *prov)
 		"Use requires single-threaded access by provider.\n");
 }
 
+void ofi_atomic_init(void)
+{
+}
+
 #endif /* HAVE_BUILTIN_MM_ATOMICS */
 
 int ofi_atomic_valid(const struct fi_provider *prov,
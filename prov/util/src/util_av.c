@@ -49,6 +49,7 @@
 #endif
 
 #include <ofi_util.h>
+#include <fasthash.h>
 
 
 enum {
@@ -240,10 +241,224 @@ int ofi_get_addr(uint32_t *addr_format, uint64_t flags,
 	}
 }
 
+#define UTIL_AV_HASH_EMPTY	0
+#define UTIL_AV_HASH_TOMBSTONE	UINT64_MAX
+
+/*
+ * The slots of a named AV are published with release stores, so that
+ * other processes can walk the shared table while it is being built.
+ */
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+#define util_av_load_acquire(var)	__atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define util_av_store_release(var, val) \
+	__atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#else
+#define util_av_load_acquire(var)	(var)
+#define util_av_store_release(var, val) ((var) = (val))
+#endif
+
+static uint64_t util_av_hash_key(struct util_av *av, const void *addr)
+{
+	uint64_t key = fasthash64(addr, av->addrlen, 0);
+
+	if (OFI_UNLIKELY(key == UTIL_AV_HASH_EMPTY ||
+			 key == UTIL_AV_HASH_TOMBSTONE))
+		key = 1;
+	return key;
+}
+
+static inline int util_av_hash_live(uint64_t key)
+{
+	return key != UTIL_AV_HASH_EMPTY && key != UTIL_AV_HASH_TOMBSTONE;
+}
+
+/*
+ * Named AV in a shared memory segment.  The process that creates the
+ * segment, which must open the AV without FI_READ, builds the table; all
+ * other processes map the segment read-only and resolve addresses against
+ * it without keeping a private copy.  Entries are appended at index 'stored' and
+ * published by a release store of 'stored', so readers need no lock.
+ * Entries are never removed, since other processes may hold their
+ * fi_addr.
+ */
+#define UTIL_AV_SHM_MAGIC	0x6f66695f61763031ULL	/* "ofi_av01" */
+
+struct util_av_shm_slot {
+	uint64_t	key;
+	uint64_t	index;
+};
+
+struct util_av_shm_hdr {
+	uint64_t	magic;
+	uint64_t	count;
+	uint64_t	addrlen;
+	uint64_t	hash_size;
+	uint64_t	stored;
+	struct util_av_shm_slot slot[];
+	/* followed by count addresses, each addrlen bytes */
+};
+
+static inline char *util_av_shm_addr(struct util_av *av, uint64_t index)
+{
+	struct util_av_shm_hdr *hdr = av->shm_hdr;
+
+	return (char *) &hdr->slot[hdr->hash_size] + index * hdr->addrlen;
+}
+
+static size_t util_av_shm_size(size_t count, size_t addrlen)
+{
+	return sizeof(struct util_av_shm_hdr) +
+	       roundup_power_of_two(count * 2) *
+	       sizeof(struct util_av_shm_slot) + count * addrlen;
+}
+
+static uint64_t util_av_shm_find(struct util_av *av, const void *addr,
+				 uint64_t key)
+{
+	struct util_av_shm_hdr *hdr = av->shm_hdr;
+	uint64_t slot_key, index;
+	size_t i, n, mask = hdr->hash_size - 1;
+
+	for (i = key & mask, n = 0; n < hdr->hash_size;
+	     i = (i + 1) & mask, n++) {
+		slot_key = util_av_load_acquire(hdr->slot[i].key);
+		if (slot_key == UTIL_AV_HASH_EMPTY)
+			break;
+		if (slot_key != key)
+			continue;
+
+		index = hdr->slot[i].index;
+		if (index < hdr->count &&
+		    !memcmp(util_av_shm_addr(av, index), addr, av->addrlen))
+			return index;
+	}
+	return FI_ADDR_NOTAVAIL;
+}
+
+/*
+ * Must hold AV lock
+ */
+static int util_av_shm_insert(struct util_av *av, const void *addr,
+			      fi_addr_t *fi_addr)
+{
+	struct util_av_shm_hdr *hdr = av->shm_hdr;
+	uint64_t key, index;
+	size_t i, mask = hdr->hash_size - 1;
+
+	key = util_av_hash_key(av, addr);
+	index = util_av_shm_find(av, addr, key);
+	if (index != FI_ADDR_NOTAVAIL)
+		goto out;
+
+	if (av->flags & FI_READ)
+		return -FI_EADDRNOTAVAIL;
+
+	if (hdr->stored == hdr->count) {
+		FI_WARN(av->prov, FI_LOG_AV, "shared AV is full\n");
+		return -FI_ENOSPC;
+	}
+
+	index = hdr->stored;
+	memcpy(util_av_shm_addr(av, index), addr, av->addrlen);
+
+	for (i = key & mask; hdr->slot[i].key != UTIL_AV_HASH_EMPTY;
+	     i = (i + 1) & mask)
+		;
+	hdr->slot[i].index = index;
+	util_av_store_release(hdr->slot[i].key, key);
+	util_av_store_release(hdr->stored, index + 1);
+out:
+	if (fi_addr)
+		*fi_addr = index;
+	return 0;
+}
+
+static int util_av_shm_init(struct util_av *av, const struct fi_av_attr *attr)
+{
+	struct util_av_shm_hdr *hdr;
+	size_t size;
+	int ret;
+
+	if (attr->type != FI_AV_TABLE) {
+		FI_WARN(av->prov, FI_LOG_AV,
+			"Shared AV requires FI_AV_TABLE\n");
+		return -FI_ENOSYS;
+	}
+
+	/*
+	 * Openers without FI_READ that find the AV already created map it
+	 * like readers.  Readers may only use it once the builder has
+	 * published the magic.
+	 */
+	size = util_av_shm_size(av->count, av->addrlen);
+	ret = -FI_EBUSY;
+	if (!(attr->flags & FI_READ))
+		ret = ofi_shm_map_flags(&av->shm, attr->name, size,
+					OFI_SHM_CREATE | OFI_SHM_EXCL,
+					(void **) &hdr);
+	if (!ret) {
+		/* the new segment is zero filled */
+		hdr->count = av->count;
+		hdr->addrlen = av->addrlen;
+		hdr->hash_size = roundup_power_of_two(av->count * 2);
+		util_av_store_release(hdr->magic, UTIL_AV_SHM_MAGIC);
+		goto out;
+	} else if (ret != -FI_EBUSY) {
+		goto err;
+	}
+
+	av->flags |= FI_READ;
+	ret = ofi_shm_map_flags(&av->shm, attr->name, size, OFI_SHM_RDONLY,
+				(void **) &hdr);
+	if (ret)
+		goto err;
+
+	if (util_av_load_acquire(hdr->magic) != UTIL_AV_SHM_MAGIC) {
+		FI_WARN(av->prov, FI_LOG_AV, "shared AV %s is not built yet\n",
+			attr->name);
+		ret = -FI_EAGAIN;
+	} else if (hdr->count != av->count || hdr->addrlen != av->addrlen) {
+		FI_WARN(av->prov, FI_LOG_AV,
+			"shared AV %s does not match AV attributes\n",
+			attr->name);
+		ret = -FI_EINVAL;
+	}
+	if (ret) {
+		/* leave the segment to its owner */
+		free((void *) av->shm.name);
+		av->shm.name = NULL;
+		ofi_shm_unmap(&av->shm);
+		return ret;
+	}
+out:
+	av->shm_hdr = hdr;
+	FI_INFO(av->prov, FI_LOG_AV, "%s shared AV %s\n",
+		av->flags & FI_READ ? "Mapped" : "Created", attr->name);
+	return 0;
+err:
+	FI_WARN(av->prov, FI_LOG_AV, "unable to map shared AV %s\n",
+		attr->name);
+	return ret;
+}
+
+static void util_av_shm_close(struct util_av *av)
+{
+	/* Only the process that built the table removes its name. */
+	if (av->flags & FI_READ) {
+		free((void *) av->shm.name);
+		av->shm.name = NULL;
+	}
+	ofi_shm_unmap(&av->shm);
+	av->shm_hdr = NULL;
+}
+
 void *ofi_av_get_addr(struct util_av *av, fi_addr_t fi_addr)
 {
 	struct util_av_entry *entry;
 
+	if (av->shm_hdr)
+		return util_av_shm_addr(av, fi_addr);
+
 	entry = ofi_bufpool_get_ibuf(av->av_entry_pool, fi_addr);
 	return entry->addr;
 }
@@ -263,44 +478,178 @@ int ofi_verify_av_insert(struct util_av *av, uint64_t flags)
 	return 0;
 }
 
+/*
+ * Must hold AV lock
+ */
+static struct util_av_entry *
+util_av_hash_find(struct util_av *av, const void *addr, uint64_t key)
+{
+	struct util_av_hash *hash = av->hash;
+	size_t i, n, mask;
+
+	if (!hash)
+		return NULL;
+
+	mask = hash->size - 1;
+	for (i = key & mask, n = 0; n < hash->size; i = (i + 1) & mask, n++) {
+		if (hash->slot[i].key == UTIL_AV_HASH_EMPTY)
+			break;
+
+		/* The key only filters, the address decides. */
+		if (hash->slot[i].key == key &&
+		    !memcmp(hash->slot[i].entry->addr, addr, av->addrlen))
+			return hash->slot[i].entry;
+	}
+	return NULL;
+}
+
+/*
+ * Must hold AV lock.  The address must not already be in the table.
+ */
+static void util_av_hash_add(struct util_av_hash *hash, uint64_t key,
+			     struct util_av_entry *entry)
+{
+	size_t i, mask = hash->size - 1;
+
+	for (i = key & mask; util_av_hash_live(hash->slot[i].key);
+	     i = (i + 1) & mask)
+		;
+
+	if (hash->slot[i].key == UTIL_AV_HASH_EMPTY)
+		hash->used++;
+	hash->slot[i].entry = entry;
+	hash->slot[i].key = key;
+}
+
+/*
+ * Must hold AV lock.  Rebuilds the table at the given size, dropping
+ * tombstones.
+ */
+static int util_av_hash_resize(struct util_av *av, size_t size)
+{
+	struct util_av_hash *hash, *old = av->hash;
+	size_t i;
+
+	hash = calloc(1, sizeof(*hash) + size * sizeof(hash->slot[0]));
+	if (!hash)
+		return -FI_ENOMEM;
+
+	hash->size = size;
+	if (old) {
+		for (i = 0; i < old->size; i++) {
+			if (util_av_hash_live(old->slot[i].key))
+				util_av_hash_add(hash, old->slot[i].key,
+						 old->slot[i].entry);
+		}
+		free(old);
+	}
+
+	av->hash = hash;
+	return 0;
+}
+
+/*
+ * Must hold AV lock.  Ensures that count more addresses can be inserted
+ * without growing the table, keeping the load factor, tombstones
+ * included, at or below 1/2.  A rebuild leaves the live addresses at no
+ * more than 1/3 of the slots, so that removing and inserting addresses
+ * at a steady count only rebuilds the table once every size/6 inserts.
+ */
+int ofi_av_reserve(struct util_av *av, size_t count)
+{
+	if (av->shm_hdr)
+		return 0;
+
+	if (av->hash && (av->hash->used + count) * 2 <= av->hash->size)
+		return 0;
+
+	return util_av_hash_resize(av,
+			roundup_power_of_two((av->hash_cnt + count) * 3));
+}
+
 /*
  * Must hold AV lock
  */
 int ofi_av_insert_addr(struct util_av *av, const void *addr, fi_addr_t *fi_addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
+	uint64_t key;
+	int ret;
+
+	if (av->shm_hdr)
+		return util_av_shm_insert(av, addr, fi_addr);
 
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	key = util_av_hash_key(av, addr);
+	entry = util_av_hash_find(av, addr, key);
 	if (entry) {
 		if (fi_addr)
 			*fi_addr = ofi_buf_index(entry);
 		ofi_atomic_inc32(&entry->use_cnt);
 		return 0;
-	} else {
-		entry = ofi_ibuf_alloc(av->av_entry_pool);
-		if (!entry)
-			return -FI_ENOMEM;
-		if (fi_addr)
-			*fi_addr = ofi_buf_index(entry);
-		memcpy(entry->addr, addr, av->addrlen);
-		ofi_atomic_initialize32(&entry->use_cnt, 1);
-		HASH_ADD(hh, av->hash, addr, av->addrlen, entry);
 	}
+
+	ret = ofi_av_reserve(av, 1);
+	if (ret)
+		return ret;
+
+	entry = ofi_ibuf_alloc(av->av_entry_pool);
+	if (!entry)
+		return -FI_ENOMEM;
+	if (fi_addr)
+		*fi_addr = ofi_buf_index(entry);
+	memcpy(entry->addr, addr, av->addrlen);
+	ofi_atomic_initialize32(&entry->use_cnt, 1);
+	util_av_hash_add(av->hash, key, entry);
+	av->hash_cnt++;
 	return 0;
 }
 
+static int util_av_cmp_fi_addr(const void *a, const void *b)
+{
+	fi_addr_t x = *(const fi_addr_t *) a, y = *(const fi_addr_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Walks the AV in fi_addr order, which matches insertion order as long
+ * as no addresses were removed.
+ */
 int ofi_av_elements_iter(struct util_av *av, ofi_av_apply_func apply, void *arg)
 {
-	struct util_av_entry *av_entry = NULL, *av_entry_tmp = NULL;
-	int ret;
+	struct util_av_hash *hash = av->hash;
+	fi_addr_t *fi_addrs;
+	size_t i, cnt = 0;
+	int ret = 0;
 
-	HASH_ITER(hh, av->hash, av_entry, av_entry_tmp) {
-		ret = apply(av, av_entry->addr,
-			    ofi_buf_index(av_entry), arg);
+	if (av->shm_hdr) {
+		cnt = util_av_load_acquire(av->shm_hdr->stored);
+		for (i = 0; i < cnt && !ret; i++)
+			ret = apply(av, util_av_shm_addr(av, i), i, arg);
+		return ret;
+	}
+
+	if (!hash || !av->hash_cnt)
+		return 0;
+
+	fi_addrs = malloc(av->hash_cnt * sizeof(*fi_addrs));
+	if (!fi_addrs)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < hash->size && cnt < av->hash_cnt; i++) {
+		if (util_av_hash_live(hash->slot[i].key))
+			fi_addrs[cnt++] = ofi_buf_index(hash->slot[i].entry);
+	}
+	qsort(fi_addrs, cnt, sizeof(*fi_addrs), util_av_cmp_fi_addr);
+
+	for (i = 0; i < cnt; i++) {
+		ret = apply(av, ofi_av_get_addr(av, fi_addrs[i]),
+			    fi_addrs[i], arg);
 		if (OFI_UNLIKELY(ret))
-			return ret;
+			break;
 	}
-	return 0;
+	free(fi_addrs);
+	return ret;
 }
 
 /*
@@ -309,7 +658,14 @@ int ofi_av_elements_iter(struct util_av *av, ofi_av_apply_func apply, void *arg)
 int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 {
 	struct util_av_entry *av_entry;
+	struct util_av_hash *hash = av->hash;
+	size_t i, mask;
+	uint64_t key;
+
+	if (av->shm_hdr)
+		return -FI_ENOSYS;
 
+	mask = hash->size - 1;
 	av_entry = ofi_bufpool_get_ibuf(av->av_entry_pool, fi_addr);
 	if (!av_entry)
 		return -FI_ENOENT;
@@ -317,22 +673,35 @@ int ofi_av_remove_addr(struct util_av *av, fi_addr_t fi_addr)
 	if (ofi_atomic_dec32(&av_entry->use_cnt))
 		return FI_SUCCESS;
 
-	HASH_DELETE(hh, av->hash, av_entry);
+	key = util_av_hash_key(av, av_entry->addr);
+	for (i = key & mask; hash->slot[i].key != UTIL_AV_HASH_EMPTY;
+	     i = (i + 1) & mask) {
+		if (hash->slot[i].entry == av_entry &&
+		    hash->slot[i].key == key) {
+			hash->slot[i].key = UTIL_AV_HASH_TOMBSTONE;
+			av->hash_cnt--;
+			break;
+		}
+	}
 	ofi_ibuf_free(av_entry);
 	return 0;
 }
 
 fi_addr_t ofi_av_lookup_fi_addr_unsafe(struct util_av *av, const void *addr)
 {
-	struct util_av_entry *entry = NULL;
+	struct util_av_entry *entry;
+
+	if (av->shm_hdr)
+		return util_av_shm_find(av, addr, util_av_hash_key(av, addr));
 
-	HASH_FIND(hh, av->hash, addr, av->addrlen, entry);
+	entry = util_av_hash_find(av, addr, util_av_hash_key(av, addr));
 	return entry ? ofi_buf_index(entry) : FI_ADDR_NOTAVAIL;
 }
 
 fi_addr_t ofi_av_lookup_fi_addr(struct util_av *av, const void *addr)
 {
 	fi_addr_t fi_addr;
+
 	fastlock_acquire(&av->lock);
 	fi_addr = ofi_av_lookup_fi_addr_unsafe(av, addr);
 	fastlock_release(&av->lock);
@@ -377,7 +746,11 @@ int ofi_av_bind(struct fid *av_fid, struct fid *eq_fid, uint64_t flags)
 
 static void util_av_close(struct util_av *av)
 {
-	HASH_CLEAR(hh, av->hash);
+	if (av->shm_hdr) {
+		util_av_shm_close(av);
+		return;
+	}
+	free(av->hash);
 	ofi_bufpool_destroy(av->av_entry_pool);
 }
 
@@ -435,9 +808,6 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 				  OFI_BUFPOOL_HUGEPAGES,
 	};
 
-	/* TODO: Handle FI_READ */
-	/* TODO: Handle mmap - shared AV */
-
 	ret = util_verify_av_util_attr(av->domain, util_attr);
 	if (ret)
 		return ret;
@@ -457,9 +827,21 @@ static int util_av_init(struct util_av *av, const struct fi_av_attr *attr,
 	av->addrlen = util_attr->addrlen;
 	av->flags = util_attr->flags | attr->flags;
 	av->hash = NULL;
+	av->hash_cnt = 0;
+	av->shm_hdr = NULL;
+
+	if (attr->name)
+		return util_av_shm_init(av, attr);
 
 	pool_attr.chunk_cnt = av->count;
-	return ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	ret = ofi_bufpool_create_attr(&pool_attr, &av->av_entry_pool);
+	if (ret)
+		return ret;
+
+	ret = util_av_hash_resize(av, av->count * 2);
+	if (ret)
+		ofi_bufpool_destroy(av->av_entry_pool);
+	return ret;
 }
 
 static int util_verify_av_attr(struct util_domain *domain,
@@ -479,11 +861,6 @@ static int util_verify_av_attr(struct util_domain *domain,
 		return -FI_EINVAL;
 	}
 
-	if (attr->name) {
-		FI_WARN(domain->prov, FI_LOG_AV, "Shared AV is unsupported\n");
-		return -FI_ENOSYS;
-	}
-
 	if (attr->flags & ~(FI_EVENT | FI_READ | FI_SYMMETRIC)) {
 		FI_WARN(domain->prov, FI_LOG_AV, "invalid flags\n");
 		return -FI_EINVAL;
@@ -492,8 +869,9 @@ static int util_verify_av_attr(struct util_domain *domain,
 	return 0;
 }
 
-int ofi_av_init_lightweight(struct util_domain *domain, const struct fi_av_attr *attr,
-			    struct util_av *av, void *context)
+static int util_av_init_common(struct util_domain *domain,
+			       const struct fi_av_attr *attr,
+			       struct util_av *av, void *context)
 {
 	int ret;
 
@@ -518,11 +896,22 @@ int ofi_av_init_lightweight(struct util_domain *domain, const struct fi_av_attr
 	return 0;
 }
 
+int ofi_av_init_lightweight(struct util_domain *domain, const struct fi_av_attr *attr,
+			    struct util_av *av, void *context)
+{
+	if (attr->name) {
+		FI_WARN(domain->prov, FI_LOG_AV, "Shared AV is unsupported\n");
+		return -FI_ENOSYS;
+	}
+
+	return util_av_init_common(domain, attr, av, context);
+}
+
 int ofi_av_init(struct util_domain *domain, const struct fi_av_attr *attr,
 		const struct util_av_attr *util_attr,
 		struct util_av *av, void *context)
 {
-	int ret = ofi_av_init_lightweight(domain, attr, av, context);
+	int ret = util_av_init_common(domain, attr, av, context);
 	if (ret)
 		return ret;
 
@@ -621,6 +1010,15 @@ int ofi_ip_av_insertv(struct util_av *av, const void *addr, size_t addrlen,
 	size_t i;
 
 	FI_DBG(av->prov, FI_LOG_AV, "inserting %zu addresses\n", count);
+
+	/* Size the hash table once instead of growing it per address. */
+	fastlock_acquire(&av->lock);
+	ret = ofi_av_reserve(av, count);
+	fastlock_release(&av->lock);
+	if (ret)
+		FI_INFO(av->prov, FI_LOG_AV, "unable to reserve %zu addresses\n",
+			count);
+
 	for (i = 0; i < count; i++) {
 		ret = ip_av_insert_addr(av, (const char *) addr + i * addrlen,
 					fi_addr ? &fi_addr[i] : NULL, context);
@@ -55,6 +55,67 @@
 #include <ofi_atomic.h>
 #include <ofi_coll.h>
 #include <ofi_osd.h>
+#include <fasthash.h>
+
+struct ofi_coll_params coll_params = {
+	.allreduce_limit = 65536,
+	.segment_size = 65536,
+	.node_limit = 65536,
+	.sched_cache = 16,
+	.sched_cache_size = 1048576,
+};
+
+void ofi_coll_init(void)
+{
+	fi_param_define(NULL, "coll_allreduce_limit", FI_PARAM_SIZE_T,
+			"Defines the allreduce size, in bytes, at which software"
+			" collectives switch from recursive doubling to a"
+			" reduce-scatter followed by an allgather.  Larger"
+			" operations move less data per process at the cost"
+			" of more steps.  (default: 65536)");
+
+	fi_param_define(NULL, "coll_segment_size", FI_PARAM_SIZE_T,
+			"Defines the segment size, in bytes, used to pipeline"
+			" large broadcast and scatter operations through the"
+			" tree of processes.  Broadcasts larger than this, and"
+			" scatters that deliver at least this much to each"
+			" process, are forwarded a segment at a time.  Zero"
+			" disables pipelining.  (default: 65536)");
+
+	fi_param_define(NULL, "coll_node_limit", FI_PARAM_SIZE_T,
+			"Defines the largest allreduce, in bytes, that software"
+			" collectives run hierarchically.  Such operations are"
+			" reduced through shared memory among the processes on"
+			" each node, then among one leader per node.  This"
+			" also sizes the per process slots of the shared"
+			" segment.  Zero disables hierarchical collectives."
+			"  (default: 65536)");
+
+	fi_param_define(NULL, "coll_sched_cache", FI_PARAM_SIZE_T,
+			"Defines the number of completed allreduce and barrier"
+			" schedules kept per collective group.  Issuing the"
+			" same operation again, with the same buffers, count,"
+			" datatype and op, restarts the kept schedule instead"
+			" of building a new one.  Zero disables reuse."
+			"  (default: 16)");
+
+	fi_param_define(NULL, "coll_sched_cache_size", FI_PARAM_SIZE_T,
+			"Defines the total size, in bytes, of the temporary"
+			" buffers held by the schedules kept per collective"
+			" group.  Operations whose buffers do not fit are"
+			" not kept.  (default: 1048576)");
+
+	fi_param_get_size_t(NULL, "coll_allreduce_limit",
+			    &coll_params.allreduce_limit);
+	fi_param_get_size_t(NULL, "coll_segment_size",
+			    &coll_params.segment_size);
+	fi_param_get_size_t(NULL, "coll_node_limit",
+			    &coll_params.node_limit);
+	fi_param_get_size_t(NULL, "coll_sched_cache",
+			    &coll_params.sched_cache);
+	fi_param_get_size_t(NULL, "coll_sched_cache_size",
+			    &coll_params.sched_cache_size);
+}
 
 int ofi_av_set_union(struct fid_av_set *dst, const struct fid_av_set *src)
 {
@@ -187,6 +248,8 @@ static inline int util_coll_mc_alloc(struct util_coll_mc **coll_mc)
 	if (!*coll_mc)
 		return -FI_ENOMEM;
 
+	dlist_init(&(*coll_mc)->sched_list);
+	dlist_init(&(*coll_mc)->active_list);
 	return FI_SUCCESS;
 }
 
@@ -207,21 +270,48 @@ static inline uint32_t util_coll_get_next_id(struct util_coll_mc *coll_mc)
 	return cid << 16 | coll_mc->seq++;
 }
 
+/*
+ * The sequence number in a cid wraps after 64k operations, and a new
+ * operation must not reuse the cid, and so the tags, of one still in
+ * flight on the group.  Operations are started in cid order, so only the
+ * oldest one can collide.  The caller is asked to retry until it
+ * completes; since the sequence number is not consumed, every member
+ * still draws the same cid for the operation.
+ */
+static inline int util_coll_cid_busy(struct util_coll_mc *coll_mc)
+{
+	struct util_coll_operation *oldest;
+
+	if (dlist_empty(&coll_mc->active_list))
+		return 0;
+
+	oldest = container_of(coll_mc->active_list.next,
+			      struct util_coll_operation, active_entry);
+	return (uint16_t) oldest->cid == coll_mc->seq;
+}
+
 static inline int util_coll_op_create(struct util_coll_operation **coll_op,
 				    struct util_coll_mc *coll_mc,
 				    enum util_coll_op_type type, void *context,
 				    util_coll_comp_fn_t comp_fn)
 {
+	if (util_coll_cid_busy(coll_mc))
+		return -FI_EAGAIN;
+
 	*coll_op = calloc(1, sizeof(**coll_op));
 	if (!(*coll_op))
 		return -FI_ENOMEM;
 
 	(*coll_op)->cid = util_coll_get_next_id(coll_mc);
 	(*coll_op)->mc = coll_mc;
+	(*coll_op)->group = coll_mc;
 	(*coll_op)->type = type;
 	(*coll_op)->context = context;
 	(*coll_op)->comp_fn = comp_fn;
+	(*coll_op)->busy = 1;
 	dlist_init(&(*coll_op)->work_queue);
+	slist_init(&(*coll_op)->ready_queue);
+	slist_init(&(*coll_op)->sched);
 
 	return FI_SUCCESS;
 }
@@ -277,6 +367,18 @@ static inline void util_coll_op_log_work(struct util_coll_operation *coll_op)
 			       "\t%ld: { %p [%s] COMPLETION }\n", count, cur_item,
 			       log_util_coll_state[cur_item->state]);
 			break;
+		case UTIL_COLL_WAIT:
+		case UTIL_COLL_POST:
+			FI_DBG(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
+			       "\t%ld: { %p [%s] %s }\n", count, cur_item,
+			       log_util_coll_state[cur_item->state],
+			       cur_item->type == UTIL_COLL_WAIT ? "WAIT" : "POST");
+			break;
+		case UTIL_COLL_ATTACH:
+			FI_DBG(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
+			       "\t%ld: { %p [%s] ATTACH }\n", count, cur_item,
+			       log_util_coll_state[cur_item->state]);
+			break;
 		default:
 			FI_DBG(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
 			       "\t%ld: { %p [%s] UNKNOWN }\n", count, cur_item,
@@ -316,11 +418,16 @@ static inline void util_coll_op_progress_work(struct util_ep *util_ep,
 			FI_DBG(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
 			       "Removing Completed Work item: %p \n", cur_item);
 			dlist_remove(&cur_item->waiting_entry);
-			free(cur_item);
+			if (!coll_op->persistent)
+				free(cur_item);
 
 			// if the work queue is empty, we're done
 			if (dlist_empty(&coll_op->work_queue)) {
-				free(coll_op);
+				dlist_remove(&coll_op->active_entry);
+				if (coll_op->persistent)
+					coll_op->busy = 0;
+				else
+					free(coll_op);
 				return;
 			}
 			continue;
@@ -353,7 +460,19 @@ static inline void util_coll_op_progress_work(struct util_ep *util_ep,
 	util_coll_op_log_work(coll_op);
 
 	next_ready->state = UTIL_COLL_PROCESSING;
-	slist_insert_tail(&next_ready->ready_entry, &util_ep->coll_ready_queue);
+	slist_insert_tail(&next_ready->ready_entry, &coll_op->ready_queue);
+	if (!coll_op->queued) {
+		coll_op->queued = 1;
+		slist_insert_tail(&coll_op->ready_entry,
+				  &util_ep->coll_ready_queue);
+	}
+}
+
+static inline void util_coll_op_start(struct util_ep *util_ep,
+				      struct util_coll_operation *coll_op)
+{
+	dlist_insert_tail(&coll_op->active_entry, &coll_op->group->active_list);
+	util_coll_op_progress_work(util_ep, coll_op);
 }
 
 static inline void util_coll_op_bind_work(struct util_coll_operation *coll_op,
@@ -361,6 +480,7 @@ static inline void util_coll_op_bind_work(struct util_coll_operation *coll_op,
 {
 	item->coll_op = coll_op;
 	dlist_insert_tail(&item->waiting_entry, &coll_op->work_queue);
+	slist_insert_tail(&item->sched_entry, &coll_op->sched);
 }
 
 static int util_coll_sched_send(struct util_coll_operation *coll_op, uint32_t dest,
@@ -470,6 +590,315 @@ static int util_coll_sched_comp(struct util_coll_operation *coll_op)
 	return FI_SUCCESS;
 }
 
+static int util_coll_sched_flag(struct util_coll_operation *coll_op,
+				enum coll_work_type type, uint64_t *flag,
+				uint64_t value)
+{
+	struct util_coll_flag_item *flag_item;
+
+	flag_item = calloc(1, sizeof(*flag_item));
+	if (!flag_item)
+		return -FI_ENOMEM;
+
+	flag_item->hdr.type = type;
+	flag_item->hdr.state = UTIL_COLL_WAITING;
+	flag_item->hdr.fence = 1;
+	flag_item->flag = flag;
+	flag_item->value = value;
+
+	util_coll_op_bind_work(coll_op, &flag_item->hdr);
+	return FI_SUCCESS;
+}
+
+static int util_coll_sched_attach(struct util_coll_operation *coll_op)
+{
+	struct util_coll_work_item *attach_item;
+
+	attach_item = calloc(1, sizeof(*attach_item));
+	if (!attach_item)
+		return -FI_ENOMEM;
+
+	attach_item->type = UTIL_COLL_ATTACH;
+	attach_item->state = UTIL_COLL_WAITING;
+	attach_item->fence = 1;
+
+	util_coll_op_bind_work(coll_op, attach_item);
+	return FI_SUCCESS;
+}
+
+/*
+ * Hierarchical collectives.  Members whose AV addresses share an IP
+ * address run on the same node, and the lowest ranked member of each
+ * node is its leader.  The leader maps a shared segment during the join
+ * that the other members of its node attach to, and is the only member
+ * of the node that talks to the other nodes.  The segment holds a
+ * control line and a data slot for every member of the node.
+ */
+#ifdef HAVE_BUILTIN_MM_ATOMICS
+#define UTIL_COLL_NODE 1
+#define util_coll_load_acquire(var)	__atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define util_coll_store_release(var, val) \
+	__atomic_store_n(&(var), (val), __ATOMIC_RELEASE)
+#else
+#define UTIL_COLL_NODE 0
+#define util_coll_load_acquire(var)	(var)
+#define util_coll_store_release(var, val) ((var) = (val))
+#endif
+
+#define UTIL_COLL_NODE_MAGIC	0x6f66695f636f6c6cULL	/* "ofi_coll" */
+#define UTIL_COLL_NODE_LINE	64
+/*
+ * Set in a node flag posted by an operation that failed, so that the
+ * members of the node waiting on it fail the operation as well.
+ */
+#define UTIL_COLL_NODE_FAILED	(1ULL << 63)
+
+struct util_coll_node_hdr {
+	uint64_t	magic;
+	uint64_t	nlocal;
+	uint64_t	slot_size;
+};
+
+struct util_coll_node {
+	struct util_shm		shm;
+	char			*region;
+	char			name[NAME_MAX];
+	struct util_coll_mc	*leader_mc;
+	size_t			nlocal;
+	size_t			local_idx;
+	size_t			slot_size;
+	uint64_t		seq;
+	/* last sequence number whose operation completed locally */
+	uint64_t		done;
+};
+
+static inline size_t util_coll_node_size(struct util_coll_node *node)
+{
+	return UTIL_COLL_NODE_LINE * (node->nlocal + 1) +
+	       node->nlocal * node->slot_size;
+}
+
+static inline uint64_t *util_coll_node_flag(struct util_coll_node *node,
+					    size_t idx)
+{
+	return (uint64_t *) (node->region + UTIL_COLL_NODE_LINE * (idx + 1));
+}
+
+static inline void *util_coll_node_slot(struct util_coll_node *node, size_t idx)
+{
+	return node->region + UTIL_COLL_NODE_LINE * (node->nlocal + 1) +
+	       idx * node->slot_size;
+}
+
+static inline int util_coll_node_enabled(void)
+{
+	return UTIL_COLL_NODE && coll_params.node_limit;
+}
+
+static int util_coll_same_host(const struct sockaddr *addr1,
+			       const struct sockaddr *addr2)
+{
+	if (addr1->sa_family != addr2->sa_family)
+		return 0;
+
+	switch (addr1->sa_family) {
+	case AF_INET:
+	case AF_INET6:
+		return ofi_equals_ipaddr(addr1, addr2);
+	default:
+		return 0;
+	}
+}
+
+static void util_coll_node_free(struct util_coll_mc *coll_mc)
+{
+	struct util_coll_node *node = coll_mc->node;
+
+	if (!node)
+		return;
+
+	if (node->region) {
+		/* only the leader, which created the segment, removes it */
+		if (node->local_idx) {
+			free((void *) node->shm.name);
+			node->shm.name = NULL;
+		}
+		ofi_shm_unmap(&node->shm);
+	}
+
+	if (node->leader_mc) {
+		free(node->leader_mc->av_set->fi_addr_array);
+		free(node->leader_mc->av_set);
+		free(node->leader_mc);
+	}
+	free(node);
+	coll_mc->node = NULL;
+}
+
+static int util_coll_node_leader_mc(struct util_coll_mc *coll_mc,
+				    fi_addr_t *leaders, size_t nleaders,
+				    size_t leader_rank)
+{
+	struct util_coll_mc *leader_mc;
+
+	leader_mc = calloc(1, sizeof(*leader_mc));
+	if (!leader_mc)
+		return -FI_ENOMEM;
+
+	leader_mc->av_set = calloc(1, sizeof(*leader_mc->av_set));
+	if (!leader_mc->av_set) {
+		free(leader_mc);
+		return -FI_ENOMEM;
+	}
+
+	leader_mc->av_set->av = coll_mc->av_set->av;
+	leader_mc->av_set->fi_addr_array = leaders;
+	leader_mc->av_set->fi_addr_count = nleaders;
+	leader_mc->ep = coll_mc->ep;
+	leader_mc->local_rank = leader_rank;
+	leader_mc->group_id = coll_mc->group_id;
+	coll_mc->node->leader_mc = leader_mc;
+	return FI_SUCCESS;
+}
+
+/*
+ * Groups the members of coll_mc by node.  Every member computes the same
+ * grouping from the AV, so all of them agree on whether the collective is
+ * hierarchical before the join completes.  A node leader creates the
+ * shared segment here, before it takes part in the join, so that the
+ * other members of its node can attach to it once the join exchange has
+ * been heard from every member.  Returns 0 on success, which includes
+ * the case where the group stays flat; *node_ok reports whether the
+ * segment could be set up.
+ */
+static int util_coll_node_init(struct util_coll_mc *coll_mc, uint32_t cid,
+			       uint8_t *node_ok)
+{
+	struct util_av *av = coll_mc->av_set->av;
+	struct util_coll_node_hdr *hdr;
+	struct util_coll_node *node;
+	const struct sockaddr *addr, *peer;
+	fi_addr_t *leaders;
+	size_t i, j, count, nleaders = 0, leader_rank = 0;
+	void *region;
+	int ret;
+
+	count = coll_mc->av_set->fi_addr_count;
+	if (!util_coll_node_enabled() || count < 2 ||
+	    coll_mc->local_rank >= count)
+		return FI_SUCCESS;
+
+	addr = ofi_av_get_addr(av, coll_mc->av_set->fi_addr_array[coll_mc->local_rank]);
+	if (addr->sa_family != AF_INET && addr->sa_family != AF_INET6)
+		return FI_SUCCESS;
+
+	node = calloc(1, sizeof(*node));
+	leaders = calloc(count, sizeof(*leaders));
+	if (!node || !leaders) {
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; i < count; i++) {
+		peer = ofi_av_get_addr(av, coll_mc->av_set->fi_addr_array[i]);
+		for (j = 0; j < i; j++) {
+			if (util_coll_same_host(peer, ofi_av_get_addr(av,
+					coll_mc->av_set->fi_addr_array[j])))
+				break;
+		}
+		if (j == i) {
+			if (i == coll_mc->local_rank)
+				leader_rank = nleaders;
+			leaders[nleaders++] = coll_mc->av_set->fi_addr_array[i];
+		}
+
+		if (!util_coll_same_host(addr, peer))
+			continue;
+
+		if (!node->nlocal)
+			snprintf(node->name, sizeof(node->name),
+				 "ofi_coll_%016" PRIx64 "_%08x",
+				 fasthash64(peer, av->addrlen, 0), cid);
+		if (i == coll_mc->local_rank)
+			node->local_idx = node->nlocal;
+		node->nlocal++;
+	}
+
+	if (nleaders == count) {
+		ret = FI_SUCCESS;
+		goto err;
+	}
+
+	coll_mc->node = node;
+	node->slot_size = ofi_get_aligned_size(coll_params.node_limit,
+					       UTIL_COLL_NODE_LINE);
+
+	if (node->local_idx) {
+		free(leaders);
+		return FI_SUCCESS;
+	}
+
+	ret = util_coll_node_leader_mc(coll_mc, leaders, nleaders, leader_rank);
+	if (ret) {
+		free(leaders);
+		util_coll_node_free(coll_mc);
+		return ret;
+	}
+
+	if (node->nlocal == 1)
+		return FI_SUCCESS;
+
+	ret = ofi_shm_map(&node->shm, node->name, util_coll_node_size(node),
+			  0, &region);
+	if (ret) {
+		FI_WARN(av->prov, FI_LOG_EP_CTRL,
+			"unable to create node segment %s\n", node->name);
+		*node_ok = 0;
+		return FI_SUCCESS;
+	}
+
+	// a segment left behind by a process that died may hold stale flags
+	node->region = region;
+	memset(region, 0, UTIL_COLL_NODE_LINE * (node->nlocal + 1));
+	hdr = region;
+	hdr->nlocal = node->nlocal;
+	hdr->slot_size = node->slot_size;
+	util_coll_store_release(hdr->magic, UTIL_COLL_NODE_MAGIC);
+	return FI_SUCCESS;
+err:
+	free(leaders);
+	free(node);
+	return ret;
+}
+
+/* Runs as part of the join, once every node leader has created its segment */
+static void util_coll_node_attach(struct util_coll_operation *join_op)
+{
+	struct util_coll_mc *coll_mc = join_op->data.join.new_mc;
+	struct util_coll_node *node = coll_mc->node;
+	struct util_coll_node_hdr *hdr;
+	void *region;
+
+	if (!node || !node->local_idx)
+		return;
+
+	if (ofi_shm_map(&node->shm, node->name, util_coll_node_size(node),
+			1, &region))
+		goto err;
+
+	node->region = region;
+	hdr = region;
+	if (util_coll_load_acquire(hdr->magic) != UTIL_COLL_NODE_MAGIC ||
+	    hdr->nlocal != node->nlocal || hdr->slot_size != node->slot_size)
+		goto err;
+
+	return;
+err:
+	FI_WARN(coll_mc->av_set->av->prov, FI_LOG_EP_CTRL,
+		"unable to attach to node segment %s\n", node->name);
+	join_op->data.join.node_ok = 0;
+}
+
 /* TODO: when this fails, clean up the already scheduled work in this function */
 static int util_coll_allreduce(struct util_coll_operation *coll_op, const void *send_buf,
 			void *result, void* tmp_buf, int count, enum fi_datatype datatype,
@@ -485,7 +914,12 @@ static int util_coll_allreduce(struct util_coll_operation *coll_op, const void *
 	local = coll_op->mc->local_rank;
 
 	// copy initial send data to result
-	memcpy(result, send_buf, count * ofi_datatype_size(datatype));
+	if (result != send_buf) {
+		ret = util_coll_sched_copy(coll_op, (void *) send_buf, result,
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+	}
 
 	if (local < 2 * rem) {
 		if (local % 2 == 0) {
@@ -569,92 +1003,540 @@ static int util_coll_allreduce(struct util_coll_operation *coll_op, const void *
 	return FI_SUCCESS;
 }
 
-static int util_coll_allgather(struct util_coll_operation *coll_op, const void *send_buf,
-			       void *result, int count, enum fi_datatype datatype)
+/*
+ * Vectors reduced by the bandwidth optimal algorithms are split into nchunks
+ * pieces whose sizes differ by at most one element.  Returns the offset of
+ * chunk i, in elements; chunk i spans [offset(i), offset(i + 1)).
+ */
+static inline size_t util_coll_chunk_offset(size_t count, size_t nchunks,
+					    size_t i)
 {
-	// allgather implemented using ring algorithm
-	int64_t ret, i, cur_offset, next_offset;
-	size_t nbytes, numranks;
-	uint64_t local_rank, left_rank, right_rank;
+	size_t base = count / nchunks, extra = count % nchunks;
+
+	return i * base + MIN(i, extra);
+}
+
+/*
+ * Rabenseifner's algorithm: a reduce-scatter by recursive halving followed by
+ * an allgather by recursive doubling.  Each process sends and receives
+ * 2 * (n - 1) / n of the vector in total, rather than log2(n) full vectors.
+ * Requires a power of two number of processes and count >= processes.
+ */
+static int util_coll_allreduce_rabenseifner(struct util_coll_operation *coll_op,
+					    const void *send_buf, void *result,
+					    void *tmp_buf, int count,
+					    enum fi_datatype datatype,
+					    enum fi_op op)
+{
+	size_t numranks, local, remote, mask;
+	size_t send_idx, recv_idx, last_idx;
+	size_t send_off, send_cnt, recv_off, recv_cnt;
+	size_t dtsize = ofi_datatype_size(datatype);
+	int ret;
 
-	local_rank = coll_op->mc->local_rank;
-	nbytes = ofi_datatype_size(datatype) * count;
 	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	assert(numranks == rounddown_power_of_two(numranks));
 
-	// copy the local value to the appropriate place in result buffer
-	ret = util_coll_sched_copy(coll_op, (void *) send_buf,
-				   (char *) result + (local_rank * nbytes), count,
-				   datatype, 1);
-	if (ret)
-		return ret;
+	if (result != send_buf) {
+		ret = util_coll_sched_copy(coll_op, (void *) send_buf, result,
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+	}
 
-	// send to right, recv from left
-	left_rank = (numranks + local_rank - 1) % numranks;
-	right_rank = (local_rank + 1) % numranks;
+	send_idx = recv_idx = 0;
+	last_idx = numranks;
+	for (mask = 1; mask < numranks; mask <<= 1) {
+		remote = local ^ mask;
+		if (local < remote) {
+			send_idx = recv_idx + numranks / (mask * 2);
+			send_off = util_coll_chunk_offset(count, numranks, send_idx);
+			send_cnt = util_coll_chunk_offset(count, numranks, last_idx) -
+				   send_off;
+			recv_off = util_coll_chunk_offset(count, numranks, recv_idx);
+			recv_cnt = send_off - recv_off;
+		} else {
+			recv_idx = send_idx + numranks / (mask * 2);
+			send_off = util_coll_chunk_offset(count, numranks, send_idx);
+			recv_off = util_coll_chunk_offset(count, numranks, recv_idx);
+			send_cnt = recv_off - send_off;
+			recv_cnt = util_coll_chunk_offset(count, numranks, last_idx) -
+				   recv_off;
+		}
 
-	cur_offset = local_rank;
-	next_offset = left_rank;
+		ret = util_coll_sched_recv(coll_op, remote,
+					   (char *) tmp_buf + recv_off * dtsize,
+					   recv_cnt, datatype, 0);
+		if (ret)
+			return ret;
 
-	// fill in result with data going right to left
-	for (i = 1; i < numranks; i++) {
-		ret = util_coll_sched_send(coll_op, right_rank,
-					   (char *) result + (cur_offset * nbytes), count,
-					   datatype, 0);
+		ret = util_coll_sched_send(coll_op, remote,
+					   (char *) result + send_off * dtsize,
+					   send_cnt, datatype, 1);
 		if (ret)
 			return ret;
 
-		ret = util_coll_sched_recv(coll_op, left_rank,
-					   (char *) result + (next_offset * nbytes),
-					   count, datatype, 1);
+		ret = util_coll_sched_reduce(coll_op,
+					     (char *) tmp_buf + recv_off * dtsize,
+					     (char *) result + recv_off * dtsize,
+					     recv_cnt, datatype, op, 1);
 		if (ret)
 			return ret;
 
-		cur_offset = next_offset;
-		next_offset = (numranks + next_offset - 1) % numranks;
+		send_idx = recv_idx;
+		if (mask * 2 < numranks)
+			last_idx = recv_idx + numranks / (mask * 2);
+	}
+
+	for (mask = numranks >> 1; mask > 0; mask >>= 1) {
+		remote = local ^ mask;
+		if (local < remote) {
+			if (mask != numranks / 2)
+				last_idx += numranks / (mask * 2);
+			recv_idx = send_idx + numranks / (mask * 2);
+			send_off = util_coll_chunk_offset(count, numranks, send_idx);
+			recv_off = util_coll_chunk_offset(count, numranks, recv_idx);
+			send_cnt = recv_off - send_off;
+			recv_cnt = util_coll_chunk_offset(count, numranks, last_idx) -
+				   recv_off;
+		} else {
+			recv_idx = send_idx - numranks / (mask * 2);
+			send_off = util_coll_chunk_offset(count, numranks, send_idx);
+			recv_off = util_coll_chunk_offset(count, numranks, recv_idx);
+			send_cnt = util_coll_chunk_offset(count, numranks, last_idx) -
+				   send_off;
+			recv_cnt = send_off - recv_off;
+		}
+
+		ret = util_coll_sched_recv(coll_op, remote,
+					   (char *) result + recv_off * dtsize,
+					   recv_cnt, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_send(coll_op, remote,
+					   (char *) result + send_off * dtsize,
+					   send_cnt, datatype, 1);
+		if (ret)
+			return ret;
+
+		if (local > remote)
+			send_idx = recv_idx;
 	}
 
 	return FI_SUCCESS;
 }
 
-static size_t util_binomial_tree_values_to_recv(uint64_t rank, size_t numranks)
+/*
+ * Ring reduce-scatter over buf, split into one chunk per process.  Step s
+ * sends chunk (first - s) to the right and reduces chunk (first - s - 1)
+ * received from the left, so after n - 1 steps chunk (first + 1) holds the
+ * full reduction.  tmp_buf must be as large as buf.
+ */
+static int util_coll_ring_reduce_scatter(struct util_coll_operation *coll_op,
+					 void *buf, void *tmp_buf, int count,
+					 enum fi_datatype datatype,
+					 enum fi_op op, size_t first)
 {
-	size_t nvalues = 0x1 << (ofi_lsb(rank) - 1);
-	if (numranks < rank + nvalues)
-		nvalues = numranks - rank;
+	size_t numranks, local, left, right, step, send_chunk, recv_chunk;
+	size_t send_off, send_cnt, recv_off, recv_cnt;
+	size_t dtsize = ofi_datatype_size(datatype);
+	int ret;
 
-	return nvalues;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	left = (local + numranks - 1) % numranks;
+	right = (local + 1) % numranks;
+
+	for (step = 0; step < numranks - 1; step++) {
+		send_chunk = (first + numranks - step) % numranks;
+		recv_chunk = (first + 2 * numranks - step - 1) % numranks;
+
+		send_off = util_coll_chunk_offset(count, numranks, send_chunk);
+		send_cnt = util_coll_chunk_offset(count, numranks,
+						  send_chunk + 1) - send_off;
+		recv_off = util_coll_chunk_offset(count, numranks, recv_chunk);
+		recv_cnt = util_coll_chunk_offset(count, numranks,
+						  recv_chunk + 1) - recv_off;
+
+		ret = util_coll_sched_recv(coll_op, left,
+					   (char *) tmp_buf + recv_off * dtsize,
+					   recv_cnt, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_send(coll_op, right,
+					   (char *) buf + send_off * dtsize,
+					   send_cnt, datatype, 1);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_reduce(coll_op,
+					     (char *) tmp_buf + recv_off * dtsize,
+					     (char *) buf + recv_off * dtsize,
+					     recv_cnt, datatype, op, 1);
+		if (ret)
+			return ret;
+	}
+
+	return FI_SUCCESS;
 }
 
-static int util_coll_scatter(struct util_coll_operation *coll_op, const void *data,
-			     void *result, void **temp, size_t count, uint64_t root,
-			     enum fi_datatype datatype)
+/*
+ * Ring allreduce: a ring reduce-scatter followed by n - 1 steps that
+ * forward the reduced chunks around the ring.  Moves the same amount of
+ * data as Rabenseifner's algorithm for any number of processes, at the
+ * cost of 2 * (n - 1) steps.  Requires count >= processes.
+ */
+static int util_coll_allreduce_ring(struct util_coll_operation *coll_op,
+				    const void *send_buf, void *result,
+				    void *tmp_buf, int count,
+				    enum fi_datatype datatype, enum fi_op op)
 {
-	// scatter implemented with binomial tree algorithm
-	uint64_t local_rank, relative_rank;
-	size_t nbytes, numranks, send_cnt, cur_cnt = 0;
-	int ret, mask, remote_rank;
-	void *send_data;
+	size_t numranks, local, left, right, step, send_chunk, recv_chunk;
+	size_t send_off, send_cnt, recv_off, recv_cnt;
+	size_t dtsize = ofi_datatype_size(datatype);
+	int ret;
 
-	local_rank = coll_op->mc->local_rank;
 	numranks = coll_op->mc->av_set->fi_addr_count;
-	relative_rank = (local_rank >= root) ? local_rank - root : local_rank - root + numranks;
-	nbytes = count * ofi_datatype_size(datatype);
-
-	// check if we need to participate
-	if (count == 0)
-		return FI_SUCCESS;
+	local = coll_op->mc->local_rank;
+	left = (local + numranks - 1) % numranks;
+	right = (local + 1) % numranks;
 
-	// non-root even nodes get a temp buffer for receiving data
-	// these nodes may need to send part of what they receive
-	if (relative_rank && !(relative_rank % 2)) {
-		cur_cnt = count * util_binomial_tree_values_to_recv(relative_rank, numranks);
-		*temp = malloc(cur_cnt * ofi_datatype_size(datatype));
-		if (!*temp)
-			return -FI_ENOMEM;
+	if (result != send_buf) {
+		ret = util_coll_sched_copy(coll_op, (void *) send_buf, result,
+					   count, datatype, 1);
+		if (ret)
+			return ret;
 	}
 
-	if (local_rank == root) {
-		cur_cnt = count * numranks;
+	ret = util_coll_ring_reduce_scatter(coll_op, result, tmp_buf, count,
+					    datatype, op, local);
+	if (ret)
+		return ret;
+
+	// we hold chunk (local + 1); step s forwards chunk (local + 1 - s)
+	for (step = 0; step < numranks - 1; step++) {
+		send_chunk = (local + 1 + numranks - step) % numranks;
+		recv_chunk = (local + numranks - step) % numranks;
+
+		send_off = util_coll_chunk_offset(count, numranks, send_chunk);
+		send_cnt = util_coll_chunk_offset(count, numranks,
+						  send_chunk + 1) - send_off;
+		recv_off = util_coll_chunk_offset(count, numranks, recv_chunk);
+		recv_cnt = util_coll_chunk_offset(count, numranks,
+						  recv_chunk + 1) - recv_off;
+
+		ret = util_coll_sched_recv(coll_op, left,
+					   (char *) result + recv_off * dtsize,
+					   recv_cnt, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_send(coll_op, right,
+					   (char *) result + send_off * dtsize,
+					   send_cnt, datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	return FI_SUCCESS;
+}
+
+static int util_coll_allreduce_select(struct util_coll_operation *coll_op,
+				      const void *send_buf, void *result,
+				      void *tmp_buf, int count,
+				      enum fi_datatype datatype, enum fi_op op)
+{
+	size_t numranks = coll_op->mc->av_set->fi_addr_count;
+
+	if (count * ofi_datatype_size(datatype) < coll_params.allreduce_limit ||
+	    count < numranks)
+		return util_coll_allreduce(coll_op, send_buf, result, tmp_buf,
+					   count, datatype, op);
+
+	if (numranks == rounddown_power_of_two(numranks))
+		return util_coll_allreduce_rabenseifner(coll_op, send_buf,
+					result, tmp_buf, count, datatype, op);
+
+	return util_coll_allreduce_ring(coll_op, send_buf, result, tmp_buf,
+					count, datatype, op);
+}
+
+/*
+ * Hierarchical allreduce.  Members of a node hand their data to the node
+ * leader through the shared segment, the leaders allreduce among
+ * themselves, and each leader publishes the result back to its node.
+ * The leader waits for every member's sequence number before it reads
+ * their slots, and a member reuses its slot only after it has seen the
+ * leader publish the previous result, so the slots need no other locking.
+ * Since collectives may be outstanding together, each operation first waits
+ * for the previous one to complete locally, which keeps a member from
+ * reusing its slot, or a leader slot 0, while the previous result is read.
+ */
+static int util_coll_allreduce_node(struct util_coll_operation *coll_op,
+				    const void *send_buf, void *result,
+				    void *tmp_buf, int count,
+				    enum fi_datatype datatype, enum fi_op op)
+{
+	struct util_coll_node *node = coll_op->mc->node;
+	uint64_t seq = ++node->seq;
+	size_t i;
+	int ret;
+
+	coll_op->node_seq = seq;
+	ret = util_coll_sched_flag(coll_op, UTIL_COLL_WAIT, &node->done,
+				   seq - 1);
+	if (ret)
+		return ret;
+
+	if (node->local_idx) {
+		ret = util_coll_sched_copy(coll_op, (void *) send_buf,
+					   util_coll_node_slot(node, node->local_idx),
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_flag(coll_op, UTIL_COLL_POST,
+					   util_coll_node_flag(node, node->local_idx),
+					   seq);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_flag(coll_op, UTIL_COLL_WAIT,
+					   util_coll_node_flag(node, 0), seq);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_copy(coll_op, util_coll_node_slot(node, 0),
+					   result, count, datatype, 1);
+		if (ret)
+			return ret;
+
+		goto out;
+	}
+
+	if (result != send_buf) {
+		ret = util_coll_sched_copy(coll_op, (void *) send_buf, result,
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 1; i < node->nlocal; i++) {
+		ret = util_coll_sched_flag(coll_op, UTIL_COLL_WAIT,
+					   util_coll_node_flag(node, i), seq);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_reduce(coll_op, util_coll_node_slot(node, i),
+					     result, count, datatype, op, 1);
+		if (ret)
+			return ret;
+	}
+
+	if (node->leader_mc->av_set->fi_addr_count > 1) {
+		// the transfers address the other leaders by leader rank, but
+		// keep the cid drawn from the full group
+		coll_op->mc = node->leader_mc;
+		ret = util_coll_allreduce_select(coll_op, result, result, tmp_buf,
+						 count, datatype, op);
+		if (ret)
+			return ret;
+	}
+
+	if (node->nlocal > 1) {
+		ret = util_coll_sched_copy(coll_op, result,
+					   util_coll_node_slot(node, 0),
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_flag(coll_op, UTIL_COLL_POST,
+					   util_coll_node_flag(node, 0), seq);
+		if (ret)
+			return ret;
+	}
+out:
+	return util_coll_sched_flag(coll_op, UTIL_COLL_POST, &node->done, seq);
+}
+
+/*
+ * Reduce-scatter by recursive halving: at each step a process keeps the
+ * half of its current range of chunks that contains its own chunk, and
+ * exchanges the other half with the partner that owns it.  Requires a power
+ * of two number of processes.  The result is left in chunk local of buf.
+ */
+static int util_coll_halving_reduce_scatter(struct util_coll_operation *coll_op,
+					    void *buf, void *tmp_buf, int count,
+					    enum fi_datatype datatype,
+					    enum fi_op op)
+{
+	size_t numranks, local, remote, mask, lo, keep, give;
+	size_t nbytes = count * ofi_datatype_size(datatype);
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	assert(numranks == rounddown_power_of_two(numranks));
+
+	lo = 0;
+	for (mask = numranks >> 1; mask > 0; mask >>= 1) {
+		remote = local ^ mask;
+		if (local < remote) {
+			keep = lo;
+			give = lo + mask;
+		} else {
+			keep = lo + mask;
+			give = lo;
+		}
+
+		ret = util_coll_sched_recv(coll_op, remote,
+					   (char *) tmp_buf + keep * nbytes,
+					   mask * count, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_send(coll_op, remote,
+					   (char *) buf + give * nbytes,
+					   mask * count, datatype, 1);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_reduce(coll_op,
+					     (char *) tmp_buf + keep * nbytes,
+					     (char *) buf + keep * nbytes,
+					     mask * count, datatype, op, 1);
+		if (ret)
+			return ret;
+
+		lo = keep;
+	}
+
+	return FI_SUCCESS;
+}
+
+static int util_coll_reduce_scatter(struct util_coll_operation *coll_op,
+				    const void *send_buf, void *result,
+				    void *tmp_buf, int count,
+				    enum fi_datatype datatype, enum fi_op op)
+{
+	size_t numranks, local, nbytes;
+	void *acc;
+	int ret;
+
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	local = coll_op->mc->local_rank;
+	nbytes = count * ofi_datatype_size(datatype);
+
+	// accumulate into the first half of tmp_buf, receive into the second
+	acc = tmp_buf;
+	memcpy(acc, send_buf, numranks * nbytes);
+
+	if (numranks == rounddown_power_of_two(numranks)) {
+		ret = util_coll_halving_reduce_scatter(coll_op, acc,
+				(char *) tmp_buf + numranks * nbytes,
+				count, datatype, op);
+	} else {
+		ret = util_coll_ring_reduce_scatter(coll_op, acc,
+				(char *) tmp_buf + numranks * nbytes,
+				count * numranks, datatype, op,
+				(local + numranks - 1) % numranks);
+	}
+	if (ret)
+		return ret;
+
+	return util_coll_sched_copy(coll_op, (char *) acc + local * nbytes,
+				    result, count, datatype, 1);
+}
+
+static int util_coll_allgather(struct util_coll_operation *coll_op, const void *send_buf,
+			       void *result, int count, enum fi_datatype datatype)
+{
+	// allgather implemented using ring algorithm
+	int64_t ret, i, cur_offset, next_offset;
+	size_t nbytes, numranks;
+	uint64_t local_rank, left_rank, right_rank;
+
+	local_rank = coll_op->mc->local_rank;
+	nbytes = ofi_datatype_size(datatype) * count;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+
+	// copy the local value to the appropriate place in result buffer
+	ret = util_coll_sched_copy(coll_op, (void *) send_buf,
+				   (char *) result + (local_rank * nbytes), count,
+				   datatype, 1);
+	if (ret)
+		return ret;
+
+	// send to right, recv from left
+	left_rank = (numranks + local_rank - 1) % numranks;
+	right_rank = (local_rank + 1) % numranks;
+
+	cur_offset = local_rank;
+	next_offset = left_rank;
+
+	// fill in result with data going right to left
+	for (i = 1; i < numranks; i++) {
+		ret = util_coll_sched_send(coll_op, right_rank,
+					   (char *) result + (cur_offset * nbytes), count,
+					   datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_recv(coll_op, left_rank,
+					   (char *) result + (next_offset * nbytes),
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+
+		cur_offset = next_offset;
+		next_offset = (numranks + next_offset - 1) % numranks;
+	}
+
+	return FI_SUCCESS;
+}
+
+static size_t util_binomial_tree_values_to_recv(uint64_t rank, size_t numranks)
+{
+	size_t nvalues = 0x1 << (ofi_lsb(rank) - 1);
+	if (numranks < rank + nvalues)
+		nvalues = numranks - rank;
+
+	return nvalues;
+}
+
+static int util_coll_scatter(struct util_coll_operation *coll_op, const void *data,
+			     void *result, void **temp, size_t count, uint64_t root,
+			     enum fi_datatype datatype)
+{
+	// scatter implemented with binomial tree algorithm
+	uint64_t local_rank, relative_rank;
+	size_t nbytes, numranks, send_cnt, cur_cnt = 0;
+	int ret, mask, remote_rank;
+	void *send_data;
+
+	local_rank = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	relative_rank = (local_rank >= root) ? local_rank - root : local_rank - root + numranks;
+	nbytes = count * ofi_datatype_size(datatype);
+
+	// check if we need to participate
+	if (count == 0)
+		return FI_SUCCESS;
+
+	// non-root even nodes get a temp buffer for receiving data
+	// these nodes may need to send part of what they receive
+	if (relative_rank && !(relative_rank % 2)) {
+		cur_cnt = count * util_binomial_tree_values_to_recv(relative_rank, numranks);
+		*temp = malloc(cur_cnt * ofi_datatype_size(datatype));
+		if (!*temp)
+			return -FI_ENOMEM;
+	}
+
+	if (local_rank == root) {
+		cur_cnt = count * numranks;
 		if (root != 0) {
 			// if we're root but not rank 0, we need to reorder the send buffer
 			// according to destination rank. if we're rank 3, data intended for
@@ -746,12 +1628,593 @@ static int util_coll_scatter(struct util_coll_operation *coll_op, const void *da
 	return FI_SUCCESS;
 }
 
+/*
+ * A run of elements moved as one message by the pipelined algorithms.
+ * Offsets and counts are in elements.  dest is the relative rank of the
+ * child a scatter segment is forwarded to, or -1 if it stays local.
+ */
+struct util_coll_seg {
+	size_t	offset;
+	size_t	count;
+	int64_t	dest;
+};
+
+/*
+ * Lists the segments that relative rank rel receives during a pipelined
+ * scatter, in the order they are sent.  Each child's subtree comes first,
+ * largest subtree first and in the child's own order, so that every
+ * segment can be forwarded unchanged as soon as it arrives.  The block
+ * kept by rel comes last.
+ */
+static void util_coll_scatter_segs(uint64_t rel, size_t numranks, size_t offset,
+				   size_t count, size_t seg_cnt,
+				   struct util_coll_seg *segs, size_t *nsegs)
+{
+	uint64_t mask;
+	size_t i, first, off;
+
+	mask = rel ? 1ULL << (ofi_lsb(rel) - 1) : roundup_power_of_two(numranks);
+	for (mask >>= 1; mask > 0; mask >>= 1) {
+		if (rel + mask >= numranks)
+			continue;
+
+		first = *nsegs;
+		util_coll_scatter_segs(rel + mask, numranks, offset + mask * count,
+				       count, seg_cnt, segs, nsegs);
+		for (i = first; i < *nsegs; i++)
+			segs[i].dest = rel + mask;
+	}
+
+	for (off = 0; off < count; off += seg_cnt) {
+		segs[*nsegs].offset = offset + off;
+		segs[*nsegs].count = MIN(seg_cnt, count - off);
+		segs[*nsegs].dest = -1;
+		(*nsegs)++;
+	}
+}
+
+/*
+ * Pipelined scatter for large blocks.  The binomial tree is the same as
+ * util_coll_scatter, but every transfer is split into segments, and a
+ * branch node forwards segment i while it receives segment i + 1 instead
+ * of waiting for its whole subtree to arrive.
+ */
+static int util_coll_scatter_pipelined(struct util_coll_operation *coll_op,
+				       const void *data, void *result, void **temp,
+				       size_t count, size_t seg_cnt, uint64_t root,
+				       enum fi_datatype datatype)
+{
+	struct util_coll_seg *segs;
+	uint64_t local_rank, relative_rank, parent;
+	size_t i, nsegs = 0, numranks, subtree, dtsize;
+	void *buf;
+	int ret;
+
+	local_rank = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	relative_rank = (local_rank >= root) ? local_rank - root :
+					       local_rank - root + numranks;
+	dtsize = ofi_datatype_size(datatype);
+
+	subtree = relative_rank ?
+		  util_binomial_tree_values_to_recv(relative_rank, numranks) :
+		  numranks;
+
+	segs = calloc(subtree * ((count + seg_cnt - 1) / seg_cnt), sizeof(*segs));
+	if (!segs)
+		return -FI_ENOMEM;
+
+	util_coll_scatter_segs(relative_rank, numranks, 0, count, seg_cnt,
+			       segs, &nsegs);
+
+	if (relative_rank % 2) {
+		buf = result;
+	} else if (relative_rank || root) {
+		*temp = malloc(subtree * count * dtsize);
+		if (!*temp) {
+			ret = -FI_ENOMEM;
+			goto out;
+		}
+		buf = *temp;
+	} else {
+		buf = (void *) data;
+	}
+
+	if (!relative_rank) {
+		if (root) {
+			ret = util_coll_sched_copy(coll_op,
+						   (char *) data + count * dtsize * root,
+						   buf, (numranks - root) * count,
+						   datatype, 1);
+			if (ret)
+				goto out;
+
+			ret = util_coll_sched_copy(coll_op, (void *) data,
+						   (char *) buf + (numranks - root) *
+						   count * dtsize, root * count,
+						   datatype, 1);
+			if (ret)
+				goto out;
+		}
+
+		for (i = 0; i < nsegs; i++) {
+			if (segs[i].dest < 0)
+				continue;
+
+			ret = util_coll_sched_send(coll_op,
+					(segs[i].dest + root) % numranks,
+					(char *) buf + segs[i].offset * dtsize,
+					segs[i].count, datatype, 0);
+			if (ret)
+				goto out;
+		}
+	} else {
+		parent = relative_rank & (relative_rank - 1);
+		parent = (parent + root) % numranks;
+
+		ret = util_coll_sched_recv(coll_op, parent,
+					   (char *) buf + segs[0].offset * dtsize,
+					   segs[0].count, datatype, 1);
+		if (ret)
+			goto out;
+
+		for (i = 0; i < nsegs; i++) {
+			if (i + 1 < nsegs) {
+				ret = util_coll_sched_recv(coll_op, parent,
+					(char *) buf + segs[i + 1].offset * dtsize,
+					segs[i + 1].count, datatype,
+					i + 2 == nsegs);
+				if (ret)
+					goto out;
+			}
+
+			if (segs[i].dest < 0)
+				continue;
+
+			ret = util_coll_sched_send(coll_op,
+					(segs[i].dest + root) % numranks,
+					(char *) buf + segs[i].offset * dtsize,
+					segs[i].count, datatype, 1);
+			if (ret)
+				goto out;
+		}
+	}
+
+	if (buf != result)
+		ret = util_coll_sched_copy(coll_op, buf, result, count, datatype, 1);
+out:
+	free(segs);
+	return ret;
+}
+
+/*
+ * Pipelined broadcast for large payloads.  The buffer is split into
+ * segments that flow down a chain or a binary tree rooted at root, and
+ * every process forwards segment k to its children while it receives
+ * segment k + 1.  A chain moves each segment once per process, so it
+ * wins when there are many more segments than processes; otherwise the
+ * shallower binary tree finishes first.  With a single segment this is
+ * a plain tree broadcast of the whole buffer.
+ */
+static int util_coll_bcast_pipelined(struct util_coll_operation *coll_op,
+				     void *buf, size_t count, size_t seg_cnt,
+				     uint64_t root, enum fi_datatype datatype)
+{
+	uint64_t local_rank, relative_rank, child;
+	size_t numranks, nsegs, fanout, nchild, dtsize, k, c;
+	char *seg;
+	int ret;
+
+	local_rank = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	relative_rank = (local_rank >= root) ? local_rank - root :
+					       local_rank - root + numranks;
+	dtsize = ofi_datatype_size(datatype);
+	nsegs = (count + seg_cnt - 1) / seg_cnt;
+
+	fanout = (nsegs + numranks - 2 <=
+		  2 * (nsegs + ofi_msb(numranks) - 2)) ? 1 : 2;
+
+	for (nchild = 0; nchild < fanout; nchild++) {
+		if (relative_rank * fanout + nchild + 1 >= numranks)
+			break;
+	}
+
+	if (relative_rank) {
+		ret = util_coll_sched_recv(coll_op,
+				((relative_rank - 1) / fanout + root) % numranks,
+				buf, MIN(seg_cnt, count), datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	for (k = 0; k < nsegs; k++) {
+		if (relative_rank && k + 1 < nsegs) {
+			seg = (char *) buf + (k + 1) * seg_cnt * dtsize;
+			ret = util_coll_sched_recv(coll_op,
+				((relative_rank - 1) / fanout + root) % numranks,
+				seg, MIN(seg_cnt, count - (k + 1) * seg_cnt),
+				datatype, !nchild && k + 2 == nsegs);
+			if (ret)
+				return ret;
+		}
+
+		seg = (char *) buf + k * seg_cnt * dtsize;
+		for (c = 0; c < nchild; c++) {
+			child = relative_rank * fanout + c + 1;
+			ret = util_coll_sched_send(coll_op, (child + root) % numranks,
+					seg, MIN(seg_cnt, count - k * seg_cnt),
+					datatype, c + 1 == nchild &&
+					(relative_rank || k + 1 == nsegs));
+			if (ret)
+				return ret;
+		}
+	}
+
+	return FI_SUCCESS;
+}
+
+static int util_coll_reduce(struct util_coll_operation *coll_op, const void *send_buf,
+			    void *result, void *tmp_buf, int count, uint64_t root,
+			    enum fi_datatype datatype, enum fi_op op)
+{
+	// reduce implemented with binomial tree algorithm
+	uint64_t local_rank, relative_rank, remote_rank;
+	size_t numranks, nbytes, mask;
+	void *acc;
+	int ret;
+
+	local_rank = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	relative_rank = (local_rank + numranks - root) % numranks;
+	nbytes = count * ofi_datatype_size(datatype);
+
+	// the root reduces into result, all others into the end of tmp_buf
+	acc = local_rank == root ? result : (char *) tmp_buf + nbytes;
+	memcpy(acc, send_buf, nbytes);
+
+	for (mask = 1; mask < numranks; mask <<= 1) {
+		if (relative_rank & mask) {
+			remote_rank = (local_rank + numranks - mask) % numranks;
+			return util_coll_sched_send(coll_op, remote_rank, acc,
+						    count, datatype, 1);
+		}
+
+		if (relative_rank + mask < numranks) {
+			remote_rank = (local_rank + mask) % numranks;
+			ret = util_coll_sched_recv(coll_op, remote_rank, tmp_buf,
+						   count, datatype, 1);
+			if (ret)
+				return ret;
+
+			ret = util_coll_sched_reduce(coll_op, tmp_buf, acc, count,
+						     datatype, op, 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return FI_SUCCESS;
+}
+
+static int util_coll_gather(struct util_coll_operation *coll_op, const void *data,
+			    void *result, void **temp, int count, uint64_t root,
+			    enum fi_datatype datatype)
+{
+	// gather implemented with binomial tree algorithm, the reverse of scatter
+	uint64_t local_rank, relative_rank, remote_rank;
+	size_t numranks, nbytes, nvalues, mask;
+	void *gather_buf;
+	int ret;
+
+	local_rank = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	relative_rank = (local_rank + numranks - root) % numranks;
+	nbytes = count * ofi_datatype_size(datatype);
+
+	if (count == 0)
+		return FI_SUCCESS;
+
+	// leaf nodes send their data directly
+	if (relative_rank % 2) {
+		remote_rank = (local_rank + numranks - 1) % numranks;
+		return util_coll_sched_send(coll_op, remote_rank, (void *) data,
+					    count, datatype, 1);
+	}
+
+	// branch nodes collect their subtree in relative rank order.  only a
+	// root at rank 0 can collect directly into the result buffer
+	nvalues = relative_rank ?
+		  util_binomial_tree_values_to_recv(relative_rank, numranks) :
+		  numranks;
+	if (local_rank == root && root == 0) {
+		gather_buf = result;
+	} else {
+		*temp = malloc(nvalues * nbytes);
+		if (!*temp)
+			return -FI_ENOMEM;
+		gather_buf = *temp;
+	}
+	memcpy(gather_buf, data, nbytes);
+
+	for (mask = 1; mask < numranks; mask <<= 1) {
+		if (relative_rank & mask) {
+			remote_rank = (local_rank + numranks - mask) % numranks;
+			return util_coll_sched_send(coll_op, remote_rank,
+						    gather_buf, nvalues * count,
+						    datatype, 1);
+		}
+
+		if (relative_rank + mask < numranks) {
+			remote_rank = (local_rank + mask) % numranks;
+			ret = util_coll_sched_recv(coll_op, remote_rank,
+					(char *) gather_buf + mask * nbytes,
+					MIN(mask, numranks - relative_rank - mask) *
+					count, datatype, 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	if (gather_buf == result)
+		return FI_SUCCESS;
+
+	// a root other than rank 0 holds the data rotated by its rank
+	ret = util_coll_sched_copy(coll_op, gather_buf,
+				   (char *) result + root * nbytes,
+				   (numranks - root) * count, datatype, 1);
+	if (ret)
+		return ret;
+
+	return util_coll_sched_copy(coll_op,
+				    (char *) gather_buf + (numranks - root) * nbytes,
+				    result, root * count, datatype, 1);
+}
+
+static int util_coll_alltoall(struct util_coll_operation *coll_op, const void *send_buf,
+			      void *result, int count, enum fi_datatype datatype)
+{
+	// alltoall implemented with pairwise exchange
+	uint64_t local_rank, src_rank, dst_rank;
+	size_t numranks, nbytes, step;
+	int ret;
+
+	local_rank = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+	nbytes = count * ofi_datatype_size(datatype);
+
+	ret = util_coll_sched_copy(coll_op, (char *) send_buf + local_rank * nbytes,
+				   (char *) result + local_rank * nbytes, count,
+				   datatype, 1);
+	if (ret)
+		return ret;
+
+	// at step i, send to the process i to the right and receive from the
+	// process i to the left, so each pair exchanges exactly once
+	for (step = 1; step < numranks; step++) {
+		dst_rank = (local_rank + step) % numranks;
+		src_rank = (local_rank + numranks - step) % numranks;
+
+		ret = util_coll_sched_recv(coll_op, src_rank,
+					   (char *) result + src_rank * nbytes,
+					   count, datatype, 0);
+		if (ret)
+			return ret;
+
+		ret = util_coll_sched_send(coll_op, dst_rank,
+					   (char *) send_buf + dst_rank * nbytes,
+					   count, datatype, 1);
+		if (ret)
+			return ret;
+	}
+
+	return FI_SUCCESS;
+}
+
+static void util_coll_op_free_data(struct util_coll_operation *coll_op)
+{
+	switch (coll_op->type) {
+	case UTIL_COLL_ALLREDUCE_OP:
+		free(coll_op->data.allreduce.data);
+		break;
+	case UTIL_COLL_SCATTER_OP:
+		free(coll_op->data.scatter);
+		break;
+	case UTIL_COLL_BROADCAST_OP:
+		free(coll_op->data.broadcast.chunk);
+		free(coll_op->data.broadcast.scatter);
+		break;
+	case UTIL_COLL_REDUCE_OP:
+		free(coll_op->data.reduce);
+		break;
+	case UTIL_COLL_REDUCE_SCATTER_OP:
+		free(coll_op->data.reduce_scatter);
+		break;
+	case UTIL_COLL_GATHER_OP:
+		free(coll_op->data.gather);
+		break;
+	case UTIL_COLL_JOIN_OP:
+	case UTIL_COLL_BARRIER_OP:
+	case UTIL_COLL_ALLGATHER_OP:
+	case UTIL_COLL_ALLTOALL_OP:
+	default:
+		//nothing to clean up
+		break;
+	}
+}
+
+static void util_coll_sched_free(struct util_coll_operation *coll_op)
+{
+	struct util_coll_work_item *item;
+
+	while (!slist_empty(&coll_op->sched)) {
+		slist_remove_head_container(&coll_op->sched,
+					    struct util_coll_work_item, item,
+					    sched_entry);
+		free(item);
+	}
+
+	util_coll_op_free_data(coll_op);
+	free(coll_op);
+}
+
+/*
+ * Frees an operation whose schedule could not be built.  It was never
+ * started, so its node sequence number is given back: the next node
+ * operation takes it and waits only for the ones before.
+ */
+static void util_coll_op_abort(struct util_coll_operation *coll_op)
+{
+	if (coll_op->node_seq)
+		coll_op->group->node->seq--;
+	util_coll_sched_free(coll_op);
+}
+
+static inline int util_coll_sched_match(struct util_coll_sched_key *key1,
+					struct util_coll_sched_key *key2)
+{
+	return key1->type == key2->type && key1->buf == key2->buf &&
+	       key1->result == key2->result && key1->count == key2->count &&
+	       key1->datatype == key2->datatype && key1->op == key2->op;
+}
+
+/*
+ * Finds an idle schedule built for key and restarts it under a new cid.
+ * Only the tags of the transfers and the sequence numbers of the node
+ * flags depend on the instance, everything else, including the buffers
+ * the work items point at, is reused as built.
+ */
+static struct util_coll_operation *
+util_coll_sched_restart(struct util_coll_mc *coll_mc,
+			struct util_coll_sched_key *key, void *context)
+{
+	struct util_coll_operation *coll_op;
+	struct util_coll_work_item *item;
+	struct util_coll_xfer_item *xfer_item;
+	struct util_coll_flag_item *flag_item;
+	struct slist_entry *entry, *prev;
+	uint64_t delta = 0;
+
+	if (util_coll_cid_busy(coll_mc))
+		return NULL;
+
+	dlist_foreach_container(&coll_mc->sched_list, struct util_coll_operation,
+				coll_op, sched_entry) {
+		if (!coll_op->busy && util_coll_sched_match(&coll_op->key, key))
+			goto found;
+	}
+	return NULL;
+
+found:
+	dlist_remove(&coll_op->sched_entry);
+	dlist_insert_head(&coll_op->sched_entry, &coll_mc->sched_list);
+
+	coll_op->cid = util_coll_get_next_id(coll_mc);
+	coll_op->context = context;
+	coll_op->busy = 1;
+	if (coll_op->node_seq) {
+		delta = ++coll_mc->node->seq - coll_op->node_seq;
+		coll_op->node_seq += delta;
+	}
+
+	(void) prev; /* Makes compiler happy */
+	slist_foreach(&coll_op->sched, entry, prev) {
+		item = container_of(entry, struct util_coll_work_item,
+				    sched_entry);
+		item->state = UTIL_COLL_WAITING;
+
+		switch (item->type) {
+		case UTIL_COLL_SEND:
+			xfer_item = container_of(item, struct util_coll_xfer_item,
+						 hdr);
+			xfer_item->tag = util_coll_form_tag(coll_op->cid,
+						coll_op->mc->local_rank);
+			break;
+		case UTIL_COLL_RECV:
+			xfer_item = container_of(item, struct util_coll_xfer_item,
+						 hdr);
+			xfer_item->tag = util_coll_form_tag(coll_op->cid,
+						xfer_item->remote_rank);
+			break;
+		case UTIL_COLL_WAIT:
+		case UTIL_COLL_POST:
+			flag_item = container_of(item, struct util_coll_flag_item,
+						 hdr);
+			flag_item->value += delta;
+			break;
+		default:
+			break;
+		}
+		dlist_insert_tail(&item->waiting_entry, &coll_op->work_queue);
+	}
+
+	return coll_op;
+}
+
+/* Bytes of temporary buffers held by a kept schedule */
+static inline size_t util_coll_sched_bytes(struct util_coll_operation *coll_op)
+{
+	return coll_op->type == UTIL_COLL_ALLREDUCE_OP ?
+	       coll_op->data.allreduce.size : 0;
+}
+
+/*
+ * Keeps a newly built schedule on its group.  The least recently used idle
+ * schedules are released until the group holds fewer than coll_sched_cache
+ * schedules and the new one's buffers fit in coll_sched_cache_size; if
+ * that cannot be done the new one is not kept.
+ */
+static void util_coll_sched_insert(struct util_coll_mc *coll_mc,
+				   struct util_coll_operation *coll_op,
+				   struct util_coll_sched_key *key)
+{
+	struct util_coll_operation *cur, *lru;
+	size_t bytes = util_coll_sched_bytes(coll_op);
+
+	if (!coll_params.sched_cache || bytes > coll_params.sched_cache_size)
+		return;
+
+	while (coll_mc->sched_cnt >= coll_params.sched_cache ||
+	       coll_mc->sched_bytes + bytes > coll_params.sched_cache_size) {
+		lru = NULL;
+		dlist_foreach_container_reverse(&coll_mc->sched_list,
+						struct util_coll_operation, cur,
+						sched_entry) {
+			if (!cur->busy) {
+				lru = cur;
+				break;
+			}
+		}
+		if (!lru)
+			return;
+
+		dlist_remove(&lru->sched_entry);
+		coll_mc->sched_bytes -= util_coll_sched_bytes(lru);
+		coll_mc->sched_cnt--;
+		util_coll_sched_free(lru);
+	}
+
+	coll_op->key = *key;
+	coll_op->persistent = 1;
+	dlist_insert_head(&coll_op->sched_entry, &coll_mc->sched_list);
+	coll_mc->sched_cnt++;
+	coll_mc->sched_bytes += bytes;
+}
+
 static int util_coll_close(struct fid *fid)
 {
 	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *coll_op;
 
 	coll_mc = container_of(fid, struct util_coll_mc, mc_fid.fid);
 
+	while (!dlist_empty(&coll_mc->sched_list)) {
+		dlist_pop_front(&coll_mc->sched_list, struct util_coll_operation,
+				coll_op, sched_entry);
+		util_coll_sched_free(coll_op);
+	}
+
+	util_coll_node_free(coll_mc);
 	free(coll_mc);
 	return FI_SUCCESS;
 }
@@ -806,6 +2269,12 @@ void util_coll_join_comp(struct util_coll_operation *coll_op)
 
 	coll_op->data.join.new_mc->seq = 0;
 	coll_op->data.join.new_mc->group_id = ofi_bitmask_get_lsbset(coll_op->data.join.data);
+	if (!coll_op->data.join.node_agreed)
+		util_coll_node_free(coll_op->data.join.new_mc);
+	else if (coll_op->data.join.new_mc->node &&
+		 coll_op->data.join.new_mc->node->leader_mc)
+		coll_op->data.join.new_mc->node->leader_mc->group_id =
+			coll_op->data.join.new_mc->group_id;
 	// mark the local mask bit
 	ofi_bitmask_unset(ep->coll_cid_mask, coll_op->data.join.new_mc->group_id);
 
@@ -823,41 +2292,26 @@ void util_coll_join_comp(struct util_coll_operation *coll_op)
 	ofi_bitmask_free(&coll_op->data.join.tmp);
 }
 
-void util_coll_collective_comp(struct util_coll_operation *coll_op)
-{
-	struct util_ep *ep;
-
-	ep = container_of(coll_op->mc->ep, struct util_ep, ep_fid);
-
-	if (ofi_cq_write(ep->tx_cq, coll_op->context, FI_COLLECTIVE, 0, 0, 0, 0))
-		FI_WARN(ep->domain->fabric->prov, FI_LOG_DOMAIN,
-			"barrier collective - cq write failed\n");
-
-	switch (coll_op->type) {
-	case UTIL_COLL_ALLREDUCE_OP:
-		free(coll_op->data.allreduce.data);
-		break;
-	case UTIL_COLL_SCATTER_OP:
-		free(coll_op->data.scatter);
-		break;
-	case UTIL_COLL_BROADCAST_OP:
-		free(coll_op->data.broadcast.chunk);
-		free(coll_op->data.broadcast.scatter);
-		break;
-	case UTIL_COLL_JOIN_OP:
-	case UTIL_COLL_BARRIER_OP:
-	case UTIL_COLL_ALLGATHER_OP:
-	default:
-		//nothing to clean up
-		break;
-	}
-}
-
+void util_coll_collective_comp(struct util_coll_operation *coll_op)
+{
+	struct util_ep *ep;
+
+	ep = container_of(coll_op->mc->ep, struct util_ep, ep_fid);
+
+	if (ofi_cq_write(ep->tx_cq, coll_op->context, FI_COLLECTIVE, 0, 0, 0, 0))
+		FI_WARN(ep->domain->fabric->prov, FI_LOG_DOMAIN,
+			"barrier collective - cq write failed\n");
+
+	// persistent schedules keep their buffers until they are released
+	if (!coll_op->persistent)
+		util_coll_op_free_data(coll_op);
+}
+
 static int util_coll_proc_reduce_item(struct util_coll_reduce_item *reduce_item)
 {
 	if (FI_MIN <= reduce_item->op && FI_BXOR >= reduce_item->op) {
-		ofi_atomic_write_handlers[reduce_item->op]
-					 [reduce_item->datatype](
+		ofi_reduce_handlers[reduce_item->op]
+				   [reduce_item->datatype](
 						 reduce_item->inout_buf,
 						 reduce_item->in_buf,
 						 reduce_item->count);
@@ -908,72 +2362,262 @@ int util_coll_process_xfer_item(struct util_coll_xfer_item *item) {
 	return -FI_ENOSYS;
 }
 
-int ofi_coll_ep_progress(struct fid_ep *ep)
+static int util_coll_process_work_item(struct util_coll_work_item *work_item)
 {
-	struct util_coll_work_item *work_item;
 	struct util_coll_reduce_item *reduce_item;
 	struct util_coll_copy_item *copy_item;
 	struct util_coll_xfer_item *xfer_item;
+	struct util_coll_flag_item *flag_item;
+	uint64_t flag;
+	int ret;
+
+	switch (work_item->type) {
+	case UTIL_COLL_SEND:
+	case UTIL_COLL_RECV:
+		xfer_item = container_of(work_item, struct util_coll_xfer_item, hdr);
+		return util_coll_process_xfer_item(xfer_item);
+	case UTIL_COLL_REDUCE:
+		reduce_item = container_of(work_item, struct util_coll_reduce_item, hdr);
+		ret = util_coll_proc_reduce_item(reduce_item);
+		if (ret)
+			return ret;
+
+		reduce_item->hdr.state = UTIL_COLL_COMPLETE;
+		return FI_SUCCESS;
+	case UTIL_COLL_COPY:
+		copy_item = container_of(work_item, struct util_coll_copy_item, hdr);
+		memcpy(copy_item->out_buf, copy_item->in_buf,
+		       copy_item->count * ofi_datatype_size(copy_item->datatype));
+
+		copy_item->hdr.state = UTIL_COLL_COMPLETE;
+		return FI_SUCCESS;
+	case UTIL_COLL_WAIT:
+		flag_item = container_of(work_item, struct util_coll_flag_item, hdr);
+		flag = util_coll_load_acquire(*flag_item->flag);
+		if ((flag & ~UTIL_COLL_NODE_FAILED) < flag_item->value)
+			return -FI_EAGAIN;
+		if (flag == (flag_item->value | UTIL_COLL_NODE_FAILED))
+			return -FI_EIO;
+
+		flag_item->hdr.state = UTIL_COLL_COMPLETE;
+		return FI_SUCCESS;
+	case UTIL_COLL_POST:
+		flag_item = container_of(work_item, struct util_coll_flag_item, hdr);
+		util_coll_store_release(*flag_item->flag, flag_item->value);
+
+		flag_item->hdr.state = UTIL_COLL_COMPLETE;
+		return FI_SUCCESS;
+	case UTIL_COLL_ATTACH:
+		util_coll_node_attach(work_item->coll_op);
+
+		work_item->state = UTIL_COLL_COMPLETE;
+		return FI_SUCCESS;
+	case UTIL_COLL_COMP:
+		if (work_item->coll_op->comp_fn)
+			work_item->coll_op->comp_fn(work_item->coll_op);
+
+		work_item->state = UTIL_COLL_COMPLETE;
+		return FI_SUCCESS;
+	default:
+		return -FI_ENOSYS;
+	}
+}
+
+/*
+ * Frees a failed operation once none of its transfers is left.
+ */
+static void util_coll_op_release(struct util_coll_operation *coll_op)
+{
+	struct util_coll_mc *coll_mc = coll_op->group;
+
+	/*
+	 * The node operation that follows waits for this one to complete
+	 * locally.  A failed operation got past that wait itself, so every
+	 * earlier one is done.
+	 */
+	if (coll_op->node_seq && coll_mc->node->done < coll_op->node_seq)
+		coll_mc->node->done = coll_op->node_seq;
+
+	/*
+	 * The new group never got a group id, so it holds no bit of the
+	 * endpoint's cid mask.  The application still closes its fid.
+	 */
+	if (coll_op->type == UTIL_COLL_JOIN_OP) {
+		util_coll_node_free(coll_op->data.join.new_mc);
+		ofi_bitmask_free(&coll_op->data.join.data);
+		ofi_bitmask_free(&coll_op->data.join.tmp);
+	}
+
+	if (coll_op->persistent) {
+		dlist_remove(&coll_op->sched_entry);
+		coll_mc->sched_bytes -= util_coll_sched_bytes(coll_op);
+		coll_mc->sched_cnt--;
+		util_coll_sched_free(coll_op);
+	} else {
+		util_coll_op_free_data(coll_op);
+		free(coll_op);
+	}
+}
+
+/*
+ * Drops the work items of a failed operation that are not waiting on a
+ * posted transfer, and releases the operation once none are left.  Node
+ * flags the operation has yet to post are posted as failed, so that the
+ * other members of the node do not wait on them forever.
+ */
+static void util_coll_op_drain(struct util_coll_operation *coll_op)
+{
+	struct util_coll_node *node = coll_op->group->node;
+	struct util_coll_flag_item *flag_item;
+	struct util_coll_work_item *item;
+	struct dlist_entry *tmp;
+
+	dlist_foreach_container_safe(&coll_op->work_queue,
+				     struct util_coll_work_item, item,
+				     waiting_entry, tmp) {
+		if (item->state == UTIL_COLL_PROCESSING)
+			continue;
+
+		if (item->type == UTIL_COLL_POST &&
+		    item->state == UTIL_COLL_WAITING) {
+			flag_item = container_of(item, struct util_coll_flag_item,
+						 hdr);
+			if (flag_item->flag != &node->done)
+				util_coll_store_release(*flag_item->flag,
+					flag_item->value | UTIL_COLL_NODE_FAILED);
+		}
+
+		dlist_remove(&item->waiting_entry);
+		if (!coll_op->persistent)
+			free(item);
+	}
+
+	if (dlist_empty(&coll_op->work_queue))
+		util_coll_op_release(coll_op);
+}
+
+static void util_coll_op_report_error(struct util_ep *util_ep,
+				      struct util_coll_operation *coll_op,
+				      int err)
+{
+	struct fi_eq_err_entry eq_err = {0};
+	struct fi_cq_err_entry cq_err = {0};
+	struct util_coll_mc *new_mc;
+
+	if (coll_op->type == UTIL_COLL_JOIN_OP) {
+		new_mc = coll_op->data.join.new_mc;
+		eq_err.fid = &new_mc->mc_fid.fid;
+		eq_err.context = new_mc->mc_fid.fid.context;
+		eq_err.err = -err;
+		eq_err.prov_errno = err;
+		if (ofi_eq_write(&util_ep->eq->eq_fid, FI_JOIN_COMPLETE,
+				 &eq_err, sizeof(eq_err), UTIL_FLAG_ERROR) < 0)
+			FI_WARN(util_ep->domain->fabric->prov, FI_LOG_DOMAIN,
+				"join collective - eq write failed\n");
+		return;
+	}
+
+	cq_err.op_context = coll_op->context;
+	cq_err.flags = FI_COLLECTIVE;
+	cq_err.err = -err;
+	cq_err.prov_errno = err;
+	if (ofi_cq_write_error(util_ep->tx_cq, &cq_err))
+		FI_WARN(util_ep->domain->fabric->prov, FI_LOG_DOMAIN,
+			"collective - cq write failed\n");
+}
+
+/*
+ * Completes an operation whose work item failed with an error and takes
+ * it off its group, so the cid it holds can be drawn again.  Transfers
+ * already posted still reference their work items, the operation is
+ * released when the last of them completes.
+ */
+static void util_coll_op_fail(struct util_ep *util_ep,
+			      struct util_coll_operation *coll_op, int err)
+{
+	struct util_coll_work_item *item;
+
+	util_coll_op_report_error(util_ep, coll_op, err);
+
+	while (!slist_empty(&coll_op->ready_queue)) {
+		slist_remove_head_container(&coll_op->ready_queue,
+					    struct util_coll_work_item, item,
+					    ready_entry);
+		item->state = UTIL_COLL_WAITING;
+	}
+	coll_op->queued = 0;
+	coll_op->failed = 1;
+
+	dlist_remove(&coll_op->active_entry);
+	util_coll_op_drain(coll_op);
+}
+
+/*
+ * Each operation keeps its own queue of ready work, and the endpoint queues
+ * the operations that have any.  Every pass takes one item from the
+ * operation at the head and moves that operation behind the others, so
+ * outstanding collectives progress in turn.  An operation whose next item
+ * cannot proceed, because a transfer returned -FI_EAGAIN or a node flag is
+ * not yet set, is set aside until the next call and does not hold up the
+ * others.
+ */
+int ofi_coll_ep_progress(struct fid_ep *ep)
+{
+	struct util_coll_work_item *work_item;
 	struct util_coll_operation *coll_op;
 	struct util_ep *util_ep;
-	int ret;
+	struct slist blocked;
+	int ret, err = FI_SUCCESS;
 
 	util_ep  = container_of(ep, struct util_ep, ep_fid);
+	slist_init(&blocked);
 
 	while (!slist_empty(&util_ep->coll_ready_queue)) {
 		slist_remove_head_container(&util_ep->coll_ready_queue,
+					    struct util_coll_operation, coll_op,
+					    ready_entry);
+		slist_remove_head_container(&coll_op->ready_queue,
 					    struct util_coll_work_item, work_item,
 					    ready_entry);
-		coll_op = work_item->coll_op;
-		switch (work_item->type) {
-		case UTIL_COLL_SEND:
-			xfer_item = container_of(work_item, struct util_coll_xfer_item, hdr);
-			ret = util_coll_process_xfer_item(xfer_item);
-			if (ret && ret == -FI_EAGAIN) {
-				slist_insert_tail(&work_item->ready_entry,
-						  &util_ep->coll_ready_queue);
-				goto out;
-			}
-			break;
-		case UTIL_COLL_RECV:
-			xfer_item = container_of(work_item, struct util_coll_xfer_item, hdr);
-			ret = util_coll_process_xfer_item(xfer_item);
-			if (ret)
-				goto out;
-			break;
-		case UTIL_COLL_REDUCE:
-			reduce_item = container_of(work_item, struct util_coll_reduce_item, hdr);
-			ret = util_coll_proc_reduce_item(reduce_item);
-			if (ret)
-				goto out;
 
-			reduce_item->hdr.state = UTIL_COLL_COMPLETE;
-			break;
-		case UTIL_COLL_COPY:
-			copy_item = container_of(work_item, struct util_coll_copy_item, hdr);
-			memcpy(copy_item->out_buf, copy_item->in_buf,
-			       copy_item->count * ofi_datatype_size(copy_item->datatype));
-
-			copy_item->hdr.state = UTIL_COLL_COMPLETE;
-			break;
-		case UTIL_COLL_COMP:
-			if (work_item->coll_op->comp_fn)
-				work_item->coll_op->comp_fn(work_item->coll_op);
+		ret = util_coll_process_work_item(work_item);
+		if (ret == -FI_EAGAIN) {
+			// retry first, transfers to the same peer share a
+			// tag and must be posted in the order scheduled
+			slist_insert_head(&work_item->ready_entry,
+					  &coll_op->ready_queue);
+			slist_insert_tail(&coll_op->ready_entry, &blocked);
+			continue;
+		}
 
+		if (ret) {
+			FI_WARN(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
+				"collective work item failed: %s\n",
+				fi_strerror(-ret));
 			work_item->state = UTIL_COLL_COMPLETE;
-			break;
-		default:
-			ret = FI_ENOSYS;
-			goto out;
+			util_coll_op_fail(util_ep, coll_op, ret);
+			if (!err)
+				err = ret;
+			continue;
 		}
 
+		if (slist_empty(&coll_op->ready_queue))
+			coll_op->queued = 0;
+		else
+			slist_insert_tail(&coll_op->ready_entry,
+					  &util_ep->coll_ready_queue);
+
 		util_coll_op_progress_work(util_ep, coll_op);
 	}
 
-	ret = FI_SUCCESS;
+	while (!slist_empty(&blocked)) {
+		slist_remove_head_container(&blocked, struct util_coll_operation,
+					    coll_op, ready_entry);
+		slist_insert_tail(&coll_op->ready_entry,
+				  &util_ep->coll_ready_queue);
+	}
 
-out:
-	return ret;
+	return err;
 }
 
 int ofi_join_collective(struct fid_ep *ep, fi_addr_t coll_addr,
@@ -1036,22 +2680,49 @@ int ofi_join_collective(struct fid_ep *ep, fi_addr_t coll_addr,
 		ofi_bitmask_set_all(&join_op->data.join.data);
 	}
 
+	join_op->data.join.node_ok = 1;
+	join_op->data.join.node_agreed = 1;
+	if (new_coll_mc->local_rank != FI_ADDR_NOTAVAIL) {
+		ret = util_coll_node_init(new_coll_mc, join_op->cid,
+					  &join_op->data.join.node_ok);
+		if (ret)
+			goto err4;
+	}
+
 	ret = util_coll_allreduce(join_op, util_ep->coll_cid_mask->bytes,
 				  join_op->data.join.data.bytes,
 				  join_op->data.join.tmp.bytes,
 				  ofi_bitmask_bytesize(util_ep->coll_cid_mask),
 				  FI_UINT8, FI_BAND);
 	if (ret)
-		goto err4;
+		goto err5;
+
+	if (util_coll_node_enabled()) {
+		// members attach to their leader's segment once the exchange
+		// above has completed, and then agree on whether every node
+		// is set up
+		ret = util_coll_sched_attach(join_op);
+		if (ret)
+			goto err5;
+
+		ret = util_coll_allreduce(join_op, &join_op->data.join.node_ok,
+					  &join_op->data.join.node_agreed,
+					  &join_op->data.join.node_tmp, 1,
+					  FI_UINT8, FI_BAND);
+		if (ret)
+			goto err5;
+	}
 
 	ret = util_coll_sched_comp(join_op);
 	if (ret)
-		goto err4;
+		goto err5;
 
-	util_coll_op_progress_work(util_ep, join_op);
+	util_coll_op_start(util_ep, join_op);
 
 	*mc = &new_coll_mc->mc_fid;
 	return FI_SUCCESS;
+err5:
+	util_coll_node_free(new_coll_mc);
 err4:
 	ofi_bitmask_free(&join_op->data.join.tmp);
 err3:
@@ -1184,20 +2855,37 @@ ssize_t ofi_ep_barrier(struct fid_ep *ep, fi_addr_t coll_addr, void *context)
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *barrier_op;
+	struct util_coll_sched_key key = {
+		.type = UTIL_COLL_BARRIER_OP,
+	};
 	struct util_ep *util_ep;
-	uint64_t send;
 	int ret;
 
 	coll_mc = (struct util_coll_mc*) ((uintptr_t) coll_addr);
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+
+	barrier_op = util_coll_sched_restart(coll_mc, &key, context);
+	if (barrier_op)
+		goto progress;
 
 	ret = util_coll_op_create(&barrier_op, coll_mc, UTIL_COLL_BARRIER_OP, context,
 			  util_coll_collective_comp);
 	if (ret)
 		return ret;
 
-	send = ~barrier_op->mc->local_rank;
-	ret = util_coll_allreduce(barrier_op, &send, &barrier_op->data.barrier.data,
-				  &barrier_op->data.barrier.tmp, 1, FI_UINT64, FI_BAND);
+	barrier_op->data.barrier.send = ~barrier_op->mc->local_rank;
+	if (coll_mc->node)
+		ret = util_coll_allreduce_node(barrier_op,
+					       &barrier_op->data.barrier.send,
+					       &barrier_op->data.barrier.data,
+					       &barrier_op->data.barrier.tmp, 1,
+					       FI_UINT64, FI_BAND);
+	else
+		ret = util_coll_allreduce(barrier_op,
+					  &barrier_op->data.barrier.send,
+					  &barrier_op->data.barrier.data,
+					  &barrier_op->data.barrier.tmp, 1,
+					  FI_UINT64, FI_BAND);
 	if (ret)
 		goto err1;
 
@@ -1205,12 +2893,13 @@ ssize_t ofi_ep_barrier(struct fid_ep *ep, fi_addr_t coll_addr, void *context)
 	if (ret)
 		goto err1;
 
-	util_ep = container_of(ep, struct util_ep, ep_fid);
-	util_coll_op_progress_work(util_ep, barrier_op);
+	util_coll_sched_insert(coll_mc, barrier_op, &key);
+progress:
+	util_coll_op_start(util_ep, barrier_op);
 
 	return FI_SUCCESS;
 err1:
-	free(barrier_op);
+	util_coll_op_abort(barrier_op);
 	return ret;
 }
 
@@ -1221,10 +2910,24 @@ ssize_t ofi_ep_allreduce(struct fid_ep *ep, const void *buf, size_t count, void
 {
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *allreduce_op;
+	struct util_coll_sched_key key = {
+		.type = UTIL_COLL_ALLREDUCE_OP,
+		.buf = buf,
+		.result = result,
+		.count = count,
+		.datatype = datatype,
+		.op = op,
+	};
 	struct util_ep *util_ep;
 	int ret;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+
+	allreduce_op = util_coll_sched_restart(coll_mc, &key, context);
+	if (allreduce_op)
+		goto progress;
+
 	ret = util_coll_op_create(&allreduce_op, coll_mc, UTIL_COLL_ALLREDUCE_OP, context,
 				  util_coll_collective_comp);
 	if (ret)
@@ -1233,26 +2936,34 @@ ssize_t ofi_ep_allreduce(struct fid_ep *ep, const void *buf, size_t count, void
 
 	allreduce_op->data.allreduce.size = count * ofi_datatype_size(datatype);
 	allreduce_op->data.allreduce.data = calloc(count, ofi_datatype_size(datatype));
-	if (!allreduce_op->data.allreduce.data)
-		goto err1;
+	if (!allreduce_op->data.allreduce.data) {
+		ret = -FI_ENOMEM;
+		goto err;
+	}
 
-	ret = util_coll_allreduce(allreduce_op, buf, result, allreduce_op->data.allreduce.data, count,
-				  datatype, op);
+	if (coll_mc->node &&
+	    allreduce_op->data.allreduce.size <= coll_params.node_limit)
+		ret = util_coll_allreduce_node(allreduce_op, buf, result,
+					       allreduce_op->data.allreduce.data,
+					       count, datatype, op);
+	else
+		ret = util_coll_allreduce_select(allreduce_op, buf, result,
+					allreduce_op->data.allreduce.data,
+					count, datatype, op);
 	if (ret)
-		goto err2;
+		goto err;
 
 	ret = util_coll_sched_comp(allreduce_op);
 	if (ret)
-		goto err2;
+		goto err;
 
-	util_ep = container_of(ep, struct util_ep, ep_fid);
-	util_coll_op_progress_work(util_ep, allreduce_op);
+	util_coll_sched_insert(coll_mc, allreduce_op, &key);
+progress:
+	util_coll_op_start(util_ep, allreduce_op);
 
 	return FI_SUCCESS;
-err2:
-	free(allreduce_op->data.allreduce.data);
-err1:
-	free(allreduce_op);
+err:
+	util_coll_op_abort(allreduce_op);
 	return ret;
 }
 
@@ -1280,7 +2991,7 @@ ssize_t ofi_ep_allgather(struct fid_ep *ep, const void *buf, size_t count, void
 		goto err;
 
 	util_ep = container_of(ep, struct util_ep, ep_fid);
-	util_coll_op_progress_work(util_ep, allgather_op);
+	util_coll_op_start(util_ep, allgather_op);
 
 	return FI_SUCCESS;
 err:
@@ -1304,7 +3015,17 @@ ssize_t ofi_ep_scatter(struct fid_ep *ep, const void *buf, size_t count, void *d
 	if (ret)
 		return ret;
 
-	ret = util_coll_scatter(scatter_op, buf, result, &scatter_op->data.scatter, count, root_addr, datatype);
+	if (coll_params.segment_size &&
+	    count * ofi_datatype_size(datatype) >= coll_params.segment_size)
+		ret = util_coll_scatter_pipelined(scatter_op, buf, result,
+				&scatter_op->data.scatter, count,
+				MAX(coll_params.segment_size /
+				    ofi_datatype_size(datatype), 1),
+				root_addr, datatype);
+	else
+		ret = util_coll_scatter(scatter_op, buf, result,
+					&scatter_op->data.scatter, count,
+					root_addr, datatype);
 	if (ret)
 		goto err;
 
@@ -1313,7 +3034,7 @@ ssize_t ofi_ep_scatter(struct fid_ep *ep, const void *buf, size_t count, void *d
 		goto err;
 
 	util_ep = container_of(ep, struct util_ep, ep_fid);
-	util_coll_op_progress_work(util_ep, scatter_op);
+	util_coll_op_start(util_ep, scatter_op);
 
 	return FI_SUCCESS;
 err:
@@ -1328,7 +3049,7 @@ ssize_t ofi_ep_broadcast(struct fid_ep *ep, void *buf, size_t count, void *desc,
 	struct util_coll_mc *coll_mc;
 	struct util_coll_operation *broadcast_op;
 	struct util_ep *util_ep;
-	int ret, chunk_cnt, numranks, local;
+	int ret, chunk_cnt, numranks;
 
 	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
 	ret = util_coll_op_create(&broadcast_op, coll_mc, UTIL_COLL_BROADCAST_OP, context,
@@ -1336,41 +3057,212 @@ ssize_t ofi_ep_broadcast(struct fid_ep *ep, void *buf, size_t count, void *desc,
 	if (ret)
 		return ret;
 
-	local = broadcast_op->mc->local_rank;
 	numranks = broadcast_op->mc->av_set->fi_addr_count;
-	chunk_cnt = (count + numranks - 1) / numranks;
-	if (chunk_cnt * local > count && chunk_cnt * local - (int) count > chunk_cnt)
-		chunk_cnt = 0;
+	if (coll_params.segment_size &&
+	    count * ofi_datatype_size(datatype) > coll_params.segment_size) {
+		ret = util_coll_bcast_pipelined(broadcast_op, buf, count,
+				MAX(coll_params.segment_size /
+				    ofi_datatype_size(datatype), 1),
+				root_addr, datatype);
+		if (ret)
+			goto err1;
+	} else if (count % numranks) {
+		// scatter-allgather needs equal chunks, send the whole buffer
+		ret = util_coll_bcast_pipelined(broadcast_op, buf, count, count,
+						root_addr, datatype);
+		if (ret)
+			goto err1;
+	} else {
+		chunk_cnt = count / numranks;
+		broadcast_op->data.broadcast.chunk =
+			malloc(chunk_cnt * ofi_datatype_size(datatype));
+		if (!broadcast_op->data.broadcast.chunk) {
+			ret = -FI_ENOMEM;
+			goto err1;
+		}
+
+		ret = util_coll_scatter(broadcast_op, buf,
+					broadcast_op->data.broadcast.chunk,
+					&broadcast_op->data.broadcast.scatter,
+					chunk_cnt, root_addr, datatype);
+		if (ret)
+			goto err2;
+
+		ret = util_coll_allgather(broadcast_op,
+					  broadcast_op->data.broadcast.chunk,
+					  buf, chunk_cnt, datatype);
+		if (ret)
+			goto err2;
+	}
+
+	ret = util_coll_sched_comp(broadcast_op);
+	if (ret)
+		goto err2;
+
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	util_coll_op_start(util_ep, broadcast_op);
+
+	return FI_SUCCESS;
+err2:
+	free(broadcast_op->data.broadcast.chunk);
+err1:
+	free(broadcast_op);
+	return ret;
+}
 
-	broadcast_op->data.broadcast.chunk = malloc(chunk_cnt * ofi_datatype_size(datatype));
-	if (!broadcast_op->data.broadcast.chunk) {
+ssize_t ofi_ep_reduce(struct fid_ep *ep, const void *buf, size_t count, void *desc,
+		      void *result, void *result_desc, fi_addr_t coll_addr,
+		      fi_addr_t root_addr, enum fi_datatype datatype, enum fi_op op,
+		      uint64_t flags, void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *reduce_op;
+	struct util_ep *util_ep;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	ret = util_coll_op_create(&reduce_op, coll_mc, UTIL_COLL_REDUCE_OP, context,
+				  util_coll_collective_comp);
+	if (ret)
+		return ret;
+
+	reduce_op->data.reduce = calloc(2 * count, ofi_datatype_size(datatype));
+	if (!reduce_op->data.reduce) {
 		ret = -FI_ENOMEM;
 		goto err1;
 	}
 
-	ret = util_coll_scatter(broadcast_op, buf, broadcast_op->data.broadcast.chunk,
-				&broadcast_op->data.broadcast.scatter, chunk_cnt,
-				root_addr, datatype);
+	ret = util_coll_reduce(reduce_op, buf, result, reduce_op->data.reduce,
+			       count, root_addr, datatype, op);
 	if (ret)
 		goto err2;
 
-	ret = util_coll_allgather(broadcast_op, broadcast_op->data.broadcast.chunk, buf,
-				  chunk_cnt, datatype);
+	ret = util_coll_sched_comp(reduce_op);
 	if (ret)
 		goto err2;
 
-	ret = util_coll_sched_comp(broadcast_op);
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	util_coll_op_start(util_ep, reduce_op);
+
+	return FI_SUCCESS;
+err2:
+	free(reduce_op->data.reduce);
+err1:
+	free(reduce_op);
+	return ret;
+}
+
+ssize_t ofi_ep_reduce_scatter(struct fid_ep *ep, const void *buf, size_t count,
+			      void *desc, void *result, void *result_desc,
+			      fi_addr_t coll_addr, enum fi_datatype datatype,
+			      enum fi_op op, uint64_t flags, void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *reduce_scatter_op;
+	struct util_ep *util_ep;
+	size_t numranks;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	ret = util_coll_op_create(&reduce_scatter_op, coll_mc,
+				  UTIL_COLL_REDUCE_SCATTER_OP, context,
+				  util_coll_collective_comp);
+	if (ret)
+		return ret;
+
+	numranks = coll_mc->av_set->fi_addr_count;
+	reduce_scatter_op->data.reduce_scatter =
+		calloc(2 * numranks * count, ofi_datatype_size(datatype));
+	if (!reduce_scatter_op->data.reduce_scatter) {
+		ret = -FI_ENOMEM;
+		goto err1;
+	}
+
+	ret = util_coll_reduce_scatter(reduce_scatter_op, buf, result,
+				       reduce_scatter_op->data.reduce_scatter,
+				       count, datatype, op);
+	if (ret)
+		goto err2;
+
+	ret = util_coll_sched_comp(reduce_scatter_op);
 	if (ret)
 		goto err2;
 
 	util_ep = container_of(ep, struct util_ep, ep_fid);
-	util_coll_op_progress_work(util_ep, broadcast_op);
+	util_coll_op_start(util_ep, reduce_scatter_op);
 
 	return FI_SUCCESS;
 err2:
-	free(broadcast_op->data.broadcast.chunk);
+	free(reduce_scatter_op->data.reduce_scatter);
 err1:
-	free(broadcast_op);
+	free(reduce_scatter_op);
+	return ret;
+}
+
+ssize_t ofi_ep_gather(struct fid_ep *ep, const void *buf, size_t count, void *desc,
+		      void *result, void *result_desc, fi_addr_t coll_addr,
+		      fi_addr_t root_addr, enum fi_datatype datatype, uint64_t flags,
+		      void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *gather_op;
+	struct util_ep *util_ep;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	ret = util_coll_op_create(&gather_op, coll_mc, UTIL_COLL_GATHER_OP, context,
+				  util_coll_collective_comp);
+	if (ret)
+		return ret;
+
+	ret = util_coll_gather(gather_op, buf, result, &gather_op->data.gather,
+			       count, root_addr, datatype);
+	if (ret)
+		goto err;
+
+	ret = util_coll_sched_comp(gather_op);
+	if (ret)
+		goto err;
+
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	util_coll_op_start(util_ep, gather_op);
+
+	return FI_SUCCESS;
+err:
+	free(gather_op->data.gather);
+	free(gather_op);
+	return ret;
+}
+
+ssize_t ofi_ep_alltoall(struct fid_ep *ep, const void *buf, size_t count, void *desc,
+			void *result, void *result_desc, fi_addr_t coll_addr,
+			enum fi_datatype datatype, uint64_t flags, void *context)
+{
+	struct util_coll_mc *coll_mc;
+	struct util_coll_operation *alltoall_op;
+	struct util_ep *util_ep;
+	int ret;
+
+	coll_mc = (struct util_coll_mc *) ((uintptr_t) coll_addr);
+	ret = util_coll_op_create(&alltoall_op, coll_mc, UTIL_COLL_ALLTOALL_OP, context,
+				  util_coll_collective_comp);
+	if (ret)
+		return ret;
+
+	ret = util_coll_alltoall(alltoall_op, buf, result, count, datatype);
+	if (ret)
+		goto err;
+
+	ret = util_coll_sched_comp(alltoall_op);
+	if (ret)
+		goto err;
+
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	util_coll_op_start(util_ep, alltoall_op);
+
+	return FI_SUCCESS;
+err:
+	free(alltoall_op);
 	return ret;
 }
 
@@ -1385,6 +3277,11 @@ void ofi_coll_handle_xfer_comp(uint64_t tag, void *ctx)
 	       xfer_item, xfer_item->hdr.type == UTIL_COLL_SEND ? "SEND" : "RECV",
 	       xfer_item->remote_rank, xfer_item->hdr.coll_op->mc->local_rank,
 	       xfer_item->count, ofi_datatype_size(xfer_item->datatype));
+	if (xfer_item->hdr.coll_op->failed) {
+		util_coll_op_drain(xfer_item->hdr.coll_op);
+		return;
+	}
+
 	util_ep = container_of(xfer_item->hdr.coll_op->mc->ep, struct util_ep, ep_fid);
 	util_coll_op_progress_work(util_ep, xfer_item->hdr.coll_op);
 }
@@ -1402,19 +3299,19 @@ int ofi_query_collective(struct fid_domain *domain, enum fi_collective_op coll,
 	case FI_ALLGATHER:
 	case FI_SCATTER:
 	case FI_BROADCAST:
+	case FI_GATHER:
+	case FI_ALLTOALL:
 		ret = FI_SUCCESS;
 		break;
 	case FI_ALLREDUCE:
+	case FI_REDUCE_SCATTER:
+	case FI_REDUCE:
 		if (FI_MIN <= attr->op && FI_BXOR >= attr->op)
 			ret = fi_query_atomic(domain, attr->datatype, attr->op,
 					      &attr->datatype_attr, flags);
 		else
 			return -FI_ENOSYS;
 		break;
-	case FI_ALLTOALL:
-	case FI_REDUCE_SCATTER:
-	case FI_REDUCE:
-	case FI_GATHER:
 	default:
 		return -FI_ENOSYS;
 	}
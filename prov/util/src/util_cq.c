@@ -61,10 +61,36 @@ int ofi_cq_write_overflow(struct util_cq *cq, void *context, uint64_t flags, siz
 
 	entry->src = src;
 	slist_insert_tail(&entry->list_entry, &cq->oflow_err_list);
+	cq->oflow_cnt++;
 
 	return 0;
 }
 
+int ofi_cq_write_spsc_slow(struct util_cq *cq, void *context, uint64_t flags,
+			   size_t len, void *buf, uint64_t data, uint64_t tag,
+			   fi_addr_t src)
+{
+	struct util_cq_oflow_err_entry *entry;
+
+	if (!(entry = calloc(1, sizeof(*entry))))
+		return -FI_ENOMEM;
+
+	entry->comp.op_context = context;
+	entry->comp.flags = flags;
+	entry->comp.len = len;
+	entry->comp.buf = buf;
+	entry->comp.data = data;
+	entry->comp.tag = tag;
+	entry->src = src;
+
+	cq->cq_fastlock_acquire(&cq->cq_lock);
+	ofi_atomic_set32(&cq->spsc_slow, 1);
+	slist_insert_tail(&entry->list_entry, &cq->oflow_err_list);
+	cq->oflow_cnt++;
+	cq->cq_fastlock_release(&cq->cq_lock);
+	return 0;
+}
+
 int ofi_cq_write_error(struct util_cq *cq,
 		       const struct fi_cq_err_entry *err_entry)
 {
@@ -78,7 +104,15 @@ int ofi_cq_write_error(struct util_cq *cq,
 
 	entry->comp = *err_entry;
 	cq->cq_fastlock_acquire(&cq->cq_lock);
+	if (cq->spsc) {
+		ofi_atomic_set32(&cq->spsc_slow, 1);
+		slist_insert_tail(&entry->list_entry, &cq->oflow_err_list);
+		cq->oflow_cnt++;
+		goto unlock;
+	}
+
 	slist_insert_tail(&entry->list_entry, &cq->oflow_err_list);
+	cq->oflow_cnt++;
 
 	if (OFI_UNLIKELY(ofi_cirque_isfull(cq->cirq))) {
 		comp = ofi_cirque_tail(cq->cirq);
@@ -89,6 +123,7 @@ int ofi_cq_write_error(struct util_cq *cq,
 		comp->flags = UTIL_FLAG_ERROR;
 		ofi_cirque_commit(cq->cirq);
 	}
+unlock:
 	cq->cq_fastlock_release(&cq->cq_lock);
 	if (cq->wait)
 		cq->wait->signal(cq->wait);
@@ -166,7 +201,7 @@ int ofi_check_cq_attr(const struct fi_provider *prov,
 		return -FI_EINVAL;
 	}
 
-	if (attr->flags & ~(FI_AFFINITY)) {
+	if (attr->flags & ~(FI_AFFINITY | FI_CQ_SPSC)) {
 		FI_WARN(prov, FI_LOG_CQ, "invalid flags\n");
 		return -FI_EINVAL;
 	}
@@ -202,6 +237,58 @@ static void util_cq_read_tagged(void **dst, void *src)
 	*(char **)dst += sizeof(struct fi_cq_tagged_entry);
 }
 
+/*
+ * Bulk copy of consecutive cirque entries into the user's buffer.  Used
+ * when the CQ holds no error or overflow entries, so the per-entry flag
+ * checks can be skipped.
+ */
+#define UTIL_CQ_DEFINE_READ_BULK(name, type)				\
+static void util_cq_read_ ## name ## _bulk(void **dst,			\
+		const struct fi_cq_tagged_entry *src, size_t count)	\
+{									\
+	type *entry = (type *) *dst;					\
+	size_t i;							\
+									\
+	for (i = 0; i < count; i++)					\
+		entry[i] = *(const type *) &src[i];			\
+	*dst = &entry[count];						\
+}
+
+UTIL_CQ_DEFINE_READ_BULK(ctx, struct fi_cq_entry)
+UTIL_CQ_DEFINE_READ_BULK(msg, struct fi_cq_msg_entry)
+UTIL_CQ_DEFINE_READ_BULK(data, struct fi_cq_data_entry)
+
+static void util_cq_read_tagged_bulk(void **dst,
+		const struct fi_cq_tagged_entry *src, size_t count)
+{
+	memcpy(*dst, src, sizeof(*src) * count);
+	*(char **) dst += sizeof(*src) * count;
+}
+
+/* Caller must hold `cq_lock` and ensure `oflow_err_list` is empty */
+static ssize_t util_cq_read_bulk(struct util_cq *cq, void *buf, size_t count,
+				 fi_addr_t *src_addr)
+{
+	size_t rindex, seg;
+
+	rindex = ofi_cirque_rindex(cq->cirq);
+	seg = MIN(count, cq->cirq->size - rindex);
+
+	cq->read_bulk(&buf, &cq->cirq->buf[rindex], seg);
+	if (seg < count)
+		cq->read_bulk(&buf, cq->cirq->buf, count - seg);
+
+	if (src_addr && cq->src) {
+		memcpy(src_addr, &cq->src[rindex], sizeof(*src_addr) * seg);
+		if (seg < count)
+			memcpy(&src_addr[seg], cq->src,
+			       sizeof(*src_addr) * (count - seg));
+	}
+
+	cq->cirq->rcnt += count;
+	return count;
+}
+
 static inline
 void util_cq_read_oflow_entry(struct util_cq *cq,
 			      struct util_cq_oflow_err_entry *oflow_entry,
@@ -231,6 +318,94 @@ void util_cq_read_entry(struct util_cq *cq, struct fi_cq_tagged_entry *entry,
 	ofi_cirque_discard(cq->cirq);
 }
 
+/*
+ * Completions queued on oflow_err_list while in SPSC slow mode follow
+ * every entry in the cirque, so they may only be read once the cirque
+ * has been drained.  Caller must hold `cq_lock`.
+ */
+static ssize_t util_cq_read_spsc_slow(struct util_cq *cq, void *buf,
+				      size_t count, fi_addr_t *src_addr)
+{
+	struct util_cq_oflow_err_entry *oflow_entry;
+	struct fi_cq_tagged_entry comp;
+	ssize_t i;
+
+	for (i = 0; i < (ssize_t) count && !slist_empty(&cq->oflow_err_list);
+	     i++) {
+		oflow_entry = container_of(cq->oflow_err_list.head,
+					   struct util_cq_oflow_err_entry,
+					   list_entry);
+		if (oflow_entry->comp.err)
+			return i ? i : -FI_EAVAIL;
+
+		comp.op_context = oflow_entry->comp.op_context;
+		comp.flags = oflow_entry->comp.flags;
+		comp.len = oflow_entry->comp.len;
+		comp.buf = oflow_entry->comp.buf;
+		comp.data = oflow_entry->comp.data;
+		comp.tag = oflow_entry->comp.tag;
+		cq->read_entry(&buf, &comp);
+		if (src_addr && cq->src)
+			src_addr[i] = oflow_entry->src;
+
+		slist_remove_head(&cq->oflow_err_list);
+		free(oflow_entry);
+	}
+
+	if (slist_empty(&cq->oflow_err_list))
+		ofi_atomic_set32(&cq->spsc_slow, 0);
+	return i;
+}
+
+static ssize_t util_cq_readfrom_spsc(struct util_cq *cq, void *buf,
+				     size_t count, fi_addr_t *src_addr)
+{
+	size_t avail, rindex, seg, n;
+	ssize_t ret;
+	int slow;
+
+	/* spsc_slow must be sampled before wcnt, see util_cq_read_spsc_slow */
+	slow = ofi_atomic_get32(&cq->spsc_slow);
+	avail = ofi_cirque_load_acquire(cq->cirq->wcnt) - cq->cirq->rcnt;
+	if (!avail || !count) {
+		cq->progress(cq);
+		slow = ofi_atomic_get32(&cq->spsc_slow);
+		avail = ofi_cirque_load_acquire(cq->cirq->wcnt) -
+			cq->cirq->rcnt;
+		if (!avail && !slow)
+			return -FI_EAGAIN;
+	}
+
+	n = MIN(count, avail);
+	if (n) {
+		rindex = ofi_cirque_rindex(cq->cirq);
+		seg = MIN(n, cq->cirq->size - rindex);
+		if (src_addr && cq->src) {
+			memcpy(src_addr, &cq->src[rindex],
+			       sizeof(*src_addr) * seg);
+			if (seg < n)
+				memcpy(&src_addr[seg], cq->src,
+				       sizeof(*src_addr) * (n - seg));
+		}
+		cq->read_bulk(&buf, &cq->cirq->buf[rindex], seg);
+		if (seg < n)
+			cq->read_bulk(&buf, cq->cirq->buf, n - seg);
+		ofi_cirque_store_release(cq->cirq->rcnt, cq->cirq->rcnt + n);
+	}
+
+	if (n == count || !slow)
+		return n;
+
+	cq->cq_fastlock_acquire(&cq->cq_lock);
+	ret = util_cq_read_spsc_slow(cq, buf, count - n,
+				     src_addr ? &src_addr[n] : NULL);
+	cq->cq_fastlock_release(&cq->cq_lock);
+
+	if (ret < 0)
+		return n ? (ssize_t) n : ret;
+	return n + ret;
+}
+
 ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 			fi_addr_t *src_addr)
 {
@@ -239,6 +414,8 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 	ssize_t i;
 
 	cq = container_of(cq_fid, struct util_cq, cq_fid);
+	if (cq->spsc)
+		return util_cq_readfrom_spsc(cq, buf, count, src_addr);
 
 	cq->cq_fastlock_acquire(&cq->cq_lock);
 	if (ofi_cirque_isempty(cq->cirq) || !count) {
@@ -254,6 +431,11 @@ ssize_t ofi_cq_readfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 	if (count > ofi_cirque_usedcnt(cq->cirq))
 		count = ofi_cirque_usedcnt(cq->cirq);
 
+	if (OFI_LIKELY(slist_empty(&cq->oflow_err_list))) {
+		i = util_cq_read_bulk(cq, buf, count, src_addr);
+		goto out;
+	}
+
 	for (i = 0; i < (ssize_t)count; i++) {
 		entry = ofi_cirque_head(cq->cirq);
 		if (OFI_UNLIKELY(entry->flags & (UTIL_FLAG_ERROR |
@@ -329,8 +511,17 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	api_version = cq->domain->fabric->fabric_fid.api_version;
 
 	cq->cq_fastlock_acquire(&cq->cq_lock);
-	if (ofi_cirque_isempty(cq->cirq) ||
-	    !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_ERROR)) {
+	if (cq->spsc) {
+		if (ofi_cirque_load_acquire(cq->cirq->wcnt) != cq->cirq->rcnt ||
+		    slist_empty(&cq->oflow_err_list) ||
+		    !container_of(cq->oflow_err_list.head,
+				  struct util_cq_oflow_err_entry,
+				  list_entry)->comp.err) {
+			ret = -FI_EAGAIN;
+			goto unlock;
+		}
+	} else if (ofi_cirque_isempty(cq->cirq) ||
+		   !(ofi_cirque_head(cq->cirq)->flags & UTIL_FLAG_ERROR)) {
 		ret = -FI_EAGAIN;
 		goto unlock;
 	}
@@ -348,6 +539,12 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 		memcpy(buf, &err->comp, sizeof(struct fi_cq_err_entry_1_0));
 	}
 
+	if (cq->spsc) {
+		if (slist_empty(&cq->oflow_err_list))
+			ofi_atomic_set32(&cq->spsc_slow, 0);
+		goto out;
+	}
+
 	cirq_entry = ofi_cirque_head(cq->cirq);
 	if (!(cirq_entry->flags & UTIL_FLAG_OVERFLOW)) {
 		ofi_cirque_discard(cq->cirq);
@@ -368,7 +565,7 @@ ssize_t ofi_cq_readerr(struct fid_cq *cq_fid, struct fi_cq_err_entry *buf,
 	} else {
 		cirq_entry->flags &= ~(UTIL_FLAG_ERROR | UTIL_FLAG_OVERFLOW);
 	}
-
+out:
 	ret = 1;
 	free(err);
 unlock:
@@ -514,6 +711,7 @@ static int fi_cq_init(struct fid_domain *domain, struct fi_cq_attr *attr,
 	cq->domain = container_of(domain, struct util_domain, domain_fid);
 	ofi_atomic_initialize32(&cq->ref, 0);
 	ofi_atomic_initialize32(&cq->signaled, 0);
+	ofi_atomic_initialize32(&cq->spsc_slow, 0);
 	dlist_init(&cq->ep_list);
 	fastlock_init(&cq->ep_list_lock);
 	fastlock_init(&cq->cq_lock);
@@ -583,20 +781,106 @@ int ofi_check_bind_cq_flags(struct util_ep *ep, struct util_cq *cq,
 	return FI_SUCCESS;
 }
 
+/*
+ * Completions written to the cirque or queued on oflow_err_list since the
+ * endpoint's CQs were created.  Only compared before and after a progress
+ * call, so the unlocked reads only need to observe a change.
+ */
+static inline size_t util_ep_comp_cnt(struct util_ep *ep)
+{
+	return (ep->tx_cq ? ep->tx_cq->cirq->wcnt + ep->tx_cq->oflow_cnt : 0) +
+	       (ep->rx_cq ? ep->rx_cq->cirq->wcnt + ep->rx_cq->oflow_cnt : 0);
+}
+
+/*
+ * Endpoints that were marked active through ofi_ep_set_active() or that
+ * generated completions on their last progress call are progressed on
+ * every poll.  Idle endpoints are skipped for an exponentially growing
+ * number of polls, bounded by the number of endpoints bound to the CQ and
+ * by UTIL_EP_MAX_IDLE_SHIFT, so a CQ with a single endpoint behaves as
+ * before and the cost of each poll tracks the number of active endpoints.
+ *
+ * The scheduling state is kept per CQ binding: the endpoint's tx CQ uses
+ * slot 0 and its rx CQ slot 1, and each slot is only accessed under the
+ * ep_list_lock of its CQ.
+ */
+#define UTIL_EP_MAX_IDLE_SHIFT 6
+
 void ofi_cq_progress(struct util_cq *cq)
 {
 	struct util_ep *ep;
 	struct fid_list_entry *fid_entry;
 	struct dlist_entry *item;
+	size_t comp_cnt, ep_cnt = 0;
+	int slot;
 
 	cq->cq_fastlock_acquire(&cq->ep_list_lock);
 	dlist_foreach(&cq->ep_list, item) {
 		fid_entry = container_of(item, struct fid_list_entry, entry);
 		ep = container_of(fid_entry->fid, struct util_ep, ep_fid.fid);
+		slot = ep->tx_cq != cq;
+		ep_cnt++;
+
+		if (ep->progress_skip[slot] &&
+		    !ofi_atomic_get32(&ep->progress_active[slot])) {
+			ep->progress_skip[slot]--;
+			continue;
+		}
+
+		ofi_atomic_set32(&ep->progress_active[slot], 0);
+		comp_cnt = util_ep_comp_cnt(ep);
 		ep->progress(ep);
 
+		if (util_ep_comp_cnt(ep) != comp_cnt ||
+		    ofi_atomic_get32(&ep->progress_active[slot])) {
+			ep->progress_idle[slot] = 0;
+			ep->progress_skip[slot] = 0;
+		} else {
+			if (ep->progress_idle[slot] < UTIL_EP_MAX_IDLE_SHIFT)
+				ep->progress_idle[slot]++;
+			ep->progress_skip[slot] =
+				MIN((1U << ep->progress_idle[slot]) - 1,
+				    cq->progress_ep_cnt ?
+				    cq->progress_ep_cnt - 1 : 0);
+		}
 	}
+	cq->progress_ep_cnt = ep_cnt;
+	cq->cq_fastlock_release(&cq->ep_list_lock);
+}
+
+/*
+ * Providers call this before returning the CQ to the application, and only
+ * when they can guarantee that a single thread at a time writes completions
+ * to it and a single thread at a time reads them.  The CQ leaves SPSC mode
+ * if a second endpoint is bound to it, see ofi_cq_bind_spsc.
+ */
+void ofi_cq_set_spsc(struct util_cq *cq)
+{
+	cq->spsc = OFI_CIRQUE_SPSC &&
+		   cq->cq_fastlock_acquire == ofi_fastlock_acquire;
+}
+
+int ofi_cq_bind_spsc(struct util_cq *cq)
+{
+	int shared, ret = 0;
+
+	cq->cq_fastlock_acquire(&cq->ep_list_lock);
+	shared = cq->ep_list.next->next != &cq->ep_list;
 	cq->cq_fastlock_release(&cq->ep_list_lock);
+	if (!shared)
+		return 0;
+
+	cq->cq_fastlock_acquire(&cq->cq_lock);
+	if (ofi_cirque_load_acquire(cq->cirq->wcnt) != cq->cirq->rcnt ||
+	    ofi_atomic_get32(&cq->spsc_slow)) {
+		FI_WARN(cq->domain->prov, FI_LOG_CQ,
+			"CQ must be empty to bind a second endpoint\n");
+		ret = -FI_EBUSY;
+	} else {
+		cq->spsc = 0;
+	}
+	cq->cq_fastlock_release(&cq->cq_lock);
+	return ret;
 }
 
 int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
@@ -604,6 +888,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 		 ofi_cq_progress_func progress, void *context)
 {
 	fi_cq_read_func read_func;
+	fi_cq_read_bulk_func read_bulk;
 	int ret;
 
 	assert(progress);
@@ -619,15 +904,19 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	case FI_CQ_FORMAT_UNSPEC:
 	case FI_CQ_FORMAT_CONTEXT:
 		read_func = util_cq_read_ctx;
+		read_bulk = util_cq_read_ctx_bulk;
 		break;
 	case FI_CQ_FORMAT_MSG:
 		read_func = util_cq_read_msg;
+		read_bulk = util_cq_read_msg_bulk;
 		break;
 	case FI_CQ_FORMAT_DATA:
 		read_func = util_cq_read_data;
+		read_bulk = util_cq_read_data_bulk;
 		break;
 	case FI_CQ_FORMAT_TAGGED:
 		read_func = util_cq_read_tagged;
+		read_bulk = util_cq_read_tagged_bulk;
 		break;
 	default:
 		assert(0);
@@ -637,6 +926,7 @@ int ofi_cq_init(const struct fi_provider *prov, struct fid_domain *domain,
 	ret = fi_cq_init(domain, attr, read_func, cq, context);
 	if (ret)
 		return ret;
+	cq->read_bulk = read_bulk;
 
 	/* CQ must be fully operational before adding to wait set */
 	if (cq->wait) {
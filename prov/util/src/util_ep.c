@@ -64,9 +64,18 @@ int ofi_ep_bind_cq(struct util_ep *ep, struct util_cq *cq, uint64_t flags)
 	}
 
 	if (flags & (FI_TRANSMIT | FI_RECV)) {
-		return fid_list_insert(&cq->ep_list,
-				       &cq->ep_list_lock,
-				       &ep->ep_fid.fid);
+		ret = fid_list_insert(&cq->ep_list,
+				      &cq->ep_list_lock,
+				      &ep->ep_fid.fid);
+		if (ret || !cq->spsc)
+			return ret;
+
+		/* SPSC mode relies on a single endpoint writing completions */
+		ret = ofi_cq_bind_spsc(cq);
+		if (ret)
+			fid_list_remove(&cq->ep_list, &cq->ep_list_lock,
+					&ep->ep_fid.fid);
+		return ret;
 	}
 
 	return FI_SUCCESS;
@@ -210,7 +219,7 @@ int ofi_endpoint_init(struct fid_domain *domain, const struct util_prov *util_pr
 		      ofi_ep_progress_func progress)
 {
 	struct util_domain *util_domain;
-	int ret;
+	int ret, i;
 
 	util_domain = container_of(domain, struct util_domain, domain_fid);
 
@@ -244,6 +253,11 @@ int ofi_endpoint_init(struct fid_domain *domain, const struct util_prov *util_pr
 	ep->rem_rd_cntr_inc 	= ofi_cntr_inc_noop;
 	ep->rem_wr_cntr_inc 	= ofi_cntr_inc_noop;
 	ep->type = info->ep_attr->type;
+	for (i = 0; i < 2; i++) {
+		ofi_atomic_initialize32(&ep->progress_active[i], 1);
+		ep->progress_idle[i] = 0;
+		ep->progress_skip[i] = 0;
+	}
 	ofi_atomic_inc32(&util_domain->ref);
 	if (util_domain->eq)
 		ofi_ep_bind_eq(ep, util_domain->eq);
@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2020 Intel Corporation. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "ofi_atomic.h"
+#include "ofi_util.h"
+
+/*
+ * Unlike the handlers in util_atomic.c, these kernels operate on buffers
+ * that no other thread or peer touches, so they use plain loads and
+ * stores.  Operations that map onto vector instructions are written with
+ * compiler vector extensions, one copy per supported vector width, and
+ * fall back to a scalar loop for the tail.  The remaining operations and
+ * the complex and long double types only have a scalar version.
+ */
+
+#define OFI_REDUCE_MIN(type,dst,src)	if ((dst) > (src)) (dst) = (src)
+#define OFI_REDUCE_MAX(type,dst,src)	if ((dst) < (src)) (dst) = (src)
+#define OFI_REDUCE_SUM(type,dst,src)	(dst) += (src)
+#define OFI_REDUCE_PROD(type,dst,src)	(dst) *= (src)
+#define OFI_REDUCE_LOR(type,dst,src)	(dst) = (dst) || (src)
+#define OFI_REDUCE_LAND(type,dst,src)	(dst) = (dst) && (src)
+#define OFI_REDUCE_BOR(type,dst,src)	(dst) |= (src)
+#define OFI_REDUCE_BAND(type,dst,src)	(dst) &= (src)
+#define OFI_REDUCE_LXOR(type,dst,src)	\
+		(dst) = ((dst) && !(src)) || (!(dst) && (src))
+#define OFI_REDUCE_BXOR(type,dst,src)	(dst) ^= (src)
+#define OFI_REDUCE_WRITE(type,dst,src)	(dst) = (src)
+
+#define OFI_REDUCE_SUM_COMPLEX(type,dst,src)	\
+		(dst) = ofi_complex_sum_##type(dst,src)
+#define OFI_REDUCE_PROD_COMPLEX(type,dst,src)	\
+		(dst) = ofi_complex_prod_##type(dst,src)
+#define OFI_REDUCE_LOR_COMPLEX(type,dst,src)	\
+		(dst) = ofi_complex_lor_##type(dst,src)
+#define OFI_REDUCE_LAND_COMPLEX(type,dst,src)	\
+		(dst) = ofi_complex_land_##type(dst,src)
+#define OFI_REDUCE_LXOR_COMPLEX(type,dst,src)	\
+		(dst) = ofi_complex_lxor_##type(dst,src)
+#define OFI_REDUCE_WRITE_COMPLEX(type,dst,src)	(dst) = (src)
+
+/*
+ * Vector forms.  Comparisons yield a mask vector of signed integers of
+ * the element width, which selects between the operands.
+ */
+#define OFI_REDUCE_VEC_SUM(vec,mask,dst,src)	(dst) + (src)
+#define OFI_REDUCE_VEC_PROD(vec,mask,dst,src)	(dst) * (src)
+#define OFI_REDUCE_VEC_BOR(vec,mask,dst,src)	(dst) | (src)
+#define OFI_REDUCE_VEC_BAND(vec,mask,dst,src)	(dst) & (src)
+#define OFI_REDUCE_VEC_BXOR(vec,mask,dst,src)	(dst) ^ (src)
+#define OFI_REDUCE_VEC_MIN(vec,mask,dst,src)			\
+		(vec) (((mask) (src) & ((src) < (dst))) |	\
+		       ((mask) (dst) & ~((src) < (dst))))
+#define OFI_REDUCE_VEC_MAX(vec,mask,dst,src)			\
+		(vec) (((mask) (src) & ((src) > (dst))) |	\
+		       ((mask) (dst) & ~((src) > (dst))))
+
+#define OFI_REDUCE_TARGET_base
+#define OFI_REDUCE_WIDTH_base	16
+
+#ifdef HAVE_X86_TARGET_ATTR
+#define OFI_REDUCE_TARGET_avx2	__attribute__((target("avx2")))
+#define OFI_REDUCE_WIDTH_avx2	32
+#define OFI_REDUCE_TARGET_avx512 __attribute__((target("avx512f,avx512bw")))
+#define OFI_REDUCE_WIDTH_avx512	64
+#endif
+
+/*********************************
+ * REDUCE function templates
+ *********************************/
+
+#define OFI_DEF_NOOP_NAME NULL,
+#define OFI_DEF_NOOP_FUNC
+
+#define OFI_DEF_REDUCE_NAME(isa, op, type, itype) ofi_reduce_##op##_##type,
+#define OFI_DEF_REDUCE_FUNC(isa, op, type, itype)			\
+	static void ofi_reduce_##op##_##type				\
+		(void *dst, const void *src, size_t cnt)		\
+	{								\
+		type *d = (dst);					\
+		const type *s = (src);					\
+		size_t i;						\
+		for (i = 0; i < cnt; i++) {				\
+			op(type, d[i], s[i]);				\
+		}							\
+	}
+
+#define OFI_DEF_REDUCE_COMPLEX_NAME(isa, op, type, itype)		\
+	ofi_reduce_##op##_##type,
+#define OFI_DEF_REDUCE_COMPLEX_FUNC(isa, op, type, itype)		\
+	static void ofi_reduce_##op##_##type				\
+		(void *dst, const void *src, size_t cnt)		\
+	{								\
+		ofi_complex_##type *d = (dst);				\
+		const ofi_complex_##type *s = (src);			\
+		size_t i;						\
+		for (i = 0; i < cnt; i++) {				\
+			op(type, d[i], s[i]);				\
+		}							\
+	}
+
+#define OFI_DEF_REDUCE_VEC_NAME(isa, op, type, itype)			\
+	ofi_reduce_##isa##_##op##_##type,
+
+#if defined(__GNUC__) || defined(__clang__)
+
+#define OFI_DEF_REDUCE_VEC_FUNC(isa, op, type, itype)			\
+	static OFI_REDUCE_TARGET_##isa void				\
+	ofi_reduce_##isa##_##op##_##type				\
+		(void *dst, const void *src, size_t cnt)		\
+	{								\
+		typedef type vec_t					\
+			__attribute__((vector_size(OFI_REDUCE_WIDTH_##isa))); \
+		typedef itype mask_t __attribute__((unused,		\
+			vector_size(OFI_REDUCE_WIDTH_##isa)));		\
+		const size_t n = sizeof(vec_t) / sizeof(type);		\
+		type *d = (dst);					\
+		const type *s = (src);					\
+		vec_t vd, vs;						\
+		size_t i;						\
+									\
+		for (i = 0; i + n <= cnt; i += n) {			\
+			memcpy(&vd, &d[i], sizeof(vd));			\
+			memcpy(&vs, &s[i], sizeof(vs));			\
+			vd = OFI_REDUCE_VEC_##op(vec_t, mask_t, vd, vs); \
+			memcpy(&d[i], &vd, sizeof(vd));			\
+		}							\
+		for (; i < cnt; i++) {					\
+			OFI_REDUCE_##op(type, d[i], s[i]);		\
+		}							\
+	}
+
+#else /* __GNUC__ */
+
+#define OFI_DEF_REDUCE_VEC_FUNC(isa, op, type, itype)			\
+	static void ofi_reduce_##isa##_##op##_##type			\
+		(void *dst, const void *src, size_t cnt)		\
+	{								\
+		type *d = (dst);					\
+		const type *s = (src);					\
+		size_t i;						\
+		for (i = 0; i < cnt; i++) {				\
+			OFI_REDUCE_##op(type, d[i], s[i]);		\
+		}							\
+	}
+
+#endif /* __GNUC__ */
+
+/*********************************************************************
+ * Macros create reduce functions for each operation for each datatype
+ *********************************************************************/
+
+/*
+ * KIND - REDUCE (scalar) or REDUCE_VEC
+ * FUNCNAME - Define function or simply generate function name
+ * isa - Vector width and instruction set the function is built for
+ * op - Operation the function performs (e.g. OFI_REDUCE_MIN or MIN)
+ */
+#define OFI_DEFINE_INT_REDUCE(KIND, FUNCNAME, isa, op)			\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, int8_t, int8_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, uint8_t, int8_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, int16_t, int16_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, uint16_t, int16_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, int32_t, int32_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, uint32_t, int32_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, int64_t, int64_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, uint64_t, int64_t)
+
+#define OFI_DEFINE_REAL_REDUCE(KIND, FUNCNAME, isa, op)			\
+	OFI_DEFINE_INT_REDUCE(KIND, FUNCNAME, isa, op)			\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, float, int32_t)		\
+	OFI_DEF_##KIND##_##FUNCNAME(isa, op, double, int64_t)
+
+/* Scalar handlers for every datatype */
+#define OFI_DEFINE_ALL_REDUCE(FUNCNAME, op)				\
+	OFI_DEFINE_REAL_REDUCE(REDUCE, FUNCNAME, base, op)		\
+	OFI_DEF_REDUCE_COMPLEX_##FUNCNAME(base, op##_COMPLEX, float, 0)	\
+	OFI_DEF_REDUCE_COMPLEX_##FUNCNAME(base, op##_COMPLEX, double, 0)	\
+	OFI_DEF_REDUCE_##FUNCNAME(base, op, long_double, 0)		\
+	OFI_DEF_REDUCE_COMPLEX_##FUNCNAME(base, op##_COMPLEX, long_double, 0)
+
+/*
+ * Table rows.  The vector variants cover the integer, float and double
+ * entries; the rest of the row is shared by all instruction sets.
+ */
+#define OFI_REDUCE_ROW_INT(isa, op)					\
+	OFI_DEFINE_INT_REDUCE(REDUCE_VEC, NAME, isa, op)		\
+	NULL, NULL, NULL, NULL, NULL, NULL
+
+#define OFI_REDUCE_ROW_REALNO(isa, op)					\
+	OFI_DEFINE_REAL_REDUCE(REDUCE_VEC, NAME, isa, op)		\
+	NULL, NULL,							\
+	OFI_DEF_REDUCE_NAME(base, OFI_REDUCE_##op, long_double, 0)	\
+	NULL
+
+#define OFI_REDUCE_ROW_ALL(isa, op)					\
+	OFI_DEFINE_REAL_REDUCE(REDUCE_VEC, NAME, isa, op)		\
+	OFI_DEF_REDUCE_COMPLEX_NAME(base, OFI_REDUCE_##op##_COMPLEX, float, 0) \
+	OFI_DEF_REDUCE_COMPLEX_NAME(base, OFI_REDUCE_##op##_COMPLEX, double, 0) \
+	OFI_DEF_REDUCE_NAME(base, OFI_REDUCE_##op, long_double, 0)	\
+	OFI_DEF_REDUCE_COMPLEX_NAME(base, OFI_REDUCE_##op##_COMPLEX, long_double, 0)
+
+#define OFI_REDUCE_ROW_SCALAR(op)					\
+	OFI_DEFINE_ALL_REDUCE(NAME, OFI_REDUCE_##op)
+
+#define OFI_DEFINE_REDUCE_VEC_FUNCS(isa)				\
+	OFI_DEFINE_REAL_REDUCE(REDUCE_VEC, FUNC, isa, MIN)		\
+	OFI_DEFINE_REAL_REDUCE(REDUCE_VEC, FUNC, isa, MAX)		\
+	OFI_DEFINE_REAL_REDUCE(REDUCE_VEC, FUNC, isa, SUM)		\
+	OFI_DEFINE_REAL_REDUCE(REDUCE_VEC, FUNC, isa, PROD)		\
+	OFI_DEFINE_INT_REDUCE(REDUCE_VEC, FUNC, isa, BOR)		\
+	OFI_DEFINE_INT_REDUCE(REDUCE_VEC, FUNC, isa, BAND)		\
+	OFI_DEFINE_INT_REDUCE(REDUCE_VEC, FUNC, isa, BXOR)
+
+#define OFI_DEFINE_REDUCE_TABLE(isa)					\
+	static ofi_reduce_func						\
+	ofi_reduce_##isa##_handlers[OFI_REDUCE_OP_LAST][FI_DATATYPE_LAST] = \
+	{								\
+		{ OFI_REDUCE_ROW_REALNO(isa, MIN) },			\
+		{ OFI_REDUCE_ROW_REALNO(isa, MAX) },			\
+		{ OFI_REDUCE_ROW_ALL(isa, SUM) },			\
+		{ OFI_REDUCE_ROW_ALL(isa, PROD) },			\
+		{ OFI_REDUCE_ROW_SCALAR(LOR) },				\
+		{ OFI_REDUCE_ROW_SCALAR(LAND) },			\
+		{ OFI_REDUCE_ROW_INT(isa, BOR) },			\
+		{ OFI_REDUCE_ROW_INT(isa, BAND) },			\
+		{ OFI_REDUCE_ROW_SCALAR(LXOR) },			\
+		{ OFI_REDUCE_ROW_INT(isa, BXOR) },			\
+	};
+
+/* Scalar kernels shared by all tables */
+OFI_DEF_REDUCE_FUNC(base, OFI_REDUCE_MIN, long_double, 0)
+OFI_DEF_REDUCE_FUNC(base, OFI_REDUCE_MAX, long_double, 0)
+OFI_DEF_REDUCE_COMPLEX_FUNC(base, OFI_REDUCE_SUM_COMPLEX, float, 0)
+OFI_DEF_REDUCE_COMPLEX_FUNC(base, OFI_REDUCE_SUM_COMPLEX, double, 0)
+OFI_DEF_REDUCE_FUNC(base, OFI_REDUCE_SUM, long_double, 0)
+OFI_DEF_REDUCE_COMPLEX_FUNC(base, OFI_REDUCE_SUM_COMPLEX, long_double, 0)
+OFI_DEF_REDUCE_COMPLEX_FUNC(base, OFI_REDUCE_PROD_COMPLEX, float, 0)
+OFI_DEF_REDUCE_COMPLEX_FUNC(base, OFI_REDUCE_PROD_COMPLEX, double, 0)
+OFI_DEF_REDUCE_FUNC(base, OFI_REDUCE_PROD, long_double, 0)
+OFI_DEF_REDUCE_COMPLEX_FUNC(base, OFI_REDUCE_PROD_COMPLEX, long_double, 0)
+OFI_DEFINE_ALL_REDUCE(FUNC, OFI_REDUCE_LOR)
+OFI_DEFINE_ALL_REDUCE(FUNC, OFI_REDUCE_LAND)
+OFI_DEFINE_ALL_REDUCE(FUNC, OFI_REDUCE_LXOR)
+OFI_DEFINE_ALL_REDUCE(FUNC, OFI_REDUCE_WRITE)
+
+static ofi_reduce_func ofi_reduce_write_handlers[FI_DATATYPE_LAST] = {
+	OFI_REDUCE_ROW_SCALAR(WRITE)
+};
+
+/* 16 byte vectors: SSE2 on x86-64, generic code elsewhere */
+OFI_DEFINE_REDUCE_VEC_FUNCS(base)
+OFI_DEFINE_REDUCE_TABLE(base)
+
+#if defined(HAVE_X86_TARGET_ATTR) && defined(HAVE_CPUID) && \
+    (defined(__x86_64__) || defined(__amd64__))
+
+OFI_DEFINE_REDUCE_VEC_FUNCS(avx2)
+OFI_DEFINE_REDUCE_TABLE(avx2)
+OFI_DEFINE_REDUCE_VEC_FUNCS(avx512)
+OFI_DEFINE_REDUCE_TABLE(avx512)
+
+#define OFI_XCR0_AVX		0x06	/* SSE and AVX state */
+#define OFI_XCR0_AVX512		0xe6	/* plus opmask and ZMM state */
+
+/* The CPU feature bits alone do not say whether the OS saves the state. */
+static int ofi_reduce_os_supports(uint64_t xcr0_mask)
+{
+	uint32_t eax, edx;
+
+	if (!ofi_cpu_supports(0x1, OFI_OSXSAVE_REG, OFI_OSXSAVE_BIT))
+		return 0;
+
+	asm volatile("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return ((((uint64_t) edx << 32) | eax) & xcr0_mask) == xcr0_mask;
+}
+
+static int ofi_reduce_have_avx512(void)
+{
+	return ofi_cpu_supports(0x7, OFI_AVX512F_REG, OFI_AVX512F_BIT) &&
+	       ofi_cpu_supports(0x7, OFI_AVX512BW_REG, OFI_AVX512BW_BIT) &&
+	       ofi_reduce_os_supports(OFI_XCR0_AVX512);
+}
+
+static int ofi_reduce_have_avx2(void)
+{
+	return ofi_cpu_supports(0x7, OFI_AVX2_REG, OFI_AVX2_BIT) &&
+	       ofi_reduce_os_supports(OFI_XCR0_AVX);
+}
+
+#else
+
+#define ofi_reduce_have_avx512()	0
+#define ofi_reduce_have_avx2()		0
+#define ofi_reduce_avx512_handlers	ofi_reduce_base_handlers
+#define ofi_reduce_avx2_handlers	ofi_reduce_base_handlers
+
+#endif
+
+ofi_reduce_func (*ofi_reduce_handlers)[FI_DATATYPE_LAST] =
+	ofi_reduce_base_handlers;
+
+ofi_reduce_func ofi_atomic_serial_handlers[OFI_WRITE_OP_LAST][FI_DATATYPE_LAST];
+
+/*
+ * Only fill in the entries that have an atomic handler, so that both
+ * tables accept the same set of operations and datatypes.
+ */
+static void ofi_atomic_serial_init(void)
+{
+	ofi_reduce_func func;
+	int op, dt;
+
+	for (op = 0; op < OFI_WRITE_OP_LAST; op++) {
+		for (dt = 0; dt < FI_DATATYPE_LAST; dt++) {
+			func = ofi_atomic_write_handlers[op][dt];
+			if (!func)
+				continue;
+
+			if (op < OFI_REDUCE_OP_LAST && ofi_reduce_handlers[op][dt])
+				func = ofi_reduce_handlers[op][dt];
+			else if (op == FI_ATOMIC_WRITE)
+				func = ofi_reduce_write_handlers[dt];
+			ofi_atomic_serial_handlers[op][dt] = func;
+		}
+	}
+}
+
+ofi_atomic_write_table ofi_atomic_write_select(const struct util_domain *domain)
+{
+	if (domain->threading != FI_THREAD_DOMAIN ||
+	    domain->data_progress != FI_PROGRESS_MANUAL ||
+	    ofi_reduce_handlers == ofi_atomic_write_handlers)
+		return ofi_atomic_write_handlers;
+
+	FI_INFO(domain->prov, FI_LOG_DOMAIN,
+		"Target progress is serialized, using non-atomic handlers\n");
+	return ofi_atomic_serial_handlers;
+}
+
+void ofi_reduce_init(void)
+{
+	char *kernels = NULL;
+
+	fi_param_get_str(NULL, "reduce_kernels", &kernels);
+
+	if (kernels && !strcasecmp(kernels, "atomic")) {
+		ofi_reduce_handlers = ofi_atomic_write_handlers;
+		FI_INFO(&core_prov, FI_LOG_CORE,
+			"Using atomic handlers for reductions\n");
+		return;
+	}
+
+	ofi_reduce_handlers = ofi_reduce_base_handlers;
+	if (kernels && !strcasecmp(kernels, "base"))
+		goto out;
+
+	if (ofi_reduce_have_avx2())
+		ofi_reduce_handlers = ofi_reduce_avx2_handlers;
+	if ((!kernels || strcasecmp(kernels, "avx2")) &&
+	    ofi_reduce_have_avx512())
+		ofi_reduce_handlers = ofi_reduce_avx512_handlers;
+out:
+	FI_INFO(&core_prov, FI_LOG_CORE, "Using %s reduction kernels\n",
+		ofi_reduce_handlers == ofi_reduce_avx512_handlers ? "avx512" :
+		ofi_reduce_handlers == ofi_reduce_avx2_handlers ? "avx2" :
+		"base");
+	ofi_atomic_serial_init();
+}
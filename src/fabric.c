@@ -42,6 +42,8 @@
 
 #include <rdma/fi_errno.h>
 #include "ofi_util.h"
+#include "ofi_atomic.h"
+#include "ofi_coll.h"
 #include "ofi.h"
 #include "shared/ofi_str.h"
 #include "ofi_prov.h"
@@ -619,6 +621,7 @@ void fi_ini(void)
 	ofi_perf_init();
 	ofi_hook_init();
 	ofi_monitor_init();
+	ofi_coll_init();
 
 	fi_param_define(NULL, "provider", FI_PARAM_STRING,
 			"Only use specified provider (default: all available)");
@@ -632,6 +635,14 @@ void fi_ini(void)
 			" used by distribute OFI application. The provider uses"
 			" this to optimize resource allocations"
 			" (default: OFI service specific)");
+	fi_param_define(NULL, "reduce_kernels", FI_PARAM_STRING,
+			"Select the kernels used by the reduction steps of"
+			" software collectives and by atomics applied from"
+			" serialized progress: auto, base, avx2, avx512, or"
+			" atomic.  Kernels not supported by the CPU are not"
+			" selected (default: auto)");
+	ofi_atomic_init();
+	ofi_reduce_init();
 	fi_param_get_str(NULL, "provider", &param_val);
 	ofi_create_filter(&prov_filter, param_val);
 
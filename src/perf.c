@@ -38,6 +38,7 @@
 #include <inttypes.h>
 
 #include <rdma/fi_errno.h>
+#include <ofi.h>
 #include <ofi_perf.h>
 #include <rdma/providers/fi_log.h>
 
@@ -45,6 +46,9 @@
 enum ofi_perf_domain	perf_domain = OFI_PMU_CPU;
 uint32_t		perf_cntr = OFI_PMC_CPU_INSTR;
 uint32_t		perf_flags;
+int			perf_size_classes;
+char			*perf_dump_file;
+int			perf_dump_interval;
 
 
 void ofi_perf_init(void)
@@ -54,6 +58,25 @@ void ofi_perf_init(void)
 	fi_param_define(NULL, "perf_cntr", FI_PARAM_STRING,
 			"Performance counter to analyze (default: cpu_instr). "
 			"Options: cpu_instr, cpu_cycles.");
+	fi_param_define(NULL, "perf_size_classes", FI_PARAM_BOOL,
+			"Break performance data down by message size "
+			"(default: no).");
+	fi_param_define(NULL, "perf_dump_file", FI_PARAM_STRING,
+			"Write performance histograms to this file.  The "
+			"process id is inserted before the file extension.  "
+			"A .json extension selects JSON lines, otherwise "
+			"CSV is written (default: none).");
+	fi_param_define(NULL, "perf_dump_interval", FI_PARAM_INT,
+			"Interval in milliseconds between dumps to "
+			"perf_dump_file.  0 only dumps when the data is "
+			"released (default: 0).");
+
+	fi_param_get_bool(NULL, "perf_size_classes", &perf_size_classes);
+	fi_param_get_str(NULL, "perf_dump_file", &perf_dump_file);
+	fi_param_get_int(NULL, "perf_dump_interval", &perf_dump_interval);
+	if (perf_dump_interval < 0)
+		perf_dump_interval = 0;
+
 	fi_param_get_str(NULL, "perf_cntr", &param_val);
 	if (!param_val)
 		return;
@@ -64,6 +87,129 @@ void ofi_perf_init(void)
 	}
 }
 
+static size_t ofi_perf_hist_index(uint64_t value)
+{
+	int msb;
+
+	if (value < OFI_PERF_HIST_SUB)
+		return (size_t) value;
+
+#if defined(__GNUC__)
+	msb = 63 - __builtin_clzll(value);
+#else
+	msb = ofi_msb(value) - 1;
+#endif
+	return ((msb - OFI_PERF_HIST_SUB_SHIFT + 1) << OFI_PERF_HIST_SUB_SHIFT) +
+	       ((value >> (msb - OFI_PERF_HIST_SUB_SHIFT)) &
+		(OFI_PERF_HIST_SUB - 1));
+}
+
+/* Largest value that falls into the given bucket */
+static uint64_t ofi_perf_hist_value(size_t index)
+{
+	uint64_t base, width;
+	int msb;
+
+	if (index < OFI_PERF_HIST_SUB)
+		return index;
+
+	msb = (int) (index >> OFI_PERF_HIST_SUB_SHIFT) +
+	      OFI_PERF_HIST_SUB_SHIFT - 1;
+	width = 1ULL << (msb - OFI_PERF_HIST_SUB_SHIFT);
+	base = (1ULL << msb) + (index & (OFI_PERF_HIST_SUB - 1)) * width;
+	return base + (width - 1);
+}
+
+static uint64_t ofi_perf_hist_pct(struct ofi_perf_hist *hist,
+				  uint64_t per_mille)
+{
+	uint64_t target, total = 0;
+	size_t i;
+
+	target = (hist->events * per_mille + 999) / 1000;
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < OFI_PERF_HIST_BUCKETS; i++) {
+		total += hist->bucket[i];
+		if (total >= target)
+			return MIN(ofi_perf_hist_value(i), hist->max);
+	}
+	return hist->max;
+}
+
+static size_t ofi_perf_size_class(size_t len)
+{
+	size_t class;
+
+	if (len == SIZE_MAX)
+		return 0;
+	if (len <= 64)
+		return 1;
+
+	class = (ofi_msb(len - 1) - 7) / 2 + 2;
+	return MIN(class, OFI_PERF_SIZE_CLASSES - 1);
+}
+
+static const char *ofi_perf_size_str[OFI_PERF_SIZE_CLASSES] = {
+	"all", "64", "256", "1k", "4k", "16k", "64k", "256k", "max"
+};
+
+void ofi_perfset_record(struct ofi_perfset *set, size_t index,
+			size_t len, uint64_t value)
+{
+	struct ofi_perf_hist *hist;
+
+	hist = &set->hist[index * set->classes +
+			  (set->classes > 1 ? ofi_perf_size_class(len) : 0)];
+	hist->sum += value;
+	hist->events++;
+	if (value > hist->max)
+		hist->max = value;
+	hist->bucket[ofi_perf_hist_index(value)]++;
+}
+
+static FILE *ofi_perf_open_dump(const struct fi_provider *prov, int *json)
+{
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	static int seq;
+	char path[PATH_MAX];
+	const char *name, *ext;
+	int num, len;
+	FILE *fp;
+
+	pthread_mutex_lock(&lock);
+	num = seq++;
+	pthread_mutex_unlock(&lock);
+
+	name = strrchr(perf_dump_file, '/');
+	name = name ? name + 1 : perf_dump_file;
+	ext = strrchr(name, '.');
+	if (!ext || ext == name)
+		ext = name + strlen(name);
+
+	len = (int) (ext - perf_dump_file);
+	if (num)
+		snprintf(path, sizeof path, "%.*s.%d-%d%s", len, perf_dump_file,
+			 getpid(), num, ext);
+	else
+		snprintf(path, sizeof path, "%.*s.%d%s", len, perf_dump_file,
+			 getpid(), ext);
+
+	fp = fopen(path, "w");
+	if (!fp) {
+		FI_WARN(prov, FI_LOG_CORE, "Unable to open %s: %s\n",
+			path, strerror(errno));
+		return NULL;
+	}
+
+	*json = !strcasecmp(ext, ".json");
+	if (!*json)
+		fprintf(fp, "time_ms,counter,name,size,events,avg,"
+			"p50,p99,p999,max\n");
+	return fp;
+}
+
 int ofi_perfset_create(const struct fi_provider *prov,
 		       struct ofi_perfset *set, size_t size,
 		       enum ofi_perf_domain domain, uint32_t cntr_id,
@@ -71,6 +217,7 @@ int ofi_perfset_create(const struct fi_provider *prov,
 {
 	int ret;
 
+	memset(set, 0, sizeof(*set));
 	ret = ofi_pmu_open(&set->ctx, domain, cntr_id, flags);
 	if (ret) {
 		FI_WARN(prov, FI_LOG_CORE, "Unable to open PMU %d (%s)\n",
@@ -78,20 +225,39 @@ int ofi_perfset_create(const struct fi_provider *prov,
 		return ret;
 	}
 
+	set->classes = perf_size_classes ? OFI_PERF_SIZE_CLASSES : 1;
 	set->data = calloc(size, sizeof(*set->data));
-	if (!set->data) {
-		ofi_pmu_close(set->ctx);
-		return -FI_ENOMEM;
+	set->hist = calloc(size * set->classes, sizeof(*set->hist));
+	if (!set->data || !set->hist) {
+		ret = -FI_ENOMEM;
+		goto err;
 	}
 
 	set->prov = prov;
 	set->size = size;
+	if (perf_dump_file) {
+		set->dump_fp = ofi_perf_open_dump(prov, &set->dump_json);
+		set->dump_start = ofi_gettime_ms();
+		if (set->dump_fp && perf_dump_interval)
+			set->dump_next = set->dump_start + perf_dump_interval;
+	}
 	return 0;
+
+err:
+	free(set->hist);
+	free(set->data);
+	ofi_pmu_close(set->ctx);
+	return ret;
 }
 
 void ofi_perfset_close(struct ofi_perfset *set)
 {
+	if (set->dump_fp) {
+		ofi_perfset_dump(set);
+		fclose(set->dump_fp);
+	}
 	ofi_pmu_close(set->ctx);
+	free(set->hist);
 	free(set->data);
 }
 
@@ -132,19 +298,107 @@ static const char *ofi_perf_name(void)
 
 void ofi_perfset_log(struct ofi_perfset *set, const char *names[])
 {
-	size_t i;
+	struct ofi_perf_hist *hist;
+	size_t i, j;
 
+	set->names = names;
 	FI_TRACE(set->prov, FI_LOG_CORE, "\n");
 	FI_TRACE(set->prov, FI_LOG_CORE, "\tPERF: %s\n", ofi_perf_name());
-	FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10s%s\n", "Name", "Avg", "Events");
+	FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-6s%-10s%-10s%-10s%-10s%s\n",
+		 "Name", "Size", "Avg", "p50", "p99", "p999", "Events");
 
 	for (i = 0; i < set->size; i++) {
-		if (!set->data[i].events)
-			continue;
+		for (j = 0; j < set->classes; j++) {
+			hist = &set->hist[i * set->classes + j];
+			if (!hist->events)
+				continue;
 
-		FI_TRACE(set->prov, FI_LOG_CORE, "\t%-20s%-10g%" PRIu64 "\n",
-			names && names[i] ? names[i] : "unknown",
-			(double) set->data[i].sum / set->data[i].events,
-			set->data[i].events);
+			FI_TRACE(set->prov, FI_LOG_CORE,
+				 "\t%-20s%-6s%-10g%-10" PRIu64 "%-10" PRIu64
+				 "%-10" PRIu64 "%" PRIu64 "\n",
+				 names && names[i] ? names[i] : "unknown",
+				 ofi_perf_size_str[j],
+				 (double) hist->sum / hist->events,
+				 ofi_perf_hist_pct(hist, 500),
+				 ofi_perf_hist_pct(hist, 990),
+				 ofi_perf_hist_pct(hist, 999), hist->events);
+		}
 	}
 }
+
+static void ofi_perf_dump_csv(struct ofi_perfset *set, uint64_t now,
+			      const char *name, size_t class,
+			      struct ofi_perf_hist *hist)
+{
+	fprintf(set->dump_fp, "%" PRIu64 ",%s,%s,%s,%" PRIu64 ",%g,"
+		"%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+		now, ofi_perf_name(), name, ofi_perf_size_str[class],
+		hist->events, (double) hist->sum / hist->events,
+		ofi_perf_hist_pct(hist, 500), ofi_perf_hist_pct(hist, 990),
+		ofi_perf_hist_pct(hist, 999), hist->max);
+}
+
+static void ofi_perf_dump_json(struct ofi_perfset *set, int first,
+			       const char *name, size_t class,
+			       struct ofi_perf_hist *hist)
+{
+	fprintf(set->dump_fp, "%s{\"name\":\"%s\",\"size\":\"%s\","
+		"\"events\":%" PRIu64 ",\"avg\":%g,\"p50\":%" PRIu64 ","
+		"\"p99\":%" PRIu64 ",\"p999\":%" PRIu64 ",\"max\":%" PRIu64
+		"}", first ? "" : ",", name, ofi_perf_size_str[class],
+		hist->events, (double) hist->sum / hist->events,
+		ofi_perf_hist_pct(hist, 500), ofi_perf_hist_pct(hist, 990),
+		ofi_perf_hist_pct(hist, 999), hist->max);
+}
+
+/*
+ * Each dump appends a snapshot of the cumulative data, so that periodic
+ * dumps form a time series.  JSON output is written one object per line.
+ */
+void ofi_perfset_dump(struct ofi_perfset *set)
+{
+	struct ofi_perf_hist *hist;
+	const char *name;
+	uint64_t now;
+	size_t i, j;
+	int first = 1;
+
+	if (!set->dump_fp)
+		return;
+
+	now = ofi_gettime_ms() - set->dump_start;
+	if (set->dump_json)
+		fprintf(set->dump_fp, "{\"time_ms\":%" PRIu64 ",\"counter\":"
+			"\"%s\",\"data\":[", now, ofi_perf_name());
+
+	for (i = 0; i < set->size; i++) {
+		name = set->names && set->names[i] ? set->names[i] : "unknown";
+		for (j = 0; j < set->classes; j++) {
+			hist = &set->hist[i * set->classes + j];
+			if (!hist->events)
+				continue;
+
+			if (set->dump_json)
+				ofi_perf_dump_json(set, first, name, j, hist);
+			else
+				ofi_perf_dump_csv(set, now, name, j, hist);
+			first = 0;
+		}
+	}
+
+	if (set->dump_json)
+		fprintf(set->dump_fp, "]}\n");
+	fflush(set->dump_fp);
+}
+
+void ofi_perfset_check_dump(struct ofi_perfset *set)
+{
+	uint64_t now;
+
+	now = ofi_gettime_ms();
+	if (now < set->dump_next)
+		return;
+
+	ofi_perfset_dump(set);
+	set->dump_next = now + perf_dump_interval;
+}
@@ -105,14 +105,26 @@ int fi_wait_cond(pthread_cond_t *cond, pthread_mutex_t *mut, int timeout_ms)
 	return pthread_cond_timedwait(cond, mut, &ts);
 }
 
-int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
-		int readonly, void **mapped)
+int ofi_shm_map_flags(struct util_shm *shm, const char *name, size_t size,
+		      int shm_flags, void **mapped)
 {
 	char *fname = 0;
 	int i, ret = FI_SUCCESS;
-	int flags = O_RDWR | (readonly ? 0 : O_CREAT);
+	int flags, prot;
 	struct stat mapstat;
 
+	if (shm_flags & OFI_SHM_RDONLY) {
+		flags = O_RDONLY;
+		prot = PROT_READ;
+	} else {
+		flags = O_RDWR;
+		prot = PROT_READ | PROT_WRITE;
+	}
+	if (shm_flags & OFI_SHM_CREATE)
+		flags |= O_CREAT;
+	if (shm_flags & OFI_SHM_EXCL)
+		flags |= O_EXCL;
+
 	*mapped = MAP_FAILED;
 	memset(shm, 0, sizeof(*shm));
 
@@ -134,8 +146,9 @@ int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
 
 	shm->shared_fd = shm_open(fname, flags, S_IRUSR | S_IWUSR);
 	if (shm->shared_fd < 0) {
-		FI_WARN(&core_prov, FI_LOG_CORE, "shm_open failed\n");
-		ret = -FI_EINVAL;
+		FI_WARN(&core_prov, FI_LOG_CORE, "shm_open failed: %s\n",
+			strerror(errno));
+		ret = errno == EEXIST ? -FI_EBUSY : -FI_EINVAL;
 		goto failed;
 	}
 
@@ -146,7 +159,11 @@ int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
 		goto failed;
 	}
 
-	if (mapstat.st_size == 0) {
+	if (mapstat.st_size == 0 && (shm_flags & OFI_SHM_RDONLY)) {
+		/* the creator has not sized the segment yet */
+		ret = -FI_EAGAIN;
+		goto failed;
+	} else if (mapstat.st_size == 0) {
 		if (ftruncate(shm->shared_fd, size)) {
 			FI_WARN(&core_prov, FI_LOG_CORE,
 				"ftruncate failed: %s\n", strerror(errno));
@@ -159,8 +176,7 @@ int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
 		goto failed;
 	}
 
-	shm->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
-				MAP_SHARED, shm->shared_fd, 0);
+	shm->ptr = mmap(NULL, size, prot, MAP_SHARED, shm->shared_fd, 0);
 	if (shm->ptr == MAP_FAILED) {
 		FI_WARN(&core_prov, FI_LOG_CORE,
 			"mmap failed: %s\n", strerror(errno));
@@ -175,7 +191,9 @@ int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
 failed:
 	if (shm->shared_fd >= 0) {
 		close(shm->shared_fd);
-		shm_unlink(fname);
+		/* leave a segment that was opened, not created, to its owner */
+		if (shm_flags & OFI_SHM_CREATE)
+			shm_unlink(fname);
 	}
 	if (fname)
 		free(fname);
@@ -229,14 +229,15 @@ BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
 	return TRUE;
 }
 
-int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
-	int readonly, void **mapped)
+int ofi_shm_map_flags(struct util_shm *shm, const char *name, size_t size,
+	int shm_flags, void **mapped)
 {
 	int ret = FI_SUCCESS;
 	char *fname = 0;
 	size_t len = lstrlenA(name) + sizeof(ofi_shm_prefix);
 	LARGE_INTEGER large = {.QuadPart = size};
-	DWORD access = FILE_MAP_READ | (readonly ? 0 : FILE_MAP_WRITE);
+	DWORD access = FILE_MAP_READ |
+		       (shm_flags & OFI_SHM_RDONLY ? 0 : FILE_MAP_WRITE);
 
 	ZeroMemory(shm, sizeof(*shm));
 
@@ -250,7 +251,7 @@ int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
 	lstrcpyA(fname, ofi_shm_prefix);
 	lstrcatA(fname, name);
 
-	if (!readonly) {
+	if (shm_flags & OFI_SHM_CREATE) {
 		shm->shared_fd = CreateFileMappingA(INVALID_HANDLE_VALUE, 0,
 			PAGE_READWRITE, large.HighPart, large.LowPart,
 			shm->name);
@@ -259,7 +260,13 @@ int ofi_shm_map(struct util_shm *shm, const char *name, size_t size,
 			ret = -FI_EINVAL;
 			goto fn_nofilemap;
 		}
-	} else { /* readonly */
+		if ((shm_flags & OFI_SHM_EXCL) &&
+		    GetLastError() == ERROR_ALREADY_EXISTS) {
+			FI_WARN(&core_prov, FI_LOG_CORE, "mapping already exists\n");
+			ret = -FI_EBUSY;
+			goto fn_nomap;
+		}
+	} else { /* open existing */
 		shm->shared_fd = OpenFileMappingA(access, FALSE, shm->name);
 		if (!shm->shared_fd) {
 			FI_WARN(&core_prov, FI_LOG_CORE, "OpenFileMapping failed\n");